@@ -1,3 +1,5 @@
 set(ENGINE_SOURCE_DIR ${CMAKE_CURRENT_SOURCE_DIR}/Source)
 
 include(Runtime)
+include(Tools)
+include(Tests)
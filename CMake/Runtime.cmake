@@ -17,6 +17,8 @@ option(DX11 "DirectX11 (Windows only)" OFF)
 option(EXAMPLES "The Forge examples" OFF)
 option(VULKAN "Vulkan" OFF)
 option(DYNAMIC_LIB "Dynamic Library" OFF)
+option(MIMALLOC "Route tf_malloc to mimalloc" OFF)
+option(MEMORY_SAMPLING "Sampled heap profile of tf_malloc allocations" OFF)
 
 set(ASSIMP OFF)
 set(OZZ OFF)
@@ -104,6 +106,19 @@ if(${VULKAN} MATCHES ON)
 endif()
 
 
+# mimalloc is built as a single translation unit and only backs tf_malloc, system malloc is not overridden
+set(MEMORY_LIBRARIES "")
+if(${MIMALLOC} MATCHES ON)
+    add_compile_definitions(ENABLE_MIMALLOC)
+    add_library(Mimalloc STATIC ${ENGINE_SOURCE_DIR}/ThirdParty/mimalloc/src/static.c)
+    target_include_directories(Mimalloc PUBLIC ${ENGINE_SOURCE_DIR}/ThirdParty/mimalloc/include)
+    target_compile_definitions(Mimalloc PRIVATE MI_STATIC_LIB)
+    set(MEMORY_LIBRARIES Mimalloc)
+endif()
+if(${MEMORY_SAMPLING} MATCHES ON)
+    add_compile_definitions(ENABLE_MEMORY_SAMPLING)
+endif()
+
 message("\n")
 
 include(Platform)
@@ -171,7 +186,7 @@ if(Vulkan_FOUND MATCHES TRUE)
     target_include_directories(${ENGINE_RUNTIME} PUBLIC ${Vulkan_INCLUDE_DIRS})
 endif()
 
-target_link_libraries(${ENGINE_RUNTIME} PUBLIC ${RHI_LIBRARIES} ${THIRD_PARTY_DEPS})
+target_link_libraries(${ENGINE_RUNTIME} PUBLIC ${RHI_LIBRARIES} ${THIRD_PARTY_DEPS} ${MEMORY_LIBRARIES})
 
 target_link_directories(${ENGINE_RUNTIME} PUBLIC ${RHI_LIBRARY_PATHS})
 
@@ -0,0 +1,28 @@
+# Runtime tests and benchmarks. Every source file is a standalone executable.
+
+option(TESTS "Runtime tests and benchmarks" OFF)
+
+set(RUNTIME_CORE_TEST_DIR ${ENGINE_SOURCE_DIR}/Tests/Runtime/Core)
+
+set(RUNTIME_CORE_TEST_FILES
+    ${RUNTIME_CORE_TEST_DIR}/Algorithms.cpp
+    ${RUNTIME_CORE_TEST_DIR}/FileSystem.cpp
+    ${RUNTIME_CORE_TEST_DIR}/Log.cpp
+    ${RUNTIME_CORE_TEST_DIR}/Memory.cpp
+    ${RUNTIME_CORE_TEST_DIR}/Thread.cpp
+)
+
+if(${TESTS} MATCHES ON)
+    foreach(TEST_FILE ${RUNTIME_CORE_TEST_FILES})
+        get_filename_component(TEST_NAME ${TEST_FILE} NAME_WE)
+        add_executable(Test${TEST_NAME} ${TEST_FILE})
+        target_link_libraries(Test${TEST_NAME} ${ENGINE_RUNTIME})
+        set_property(TARGET Test${TEST_NAME} PROPERTY CXX_STANDARD 17)
+    endforeach()
+
+    # Archive round trip test creates archives with the archive tool library
+    target_sources(TestFileSystem PRIVATE ${ENGINE_SOURCE_DIR}/Tools/BunyArchive/Buny.c)
+
+    # Log test decodes the binary log file it wrote and compares it to the text log
+    target_sources(TestLog PRIVATE ${ENGINE_SOURCE_DIR}/Tools/LogDecoder/LogDecoder.c)
+endif()
@@ -0,0 +1,7 @@
+# Command line tools that don't depend on the runtime.
+
+set(ENGINE_TOOLS_DIR ${ENGINE_SOURCE_DIR}/Tools)
+
+# Turns binary log files written by addBinaryLogFile into text
+add_executable(LogDecoder ${ENGINE_TOOLS_DIR}/LogDecoder/LogDecoder.c ${ENGINE_TOOLS_DIR}/LogDecoder/LogDecoderTool.c)
+set_property(TARGET LogDecoder PROPERTY C_STANDARD 99)
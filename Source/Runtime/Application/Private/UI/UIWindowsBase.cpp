@@ -58,6 +58,8 @@
 #include "../../Tools/ReloadServer/ReloadClient.h"
 #endif
 #include <Core/IMath.h>
+#include <Runtime/Core/Private/Memory/Arena.h>
+
 #include <Core/IMemory.h>
 
 #ifdef ENABLE_FORGE_STACKTRACE_DUMP
@@ -210,6 +212,9 @@ void updateBaseSubsystems(float deltaTime, bool appDrawn)
     extern void platformUpdateUserInterface(float deltaTime);
     extern void platformUpdateWindowSystem();
 
+    // Scratch arenas of all threads are reset on their first use in the new frame
+    tf_arena_next_frame();
+
     platformUpdateWindowSystem();
 
 #ifdef ENABLE_FORGE_SCRIPTING
@@ -0,0 +1,870 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Asynchronous reads, see fsReadAsync.
+//
+// Every read takes one of FS_MAX_ASYNC_READS slots until it is waited on or its callback is called.
+// Reads of Unix file streams are submitted to an io_uring and completed by a thread reaping the completion queue.
+// Other reads are queued for a few IO threads. Streams without (*ReadAt) are read with seek and read,
+// IO threads take one read of such a stream at a time.
+//
+// Callbacks run on IO threads and must not wait for slots, reads started by callbacks while every slot is taken
+// are done by the same thread once the callback returned.
+
+#include <Core/IConfig.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <Core/IFileSystem.h>
+#include <Core/ILog.h>
+#include <Core/IThread.h>
+
+#if defined(__linux__) && !defined(ANDROID) && !defined(FS_DISABLE_IO_URING)
+#define FS_IO_URING 1
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../Threading/Atomics.h"
+#include "FileSystemInternal.h"
+#else
+#define FS_IO_URING 0
+#endif
+
+#include <Core/IMemory.h>
+
+// Used when io_uring is unavailable
+#ifndef FS_ASYNC_READ_THREAD_COUNT
+#define FS_ASYNC_READ_THREAD_COUNT 8
+#endif
+
+#define ASYNC_READ_NONE UINT32_MAX
+
+// Streams without (*ReadAt) read at the same time: by IO threads, by the completion thread and by callers holding a slot
+#define ASYNC_READ_MAX_SEEK_STREAMS (FS_MAX_ASYNC_READS + FS_ASYNC_READ_THREAD_COUNT + 1)
+
+typedef enum AsyncReadState
+{
+    ASYNC_READ_FREE = 0,
+    ASYNC_READ_PENDING,
+    ASYNC_READ_DONE,
+} AsyncReadState;
+
+struct AsyncRead
+{
+    FileStream*    pStream;
+    uint8_t*       pDst;
+    ssize_t        mOffset;
+    size_t         mSize;
+    // Bytes read so far while pending
+    size_t         mBytesRead;
+    FsReadCallback pCallback;
+    void*          pUserData;
+    // Incremented when the slot is released, tokens of released reads don't match it anymore
+    uint32_t       mGeneration;
+    AsyncReadState mState;
+    // Next slot in the free list or in the IO thread queue
+    uint32_t       mNext;
+    // Submitted to the io_uring
+    bool           mUring;
+};
+
+// Read started by a callback while every slot was taken
+struct AsyncReadDeferred
+{
+    FileStream*               pStream;
+    void*                     pDst;
+    ssize_t                   mOffset;
+    size_t                    mSize;
+    FsReadCallback            pCallback;
+    void*                     pUserData;
+    struct AsyncReadDeferred* pNext;
+};
+
+#if FS_IO_URING
+struct AsyncReadUring
+{
+    int                  mFd;
+    uint32_t             mSqMask;
+    tfrg_atomic32_t*     pSqHead;
+    tfrg_atomic32_t*     pSqTail;
+    uint32_t*            pSqArray;
+    struct io_uring_sqe* pSqes;
+    uint32_t             mCqMask;
+    tfrg_atomic32_t*     pCqHead;
+    tfrg_atomic32_t*     pCqTail;
+    struct io_uring_cqe* pCqes;
+    void*                pRing;
+    size_t               mRingSize;
+    size_t               mSqesSize;
+    ThreadHandle         mThread;
+    // Entries taken by the kernel whose completion wasn't reaped yet
+    tfrg_atomic32_t      mInFlight_Atomic;
+    // Completion thread stopped on an error, reads went to the IO threads since
+    bool                 mFailed;
+};
+
+// user_data of the request stopping the completion thread
+#define ASYNC_READ_URING_QUIT UINT64_MAX
+// Larger reads are split, sqe length is 32 bit
+#define ASYNC_READ_URING_MAX_SIZE ((size_t)1 << 30)
+// Milliseconds uringFlush waits for the kernel to take entries when nothing is in flight
+#define ASYNC_READ_URING_MAX_RETRIES 100
+#endif
+
+static struct
+{
+    Mutex             mMutex;
+    // Signaled when reads are done or slots are released
+    ConditionVariable mDoneCondition;
+    // Signaled when reads are queued for IO threads
+    ConditionVariable mWorkCondition;
+    struct AsyncRead  mReads[FS_MAX_ASYNC_READS];
+    uint32_t          mFreeHead;
+    uint32_t          mQueueHead;
+    uint32_t          mQueueTail;
+    uint32_t          mPendingCount;
+    ThreadHandle      mThreads[FS_ASYNC_READ_THREAD_COUNT];
+    uint32_t          mThreadCount;
+    // Streams without (*ReadAt) being read, see acquireSeekStream
+    FileStream*       pSeekStreams[ASYNC_READ_MAX_SEEK_STREAMS];
+    uint32_t          mSeekStreamCount;
+    bool              mQuit;
+    bool              mInitialized;
+#if FS_IO_URING
+    // Ring and completion thread exist
+    bool                  mUringInitialized;
+    // Reads are submitted to the ring
+    bool                  mUringRunning;
+    struct AsyncReadUring mUring;
+#endif
+} gAsyncRead;
+
+// Set on IO threads and on the completion thread, they run callbacks
+static THREAD_LOCAL bool                      gAsyncReadThread = false;
+static THREAD_LOCAL struct AsyncReadDeferred* gDeferredHead = NULL;
+static THREAD_LOCAL struct AsyncReadDeferred* gDeferredTail = NULL;
+
+static inline FsReadToken asyncReadToken(const struct AsyncRead* pRead)
+{
+    return ((uint64_t)pRead->mGeneration << 32) | (uint64_t)(pRead - gAsyncRead.mReads);
+}
+
+static inline struct AsyncRead* asyncReadFromToken(FsReadToken token)
+{
+    uint32_t index = (uint32_t)token;
+    if (token == FS_READ_TOKEN_NONE || index >= FS_MAX_ASYNC_READS)
+        return NULL;
+    return &gAsyncRead.mReads[index];
+}
+
+// Following are called with the mutex locked
+
+// Returns NULL on IO threads when every slot is taken, slots may only be released by the calling thread
+static struct AsyncRead* acquireRead(void)
+{
+    while (gAsyncRead.mFreeHead == ASYNC_READ_NONE)
+    {
+        if (gAsyncReadThread)
+            return NULL;
+        waitConditionVariable(&gAsyncRead.mDoneCondition, &gAsyncRead.mMutex, TIMEOUT_INFINITE);
+    }
+
+    struct AsyncRead* pRead = &gAsyncRead.mReads[gAsyncRead.mFreeHead];
+    gAsyncRead.mFreeHead = pRead->mNext;
+    pRead->mState = ASYNC_READ_PENDING;
+    pRead->mNext = ASYNC_READ_NONE;
+    ++gAsyncRead.mPendingCount;
+    return pRead;
+}
+
+static void releaseRead(struct AsyncRead* pRead)
+{
+    // Generation 0 would make a token equal to FS_READ_TOKEN_NONE
+    if (++pRead->mGeneration == 0)
+        pRead->mGeneration = 1;
+    pRead->mState = ASYNC_READ_FREE;
+    pRead->mNext = gAsyncRead.mFreeHead;
+    gAsyncRead.mFreeHead = (uint32_t)(pRead - gAsyncRead.mReads);
+    wakeAllConditionVariable(&gAsyncRead.mDoneCondition);
+}
+
+// Only one read of a stream without (*ReadAt) is done at a time, they share the seek position.
+// Returns false if the stream is being read.
+static bool acquireSeekStream(FileStream* pStream)
+{
+    for (uint32_t i = 0; i < gAsyncRead.mSeekStreamCount; ++i)
+    {
+        if (gAsyncRead.pSeekStreams[i] == pStream)
+            return false;
+    }
+    ASSERT(gAsyncRead.mSeekStreamCount < ASYNC_READ_MAX_SEEK_STREAMS);
+    gAsyncRead.pSeekStreams[gAsyncRead.mSeekStreamCount++] = pStream;
+    return true;
+}
+
+static void releaseSeekStream(FileStream* pStream)
+{
+    for (uint32_t i = 0; i < gAsyncRead.mSeekStreamCount; ++i)
+    {
+        if (gAsyncRead.pSeekStreams[i] == pStream)
+        {
+            gAsyncRead.pSeekStreams[i] = gAsyncRead.pSeekStreams[--gAsyncRead.mSeekStreamCount];
+            break;
+        }
+    }
+    // Queued reads of the stream and readers waiting in readStreamNow can go on
+    wakeAllConditionVariable(&gAsyncRead.mWorkCondition);
+    wakeAllConditionVariable(&gAsyncRead.mDoneCondition);
+}
+
+// Following are called without the mutex
+
+// Stream without (*ReadAt) has to be acquired by acquireSeekStream, it is released here
+static size_t readStream(FileStream* pStream, void* pDst, size_t size, ssize_t offset)
+{
+    if (fsStreamCanReadAt(pStream))
+        return fsReadFromStreamAt(pStream, pDst, size, offset);
+
+    size_t bytesRead = 0;
+    if (fsSeekStream(pStream, SBO_START_OF_FILE, offset))
+        bytesRead = fsReadFromStream(pStream, pDst, size);
+    acquireMutex(&gAsyncRead.mMutex);
+    releaseSeekStream(pStream);
+    releaseMutex(&gAsyncRead.mMutex);
+    return bytesRead;
+}
+
+// Reads on the calling thread, waits until other threads are done with a stream without (*ReadAt)
+static size_t readStreamNow(FileStream* pStream, void* pDst, size_t size, ssize_t offset)
+{
+    if (!fsStreamCanReadAt(pStream))
+    {
+        acquireMutex(&gAsyncRead.mMutex);
+        while (!acquireSeekStream(pStream))
+            waitConditionVariable(&gAsyncRead.mDoneCondition, &gAsyncRead.mMutex, TIMEOUT_INFINITE);
+        releaseMutex(&gAsyncRead.mMutex);
+    }
+    return readStream(pStream, pDst, size, offset);
+}
+
+// Reads started by callbacks while every slot was taken, in order. Called on IO threads once a callback returned.
+static void runDeferredReads(void)
+{
+    while (gDeferredHead)
+    {
+        struct AsyncReadDeferred* pDeferred = gDeferredHead;
+        gDeferredHead = pDeferred->pNext;
+        if (!gDeferredHead)
+            gDeferredTail = NULL;
+
+        size_t bytesRead = readStreamNow(pDeferred->pStream, pDeferred->pDst, pDeferred->mSize, pDeferred->mOffset);
+        // May defer more reads
+        pDeferred->pCallback(pDeferred->pUserData, pDeferred->pStream, pDeferred->pDst, bytesRead);
+        tf_free(pDeferred);
+    }
+}
+
+static void completeRead(struct AsyncRead* pRead, size_t bytesRead)
+{
+    acquireMutex(&gAsyncRead.mMutex);
+    if (!pRead->pCallback)
+    {
+        --gAsyncRead.mPendingCount;
+        pRead->mBytesRead = bytesRead;
+        pRead->mState = ASYNC_READ_DONE;
+        wakeAllConditionVariable(&gAsyncRead.mDoneCondition);
+        releaseMutex(&gAsyncRead.mMutex);
+        return;
+    }
+
+    // Slot is released before the callback, so the callback can start another read.
+    // Read stays pending until the callback returned, fsExitAsyncRead waits for it.
+    FsReadCallback pCallback = pRead->pCallback;
+    void*          pUserData = pRead->pUserData;
+    FileStream*    pStream = pRead->pStream;
+    void*          pDst = pRead->pDst;
+    releaseRead(pRead);
+    releaseMutex(&gAsyncRead.mMutex);
+
+    pCallback(pUserData, pStream, pDst, bytesRead);
+    if (gAsyncReadThread)
+        runDeferredReads();
+
+    acquireMutex(&gAsyncRead.mMutex);
+    --gAsyncRead.mPendingCount;
+    wakeAllConditionVariable(&gAsyncRead.mDoneCondition);
+    releaseMutex(&gAsyncRead.mMutex);
+}
+
+/************************************************************************/
+// MARK: - IO threads
+/************************************************************************/
+
+// Called with the mutex locked. Takes the first queued read which can be done now,
+// reads of a stream without (*ReadAt) wait while another read of the stream is done.
+static struct AsyncRead* dequeueRead(void)
+{
+    uint32_t previous = ASYNC_READ_NONE;
+    for (uint32_t index = gAsyncRead.mQueueHead; index != ASYNC_READ_NONE; previous = index, index = gAsyncRead.mReads[index].mNext)
+    {
+        struct AsyncRead* pRead = &gAsyncRead.mReads[index];
+        if (!fsStreamCanReadAt(pRead->pStream) && !acquireSeekStream(pRead->pStream))
+            continue;
+
+        if (previous == ASYNC_READ_NONE)
+            gAsyncRead.mQueueHead = pRead->mNext;
+        else
+            gAsyncRead.mReads[previous].mNext = pRead->mNext;
+        if (gAsyncRead.mQueueTail == index)
+            gAsyncRead.mQueueTail = previous;
+        pRead->mNext = ASYNC_READ_NONE;
+        return pRead;
+    }
+    return NULL;
+}
+
+static void asyncReadThreadFunc(void* pData)
+{
+    (void)pData;
+    gAsyncReadThread = true;
+    acquireMutex(&gAsyncRead.mMutex);
+    for (;;)
+    {
+        struct AsyncRead* pRead = dequeueRead();
+        if (!pRead)
+        {
+            // Queued reads are finished before quitting
+            if (gAsyncRead.mQuit && gAsyncRead.mQueueHead == ASYNC_READ_NONE)
+                break;
+            waitConditionVariable(&gAsyncRead.mWorkCondition, &gAsyncRead.mMutex, TIMEOUT_INFINITE);
+            continue;
+        }
+        releaseMutex(&gAsyncRead.mMutex);
+
+        completeRead(pRead, readStream(pRead->pStream, pRead->pDst, pRead->mSize, pRead->mOffset));
+
+        acquireMutex(&gAsyncRead.mMutex);
+    }
+    releaseMutex(&gAsyncRead.mMutex);
+}
+
+static void queueRead(struct AsyncRead* pRead)
+{
+    if (gAsyncRead.mQueueTail == ASYNC_READ_NONE)
+        gAsyncRead.mQueueHead = (uint32_t)(pRead - gAsyncRead.mReads);
+    else
+        gAsyncRead.mReads[gAsyncRead.mQueueTail].mNext = (uint32_t)(pRead - gAsyncRead.mReads);
+    gAsyncRead.mQueueTail = (uint32_t)(pRead - gAsyncRead.mReads);
+    wakeOneConditionVariable(&gAsyncRead.mWorkCondition);
+}
+
+static void initAsyncReadThreads(void)
+{
+    uint32_t threadCount = getNumCPUCores();
+    if (threadCount > FS_ASYNC_READ_THREAD_COUNT)
+        threadCount = FS_ASYNC_READ_THREAD_COUNT;
+    if (threadCount < 2)
+        threadCount = 2;
+
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        ThreadDesc threadDesc = { 0 };
+        threadDesc.pFunc = asyncReadThreadFunc;
+        snprintf(threadDesc.mThreadName, sizeof(threadDesc.mThreadName), "AsyncRead %u", i + 1);
+        if (!initThread(&threadDesc, &gAsyncRead.mThreads[gAsyncRead.mThreadCount]))
+            break;
+        ++gAsyncRead.mThreadCount;
+    }
+}
+
+static void exitAsyncReadThreads(void)
+{
+    acquireMutex(&gAsyncRead.mMutex);
+    gAsyncRead.mQuit = true;
+    wakeAllConditionVariable(&gAsyncRead.mWorkCondition);
+    releaseMutex(&gAsyncRead.mMutex);
+
+    for (uint32_t i = 0; i < gAsyncRead.mThreadCount; ++i)
+        joinThread(gAsyncRead.mThreads[i]);
+    gAsyncRead.mThreadCount = 0;
+}
+
+/************************************************************************/
+// MARK: - io_uring
+/************************************************************************/
+
+#if FS_IO_URING
+static int uringEnter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+{
+    int res;
+    do
+    {
+        res = (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+    } while (res < 0 && errno == EINTR);
+    return res;
+}
+
+// Called with the mutex locked, submits all queued entries. io_uring_enter may take only part of them.
+// When the kernel is out of resources (EAGAIN) or the completion queue is full (EBUSY) while requests are in flight,
+// entries stay queued and the completion thread submits them after reaping completions.
+// Returns false on any other error, queued entries are left in the ring then.
+static bool uringFlush(struct AsyncReadUring* pUring)
+{
+    uint32_t tail = *pUring->pSqTail;
+    uint32_t retryCount = 0;
+    for (;;)
+    {
+        uint32_t head = tfrg_atomic32_load_acquire(pUring->pSqHead);
+        if (head == tail)
+            return true;
+
+        int res = uringEnter(pUring->mFd, tail - head, 0, 0);
+        uint32_t submitted = tfrg_atomic32_load_acquire(pUring->pSqHead) - head;
+        tfrg_atomic32_add_relaxed(&pUring->mInFlight_Atomic, submitted);
+        if (submitted)
+            continue;
+        if (res >= 0)
+            errno = EAGAIN;
+        if (errno != EAGAIN && errno != EBUSY)
+            return false;
+        if (tfrg_atomic32_load_relaxed(&pUring->mInFlight_Atomic))
+            return true;
+        // Nothing completes which would free resources, give the kernel some time
+        if (++retryCount > ASYNC_READ_URING_MAX_RETRIES)
+            return false;
+        threadSleep(1);
+    }
+}
+
+// Called with the mutex locked, submits the part of the read which isn't done yet.
+// Returns false when the entry couldn't be submitted, it is taken back from the ring then.
+static bool uringPush(struct AsyncReadUring* pUring, int fd, uint8_t opcode, const struct AsyncRead* pRead, uint64_t userData)
+{
+    uint32_t             tail = *pUring->pSqTail;
+    uint32_t             index = tail & pUring->mSqMask;
+    struct io_uring_sqe* pSqe = &pUring->pSqes[index];
+    memset(pSqe, 0, sizeof(*pSqe));
+    pSqe->opcode = opcode;
+    pSqe->fd = fd;
+    pSqe->user_data = userData;
+    if (pRead)
+    {
+        size_t size = pRead->mSize - pRead->mBytesRead;
+        pSqe->addr = (uint64_t)(uintptr_t)(pRead->pDst + pRead->mBytesRead);
+        pSqe->len = (uint32_t)(size < ASYNC_READ_URING_MAX_SIZE ? size : ASYNC_READ_URING_MAX_SIZE);
+        pSqe->off = (uint64_t)pRead->mOffset + pRead->mBytesRead;
+    }
+    pUring->pSqArray[index] = index;
+    tfrg_atomic32_store_release(pUring->pSqTail, tail + 1);
+
+    // Entries left by earlier calls go along
+    if (uringFlush(pUring))
+        return true;
+
+    LOGF(eERROR, "Failed to submit io_uring read: %s", strerror(errno));
+    // Entries are only consumed by io_uring_enter, the head tells whether this one went along anyway
+    if (tfrg_atomic32_load_acquire(pUring->pSqHead) == tail + 1)
+        return true;
+    tfrg_atomic32_store_release(pUring->pSqTail, tail);
+    return false;
+}
+
+static bool uringSubmitRead(struct AsyncRead* pRead, int fd)
+{
+    pRead->mUring = uringPush(&gAsyncRead.mUring, fd, IORING_OP_READ, pRead, (uint64_t)(pRead - gAsyncRead.mReads));
+    return pRead->mUring;
+}
+
+// Called by the completion thread when the ring stopped working. New reads go to the IO threads,
+// reads still in the ring are completed with what was read so far.
+static void uringFail(struct AsyncReadUring* pUring)
+{
+    uint32_t failed[FS_MAX_ASYNC_READS];
+    uint32_t failedCount = 0;
+
+    acquireMutex(&gAsyncRead.mMutex);
+    pUring->mFailed = true;
+    gAsyncRead.mUringRunning = false;
+    if (!gAsyncRead.mThreadCount)
+        initAsyncReadThreads();
+    for (uint32_t i = 0; i < FS_MAX_ASYNC_READS; ++i)
+    {
+        struct AsyncRead* pRead = &gAsyncRead.mReads[i];
+        if (pRead->mState == ASYNC_READ_PENDING && pRead->mUring)
+        {
+            pRead->mUring = false;
+            failed[failedCount++] = i;
+        }
+    }
+    releaseMutex(&gAsyncRead.mMutex);
+
+    if (failedCount)
+    {
+        LOGF(eERROR, "Failing %u asynchronous reads left in io_uring", failedCount);
+    }
+    for (uint32_t i = 0; i < failedCount; ++i)
+        completeRead(&gAsyncRead.mReads[failed[i]], gAsyncRead.mReads[failed[i]].mBytesRead);
+}
+
+static void uringCompletionThreadFunc(void* pData)
+{
+    struct AsyncReadUring* pUring = (struct AsyncReadUring*)pData;
+    bool                   quit = false;
+    gAsyncReadThread = true;
+    while (!quit)
+    {
+        if (uringEnter(pUring->mFd, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+        {
+            LOGF(eERROR, "Failed to wait for io_uring completions, switching to IO threads: %s", strerror(errno));
+            uringFail(pUring);
+            break;
+        }
+
+        uint32_t head = *pUring->pCqHead;
+        uint32_t tail = tfrg_atomic32_load_acquire(pUring->pCqTail);
+        for (; head != tail; ++head)
+        {
+            const struct io_uring_cqe* pCqe = &pUring->pCqes[head & pUring->mCqMask];
+            uint64_t                   userData = pCqe->user_data;
+            int32_t                    res = pCqe->res;
+            tfrg_atomic32_store_release(pUring->pCqHead, head + 1);
+            tfrg_atomic32_add_relaxed(&pUring->mInFlight_Atomic, -1);
+
+            if (userData == ASYNC_READ_URING_QUIT)
+            {
+                quit = true;
+                continue;
+            }
+
+            struct AsyncRead* pRead = &gAsyncRead.mReads[userData];
+            if (res < 0)
+            {
+                LOGF(eERROR, "Error reading %s at offset %lld: %s", humanReadableSize(pRead->mSize).str, (long long)pRead->mOffset,
+                     strerror(-res));
+                completeRead(pRead, pRead->mBytesRead);
+                continue;
+            }
+
+            pRead->mBytesRead += (size_t)res;
+            // Short read without reaching the end of the file
+            if (res > 0 && pRead->mBytesRead < pRead->mSize)
+            {
+                acquireMutex(&gAsyncRead.mMutex);
+                bool submitted = uringSubmitRead(pRead, unixFsGetDescriptor(pRead->pStream));
+                releaseMutex(&gAsyncRead.mMutex);
+                if (submitted)
+                    continue;
+                // Rest is read here
+                pRead->mBytesRead += fsReadFromStreamAt(pRead->pStream, pRead->pDst + pRead->mBytesRead,
+                                                        pRead->mSize - pRead->mBytesRead, pRead->mOffset + (ssize_t)pRead->mBytesRead);
+            }
+            completeRead(pRead, pRead->mBytesRead);
+        }
+
+        // Entries the kernel had no room for when they were queued
+        if (!quit && tfrg_atomic32_load_relaxed(pUring->pSqTail) != tfrg_atomic32_load_acquire(pUring->pSqHead))
+        {
+            acquireMutex(&gAsyncRead.mMutex);
+            bool flushed = uringFlush(pUring);
+            releaseMutex(&gAsyncRead.mMutex);
+            if (!flushed)
+            {
+                LOGF(eERROR, "Failed to submit queued io_uring reads, switching to IO threads: %s", strerror(errno));
+                uringFail(pUring);
+                break;
+            }
+        }
+    }
+}
+
+static bool initAsyncReadUring(void)
+{
+    struct AsyncReadUring* pUring = &gAsyncRead.mUring;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    pUring->mFd = (int)syscall(__NR_io_uring_setup, FS_MAX_ASYNC_READS, &params);
+    if (pUring->mFd < 0)
+    {
+        LOGF(eINFO, "io_uring is unavailable: %s", strerror(errno));
+        return false;
+    }
+
+    // IORING_OP_READ came along with IORING_FEAT_RW_CUR_POS
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        LOGF(eINFO, "io_uring is too old for asynchronous reads");
+        close(pUring->mFd);
+        return false;
+    }
+
+    size_t sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    pUring->mRingSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+    pUring->mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    uint8_t* pRing = (uint8_t*)mmap(NULL, pUring->mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pUring->mFd,
+                                    IORING_OFF_SQ_RING);
+    void*    pSqes = mmap(NULL, pUring->mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pUring->mFd, IORING_OFF_SQES);
+    if (pRing == MAP_FAILED || pSqes == MAP_FAILED)
+    {
+        LOGF(eERROR, "Failed to map io_uring: %s", strerror(errno));
+        if (pRing != MAP_FAILED)
+            munmap(pRing, pUring->mRingSize);
+        if (pSqes != MAP_FAILED)
+            munmap(pSqes, pUring->mSqesSize);
+        close(pUring->mFd);
+        return false;
+    }
+
+    pUring->pRing = pRing;
+    pUring->mFailed = false;
+    pUring->mSqMask = *(uint32_t*)(pRing + params.sq_off.ring_mask);
+    pUring->pSqHead = (tfrg_atomic32_t*)(pRing + params.sq_off.head);
+    pUring->pSqTail = (tfrg_atomic32_t*)(pRing + params.sq_off.tail);
+    pUring->pSqArray = (uint32_t*)(pRing + params.sq_off.array);
+    pUring->pSqes = (struct io_uring_sqe*)pSqes;
+    pUring->mCqMask = *(uint32_t*)(pRing + params.cq_off.ring_mask);
+    pUring->pCqHead = (tfrg_atomic32_t*)(pRing + params.cq_off.head);
+    pUring->pCqTail = (tfrg_atomic32_t*)(pRing + params.cq_off.tail);
+    pUring->pCqes = (struct io_uring_cqe*)(pRing + params.cq_off.cqes);
+
+    ThreadDesc threadDesc = { 0 };
+    threadDesc.pFunc = uringCompletionThreadFunc;
+    threadDesc.pData = pUring;
+    strncpy(threadDesc.mThreadName, "AsyncRead", sizeof(threadDesc.mThreadName));
+    if (!initThread(&threadDesc, &pUring->mThread))
+    {
+        munmap(pUring->pSqes, pUring->mSqesSize);
+        munmap(pUring->pRing, pUring->mRingSize);
+        close(pUring->mFd);
+        return false;
+    }
+    return true;
+}
+
+static void exitAsyncReadUring(void)
+{
+    struct AsyncReadUring* pUring = &gAsyncRead.mUring;
+
+    acquireMutex(&gAsyncRead.mMutex);
+    bool quit = pUring->mFailed || uringPush(pUring, -1, IORING_OP_NOP, NULL, ASYNC_READ_URING_QUIT);
+    releaseMutex(&gAsyncRead.mMutex);
+    if (!quit)
+    {
+        // Completion thread may still use the ring, both are leaked
+        LOGF(eERROR, "Failed to stop io_uring completion thread");
+        return;
+    }
+
+    joinThread(pUring->mThread);
+    munmap(pUring->pSqes, pUring->mSqesSize);
+    munmap(pUring->pRing, pUring->mRingSize);
+    close(pUring->mFd);
+}
+#endif
+
+/************************************************************************/
+// MARK: - Interface
+/************************************************************************/
+
+bool fsInitAsyncRead(void)
+{
+    if (gAsyncRead.mInitialized)
+        return true;
+
+    initMutex(&gAsyncRead.mMutex);
+    initConditionVariable(&gAsyncRead.mDoneCondition);
+    initConditionVariable(&gAsyncRead.mWorkCondition);
+
+    for (uint32_t i = 0; i < FS_MAX_ASYNC_READS; ++i)
+    {
+        gAsyncRead.mReads[i].mGeneration = 1;
+        gAsyncRead.mReads[i].mState = ASYNC_READ_FREE;
+        gAsyncRead.mReads[i].mNext = i + 1 < FS_MAX_ASYNC_READS ? i + 1 : ASYNC_READ_NONE;
+    }
+    gAsyncRead.mFreeHead = 0;
+    gAsyncRead.mQueueHead = ASYNC_READ_NONE;
+    gAsyncRead.mQueueTail = ASYNC_READ_NONE;
+    gAsyncRead.mPendingCount = 0;
+    gAsyncRead.mSeekStreamCount = 0;
+    gAsyncRead.mQuit = false;
+
+#if FS_IO_URING
+    gAsyncRead.mUringInitialized = initAsyncReadUring();
+    gAsyncRead.mUringRunning = gAsyncRead.mUringInitialized;
+    // IO threads are started by the first read which can't go to the ring
+    if (!gAsyncRead.mUringRunning)
+#endif
+    {
+        // Without IO threads streams are read synchronously
+        initAsyncReadThreads();
+    }
+
+    gAsyncRead.mInitialized = true;
+    return true;
+}
+
+void fsExitAsyncRead(void)
+{
+    if (!gAsyncRead.mInitialized)
+        return;
+
+    acquireMutex(&gAsyncRead.mMutex);
+    if (gAsyncRead.mPendingCount)
+    {
+        LOGF(eWARNING, "Waiting for %u asynchronous reads before closing the file system", gAsyncRead.mPendingCount);
+    }
+    while (gAsyncRead.mPendingCount)
+        waitConditionVariable(&gAsyncRead.mDoneCondition, &gAsyncRead.mMutex, TIMEOUT_INFINITE);
+    releaseMutex(&gAsyncRead.mMutex);
+
+#if FS_IO_URING
+    if (gAsyncRead.mUringInitialized)
+        exitAsyncReadUring();
+    gAsyncRead.mUringInitialized = false;
+    gAsyncRead.mUringRunning = false;
+#endif
+    exitAsyncReadThreads();
+
+    destroyConditionVariable(&gAsyncRead.mWorkCondition);
+    destroyConditionVariable(&gAsyncRead.mDoneCondition);
+    destroyMutex(&gAsyncRead.mMutex);
+    gAsyncRead.mInitialized = false;
+}
+
+// Called on IO threads when every slot is taken
+static FsReadToken deferRead(FileStream* pStream, ssize_t offset, size_t size, void* pDst, FsReadCallback callback, void* pUserData)
+{
+    struct AsyncReadDeferred* pDeferred = callback ? (struct AsyncReadDeferred*)tf_malloc(sizeof(*pDeferred)) : NULL;
+    if (!pDeferred)
+    {
+        // Read without callback can't be waited for, it's done now
+        size_t bytesRead = readStreamNow(pStream, pDst, size, offset);
+        if (callback)
+            callback(pUserData, pStream, pDst, bytesRead);
+        return FS_READ_TOKEN_NONE;
+    }
+
+    pDeferred->pStream = pStream;
+    pDeferred->pDst = pDst;
+    pDeferred->mOffset = offset;
+    pDeferred->mSize = size;
+    pDeferred->pCallback = callback;
+    pDeferred->pUserData = pUserData;
+    pDeferred->pNext = NULL;
+    if (gDeferredTail)
+        gDeferredTail->pNext = pDeferred;
+    else
+        gDeferredHead = pDeferred;
+    gDeferredTail = pDeferred;
+    return FS_READ_TOKEN_NONE;
+}
+
+FsReadToken fsReadAsync(FileStream* pStream, ssize_t offset, size_t size, void* pDst, FsReadCallback callback, void* pUserData)
+{
+    ASSERT(pStream && pDst);
+    if (!gAsyncRead.mInitialized)
+    {
+        LOGF(eERROR, "fsReadAsync called before initFileSystem");
+        return FS_READ_TOKEN_NONE;
+    }
+
+    acquireMutex(&gAsyncRead.mMutex);
+    struct AsyncRead* pRead = acquireRead();
+    if (!pRead)
+    {
+        releaseMutex(&gAsyncRead.mMutex);
+        return deferRead(pStream, offset, size, pDst, callback, pUserData);
+    }
+    pRead->pStream = pStream;
+    pRead->pDst = (uint8_t*)pDst;
+    pRead->mOffset = offset;
+    pRead->mSize = size;
+    pRead->mBytesRead = 0;
+    pRead->pCallback = callback;
+    pRead->pUserData = pUserData;
+    pRead->mUring = false;
+    FsReadToken token = asyncReadToken(pRead);
+
+#if FS_IO_URING
+    // Read is done below when it can't be submitted
+    int fd = gAsyncRead.mUringRunning ? unixFsGetDescriptor(pStream) : -1;
+    if (fd >= 0 && size && uringSubmitRead(pRead, fd))
+    {
+        releaseMutex(&gAsyncRead.mMutex);
+        return token;
+    }
+#endif
+
+    if (!gAsyncRead.mThreadCount)
+        initAsyncReadThreads();
+    if (gAsyncRead.mThreadCount)
+    {
+        queueRead(pRead);
+        releaseMutex(&gAsyncRead.mMutex);
+        return token;
+    }
+    releaseMutex(&gAsyncRead.mMutex);
+
+    completeRead(pRead, readStreamNow(pStream, pDst, size, offset));
+    return token;
+}
+
+bool fsIsReadDone(FsReadToken token)
+{
+    struct AsyncRead* pRead = asyncReadFromToken(token);
+    if (!pRead)
+        return true;
+
+    acquireMutex(&gAsyncRead.mMutex);
+    bool done = pRead->mGeneration != (uint32_t)(token >> 32) || pRead->mState != ASYNC_READ_PENDING;
+    releaseMutex(&gAsyncRead.mMutex);
+    return done;
+}
+
+size_t fsWaitRead(FsReadToken token)
+{
+    struct AsyncRead* pRead = asyncReadFromToken(token);
+    if (!pRead)
+        return 0;
+
+    uint32_t generation = (uint32_t)(token >> 32);
+    size_t   bytesRead = 0;
+    acquireMutex(&gAsyncRead.mMutex);
+    while (pRead->mGeneration == generation && pRead->mState == ASYNC_READ_PENDING)
+        waitConditionVariable(&gAsyncRead.mDoneCondition, &gAsyncRead.mMutex, TIMEOUT_INFINITE);
+    // Reads with a callback are already released
+    if (pRead->mGeneration == generation)
+    {
+        bytesRead = pRead->mBytesRead;
+        releaseRead(pRead);
+    }
+    releaseMutex(&gAsyncRead.mMutex);
+    return bytesRead;
+}
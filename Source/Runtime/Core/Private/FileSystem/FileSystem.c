@@ -31,6 +31,9 @@
 #include <Core/IThread.h>
 #include <Core/ITime.h>
 
+#include "../Threading/Atomics.h"
+#include "../Threading/ThreadSystem.h"
+
 #include <Core/IMemory.h>
 
 // This macro enables custom ZSTD allocator features
@@ -595,6 +598,28 @@ static size_t ioMemoryStreamRead(FileStream* fs, void* dst, size_t size)
     return bytesToRead;
 }
 
+static size_t ioMemoryStreamReadAt(FileStream* fs, void* dst, size_t size, ssize_t offset)
+{
+    if (!(fs->mMode & FM_READ))
+    {
+        LOGF(eWARNING, "Attempting to read from stream that doesn't have FM_READ flag.");
+        return 0;
+    }
+
+    MEMSD(stream, fs);
+
+    if (offset < 0 || offset >= stream->mSize)
+    {
+        return 0;
+    }
+
+    size_t bytesToRead = (size_t)(stream->mSize - offset);
+    if (bytesToRead > size)
+        bytesToRead = size;
+    memcpy(dst, stream->pBuffer + offset, bytesToRead);
+    return bytesToRead;
+}
+
 static size_t ioMemoryStreamWrite(FileStream* fs, const void* src, size_t size)
 {
     if (!(fs->mMode & FM_WRITE))
@@ -731,6 +756,7 @@ static IFileSystem gMemoryFileIO = {
     NULL,
     NULL,
     ioMemoryStreamMemoryMap,
+    ioMemoryStreamReadAt,
     NULL,
 };
 
@@ -1305,6 +1331,8 @@ const char* bunyArFormatName(enum BunyArFileFormat format)
         return "LZ4";
     case BUNYAR_FILE_FORMAT_ZSTD_BLOCKS:
         return "zstd";
+    case BUNYAR_FILE_FORMAT_TOMBSTONE:
+        return "tombstone";
     default:
         return "unknown";
     }
@@ -1314,6 +1342,11 @@ const char* bunyArFormatName(enum BunyArFileFormat format)
 // MARK: - Archive filesystem
 /************************************************************************/
 
+// Reads of fewer whole blocks are decompressed by the reading thread
+#ifndef BUNYAR_PARALLEL_MIN_BLOCKS
+#define BUNYAR_PARALLEL_MIN_BLOCKS 4
+#endif
+
 struct BunyArBlockBuffer
 {
     size_t   usedSize;   // size of valid data
@@ -1329,8 +1362,47 @@ struct BunyArFileStream
     struct BunyArBlockBuffer       compressed;
     struct BunyArBlockBuffer       decompressed;
     BunyArBlockPointer*            currentBlock;
+    // Holds currentBlock instead of decompressed buffer when set
+    struct BunyArCachedBlock*      cachedBlock;
     struct BunyArBlockFormatHeader blocksHeader;
     BunyArBlockPointer*            blocks;
+    // Position where the previous read ended
+    size_t                         readEnd;
+    // Allocated once the stream is read sequentially
+    struct BunyArReadAhead*        readAhead;
+};
+
+// Decompression state of a threadSystem task
+struct BunyArDecompressor
+{
+    struct BunyArDecompressor* next;
+    ZSTD_DCtx*                 zstd_ctx;
+    struct BunyArBlockBuffer   compressed;
+};
+
+struct BunyArReadAheadTask
+{
+    struct BunyArMetadata*   archive;
+    struct BunyArFileStream* fs;
+    uint64_t                 block;
+    ThreadSystemTaskHandle   handle;
+};
+
+struct BunyArReadAhead
+{
+    // Blocks decompressed ahead of the reader, 0 until reads are sequential
+    uint32_t                   depth;
+    // Blocks [.., endBlock) were scheduled since reads became sequential
+    uint64_t                   endBlock;
+    // Block N is decompressed by tasks[N % BUNYAR_READ_AHEAD_MAX_DEPTH]
+    struct BunyArReadAheadTask tasks[BUNYAR_READ_AHEAD_MAX_DEPTH];
+};
+
+// Pre-digested dictionary, referenced by ID from zstd frames
+struct BunyArDictionary
+{
+    uint32_t    id;
+    ZSTD_DDict* ddict;
 };
 
 struct BunyArMetadata
@@ -1340,6 +1412,9 @@ struct BunyArMetadata
     char*                   nodeNames;
     struct BunyArHashTable* hashTable;
 
+    uint64_t                 dictionaryCount;
+    struct BunyArDictionary* dictionaries;
+
     const uint8_t* memoryBeg;
     const uint8_t* memoryEnd;
 
@@ -1349,6 +1424,25 @@ struct BunyArMetadata
 
     bool  archiveStreamLocking;
     Mutex mutex;
+
+    // Decompressed blocks go through the shared block cache
+    bool blockCache;
+
+    // Reads spanning BUNYAR_PARALLEL_MIN_BLOCKS blocks are decompressed by threadSystem tasks
+    ThreadSystem               threadSystem;
+    Mutex                      decompressorMutex;
+    // Contexts of tasks which are not decompressing, protected by decompressorMutex
+    struct BunyArDecompressor* decompressors;
+
+    // Read-ahead is disabled if readAheadDepth is 0
+    uint32_t readAheadDepth;
+    uint64_t readAheadSize;
+    // Size of blocks being read ahead, protected by decompressorMutex
+    uint64_t readAheadUsedSize;
+
+    // First-open sequence number of every node, 0 if node was not opened. NULL unless trace is recorded
+    tfrg_atomic64_t* accessOrder;
+    tfrg_atomic64_t  accessCount;
 };
 
 struct BunyArNodeSearchCtx
@@ -1407,6 +1501,10 @@ static inline size_t bunyArStreamRead(struct BunyArMetadata* a, uint64_t positio
         return read;
     }
 
+    // Positional reads don't share the seek position, no need to lock
+    if (fsStreamCanReadAt(a->archiveStream))
+        return fsReadFromStreamAt(a->archiveStream, dst, size, (ssize_t)position);
+
     if (a->archiveStreamLocking)
         acquireMutex(&a->mutex);
 
@@ -1434,8 +1532,363 @@ static inline bool bunyArReadLocation(struct BunyArMetadata* a,
     return bunyArStreamRead(a, ptr.offset, ptr.size, dst) == ptr.size;
 }
 
+/************************************************************************/
+// MARK: - Archive block cache
+/************************************************************************/
+
+// Decompressed blocks shared by all archive streams, least recently used blocks are evicted past the budget.
+// Blocks are keyed by archive and block location within archive.
+// Streams pin the block they read from, pinned blocks are not freed until released.
+
+struct BunyArCachedBlock
+{
+    const struct BunyArMetadata* archive;
+    uint64_t                     location;
+    struct BunyArCachedBlock*    hashNext;
+    // Most recently used block is at the head
+    struct BunyArCachedBlock*    lruPrev;
+    struct BunyArCachedBlock*    lruNext;
+    uint32_t                     refCount;
+    // False once evicted while pinned, block is freed by the last release
+    bool                         cached;
+    struct BunyArBlockBuffer     data;
+};
+
+static struct
+{
+    Mutex                      mutex;
+    uint64_t                   budget;
+    uint64_t                   usedSize;
+    uint64_t                   blockCount;
+    struct BunyArCachedBlock** buckets;
+    uint64_t                   bucketCount;
+    struct BunyArCachedBlock*  lruHead;
+    struct BunyArCachedBlock*  lruTail;
+    uint64_t                   hitCount;
+    uint64_t                   missCount;
+    uint64_t                   evictionCount;
+    uint64_t                   readAheadCount;
+} gBunyArBlockCache;
+
+static CallOnceGuard gBunyArBlockCacheInitGuard = INIT_CALL_ONCE_GUARD;
+
+static void bunyArBlockCacheInit(void)
+{
+    initMutex(&gBunyArBlockCache.mutex);
+    gBunyArBlockCache.budget = BUNYAR_BLOCK_CACHE_DEFAULT_SIZE;
+}
+
+static inline uint64_t bunyArBlockCacheHash(const struct BunyArMetadata* archive, uint64_t location)
+{
+    return (((uint64_t)(uintptr_t)archive >> 4) ^ location) * 0x9E3779B97F4A7C15ull;
+}
+
+static inline struct BunyArCachedBlock** bunyArBlockCacheBucket(const struct BunyArMetadata* archive, uint64_t location)
+{
+    return &gBunyArBlockCache.buckets[(bunyArBlockCacheHash(archive, location) >> 32) & (gBunyArBlockCache.bucketCount - 1)];
+}
+
+// Following are called with the cache mutex locked
+
+static void bunyArBlockCacheLruUnlink(struct BunyArCachedBlock* block)
+{
+    if (block->lruPrev)
+        block->lruPrev->lruNext = block->lruNext;
+    else
+        gBunyArBlockCache.lruHead = block->lruNext;
+    if (block->lruNext)
+        block->lruNext->lruPrev = block->lruPrev;
+    else
+        gBunyArBlockCache.lruTail = block->lruPrev;
+    block->lruPrev = NULL;
+    block->lruNext = NULL;
+}
+
+static void bunyArBlockCacheLruPushFront(struct BunyArCachedBlock* block)
+{
+    block->lruPrev = NULL;
+    block->lruNext = gBunyArBlockCache.lruHead;
+    if (gBunyArBlockCache.lruHead)
+        gBunyArBlockCache.lruHead->lruPrev = block;
+    else
+        gBunyArBlockCache.lruTail = block;
+    gBunyArBlockCache.lruHead = block;
+}
+
+// Block is freed here unless pinned
+static void bunyArBlockCacheRemove(struct BunyArCachedBlock* block)
+{
+    struct BunyArCachedBlock** link = bunyArBlockCacheBucket(block->archive, block->location);
+    while (*link != block)
+        link = &(*link)->hashNext;
+    *link = block->hashNext;
+
+    bunyArBlockCacheLruUnlink(block);
+    gBunyArBlockCache.usedSize -= block->data.memorySize;
+    --gBunyArBlockCache.blockCount;
+    block->cached = false;
+    if (!block->refCount)
+        tf_free(block);
+}
+
+static void bunyArBlockCacheTrim(void)
+{
+    struct BunyArCachedBlock* block = gBunyArBlockCache.lruTail;
+    while (gBunyArBlockCache.usedSize > gBunyArBlockCache.budget && block)
+    {
+        struct BunyArCachedBlock* prev = block->lruPrev;
+        if (!block->refCount)
+        {
+            bunyArBlockCacheRemove(block);
+            ++gBunyArBlockCache.evictionCount;
+        }
+        block = prev;
+    }
+}
+
+static void bunyArBlockCacheRehash(uint64_t bucketCount)
+{
+    struct BunyArCachedBlock** buckets = (struct BunyArCachedBlock**)tf_calloc(bucketCount, sizeof(*buckets));
+    if (!buckets)
+        return;
+
+    struct BunyArCachedBlock** oldBuckets = gBunyArBlockCache.buckets;
+    uint64_t                   oldBucketCount = gBunyArBlockCache.bucketCount;
+    gBunyArBlockCache.buckets = buckets;
+    gBunyArBlockCache.bucketCount = bucketCount;
+
+    for (uint64_t i = 0; i < oldBucketCount; ++i)
+    {
+        for (struct BunyArCachedBlock* block = oldBuckets[i]; block;)
+        {
+            struct BunyArCachedBlock*  next = block->hashNext;
+            struct BunyArCachedBlock** bucket = bunyArBlockCacheBucket(block->archive, block->location);
+            block->hashNext = *bucket;
+            *bucket = block;
+            block = next;
+        }
+    }
+    tf_free(oldBuckets);
+}
+
+static struct BunyArCachedBlock* bunyArBlockCacheFind(const struct BunyArMetadata* archive, uint64_t location)
+{
+    if (!gBunyArBlockCache.blockCount)
+        return NULL;
+
+    for (struct BunyArCachedBlock* block = *bunyArBlockCacheBucket(archive, location); block; block = block->hashNext)
+    {
+        if (block->archive == archive && block->location == location)
+            return block;
+    }
+    return NULL;
+}
+
+// Returns pinned block, NULL on a miss
+static struct BunyArCachedBlock* bunyArBlockCacheAcquire(const struct BunyArMetadata* archive, uint64_t location)
+{
+    acquireMutex(&gBunyArBlockCache.mutex);
+    struct BunyArCachedBlock* block = bunyArBlockCacheFind(archive, location);
+    if (block)
+    {
+        ++block->refCount;
+        ++gBunyArBlockCache.hitCount;
+        bunyArBlockCacheLruUnlink(block);
+        bunyArBlockCacheLruPushFront(block);
+    }
+    else
+    {
+        ++gBunyArBlockCache.missCount;
+    }
+    releaseMutex(&gBunyArBlockCache.mutex);
+    return block;
+}
+
+// Returns false if block is cached, otherwise counts block as read ahead
+static bool bunyArBlockCacheBeginReadAhead(const struct BunyArMetadata* archive, uint64_t location)
+{
+    acquireMutex(&gBunyArBlockCache.mutex);
+    bool missing = !bunyArBlockCacheFind(archive, location);
+    if (missing)
+        ++gBunyArBlockCache.readAheadCount;
+    releaseMutex(&gBunyArBlockCache.mutex);
+    return missing;
+}
+
+static void bunyArBlockCacheRelease(struct BunyArCachedBlock* block)
+{
+    acquireMutex(&gBunyArBlockCache.mutex);
+    ASSERT(block->refCount);
+    if (!--block->refCount)
+    {
+        if (!block->cached)
+            tf_free(block);
+        else
+            bunyArBlockCacheTrim();
+    }
+    releaseMutex(&gBunyArBlockCache.mutex);
+}
+
+// Returns NULL if the block doesn't fit into the budget
+static struct BunyArCachedBlock* bunyArBlockCacheAllocate(const struct BunyArMetadata* archive, uint64_t location, uint64_t size)
+{
+    acquireMutex(&gBunyArBlockCache.mutex);
+    bool fits = size <= gBunyArBlockCache.budget;
+    releaseMutex(&gBunyArBlockCache.mutex);
+    if (!fits)
+        return NULL;
+
+    struct BunyArCachedBlock* block = (struct BunyArCachedBlock*)tf_malloc(sizeof(*block) + size);
+    if (!block)
+        return NULL;
+
+    memset(block, 0, sizeof(*block));
+    block->archive = archive;
+    block->location = location;
+    block->data.memory = (uint8_t*)(block + 1);
+    block->data.memorySize = size;
+    return block;
+}
+
+// Takes ownership of the filled block and returns it pinned, or the block inserted by another stream in the meantime
+static struct BunyArCachedBlock* bunyArBlockCacheInsert(struct BunyArCachedBlock* block)
+{
+    acquireMutex(&gBunyArBlockCache.mutex);
+    struct BunyArCachedBlock* existing = bunyArBlockCacheFind(block->archive, block->location);
+    if (existing)
+    {
+        tf_free(block);
+        block = existing;
+        bunyArBlockCacheLruUnlink(block);
+    }
+    else
+    {
+        if (gBunyArBlockCache.blockCount >= gBunyArBlockCache.bucketCount)
+            bunyArBlockCacheRehash(gBunyArBlockCache.bucketCount ? gBunyArBlockCache.bucketCount * 2 : 256);
+
+        struct BunyArCachedBlock** bucket = bunyArBlockCacheBucket(block->archive, block->location);
+        block->hashNext = *bucket;
+        *bucket = block;
+        block->cached = true;
+        gBunyArBlockCache.usedSize += block->data.memorySize;
+        ++gBunyArBlockCache.blockCount;
+    }
+    ++block->refCount;
+    bunyArBlockCacheLruPushFront(block);
+    bunyArBlockCacheTrim();
+    releaseMutex(&gBunyArBlockCache.mutex);
+    return block;
+}
+
+static void bunyArBlockCachePurge(const struct BunyArMetadata* archive)
+{
+    acquireMutex(&gBunyArBlockCache.mutex);
+    for (struct BunyArCachedBlock* block = gBunyArBlockCache.lruHead; block;)
+    {
+        struct BunyArCachedBlock* next = block->lruNext;
+        if (block->archive == archive)
+            bunyArBlockCacheRemove(block);
+        block = next;
+    }
+    if (!gBunyArBlockCache.blockCount)
+    {
+        tf_free(gBunyArBlockCache.buckets);
+        gBunyArBlockCache.buckets = NULL;
+        gBunyArBlockCache.bucketCount = 0;
+    }
+    releaseMutex(&gBunyArBlockCache.mutex);
+}
+
+void fsArchiveSetBlockCacheBudget(uint64_t budget)
+{
+    callOnce(&gBunyArBlockCacheInitGuard, bunyArBlockCacheInit);
+
+    acquireMutex(&gBunyArBlockCache.mutex);
+    gBunyArBlockCache.budget = budget;
+    bunyArBlockCacheTrim();
+    releaseMutex(&gBunyArBlockCache.mutex);
+}
+
+void fsArchiveGetBlockCacheStats(struct BunyArBlockCacheStats* outStats)
+{
+    callOnce(&gBunyArBlockCacheInitGuard, bunyArBlockCacheInit);
+
+    acquireMutex(&gBunyArBlockCache.mutex);
+    outStats->hitCount = gBunyArBlockCache.hitCount;
+    outStats->missCount = gBunyArBlockCache.missCount;
+    outStats->evictionCount = gBunyArBlockCache.evictionCount;
+    outStats->blockCount = gBunyArBlockCache.blockCount;
+    outStats->usedSize = gBunyArBlockCache.usedSize;
+    outStats->budget = gBunyArBlockCache.budget;
+    outStats->readAheadCount = gBunyArBlockCache.readAheadCount;
+    releaseMutex(&gBunyArBlockCache.mutex);
+}
+
 static const struct ArchiveOpenDesc BUNYAR_OPEN_DESC_DEFAULT = { 0 };
 
+static bool bunyArLoadDictionaries(struct BunyArMetadata* archive, struct BunyArPointer64 location)
+{
+    uint64_t dictionaryCount = location.size / sizeof(struct BunyArPointer64);
+
+    struct BunyArPointer64* pointers = (struct BunyArPointer64*)tf_malloc(location.size);
+    archive->dictionaries = (struct BunyArDictionary*)tf_calloc(dictionaryCount, sizeof *archive->dictionaries);
+    if (!pointers || !archive->dictionaries)
+    {
+        tf_free(pointers);
+        return false;
+    }
+
+    archive->dictionaryCount = dictionaryCount;
+
+    bool  success = bunyArReadLocation(archive, location, pointers);
+    void* content = NULL;
+
+    for (uint64_t i = 0; success && i < dictionaryCount; ++i)
+    {
+        struct BunyArPointer64 ptr = pointers[i];
+
+        const void*           dictionary;
+        ZSTD_dictLoadMethod_e loadMethod;
+
+        if (archive->memoryBeg)
+        {
+            // Archive memory outlives dictionaries
+            const uint8_t* memory;
+            uint64_t       size;
+            bunyArMemoryReadPrepare(archive, ptr, &memory, &size);
+            success = size == ptr.size;
+            dictionary = memory;
+            loadMethod = ZSTD_dlm_byRef;
+        }
+        else
+        {
+            void* newContent = tf_realloc(content, ptr.size);
+            if (!newContent)
+            {
+                success = false;
+                break;
+            }
+            content = newContent;
+            success = bunyArReadLocation(archive, ptr, content);
+            dictionary = content;
+            loadMethod = ZSTD_dlm_byCopy;
+        }
+
+        if (!success)
+            break;
+
+        struct BunyArDictionary* dst = archive->dictionaries + i;
+
+        dst->ddict = ZSTD_createDDict_advanced(dictionary, ptr.size, loadMethod, ZSTD_dct_fullDict, ZSTD_MEMORY_ALLOCATOR);
+        dst->id = dst->ddict ? ZSTD_getDictID_fromDDict(dst->ddict) : 0;
+        success = dst->id != 0;
+    }
+
+    tf_free(content);
+    tf_free(pointers);
+    return success;
+}
+
 static bool bunyArchiveOpen(FileStream* stream, uint64_t memorySize, const void* memory, const struct ArchiveOpenDesc* desc,
                             IFileSystem* out)
 {
@@ -1450,17 +1903,20 @@ static bool bunyArchiveOpen(FileStream* stream, uint64_t memorySize, const void*
     ////////////////////////
     // Read and check header
 
-    struct BunyArHeader header;
+    struct BunyArHeader header = { 0 };
+
+    // Headers of older versions are shorter
+    const size_t headerMinSize = offsetof(struct BunyArHeader, dictionariesPointer);
 
     bool headerReaded = false;
 
     if (streamMode)
     {
-        headerReaded = fsSeekStream(stream, SBO_START_OF_FILE, 0) && fsReadFromStream(stream, &header, sizeof header) == sizeof header;
+        headerReaded = fsSeekStream(stream, SBO_START_OF_FILE, 0) && fsReadFromStream(stream, &header, sizeof header) >= headerMinSize;
     }
-    else if (memorySize >= sizeof header)
+    else if (memorySize >= headerMinSize)
     {
-        memcpy(&header, memory, sizeof header);
+        memcpy(&header, memory, memorySize < sizeof header ? (size_t)memorySize : sizeof header);
         headerReaded = true;
     }
 
@@ -1481,12 +1937,19 @@ static bool bunyArchiveOpen(FileStream* stream, uint64_t memorySize, const void*
         return false;
     }
 
-    if (header.version.compatible != 0)
+    if (header.version.compatible > BUNYAR_VERSION)
     {
-        LOGF(eERROR, "Failed to open archive: version %llu not supported, expected 0", (unsigned long long)header.version.actual);
+        LOGF(eERROR, "Failed to open archive: version %llu not supported, expected %u or lower", (unsigned long long)header.version.compatible,
+             BUNYAR_VERSION);
         return false;
     }
 
+    // Older header is followed by other data
+    if (header.version.actual < 1)
+        memset(&header.dictionariesPointer, 0, sizeof header.dictionariesPointer);
+    if (header.version.actual < 3)
+        memset(&header.nodeSourcesPointer, 0, sizeof header.nodeSourcesPointer);
+
     ///////////////////////////////////////
     // Allocate memory for archive metadata
     // includes Archive struct, file nodes, file names
@@ -1693,7 +2156,19 @@ static bool bunyArchiveOpen(FileStream* stream, uint64_t memorySize, const void*
 
     initBunyArFsInterface(out, archive);
 
-    if (streamMode && desc->protectStreamCriticalSection)
+    if (header.dictionariesPointer.size && !bunyArLoadDictionaries(archive, header.dictionariesPointer))
+    {
+        LOGF(eERROR, "Failed to open archive: dictionaries reading failure");
+        fsArchiveClose(out);
+        return false;
+    }
+
+    archive->blockCache = !desc->disableBlockCache;
+    if (archive->blockCache)
+        callOnce(&gBunyArBlockCacheInitGuard, bunyArBlockCacheInit);
+
+    // Decompression tasks read the stream concurrently
+    if (streamMode && (desc->protectStreamCriticalSection || desc->threadSystem) && !fsStreamCanReadAt(stream))
     {
         if (!initMutex(&archive->mutex))
         {
@@ -1704,6 +2179,35 @@ static bool bunyArchiveOpen(FileStream* stream, uint64_t memorySize, const void*
         archive->archiveStreamLocking = true;
     }
 
+    if (desc->threadSystem)
+    {
+        if (!initMutex(&archive->decompressorMutex))
+        {
+            fsArchiveClose(out);
+            return false;
+        }
+
+        archive->threadSystem = desc->threadSystem;
+
+        if (archive->blockCache && !desc->disableReadAhead)
+        {
+            archive->readAheadDepth = desc->readAheadDepth ? desc->readAheadDepth : BUNYAR_READ_AHEAD_DEFAULT_DEPTH;
+            if (archive->readAheadDepth > BUNYAR_READ_AHEAD_MAX_DEPTH)
+                archive->readAheadDepth = BUNYAR_READ_AHEAD_MAX_DEPTH;
+            archive->readAheadSize = desc->readAheadSize ? desc->readAheadSize : BUNYAR_READ_AHEAD_DEFAULT_SIZE;
+        }
+    }
+
+    if (desc->recordAccessTrace)
+    {
+        archive->accessOrder = (tfrg_atomic64_t*)tf_calloc(archive->nodeCount ? archive->nodeCount : 1, sizeof(tfrg_atomic64_t));
+        if (!archive->accessOrder)
+        {
+            fsArchiveClose(out);
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -1770,6 +2274,29 @@ FORGE_API bool fsArchiveClose(IFileSystem* fs)
         destroyMutex(&archive->mutex);
     }
 
+    if (archive->blockCache)
+    {
+        bunyArBlockCachePurge(archive);
+    }
+
+    if (archive->threadSystem)
+    {
+        while (archive->decompressors)
+        {
+            struct BunyArDecompressor* decompressor = archive->decompressors;
+            archive->decompressors = decompressor->next;
+            ZSTD_freeDCtx(decompressor->zstd_ctx);
+            tf_free(decompressor->compressed.memory);
+            tf_free(decompressor);
+        }
+        destroyMutex(&archive->decompressorMutex);
+    }
+
+    for (uint64_t i = 0; i < archive->dictionaryCount; ++i)
+        ZSTD_freeDDict(archive->dictionaries[i].ddict);
+    tf_free(archive->dictionaries);
+
+    tf_free((void*)archive->accessOrder);
     tf_free(archive->hashTable);
     tf_free(archive);
     return true;
@@ -1864,6 +2391,9 @@ static bool ioArchiveOpenByUid(IFileSystem* inFs, uint64_t index, FileMode mode,
         compressedBufferSize = archive->memoryBeg ? 0 : blocksHeader.blockSize;
     }
     break;
+    // File is deleted
+    case BUNYAR_FILE_FORMAT_TOMBSTONE:
+        return false;
     default:
     {
         LOGF(eERROR, "Archive contains file '%s' written with unsupported format %llu", archive->nodeNames + node->namePointer.offset,
@@ -1915,6 +2445,13 @@ static bool ioArchiveOpenByUid(IFileSystem* inFs, uint64_t index, FileMode mode,
 
     ++archive->virtualStreamCount;
 
+    // Concurrent first opens may both take a sequence number, only one is stored
+    if (archive->accessOrder && !tfrg_atomic64_load_relaxed(&archive->accessOrder[index]))
+    {
+        uint64_t sequence = tfrg_atomic64_add_relaxed(&archive->accessCount, 1) + 1;
+        tfrg_atomic64_cas_relaxed(&archive->accessOrder[index], 0, sequence);
+    }
+
     return true;
 }
 
@@ -1926,6 +2463,17 @@ static bool ioArchiveFsOpen(IFileSystem* fs, const ResourceDirectory rd, const c
     return fs->OpenByUid(fs, index, mode, pOutStream);
 }
 
+// Waits for read-ahead of blocks [beginBlock, endBlock)
+static void bunyArReadAheadWait(struct BunyArMetadata* archive, struct BunyArFileStream* fs, uint64_t beginBlock, uint64_t endBlock)
+{
+    for (uint32_t i = 0; i < BUNYAR_READ_AHEAD_MAX_DEPTH; ++i)
+    {
+        const struct BunyArReadAheadTask* task = &fs->readAhead->tasks[i];
+        if (task->block >= beginBlock && task->block < endBlock)
+            threadSystemWaitTask(archive->threadSystem, task->handle);
+    }
+}
+
 static bool ioArchiveFsClose(FileStream* fs)
 {
     if (!fs->pIO)
@@ -1938,6 +2486,14 @@ static bool ioArchiveFsClose(FileStream* fs)
     --archive->virtualStreamCount;
 
     struct BunyArFileStream* stream = getFsBunyArStream(fs);
+    if (stream->readAhead)
+    {
+        // Tasks reference the stream
+        bunyArReadAheadWait(archive, stream, 0, UINT64_MAX);
+        tf_free(stream->readAhead);
+    }
+    if (stream->cachedBlock)
+        bunyArBlockCacheRelease(stream->cachedBlock);
     ZSTD_freeDCtx(stream->zstd_ctx);
     tf_free(stream);
 
@@ -1954,8 +2510,24 @@ static inline struct BunyArPointer64 bunyArDecodeBlockPointerInfo(struct BunyArN
     };
 }
 
-static bool bunyArReadBlockToBuffer(struct BunyArMetadata* archive, struct BunyArFileStream* fs, BunyArBlockPointer* blockToRead,
-                                    struct BunyArBlockBuffer* dst)
+// Blocks compressed without dictionary have no dictionary ID
+static inline const ZSTD_DDict* bunyArFindDictionary(const struct BunyArMetadata* archive, const void* src, size_t srcSize)
+{
+    if (!archive->dictionaryCount)
+        return NULL;
+
+    uint32_t id = ZSTD_getDictID_fromFrame(src, srcSize);
+    for (uint64_t i = 0; id && i < archive->dictionaryCount; ++i)
+    {
+        if (archive->dictionaries[i].id == id)
+            return archive->dictionaries[i].ddict;
+    }
+    return NULL;
+}
+
+// 'compressedMemory' receives compressed data unless archive is read from memory
+static bool bunyArDecompressBlock(struct BunyArMetadata* archive, struct BunyArFileStream* fs, BunyArBlockPointer* blockToRead,
+                                  ZSTD_DCtx* zstdCtx, uint8_t* compressedMemory, struct BunyArBlockBuffer* dst)
 {
     uint64_t       srcSize;
     const uint8_t* srcMemory;
@@ -1975,9 +2547,9 @@ static bool bunyArReadBlockToBuffer(struct BunyArMetadata* archive, struct BunyA
         }
         else
         {
-            if (!bunyArReadLocation(archive, loc, fs->compressed.memory))
+            if (!bunyArReadLocation(archive, loc, compressedMemory))
                 return false;
-            srcMemory = fs->compressed.memory;
+            srcMemory = compressedMemory;
             srcSize = loc.size;
         }
     }
@@ -2002,7 +2574,10 @@ static bool bunyArReadBlockToBuffer(struct BunyArMetadata* archive, struct BunyA
     break;
     case BUNYAR_FILE_FORMAT_ZSTD_BLOCKS:
     {
-        size_t decompressedSize = ZSTD_decompressDCtx(fs->zstd_ctx, dst->memory, dst->memorySize, srcMemory, srcSize);
+        const ZSTD_DDict* ddict = bunyArFindDictionary(archive, srcMemory, srcSize);
+
+        size_t decompressedSize = ddict ? ZSTD_decompress_usingDDict(zstdCtx, dst->memory, dst->memorySize, srcMemory, srcSize, ddict)
+                                        : ZSTD_decompressDCtx(zstdCtx, dst->memory, dst->memorySize, srcMemory, srcSize);
 
         if (ZSTD_isError(decompressedSize))
         {
@@ -2024,11 +2599,66 @@ static bool bunyArReadBlockToBuffer(struct BunyArMetadata* archive, struct BunyA
     return false;
 }
 
+static inline bool bunyArReadBlockToBuffer(struct BunyArMetadata* archive, struct BunyArFileStream* fs, BunyArBlockPointer* blockToRead,
+                                           struct BunyArBlockBuffer* dst)
+{
+    return bunyArDecompressBlock(archive, fs, blockToRead, fs->zstd_ctx, fs->compressed.memory, dst);
+}
+
+static inline uint64_t bunyArBlockLocation(struct BunyArFileStream* fs, BunyArBlockPointer* block)
+{
+    struct BunyArBlockInfo blockInfo = bunyArDecodeBlockPointer(*block);
+    return bunyArDecodeBlockPointerInfo(fs->node, &fs->blocksHeader, &blockInfo).offset;
+}
+
+static inline uint64_t bunyArBlockSize(struct BunyArFileStream* fs, BunyArBlockPointer* block)
+{
+    return (uint64_t)(block - fs->blocks) == fs->blocksHeader.blockCount - 1 ? fs->blocksHeader.blockSizeLast : fs->blocksHeader.blockSize;
+}
+
+// Returns decompressed data of currentBlock
+static inline const struct BunyArBlockBuffer* bunyArCurrentBlockData(struct BunyArFileStream* fs)
+{
+    return fs->cachedBlock ? &fs->cachedBlock->data : &fs->decompressed;
+}
+
 static bool bunyArReadBlockToStagingBuffer(struct BunyArMetadata* archive, struct BunyArFileStream* fs, BunyArBlockPointer* blockToRead)
 {
     if (fs->currentBlock == blockToRead)
         return true;
 
+    if (fs->cachedBlock)
+    {
+        bunyArBlockCacheRelease(fs->cachedBlock);
+        fs->cachedBlock = NULL;
+    }
+
+    if (archive->blockCache)
+    {
+        uint64_t location = bunyArBlockLocation(fs, blockToRead);
+
+        fs->cachedBlock = bunyArBlockCacheAcquire(archive, location);
+        if (!fs->cachedBlock)
+        {
+            struct BunyArCachedBlock* block = bunyArBlockCacheAllocate(archive, location, bunyArBlockSize(fs, blockToRead));
+            if (block && !bunyArReadBlockToBuffer(archive, fs, blockToRead, &block->data))
+            {
+                tf_free(block);
+                fs->currentBlock = NULL;
+                return false;
+            }
+            // Block larger than cache budget goes to the staging buffer
+            if (block)
+                fs->cachedBlock = bunyArBlockCacheInsert(block);
+        }
+
+        if (fs->cachedBlock)
+        {
+            fs->currentBlock = blockToRead;
+            return true;
+        }
+    }
+
     if (bunyArReadBlockToBuffer(archive, fs, blockToRead, &fs->decompressed))
     {
         fs->currentBlock = blockToRead;
@@ -2040,6 +2670,268 @@ static bool bunyArReadBlockToStagingBuffer(struct BunyArMetadata* archive, struc
     return false;
 }
 
+// Decompresses entire compressed block to 'dst', which has room for it.
+// Block is served from the cache when it's there, but isn't added to it. Caller consumes the whole block, and bulk reads
+// would evict every hot block otherwise. Partially consumed blocks and read-ahead results are cached instead.
+// Returns size of decompressed data.
+static uint64_t bunyArReadWholeBlock(struct BunyArMetadata* archive, struct BunyArFileStream* fs, BunyArBlockPointer* block,
+                                     ZSTD_DCtx* zstdCtx, uint8_t* compressedMemory, uint8_t* dst)
+{
+    uint64_t blockSize = bunyArBlockSize(fs, block);
+
+    struct BunyArCachedBlock* cached = archive->blockCache ? bunyArBlockCacheAcquire(archive, bunyArBlockLocation(fs, block)) : NULL;
+    if (cached)
+    {
+        uint64_t size = cached->data.usedSize;
+        memcpy(dst, cached->data.memory, size);
+        bunyArBlockCacheRelease(cached);
+        return size;
+    }
+
+    struct BunyArBlockBuffer buffer = { 0 };
+
+    buffer.memory = dst;
+    buffer.memorySize = blockSize;
+    bunyArDecompressBlock(archive, fs, block, zstdCtx, compressedMemory, &buffer);
+    return buffer.usedSize;
+}
+
+struct BunyArParallelRead
+{
+    struct BunyArMetadata*   archive;
+    struct BunyArFileStream* fs;
+    uint64_t                 firstBlock;
+    // Receives 'firstBlock'
+    uint8_t*                 dst;
+    // Lowest index of a block which failed, protected by archive->decompressorMutex
+    uint64_t                 failedBlock;
+};
+
+static struct BunyArDecompressor* bunyArAcquireDecompressor(struct BunyArMetadata* archive, struct BunyArFileStream* fs)
+{
+    acquireMutex(&archive->decompressorMutex);
+    struct BunyArDecompressor* decompressor = archive->decompressors;
+    if (decompressor)
+        archive->decompressors = decompressor->next;
+    releaseMutex(&archive->decompressorMutex);
+
+    if (!decompressor)
+    {
+        decompressor = (struct BunyArDecompressor*)tf_calloc(1, sizeof(*decompressor));
+        if (!decompressor)
+        {
+            LOGF(eERROR, "Failed to allocate archive decompressor");
+            return NULL;
+        }
+    }
+
+    if (fs->node->format == BUNYAR_FILE_FORMAT_ZSTD_BLOCKS && !decompressor->zstd_ctx)
+    {
+        decompressor->zstd_ctx = ZSTD_createDCtx_advanced(ZSTD_MEMORY_ALLOCATOR);
+        if (!decompressor->zstd_ctx)
+        {
+            LOGF(eERROR, "Failed to create ZSTD decompression context");
+            tf_free(decompressor->compressed.memory);
+            tf_free(decompressor);
+            return NULL;
+        }
+    }
+
+    // Compressed blocks are never larger than decompressed ones
+    if (!archive->memoryBeg && decompressor->compressed.memorySize < fs->blocksHeader.blockSize)
+    {
+        tf_free(decompressor->compressed.memory);
+        decompressor->compressed.memorySize = fs->blocksHeader.blockSize;
+        decompressor->compressed.memory = (uint8_t*)tf_malloc(decompressor->compressed.memorySize);
+        if (!decompressor->compressed.memory)
+        {
+            LOGF(eERROR, "Failed to allocate buffer for compressed archive blocks");
+            ZSTD_freeDCtx(decompressor->zstd_ctx);
+            tf_free(decompressor);
+            return NULL;
+        }
+    }
+
+    return decompressor;
+}
+
+static void bunyArParallelReadBlocks(void* user, uint64_t begin, uint64_t end, uint64_t threadId)
+{
+    (void)threadId;
+
+    struct BunyArParallelRead* read = (struct BunyArParallelRead*)user;
+    struct BunyArMetadata*     archive = read->archive;
+    struct BunyArFileStream*   fs = read->fs;
+
+    struct BunyArDecompressor* decompressor = bunyArAcquireDecompressor(archive, fs);
+
+    uint64_t failedBlock = decompressor ? UINT64_MAX : begin;
+    for (uint64_t i = begin; i < end && failedBlock == UINT64_MAX; ++i)
+    {
+        BunyArBlockPointer*    block = fs->blocks + i;
+        struct BunyArBlockInfo blockInfo = bunyArDecodeBlockPointer(*block);
+        uint64_t               blockSize = bunyArBlockSize(fs, block);
+        uint8_t*               dst = read->dst + (i - read->firstBlock) * fs->blocksHeader.blockSize;
+        uint64_t               sizeDone = 0;
+
+        if (!blockInfo.isCompressed)
+        {
+            if (blockInfo.size == blockSize)
+            {
+                struct BunyArPointer64 location = bunyArDecodeBlockPointerInfo(fs->node, &fs->blocksHeader, &blockInfo);
+                sizeDone = bunyArStreamRead(archive, location.offset, location.size, dst);
+            }
+        }
+        else
+        {
+            sizeDone = bunyArReadWholeBlock(archive, fs, block, decompressor->zstd_ctx, decompressor->compressed.memory, dst);
+        }
+
+        if (sizeDone != blockSize)
+            failedBlock = i;
+    }
+
+    acquireMutex(&archive->decompressorMutex);
+    if (decompressor)
+    {
+        decompressor->next = archive->decompressors;
+        archive->decompressors = decompressor;
+    }
+    if (read->failedBlock > failedBlock)
+        read->failedBlock = failedBlock;
+    releaseMutex(&archive->decompressorMutex);
+}
+
+// Decompressed size of 'blockCount' blocks starting at 'blockIndex'
+static inline uint64_t bunyArBlocksSize(struct BunyArFileStream* fs, uint64_t blockIndex, uint64_t blockCount)
+{
+    if (!blockCount)
+        return 0;
+    return (blockCount - 1) * fs->blocksHeader.blockSize + bunyArBlockSize(fs, fs->blocks + blockIndex + blockCount - 1);
+}
+
+// Decompresses 'blockCount' whole blocks starting at 'blockIndex' on threadSystem.
+// Returns size of decompressed data up to the first block which failed.
+static uint64_t bunyArParallelRead(struct BunyArMetadata* archive, struct BunyArFileStream* fs, uint64_t blockIndex, uint64_t blockCount,
+                                   uint8_t* dst)
+{
+    struct BunyArParallelRead read = { archive, fs, blockIndex, dst, UINT64_MAX };
+
+    threadSystemParallelFor(archive->threadSystem, blockIndex, blockIndex + blockCount, 0, bunyArParallelReadBlocks, &read);
+
+    return bunyArBlocksSize(fs, blockIndex, read.failedBlock == UINT64_MAX ? blockCount : read.failedBlock - blockIndex);
+}
+
+static void bunyArReadAheadBlock(void* user, uint64_t threadId)
+{
+    (void)threadId;
+
+    struct BunyArReadAheadTask* task = (struct BunyArReadAheadTask*)user;
+    struct BunyArMetadata*      archive = task->archive;
+    struct BunyArFileStream*    fs = task->fs;
+    BunyArBlockPointer*         block = fs->blocks + task->block;
+    uint64_t                    location = bunyArBlockLocation(fs, block);
+    uint64_t                    blockSize = bunyArBlockSize(fs, block);
+
+    struct BunyArDecompressor* decompressor = NULL;
+    if (bunyArBlockCacheBeginReadAhead(archive, location))
+    {
+        decompressor = bunyArAcquireDecompressor(archive, fs);
+
+        struct BunyArCachedBlock* cached = decompressor ? bunyArBlockCacheAllocate(archive, location, blockSize) : NULL;
+        if (cached && bunyArDecompressBlock(archive, fs, block, decompressor->zstd_ctx, decompressor->compressed.memory, &cached->data))
+            bunyArBlockCacheRelease(bunyArBlockCacheInsert(cached));
+        else
+            tf_free(cached);
+    }
+
+    acquireMutex(&archive->decompressorMutex);
+    if (decompressor)
+    {
+        decompressor->next = archive->decompressors;
+        archive->decompressors = decompressor;
+    }
+    archive->readAheadUsedSize -= blockSize;
+    releaseMutex(&archive->decompressorMutex);
+}
+
+// Called after every read of the stream, 'readPosition' is where the read started.
+// Blocks following the read are decompressed to the block cache while reads stay sequential.
+static void bunyArReadAheadSchedule(struct BunyArMetadata* archive, struct BunyArFileStream* fs, size_t readPosition)
+{
+    bool sequential = readPosition == fs->readEnd;
+    fs->readEnd = fs->position;
+
+    if (!sequential)
+    {
+        if (fs->readAhead)
+        {
+            fs->readAhead->depth = 0;
+            fs->readAhead->endBlock = 0;
+        }
+        return;
+    }
+
+    if (!fs->readAhead)
+    {
+        // Reads work without read-ahead, allocation is tried again by the next sequential read
+        fs->readAhead = (struct BunyArReadAhead*)tf_calloc(1, sizeof(*fs->readAhead));
+        if (!fs->readAhead)
+            return;
+    }
+
+    // Depth doubles while reads stay sequential
+    struct BunyArReadAhead* readAhead = fs->readAhead;
+    readAhead->depth = readAhead->depth ? TF_MIN(readAhead->depth * 2, archive->readAheadDepth) : 1;
+
+    // First block the next read is going to decompress
+    uint64_t block = fs->position / fs->blocksHeader.blockSize;
+    if (fs->currentBlock == fs->blocks + block)
+        ++block;
+
+    uint64_t endBlock = TF_MIN(block + readAhead->depth, fs->blocksHeader.blockCount);
+    if (block < readAhead->endBlock)
+        block = readAhead->endBlock;
+
+    for (; block < endBlock; ++block)
+    {
+        // Uncompressed blocks are read directly
+        if (!bunyArDecodeBlockPointer(fs->blocks[block]).isCompressed)
+            continue;
+
+        uint64_t blockSize = bunyArBlockSize(fs, fs->blocks + block);
+
+        acquireMutex(&archive->decompressorMutex);
+        bool fits = archive->readAheadUsedSize + blockSize <= archive->readAheadSize;
+        if (fits)
+            archive->readAheadUsedSize += blockSize;
+        releaseMutex(&archive->decompressorMutex);
+
+        if (!fits)
+            break;
+
+        // Slot was used by a block read long ago, it is done unless the pool is busy
+        struct BunyArReadAheadTask* task = &readAhead->tasks[block % BUNYAR_READ_AHEAD_MAX_DEPTH];
+        threadSystemWaitTask(archive->threadSystem, task->handle);
+
+        task->archive = archive;
+        task->fs = fs;
+        task->block = block;
+        task->handle = threadSystemAddTasksPriority(archive->threadSystem, TASK_PRIORITY_LOW, bunyArReadAheadBlock, 1, 0, task);
+    }
+
+    readAhead->endBlock = block;
+}
+
+// Number of whole blocks starting at 'blockIndex' which fit into 'size'
+static inline uint64_t bunyArWholeBlockCount(struct BunyArFileStream* fs, uint64_t blockIndex, size_t size)
+{
+    uint64_t blocksLeft = fs->blocksHeader.blockCount - blockIndex;
+    if (size >= bunyArBlocksSize(fs, blockIndex, blocksLeft))
+        return blocksLeft;
+    return size / fs->blocksHeader.blockSize;
+}
+
 static size_t ioArchiveFsRead(FileStream* pFile, void* outputBuffer, size_t outputSize)
 {
     struct BunyArFileStream* fs = getFsBunyArStream(pFile);
@@ -2063,6 +2955,7 @@ static size_t ioArchiveFsRead(FileStream* pFile, void* outputBuffer, size_t outp
     {
         uint8_t* dstMemory = (uint8_t*)outputBuffer;
         size_t   sizeToWrite = outputSize;
+        size_t   readPosition = fs->position;
 
         while (sizeToWrite > 0)
         {
@@ -2084,7 +2977,11 @@ static size_t ioArchiveFsRead(FileStream* pFile, void* outputBuffer, size_t outp
 
             struct BunyArBlockInfo blockInfo = bunyArDecodeBlockPointer(*block);
 
+            if (fs->readAhead)
+                bunyArReadAheadWait(archive, fs, blockIndex, blockIndex + 1);
+
             uint64_t sizeDone = 0;
+            bool     failed = false;
 
             if (!blockInfo.isCompressed)
             {
@@ -2111,13 +3008,20 @@ static size_t ioArchiveFsRead(FileStream* pFile, void* outputBuffer, size_t outp
                 // Avoid usage of staging buffer.
                 // We can uncompress entire block to user memory.
 
-                struct BunyArBlockBuffer buffer = { 0 };
+                uint64_t blockCount = archive->threadSystem ? bunyArWholeBlockCount(fs, blockIndex, sizeToWrite) : 1;
+                if (blockCount < BUNYAR_PARALLEL_MIN_BLOCKS)
+                    blockCount = 1;
 
-                buffer.memory = dstMemory;
-                buffer.memorySize = sizeToWrite;
-                bunyArReadBlockToBuffer(archive, fs, block, &buffer);
+                if (blockCount > 1 && fs->readAhead)
+                    bunyArReadAheadWait(archive, fs, blockIndex + 1, blockIndex + blockCount);
 
-                sizeDone = buffer.usedSize;
+                if (blockCount > 1)
+                    sizeDone = bunyArParallelRead(archive, fs, blockIndex, blockCount, dstMemory);
+                else
+                    sizeDone = bunyArReadWholeBlock(archive, fs, block, fs->zstd_ctx, fs->compressed.memory, dstMemory);
+
+                // Stop at the block which failed
+                failed = sizeDone != bunyArBlocksSize(fs, blockIndex, blockCount);
             }
             else
             {
@@ -2127,22 +3031,30 @@ static size_t ioArchiveFsRead(FileStream* pFile, void* outputBuffer, size_t outp
                 if (fs->currentBlock != block && !bunyArReadBlockToStagingBuffer(archive, fs, block))
                     break;
 
+                const struct BunyArBlockBuffer* current = bunyArCurrentBlockData(fs);
+
                 // We can't reach end of last block here, because of test before
-                ASSERT(fs->decompressed.usedSize > offsetInBlock);
+                ASSERT(current->usedSize > offsetInBlock);
 
                 // copy data from decompressed buffer to user memory
-                uint64_t availableSize = fs->decompressed.usedSize - offsetInBlock;
+                uint64_t availableSize = current->usedSize - offsetInBlock;
 
                 sizeDone = availableSize > sizeToWrite ? sizeToWrite : availableSize;
 
-                memcpy(dstMemory, fs->decompressed.memory + offsetInBlock, sizeDone);
+                memcpy(dstMemory, current->memory + offsetInBlock, sizeDone);
             }
 
             dstMemory += sizeDone;
             sizeToWrite -= sizeDone;
             fs->position += sizeDone;
+
+            if (failed)
+                break;
         }
 
+        if (archive->readAheadDepth)
+            bunyArReadAheadSchedule(archive, fs, readPosition);
+
         return outputSize - sizeToWrite;
     }
     default:
@@ -2246,6 +3158,7 @@ void fsArchiveGetDescription(IFileSystem* fs, struct BunyArDescription* outInfo)
 
     outInfo->nodeCount = archive->nodeCount;
     outInfo->hashTable = archive->hashTable;
+    outInfo->dictionaryCount = archive->dictionaryCount;
 }
 
 bool fsArchiveGetNodeDescription(IFileSystem* fs, uint64_t nodeId, struct BunyArNodeDescription* outInfo)
@@ -2263,6 +3176,7 @@ bool fsArchiveGetNodeDescription(IFileSystem* fs, uint64_t nodeId, struct BunyAr
     outInfo->fileSize = node->originalFileSize;
     outInfo->compressedSize = node->filePointer.size;
     outInfo->format = (enum BunyArFileFormat)node->format;
+    outInfo->offset = node->filePointer.offset;
 
     return true;
 }
@@ -2279,5 +3193,295 @@ bool fsArchiveGetFileBlockMetadata(FileStream* pFile, struct BunyArBlockFormatHe
     return *outBlockPtrs != NULL;
 }
 
+struct BunyArAccess
+{
+    uint64_t sequence;
+    uint64_t node;
+};
+
+static int bunyArAccessCmp(const void* v0, const void* v1)
+{
+    const struct BunyArAccess* a0 = (const struct BunyArAccess*)v0;
+    const struct BunyArAccess* a1 = (const struct BunyArAccess*)v1;
+    return a0->sequence < a1->sequence ? -1 : a0->sequence > a1->sequence;
+}
+
+bool fsArchiveWriteAccessTrace(IFileSystem* fs, ResourceDirectory rd, const char* fileName)
+{
+    struct BunyArMetadata* archive = getFsArchive(fs);
+    if (!archive->accessOrder)
+    {
+        LOGF(eERROR, "Cannot write access trace '%s': archive is opened without ArchiveOpenDesc::recordAccessTrace", fileName);
+        return false;
+    }
+
+    struct BunyArAccess* accesses = (struct BunyArAccess*)tf_malloc((archive->nodeCount ? archive->nodeCount : 1) * sizeof *accesses);
+    if (!accesses)
+        return false;
+
+    uint64_t accessCount = 0;
+    for (uint64_t i = 0; i < archive->nodeCount; ++i)
+    {
+        uint64_t sequence = tfrg_atomic64_load_relaxed(&archive->accessOrder[i]);
+        if (sequence)
+        {
+            accesses[accessCount].sequence = sequence;
+            accesses[accessCount].node = i;
+            ++accessCount;
+        }
+    }
+
+    qsort(accesses, accessCount, sizeof *accesses, bunyArAccessCmp);
+
+    FileStream stream = { 0 };
+    bool       success = fsOpenStreamFromPath(rd, fileName, FM_WRITE, &stream);
+    for (uint64_t i = 0; success && i < accessCount; ++i)
+    {
+        const char* name = archive->nodeNames + archive->nodes[accesses[i].node].namePointer.offset;
+        size_t      nameSize = strlen(name);
+        success = fsWriteToStream(&stream, name, nameSize) == nameSize && fsWriteToStream(&stream, "\n", 1) == 1;
+    }
+
+    if (!success)
+        LOGF(eERROR, "Failed to write access trace '%s'", fileName);
+
+    fsCloseStream(&stream);
+    tf_free(accesses);
+    return success;
+}
+
+/************************************************************************/
+// MARK: - Mount stack
+/************************************************************************/
+
+struct MountStackEntry
+{
+    uint64_t hash;
+    // Node of archive layer, UINT64_MAX if slot is empty
+    uint64_t nodeId;
+    uint32_t layer;
+    bool     tombstone;
+};
+
+struct MountStack
+{
+    // Sorted from highest priority to lowest
+    uint32_t               layerCount;
+    struct MountLayerDesc* layers;
+
+    // Linear probing table of node names of all archive layers,
+    // each name is resolved to the archive of highest priority having it.
+    // tableSize is a power of 2
+    uint64_t                tableSize;
+    struct MountStackEntry* table;
+};
+
+static inline struct MountStack* getFsMountStack(IFileSystem* fs) { return (struct MountStack*)fs->pUser; }
+
+static inline bool isArchiveFs(const IFileSystem* fs) { return fs->Open == ioArchiveFsOpen; }
+
+static inline const char* mountStackEntryName(const struct MountStack* stack, const struct MountStackEntry* entry)
+{
+    const struct BunyArMetadata* archive = getFsArchive(stack->layers[entry->layer].pIO);
+    return archive->nodeNames + archive->nodes[entry->nodeId].namePointer.offset;
+}
+
+// Returns slot of name, or empty slot where name would be inserted
+static struct MountStackEntry* mountStackFindSlot(const struct MountStack* stack, const char* name, uint64_t hash)
+{
+    uint64_t mask = stack->tableSize - 1;
+    for (uint64_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        struct MountStackEntry* entry = stack->table + i;
+        if (entry->nodeId == UINT64_MAX)
+            return entry;
+        if (entry->hash == hash && strcmp(mountStackEntryName(stack, entry), name) == 0)
+            return entry;
+    }
+}
+
+static const struct MountStackEntry* mountStackFind(const struct MountStack* stack, const char* name)
+{
+    if (!stack->tableSize)
+        return NULL;
+
+    struct MountStackEntry* entry = mountStackFindSlot(stack, name, archiveHashMurmur2_64(name, strlen(name), 0));
+    return entry->nodeId == UINT64_MAX ? NULL : entry;
+}
+
+static void mountStackMergeArchive(struct MountStack* stack, uint32_t layerIndex)
+{
+    struct BunyArMetadata* archive = getFsArchive(stack->layers[layerIndex].pIO);
+
+    for (uint64_t ni = 0; ni < archive->nodeCount; ++ni)
+    {
+        const struct BunyArNode* node = archive->nodes + ni;
+        const char*              name = archive->nodeNames + node->namePointer.offset;
+
+        uint64_t                hash = archiveHashMurmur2_64(name, node->namePointer.size, 0);
+        struct MountStackEntry* entry = mountStackFindSlot(stack, name, hash);
+
+        // Layers are merged from highest priority, name is overridden
+        if (entry->nodeId != UINT64_MAX)
+            continue;
+
+        entry->hash = hash;
+        entry->nodeId = ni;
+        entry->layer = layerIndex;
+        entry->tombstone = node->format == BUNYAR_FILE_FORMAT_TOMBSTONE;
+    }
+}
+
+static bool ioMountStackGetFileUid(IFileSystem* fs, ResourceDirectory rd, const char* fileName, uint64_t* outUid)
+{
+    struct MountStack* stack = getFsMountStack(fs);
+
+    char path[BUNYAR_FILE_NAME_LENGTH_MAX + 1];
+    if (!fsMergeDirAndFileName(fsGetResourceDirectory(rd), fileName, '/', sizeof path, path))
+        return false;
+
+    const struct MountStackEntry* entry = mountStackFind(stack, path);
+    if (!entry || entry->tombstone)
+        return false;
+
+    *outUid = (uint64_t)(entry - stack->table);
+    return true;
+}
+
+static bool ioMountStackOpenByUid(IFileSystem* fs, uint64_t uid, FileMode mode, FileStream* pOut)
+{
+    struct MountStack* stack = getFsMountStack(fs);
+
+    if (uid >= stack->tableSize || stack->table[uid].nodeId == UINT64_MAX)
+    {
+        LOGF(eERROR, "Cannot open mount stack file by UID %llu: bad UID", (unsigned long long)uid);
+        return false;
+    }
+
+    const struct MountStackEntry* entry = stack->table + uid;
+    if (entry->tombstone)
+        return false;
+
+    IFileSystem* layer = stack->layers[entry->layer].pIO;
+    return layer->OpenByUid(layer, entry->nodeId, mode, pOut);
+}
+
+static bool ioMountStackOpen(IFileSystem* fs, const ResourceDirectory rd, const char* fileName, FileMode mode, FileStream* pOut)
+{
+    memset(pOut, 0, sizeof *pOut);
+
+    struct MountStack* stack = getFsMountStack(fs);
+
+    if (mode != FM_READ)
+    {
+        LOGF(eERROR, "Cannot open mount stack file '%s': only FM_READ is supported", fileName);
+        return false;
+    }
+
+    char path[BUNYAR_FILE_NAME_LENGTH_MAX + 1];
+    if (!fsMergeDirAndFileName(fsGetResourceDirectory(rd), fileName, '/', sizeof path, path))
+        return false;
+
+    const struct MountStackEntry* entry = mountStackFind(stack, path);
+
+    // Layers of higher priority than the archive holding the file
+    uint32_t layerEnd = entry ? entry->layer : stack->layerCount;
+    for (uint32_t i = 0; i < layerEnd; ++i)
+    {
+        const struct MountLayerDesc* layer = stack->layers + i;
+        if (isArchiveFs(layer->pIO))
+            continue;
+
+        // System file IO logs failed opens, missing files are skipped beforehand
+        if (layer->pIO == pSystemFileIO && fsGetLastModifiedTime(layer->rootDirectory, path) == 0)
+            continue;
+
+        if (layer->pIO->Open(layer->pIO, layer->rootDirectory, path, mode, pOut))
+            return true;
+    }
+
+    if (!entry || entry->tombstone)
+        return false;
+
+    IFileSystem* archive = stack->layers[entry->layer].pIO;
+    return archive->OpenByUid(archive, entry->nodeId, mode, pOut);
+}
+
+bool fsMountStackOpen(const struct MountStackDesc* pDesc, IFileSystem* pOut)
+{
+    memset(pOut, 0, sizeof *pOut);
+
+    struct MountStack* stack = (struct MountStack*)tf_calloc(1, sizeof *stack + sizeof *stack->layers * pDesc->layerCount);
+    if (!stack)
+        return false;
+
+    stack->layerCount = pDesc->layerCount;
+    stack->layers = (struct MountLayerDesc*)(stack + 1);
+
+    uint64_t nodeCount = 0;
+
+    // Insertion sort, later layers go first among layers of the same priority
+    for (uint32_t i = 0; i < pDesc->layerCount; ++i)
+    {
+        const struct MountLayerDesc* layer = pDesc->pLayers + i;
+        if (!layer->pIO)
+        {
+            LOGF(eERROR, "Mount stack layer %u has no file system", i);
+            tf_free(stack);
+            return false;
+        }
+
+        if (isArchiveFs(layer->pIO))
+            nodeCount += getFsArchive(layer->pIO)->nodeCount;
+
+        uint32_t j = i;
+        for (; j > 0 && stack->layers[j - 1].priority <= layer->priority; --j)
+            stack->layers[j] = stack->layers[j - 1];
+        stack->layers[j] = *layer;
+    }
+
+    if (nodeCount)
+    {
+        // Load factor is at most 0.5
+        stack->tableSize = 2;
+        while (stack->tableSize < nodeCount * 2)
+            stack->tableSize *= 2;
+
+        stack->table = (struct MountStackEntry*)tf_malloc(sizeof *stack->table * stack->tableSize);
+        if (!stack->table)
+        {
+            tf_free(stack);
+            return false;
+        }
+
+        for (uint64_t i = 0; i < stack->tableSize; ++i)
+            stack->table[i].nodeId = UINT64_MAX;
+
+        for (uint32_t i = 0; i < stack->layerCount; ++i)
+        {
+            if (isArchiveFs(stack->layers[i].pIO))
+                mountStackMergeArchive(stack, i);
+        }
+    }
+
+    pOut->Open = ioMountStackOpen;
+    pOut->GetFileUid = ioMountStackGetFileUid;
+    pOut->OpenByUid = ioMountStackOpenByUid;
+    pOut->pUser = stack;
+    return true;
+}
+
+bool fsMountStackClose(IFileSystem* fs)
+{
+    struct MountStack* stack = getFsMountStack(fs);
+    if (!stack)
+        return false;
+
+    tf_free(stack->table);
+    tf_free(stack);
+    memset(fs, 0, sizeof *fs);
+    return true;
+}
+
 /************************************************************************/
 /************************************************************************/
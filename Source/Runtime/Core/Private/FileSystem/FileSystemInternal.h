@@ -0,0 +1,41 @@
+#pragma once
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Functions shared by file system implementations, not part of the public interface
+
+#include <Core/IFileSystem.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Descriptor of a Unix file stream, used by asynchronous reads to submit requests to the kernel.
+    // -1 for streams of other file systems.
+    int unixFsGetDescriptor(FileStream* fs);
+
+#ifdef __cplusplus
+}
+#endif
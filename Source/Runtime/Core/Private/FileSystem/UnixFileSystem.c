@@ -32,6 +32,8 @@
 #include <Core/IFileSystem.h>
 #include <Core/ILog.h>
 
+#include "FileSystemInternal.h"
+
 bool fsMergeDirAndFileName(const char* dir, const char* path, char separator, size_t dstSize, char* dst);
 void fsGetParentPath(const char* path, char* output);
 
@@ -284,6 +286,31 @@ static size_t ioUnixFsRead(FileStream* fs, void* dst, size_t size)
     return 0;
 }
 
+static size_t ioUnixFsReadAt(FileStream* fs, void* dst, size_t size, ssize_t offset)
+{
+    USD(stream, fs);
+    size_t readed = 0;
+    while (readed < size)
+    {
+        ssize_t res = pread(stream->descriptor, (uint8_t*)dst + readed, size - readed, (off_t)offset + (off_t)readed);
+        if (res > 0)
+        {
+            readed += (size_t)res;
+            continue;
+        }
+        if (res == 0)
+            break;
+        if (errno == EINTR)
+            continue;
+
+        char buffer[1024];
+        LOGF(eERROR, "Error reading %s at offset %lld from file '%s': %s", humanReadableSize(size).str, (long long)offset,
+             getFileName(stream, buffer, sizeof buffer), strerror(errno));
+        break;
+    }
+    return readed;
+}
+
 static ssize_t ioUnixFsGetPosition(FileStream* fs)
 {
     USD(stream, fs);
@@ -398,9 +425,18 @@ static bool ioUnixFsIsAtEnd(FileStream* fs) { return ioUnixFsGetPosition(fs) >=
 
 IFileSystem gUnixSystemFileIO = {
     ioUnixFsOpen,  ioUnixFsClose,   ioUnixFsRead, ioUnixFsWrite, ioUnixFsSeek, ioUnixFsGetPosition, ioUnixFsGetSize,
-    ioUnixFsFlush, ioUnixFsIsAtEnd, NULL,         NULL,          NULL,         ioUnixFsMemoryMap,   NULL,
+    ioUnixFsFlush, ioUnixFsIsAtEnd, NULL,         NULL,          NULL,         ioUnixFsMemoryMap,   ioUnixFsReadAt,
+    NULL,
 };
 
+int unixFsGetDescriptor(FileStream* fs)
+{
+    if (fs->pIO != &gUnixSystemFileIO)
+        return -1;
+    USD(stream, fs);
+    return stream->descriptor;
+}
+
 #if !defined(ANDROID)
 IFileSystem* pSystemFileIO = &gUnixSystemFileIO;
 #endif
@@ -0,0 +1,291 @@
+#pragma once
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Binary log files, written by Log.c for the levels passed to addBinaryLogFile and turned into text by Tools/LogDecoder.
+//
+// Logging threads don't format these messages, they only store format id, time, thread id and the raw arguments.
+// Format strings and thread names are written once per thread, ahead of the first message using them.
+// File starts with BinaryLogHeader followed by records, every record starts with BinaryLogRecord. Native byte order.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BINARY_LOG_MAGIC   "TFBINLOG"
+#define BINARY_LOG_VERSION 1
+
+typedef struct BinaryLogHeader
+{
+    char     mMagic[8];
+    uint32_t mVersion;
+    uint32_t mPadding;
+    // getUSec(false) and time() when the file was opened, converts message time to date and time
+    int64_t  mStartUSec;
+    int64_t  mStartTime;
+} BinaryLogHeader;
+
+typedef enum BinaryLogRecordType
+{
+    BINARY_LOG_RECORD_FORMAT = 1,
+    BINARY_LOG_RECORD_THREAD = 2,
+    BINARY_LOG_RECORD_MESSAGE = 3,
+} BinaryLogRecordType;
+
+// Records aren't aligned in the file, they are accessed with memcpy
+typedef struct BinaryLogRecord
+{
+    uint16_t mType;
+    uint16_t mReserved;
+    // Whole record including this header
+    uint32_t mSize;
+} BinaryLogRecord;
+
+// Followed by file name and format string, neither is null terminated
+typedef struct BinaryLogFormat
+{
+    BinaryLogRecord mRecord;
+    uint64_t        mFormatId;
+    int32_t         mLine;
+    uint16_t        mFileLength;
+    uint16_t        mFormatLength;
+} BinaryLogFormat;
+
+// Followed by the thread name
+typedef struct BinaryLogThread
+{
+    BinaryLogRecord mRecord;
+    uint64_t        mThreadId;
+    uint32_t        mNameLength;
+    uint32_t        mPadding;
+} BinaryLogThread;
+
+// Followed by the arguments in order of the format string. Numbers and pointers take 8 bytes,
+// strings a uint32_t length followed by the characters.
+typedef struct BinaryLogMessage
+{
+    BinaryLogRecord mRecord;
+    uint64_t        mFormatId;
+    int64_t         mUSec;
+    uint64_t        mThreadId;
+    uint32_t        mLevel;
+    uint32_t        mIndentation;
+} BinaryLogMessage;
+
+// C type of a printf argument
+typedef enum BinaryLogArgType
+{
+    // '%%' and malformed conversions, no argument
+    BINARY_LOG_ARG_NONE = 0,
+    BINARY_LOG_ARG_INT,
+    BINARY_LOG_ARG_LONG,
+    BINARY_LOG_ARG_LONG_LONG,
+    BINARY_LOG_ARG_INTMAX,
+    BINARY_LOG_ARG_SIZE,
+    BINARY_LOG_ARG_PTRDIFF,
+    BINARY_LOG_ARG_DOUBLE,
+    BINARY_LOG_ARG_LONG_DOUBLE,
+    BINARY_LOG_ARG_STRING,
+    // Stored narrowed to char, characters above 127 become '?'
+    BINARY_LOG_ARG_WIDE_STRING,
+    BINARY_LOG_ARG_POINTER,
+    // '%n', pointer argument is consumed but not stored
+    BINARY_LOG_ARG_COUNT,
+} BinaryLogArgType;
+
+typedef struct BinaryLogSpec
+{
+    // '%' of the conversion
+    const char* pBegin;
+    // Start of the length modifier, conversion character when there is none
+    const char* pLength;
+    // Past the conversion character
+    const char* pEnd;
+    // '*' width and precision, each takes an int argument ahead of the value
+    uint32_t    mStarCount;
+    // Literal precision, -1 when there is none. Strings stop after this many characters.
+    int32_t     mPrecision;
+    // Precision is the last '*' argument
+    bool        mStarPrecision;
+    // BinaryLogArgType of the value
+    uint32_t    mType;
+    char        mConversion;
+} BinaryLogSpec;
+
+static inline bool binaryLogIsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Finds the next conversion specification in 'format'. Returns false when there is none.
+// Both Log.c and the decoder walk format strings with this, so they agree on the arguments.
+static inline bool binaryLogNextSpec(const char* format, BinaryLogSpec* pSpec)
+{
+    const char* p = strchr(format, '%');
+    if (!p)
+        return false;
+
+    pSpec->pBegin = p++;
+    pSpec->mStarCount = 0;
+    pSpec->mPrecision = -1;
+    pSpec->mStarPrecision = false;
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'')
+        ++p;
+    if (*p == '*')
+    {
+        ++pSpec->mStarCount;
+        ++p;
+    }
+    while (binaryLogIsDigit(*p))
+        ++p;
+    if (*p == '.')
+    {
+        ++p;
+        pSpec->mPrecision = 0;
+        if (*p == '*')
+        {
+            ++pSpec->mStarCount;
+            pSpec->mStarPrecision = true;
+            ++p;
+        }
+        while (binaryLogIsDigit(*p))
+        {
+            if (pSpec->mPrecision < INT32_MAX / 10)
+                pSpec->mPrecision = pSpec->mPrecision * 10 + (*p - '0');
+            ++p;
+        }
+    }
+
+    pSpec->pLength = p;
+    BinaryLogArgType integer = BINARY_LOG_ARG_INT;
+    bool             wide = false;
+    bool             longDouble = false;
+    switch (*p)
+    {
+    case 'h':
+        p += p[1] == 'h' ? 2 : 1;
+        break;
+    case 'l':
+        wide = true;
+        integer = p[1] == 'l' ? BINARY_LOG_ARG_LONG_LONG : BINARY_LOG_ARG_LONG;
+        p += p[1] == 'l' ? 2 : 1;
+        break;
+    case 'q':
+        integer = BINARY_LOG_ARG_LONG_LONG;
+        ++p;
+        break;
+    case 'j':
+        integer = BINARY_LOG_ARG_INTMAX;
+        ++p;
+        break;
+    case 'z':
+        integer = BINARY_LOG_ARG_SIZE;
+        ++p;
+        break;
+    case 't':
+        integer = BINARY_LOG_ARG_PTRDIFF;
+        ++p;
+        break;
+    case 'L':
+        longDouble = true;
+        ++p;
+        break;
+    case 'I':
+        // MSVC I64, I32 and I
+        if (p[1] == '6' && p[2] == '4')
+        {
+            integer = BINARY_LOG_ARG_LONG_LONG;
+            p += 3;
+        }
+        else if (p[1] == '3' && p[2] == '2')
+        {
+            p += 3;
+        }
+        else
+        {
+            integer = BINARY_LOG_ARG_SIZE;
+            ++p;
+        }
+        break;
+    default:
+        break;
+    }
+
+    pSpec->mConversion = *p;
+    switch (*p)
+    {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        pSpec->mType = integer;
+        break;
+    case 'c':
+    case 'C':
+        pSpec->mType = BINARY_LOG_ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        pSpec->mType = longDouble ? BINARY_LOG_ARG_LONG_DOUBLE : BINARY_LOG_ARG_DOUBLE;
+        break;
+    case 's':
+        pSpec->mType = wide ? BINARY_LOG_ARG_WIDE_STRING : BINARY_LOG_ARG_STRING;
+        break;
+    case 'S':
+        pSpec->mType = BINARY_LOG_ARG_WIDE_STRING;
+        break;
+    case 'p':
+        pSpec->mType = BINARY_LOG_ARG_POINTER;
+        break;
+    case 'n':
+        pSpec->mType = BINARY_LOG_ARG_COUNT;
+        break;
+    default:
+        // '%%', unknown conversion or end of string
+        pSpec->mType = BINARY_LOG_ARG_NONE;
+        pSpec->mStarCount = 0;
+        break;
+    }
+    pSpec->pEnd = *p ? p + 1 : p;
+    return true;
+}
+
+// Id of a format string used at file:line, FNV-1a. 'file' is the name without directories.
+// Log.c computes it once per call site and thread.
+static inline uint64_t binaryLogFormatId(const char* format, const char* file, int line)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char* p = format; *p; ++p)
+        hash = (hash ^ (uint8_t)*p) * 0x100000001b3ull;
+    for (const char* p = file; *p; ++p)
+        hash = (hash ^ (uint8_t)*p) * 0x100000001b3ull;
+    return (hash ^ (uint32_t)line) * 0x100000001b3ull;
+}
@@ -27,18 +27,40 @@
 #include <Core/IConfig.h>
 
 #include <stdarg.h>
+#include <wchar.h>
 
 #ifdef ENABLE_LOGGING
+#if defined(_WINDOWS) || defined(XBOX)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #include <Core/IFileSystem.h>
 #include <Core/ILog.h>
 #include <Core/IThread.h>
 #include <Core/ITime.h>
 
+#include "../Threading/Atomics.h"
+#include "BinaryLog.h"
+
 #include <Core/IMemory.h>
 
 #define LOG_CALLBACK_MAX_ID FS_MAX_PATH
 #define LOG_MAX_BUFFER      1024
 
+// Messages are formatted by the logging thread into its own ring and written to the callbacks by the log thread.
+// Every ring has a single producer (owning thread) and a single consumer (whoever holds mLogMutex).
+#define LOG_RING_SIZE           (64 * 1024)
+#define LOG_RECORD_ALIGNMENT    16
+// Log thread wakes up at least this often, earlier when a ring is half full or on flushLog
+#define LOG_DRAIN_INTERVAL_MS   10
+// Marks raw messages, which don't get a level prefix
+#define LOG_RECORD_RAW          UINT16_MAX
+// Marks binary log records, which go to the binary log file
+#define LOG_RECORD_BINARY       (UINT16_MAX - 1)
+#define LOG_ALIGN_RECORD(size)  (((size) + LOG_RECORD_ALIGNMENT - 1) & ~(uint32_t)(LOG_RECORD_ALIGNMENT - 1))
+
 typedef struct LogCallback
 {
     char          mID[LOG_CALLBACK_MAX_ID];
@@ -62,24 +84,156 @@ static void initLogCallback(LogCallback* pLogCallback, const char* id, void* pUs
     pLogCallback->mLevel = level;
 }
 
+// Header of a message in a ring, followed by the null terminated message
+typedef struct LogRecord
+{
+    // Order of messages across rings
+    uint32_t mSequence;
+    // Whole record including the header, LOG_RECORD_ALIGNMENT aligned.
+    uint32_t mSize;
+    // 0 marks padding up to the end of the ring
+    uint32_t mLevel;
+    // Where level prefix is written, LOG_RECORD_RAW for raw messages and LOG_RECORD_BINARY for binary log records
+    uint16_t mPrefixOffset;
+    uint8_t  mError;
+    uint8_t  mPadding;
+    // Binary log file the binary log records were encoded for, see Log::mBinaryGeneration_Atomic
+    uint32_t mBinaryGeneration;
+} LogRecord;
+
+typedef struct LogRing
+{
+    // Written by the owning thread
+    tfrg_atomic32_t mHead_Atomic;
+    uint8_t         mHeadPadding[60];
+    // Written by the consumer
+    tfrg_atomic32_t mTail_Atomic;
+    // Set when the owning thread exits, ring is freed once drained
+    tfrg_atomic32_t mDetached_Atomic;
+    // Consumer state, only accessed with mLogMutex locked
+    uint32_t        mDrainHead;
+    uint32_t        mDrainTail;
+    struct LogRing* pNext;
+    char            mBuffer[LOG_RING_SIZE];
+} LogRing;
+
 typedef struct Log
 {
     LogCallback* pCallbacks;
     size_t       mCallbacksSize;
+    // Held while messages are passed to the callbacks
     Mutex        mLogMutex;
     uint32_t     mLogLevel;
     uint32_t     mIndentation;
+
+    // Rings of all threads which logged something, protected by mLogMutex
+    LogRing*        pRings;
+    tfrg_atomic32_t mSequence_Atomic;
+    // Incremented by initLog, thread rings of a previous initLog are stale
+    uint32_t        mGeneration;
+
+    ThreadHandle      mThread;
+    Mutex             mWakeMutex;
+    ConditionVariable mWakeCondition;
+    tfrg_atomic32_t   mDrainRequested_Atomic;
+    bool              mQuit;
+    bool              mThreadRunning;
+
+    // Stack of LogSite with counts not written yet, linked with LogSite::pNextPending
+    tfrg_atomicptr_t mPendingSites_Atomic;
+
+    // Messages of mBinaryLogLevel_Atomic levels are written to mBinaryStream unformatted
+    FileStream      mBinaryStream;
+    tfrg_atomic32_t mBinaryLogLevel_Atomic;
+    // Incremented by addBinaryLogFile, threads write thread name and formats again for a new file.
+    // Records encoded for a previous file may refer to thread and format records the new file doesn't have, they are dropped.
+    tfrg_atomic32_t mBinaryGeneration_Atomic;
+    // Binary messages dropped since the last drain, protected by mLogMutex
+    uint32_t        mDroppedBinaryMessages;
 } Log;
 
 static bool gIsLoggerInitialized = false;
 static Log  gLogger;
 
-static THREAD_LOCAL char gLogBuffer[LOG_MAX_BUFFER + 2];
-static bool              gConsoleLogging = true;
+static THREAD_LOCAL char     gLogBuffer[LOG_MAX_BUFFER + 2];
+static THREAD_LOCAL LogRing* gLogRing = NULL;
+static THREAD_LOCAL uint32_t gLogRingGeneration = 0;
+// Set while the thread passes messages to the callbacks, callbacks logging themselves are dispatched immediately
+static THREAD_LOCAL bool     gLogDispatching = false;
+// Date and time of the last preamble, formatted once per second
+static THREAD_LOCAL time_t   gLogTime = 0;
+static THREAD_LOCAL char     gLogTimeString[24];
+static THREAD_LOCAL uint32_t gLogTimeLength = 0;
+static bool                  gConsoleLogging = true;
+
+// Ring of every thread is also stored in a key with a destructor, so that rings of threads not created by initThread
+// are detached when the thread exits
+static void detachRing(void* pRing)
+{
+    if (pRing)
+        tfrg_atomic32_store_release(&((LogRing*)pRing)->mDetached_Atomic, 1);
+}
+
+#if defined(_WINDOWS) || defined(XBOX)
+static DWORD gLogRingKey = FLS_OUT_OF_INDEXES;
+
+static void WINAPI detachRingCallback(void* pRing) { detachRing(pRing); }
+
+static void initRingKey(void) { gLogRingKey = FlsAlloc(detachRingCallback); }
+
+static void exitRingKey(void)
+{
+    if (gLogRingKey != FLS_OUT_OF_INDEXES)
+        FlsFree(gLogRingKey);
+    gLogRingKey = FLS_OUT_OF_INDEXES;
+}
+
+static void setRingKey(LogRing* pRing)
+{
+    if (gLogRingKey != FLS_OUT_OF_INDEXES)
+        FlsSetValue(gLogRingKey, pRing);
+}
+#else
+static pthread_key_t gLogRingKey;
+static bool          gLogRingKeyCreated = false;
+
+static void initRingKey(void) { gLogRingKeyCreated = pthread_key_create(&gLogRingKey, detachRing) == 0; }
+
+static void exitRingKey(void)
+{
+    if (gLogRingKeyCreated)
+        pthread_key_delete(gLogRingKey);
+    gLogRingKeyCreated = false;
+}
+
+static void setRingKey(LogRing* pRing)
+{
+    if (gLogRingKeyCreated)
+        pthread_setspecific(gLogRingKey, pRing);
+}
+#endif
+
+#define BINARY_LOG_FORMAT_CACHE_SIZE 256
+
+// Format id of a call site, so that format string and file name are hashed once per site and thread
+typedef struct BinaryLogCachedFormat
+{
+    const char* pFormat;
+    const char* pFile;
+    uint64_t    mFormatId;
+    int32_t     mLine;
+    // Binary log file this thread wrote the format record to
+    uint32_t    mGeneration;
+} BinaryLogCachedFormat;
+
+// Call sites this thread logged from, direct mapped by format string address and line
+static THREAD_LOCAL BinaryLogCachedFormat gBinaryLogFormats[BINARY_LOG_FORMAT_CACHE_SIZE];
+static THREAD_LOCAL uint32_t              gBinaryLogGeneration = 0;
 
 #define LOG_PREAMBLE_SIZE  (56 + MAX_THREAD_NAME_LENGTH + FILENAME_NAME_LENGTH_LOG)
 #define LOG_LEVEL_SIZE     6
 #define LOG_MESSAGE_OFFSET (LOG_PREAMBLE_SIZE + LOG_LEVEL_SIZE)
+#define LOG_RECORD_MAX_SIZE LOG_ALIGN_RECORD((uint32_t)sizeof(LogRecord) + LOG_MAX_BUFFER + 2)
 
 static void     addInitialLogFile(const char* appName);
 static bool     isLogCallback(const char* id);
@@ -100,14 +254,13 @@ static const char* getFilename(const char* path)
     return path;
 }
 
-// Default callback
+// Default callback, stream is flushed once per batch of messages by defaultFlush
 static void defaultCallback(void* user_data, const char* message)
 {
     FileStream* fh = (FileStream*)user_data;
     ASSERT(fh);
 
     fsWriteToStream(fh, message, strlen(message));
-    fsFlushStream(fh);
 }
 
 // Close callback
@@ -128,6 +281,322 @@ static void defaultFlush(void* user_data)
     fsFlushStream(fh);
 }
 
+typedef struct LogPrefix
+{
+    uint32_t    first;
+    const char* second;
+} LogPrefix;
+
+static const LogPrefix gLogLevelPrefixes[] = { { eWARNING, "WARN| " }, { eINFO, "INFO| " }, { eDEBUG, " DBG| " }, { eERROR, " ERR| " } };
+
+// Writes binary log records of a message encoded for binary log file 'generation'. Called with mLogMutex locked
+static void dispatchBinaryMessage(const char* records, uint32_t generation)
+{
+    if (generation != tfrg_atomic32_load_relaxed(&gLogger.mBinaryGeneration_Atomic))
+    {
+        ++gLogger.mDroppedBinaryMessages;
+        return;
+    }
+
+    // Thread and format records come first, message record is the last one
+    uint32_t        size = 0;
+    BinaryLogRecord record;
+    do
+    {
+        memcpy(&record, records + size, sizeof(record));
+        size += record.mSize;
+    } while (record.mType != BINARY_LOG_RECORD_MESSAGE);
+
+    if (gLogger.mBinaryStream.pIO)
+        fsWriteToStream(&gLogger.mBinaryStream, records, size);
+}
+
+// Passes message to console and callbacks, once for every level in 'level'. Called with mLogMutex locked
+static void dispatchMessage(char* message, uint32_t level, uint32_t prefixOffset, bool error)
+{
+    if (prefixOffset == LOG_RECORD_RAW)
+    {
+        if (gConsoleLogging)
+            _PrintUnicode(message, error);
+
+        for (LogCallback* pCallback = gLogger.pCallbacks; pCallback != gLogger.pCallbacks + gLogger.mCallbacksSize; ++pCallback)
+        {
+            if (pCallback->mLevel & level)
+                pCallback->mCallback(pCallback->mUserData, message);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < sizeof(gLogLevelPrefixes) / sizeof(gLogLevelPrefixes[0]); ++i)
+    {
+        const LogPrefix* it = &gLogLevelPrefixes[i];
+        if (!(it->first & level) || !(gLogger.mLogLevel & level))
+            continue;
+
+        strncpy(message + prefixOffset, it->second, LOG_LEVEL_SIZE);
+
+        if (gConsoleLogging)
+            _PrintUnicode(message, error);
+
+        for (LogCallback* pCallback = gLogger.pCallbacks; pCallback != gLogger.pCallbacks + gLogger.mCallbacksSize; ++pCallback)
+        {
+            if (pCallback->mLevel & it->first)
+                pCallback->mCallback(pCallback->mUserData, message);
+        }
+    }
+}
+
+static void flushCallbacks(void)
+{
+    if (gLogger.mBinaryStream.pIO)
+        fsFlushStream(&gLogger.mBinaryStream);
+
+    for (LogCallback* pCallback = gLogger.pCallbacks; pCallback != gLogger.pCallbacks + gLogger.mCallbacksSize; ++pCallback)
+    {
+        if (pCallback->mFlush)
+            pCallback->mFlush(pCallback->mUserData);
+    }
+}
+
+static inline LogRecord* getRecord(LogRing* pRing, uint32_t position)
+{
+    return (LogRecord*)(pRing->mBuffer + (position & (LOG_RING_SIZE - 1)));
+}
+
+// Returns the ring record at its tail which goes next, skipping padding. NULL when the ring is drained
+static LogRecord* peekRecord(LogRing* pRing)
+{
+    while (pRing->mDrainTail != pRing->mDrainHead)
+    {
+        LogRecord* pRecord = getRecord(pRing, pRing->mDrainTail);
+        if (pRecord->mLevel)
+            return pRecord;
+        pRing->mDrainTail += pRecord->mSize;
+    }
+    return NULL;
+}
+
+// Writes all messages in the rings to the callbacks in the order they were logged and flushes the callbacks.
+// Called with mLogMutex locked
+static void drainRings(void)
+{
+    tfrg_atomic32_store_relaxed(&gLogger.mDrainRequested_Atomic, 0);
+    gLogDispatching = true;
+
+    for (LogRing* pRing = gLogger.pRings; pRing; pRing = pRing->pNext)
+    {
+        pRing->mDrainHead = tfrg_atomic32_load_acquire(&pRing->mHead_Atomic);
+        pRing->mDrainTail = tfrg_atomic32_load_relaxed(&pRing->mTail_Atomic);
+    }
+
+    uint32_t recordCount = 0;
+    for (;;)
+    {
+        // Message with the lowest sequence goes first
+        LogRing*   pNextRing = NULL;
+        LogRecord* pNextRecord = NULL;
+        for (LogRing* pRing = gLogger.pRings; pRing; pRing = pRing->pNext)
+        {
+            LogRecord* pRecord = peekRecord(pRing);
+            if (pRecord && (!pNextRecord || (int32_t)(pRecord->mSequence - pNextRecord->mSequence) < 0))
+            {
+                pNextRing = pRing;
+                pNextRecord = pRecord;
+            }
+        }
+        if (!pNextRecord)
+            break;
+
+        if (pNextRecord->mPrefixOffset == LOG_RECORD_BINARY)
+            dispatchBinaryMessage((char*)(pNextRecord + 1), pNextRecord->mBinaryGeneration);
+        else
+            dispatchMessage((char*)(pNextRecord + 1), pNextRecord->mLevel, pNextRecord->mPrefixOffset, pNextRecord->mError);
+        pNextRing->mDrainTail += pNextRecord->mSize;
+        // Space is returned right away so that a thread waiting for it can continue
+        tfrg_atomic32_store_release(&pNextRing->mTail_Atomic, pNextRing->mDrainTail);
+        ++recordCount;
+    }
+
+    if (gLogger.mDroppedBinaryMessages)
+    {
+        uint32_t dropped = gLogger.mDroppedBinaryMessages;
+        gLogger.mDroppedBinaryMessages = 0;
+        // Dispatched right away, gLogDispatching is set
+        writeLog(eWARNING, __FILE__, __LINE__, "Dropped %u binary log messages logged while the binary log file was replaced", dropped);
+        ++recordCount;
+    }
+
+    for (LogRing** ppRing = &gLogger.pRings; *ppRing;)
+    {
+        LogRing* pRing = *ppRing;
+        tfrg_atomic32_store_release(&pRing->mTail_Atomic, pRing->mDrainTail);
+        if (tfrg_atomic32_load_acquire(&pRing->mDetached_Atomic) && tfrg_atomic32_load_acquire(&pRing->mHead_Atomic) == pRing->mDrainTail)
+        {
+            *ppRing = pRing->pNext;
+            tf_free(pRing);
+            continue;
+        }
+        ppRing = &pRing->pNext;
+    }
+
+    if (recordCount)
+        flushCallbacks();
+    gLogDispatching = false;
+}
+
+static void requestDrain(void)
+{
+    if (tfrg_atomic32_load_relaxed(&gLogger.mDrainRequested_Atomic) ||
+        tfrg_atomic32_cas_relaxed(&gLogger.mDrainRequested_Atomic, 0, 1) != 0)
+        return;
+
+    acquireMutex(&gLogger.mWakeMutex);
+    wakeOneConditionVariable(&gLogger.mWakeCondition);
+    releaseMutex(&gLogger.mWakeMutex);
+}
+
+static void logThreadFunc(void* pData)
+{
+    UNREF_PARAM(pData);
+    for (;;)
+    {
+        acquireMutex(&gLogger.mWakeMutex);
+        if (!gLogger.mQuit && !tfrg_atomic32_load_relaxed(&gLogger.mDrainRequested_Atomic))
+            waitConditionVariable(&gLogger.mWakeCondition, &gLogger.mWakeMutex, LOG_DRAIN_INTERVAL_MS);
+        bool quit = gLogger.mQuit;
+        releaseMutex(&gLogger.mWakeMutex);
+
+        acquireMutex(&gLogger.mLogMutex);
+        drainRings();
+        releaseMutex(&gLogger.mLogMutex);
+
+        if (quit)
+            break;
+    }
+}
+
+static LogRing* getThreadRing(void)
+{
+    if (!gLogRing || gLogRingGeneration != gLogger.mGeneration)
+    {
+        LogRing* pRing = (LogRing*)tf_malloc(sizeof(LogRing));
+        if (!pRing)
+            return NULL;
+        pRing->mHead_Atomic = 0;
+        pRing->mTail_Atomic = 0;
+        pRing->mDetached_Atomic = 0;
+        pRing->mDrainHead = 0;
+        pRing->mDrainTail = 0;
+
+        acquireMutex(&gLogger.mLogMutex);
+        pRing->pNext = gLogger.pRings;
+        gLogger.pRings = pRing;
+        releaseMutex(&gLogger.mLogMutex);
+        setRingKey(pRing);
+        gLogRing = pRing;
+        gLogRingGeneration = gLogger.mGeneration;
+    }
+    return gLogRing;
+}
+
+// Returns record with LOG_RECORD_MAX_SIZE contiguous bytes, waits for the log thread when the ring is full
+static LogRecord* beginRecord(LogRing* pRing)
+{
+    uint32_t head = tfrg_atomic32_load_relaxed(&pRing->mHead_Atomic);
+    uint32_t toEnd = LOG_RING_SIZE - (head & (LOG_RING_SIZE - 1));
+    uint32_t needed = LOG_RECORD_MAX_SIZE + (toEnd < LOG_RECORD_MAX_SIZE ? toEnd : 0);
+    while (LOG_RING_SIZE - (head - tfrg_atomic32_load_acquire(&pRing->mTail_Atomic)) < needed)
+    {
+        requestDrain();
+        threadSleep(0);
+    }
+
+    if (toEnd < LOG_RECORD_MAX_SIZE)
+    {
+        // Message has to be contiguous, rest of the ring is skipped
+        LogRecord* pPadding = getRecord(pRing, head);
+        pPadding->mSize = toEnd;
+        pPadding->mLevel = 0;
+        head += toEnd;
+        tfrg_atomic32_store_release(&pRing->mHead_Atomic, head);
+    }
+    return getRecord(pRing, head);
+}
+
+static void commitRecord(LogRing* pRing, LogRecord* pRecord, uint32_t messageSize)
+{
+    pRecord->mSequence = tfrg_atomic32_add_relaxed(&gLogger.mSequence_Atomic, 1);
+    pRecord->mSize = LOG_ALIGN_RECORD((uint32_t)sizeof(LogRecord) + messageSize);
+    uint32_t head = tfrg_atomic32_load_relaxed(&pRing->mHead_Atomic) + pRecord->mSize;
+    tfrg_atomic32_store_release(&pRing->mHead_Atomic, head);
+
+    if (head - tfrg_atomic32_load_relaxed(&pRing->mTail_Atomic) > LOG_RING_SIZE / 2)
+        requestDrain();
+}
+
+static inline void lockLogSite(LogSite* pSite)
+{
+    while (tfrg_atomic32_load_relaxed(&pSite->mLock_Atomic) || tfrg_atomic32_cas_relaxed(&pSite->mLock_Atomic, 0, 1) != 0)
+        tfrg_cpu_relax();
+}
+
+static inline void unlockLogSite(LogSite* pSite) { tfrg_atomic32_store_release(&pSite->mLock_Atomic, 0); }
+
+static void writeLogSiteCounts(uint32_t level, const char* filename, int line_number, uint32_t repeated, uint32_t suppressed)
+{
+    if (repeated)
+        writeLog(level, filename, line_number, "Last message from here was repeated %u more times", repeated);
+    if (suppressed)
+        writeLog(level, filename, line_number, "%u more messages from here were suppressed", suppressed);
+}
+
+// Expects the site to be locked
+static void countLogSiteMessage(LogSite* pSite, uint32_t level, const char* filename, int line_number, bool repeat)
+{
+    if (repeat)
+        ++pSite->mRepeated;
+    else
+        ++pSite->mSuppressed;
+    pSite->mLevel = level;
+    pSite->pFile = filename;
+    pSite->mLine = line_number;
+    if (pSite->mPending)
+        return;
+
+    // Sites with counts not written yet are listed for flushLog
+    pSite->mPending = true;
+    uintptr_t head;
+    do
+    {
+        head = tfrg_atomicptr_load_relaxed(&gLogger.mPendingSites_Atomic);
+        pSite->pNextPending = (LogSite*)head;
+    } while ((uintptr_t)tfrg_atomicptr_cas_relaxed(&gLogger.mPendingSites_Atomic, head, (uintptr_t)pSite) != head);
+}
+
+// Writes counts of all sites which went quiet since they started counting
+static void flushLogSites(void)
+{
+    LogSite* pSite = (LogSite*)tfrg_atomicptr_store_relaxed(&gLogger.mPendingSites_Atomic, 0);
+    while (pSite)
+    {
+        lockLogSite(pSite);
+        LogSite*    pNext = pSite->pNextPending;
+        uint32_t    repeated = pSite->mRepeated;
+        uint32_t    suppressed = pSite->mSuppressed;
+        uint32_t    level = pSite->mLevel;
+        const char* filename = pSite->pFile;
+        int         line_number = pSite->mLine;
+        pSite->mRepeated = 0;
+        pSite->mSuppressed = 0;
+        pSite->mPending = false;
+        unlockLogSite(pSite);
+
+        // Counts are written with the level of the last counted message
+        writeLogSiteCounts(level, filename, line_number, repeated, suppressed);
+        pSite = pNext;
+    }
+}
+
 void initLog(const char* appName, LogLevel level /* = eALL */)
 {
     if (!gIsLoggerInitialized)
@@ -137,10 +606,24 @@ void initLog(const char* appName, LogLevel level /* = eALL */)
         initMutex(&gLogger.mLogMutex);
         gLogger.mLogLevel = level;
         gLogger.mIndentation = 0;
+        gLogger.pRings = NULL;
+        gLogger.mSequence_Atomic = 0;
+        ++gLogger.mGeneration;
+        gLogger.mDrainRequested_Atomic = 0;
+        gLogger.mQuit = false;
+        initRingKey();
 
         setMainThread();
         setCurrentThreadName("MainThread");
 
+        initMutex(&gLogger.mWakeMutex);
+        initConditionVariable(&gLogger.mWakeCondition);
+        ThreadDesc threadDesc = { 0 };
+        threadDesc.pFunc = logThreadFunc;
+        strncpy(threadDesc.mThreadName, "Log", sizeof(threadDesc.mThreadName));
+        // Without the log thread messages are written by the thread logging them
+        gLogger.mThreadRunning = initThread(&threadDesc, &gLogger.mThread);
+
         if (appName)
             addInitialLogFile(appName);
 
@@ -151,18 +634,74 @@ void initLog(const char* appName, LogLevel level /* = eALL */)
 void exitLog(void)
 {
     LOGF(eINFO, "Shutting down log system.");
+    flushLogSites();
+
+    if (gLogger.mThreadRunning)
+    {
+        acquireMutex(&gLogger.mWakeMutex);
+        gLogger.mQuit = true;
+        wakeOneConditionVariable(&gLogger.mWakeCondition);
+        releaseMutex(&gLogger.mWakeMutex);
+        joinThread(gLogger.mThread);
+        gLogger.mThreadRunning = false;
+    }
+
+    // Threads exiting from now on don't touch rings, they are all freed below
+    exitRingKey();
 
+    acquireMutex(&gLogger.mLogMutex);
+    drainRings();
     for (LogCallback* pCallback = gLogger.pCallbacks; pCallback != gLogger.pCallbacks + gLogger.mCallbacksSize; ++pCallback)
     {
         if (pCallback->mClose)
             pCallback->mClose(pCallback->mUserData);
     }
+    if (gLogger.mBinaryStream.pIO)
+        fsCloseStream(&gLogger.mBinaryStream);
+    tfrg_atomic32_store_release(&gLogger.mBinaryLogLevel_Atomic, 0);
+    // Rings of threads which are still alive are freed too, mGeneration tells them apart from rings of the next initLog
+    while (gLogger.pRings)
+    {
+        LogRing* pRing = gLogger.pRings;
+        gLogger.pRings = pRing->pNext;
+        tf_free(pRing);
+    }
+    releaseMutex(&gLogger.mLogMutex);
 
+    destroyConditionVariable(&gLogger.mWakeCondition);
+    destroyMutex(&gLogger.mWakeMutex);
     destroyMutex(&gLogger.mLogMutex);
     tf_free(gLogger.pCallbacks);
+    gLogger.pCallbacks = NULL;
+    gLogger.mCallbacksSize = 0;
     gIsLoggerInitialized = false;
 }
 
+void exitLogThread(void)
+{
+    LogRing* pRing = gLogRing;
+    gLogRing = NULL;
+    if (!pRing || !gIsLoggerInitialized || gLogRingGeneration != gLogger.mGeneration)
+        return;
+    // Ring can be freed once detached, the key destructor must not see it
+    setRingKey(NULL);
+    detachRing(pRing);
+}
+
+void flushLog(void)
+{
+    if (!gIsLoggerInitialized || gLogDispatching)
+        return;
+
+    flushLogSites();
+    acquireMutex(&gLogger.mLogMutex);
+    drainRings();
+    flushCallbacks();
+    releaseMutex(&gLogger.mLogMutex);
+}
+
+void setLogConsoleOutput(bool enable) { gConsoleLogging = enable; }
+
 void addLogFile(const char* filename, FileMode file_mode, LogLevel log_level)
 {
     if (filename == NULL)
@@ -200,6 +739,46 @@ void addLogFile(const char* filename, FileMode file_mode, LogLevel log_level)
     }
 }
 
+void addBinaryLogFile(const char* filename, uint32_t log_level)
+{
+    if (filename == NULL)
+        return;
+
+    FileStream fh;
+    memset(&fh, 0, sizeof(FileStream));
+    if (!fsOpenStreamFromPath(RD_LOG, filename, FM_WRITE, &fh))
+    {
+        writeLog(eERROR, __FILE__, __LINE__, "Failed to create binary log file %s", filename);
+        return;
+    }
+
+    BinaryLogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.mMagic, BINARY_LOG_MAGIC, sizeof(header.mMagic));
+    header.mVersion = BINARY_LOG_VERSION;
+    header.mStartUSec = getUSec(false);
+#if defined(NX64)
+    header.mStartTime = getTimeSinceStart();
+#else
+    header.mStartTime = (int64_t)time(NULL);
+#endif
+    fsWriteToStream(&fh, &header, sizeof(header));
+
+    acquireMutex(&gLogger.mLogMutex);
+    {
+        // Messages in the rings were encoded for the previous file, ones committed after this drain are dropped
+        drainRings();
+        if (gLogger.mBinaryStream.pIO)
+            fsCloseStream(&gLogger.mBinaryStream);
+        gLogger.mBinaryStream = fh;
+        tfrg_atomic32_store_release(&gLogger.mBinaryGeneration_Atomic, tfrg_atomic32_load_relaxed(&gLogger.mBinaryGeneration_Atomic) + 1);
+        tfrg_atomic32_store_release(&gLogger.mBinaryLogLevel_Atomic, log_level);
+    }
+    releaseMutex(&gLogger.mLogMutex);
+
+    writeLog(eINFO, __FILE__, __LINE__, "Opened binary log file %s", filename);
+}
+
 void addLogCallback(const char* id, uint32_t log_level, void* user_data, LogCallbackFn callback, LogCloseFn close, LogFlushFn flush)
 {
     acquireMutex(&gLogger.mLogMutex);
@@ -223,63 +802,279 @@ void addLogCallback(const char* id, uint32_t log_level, void* user_data, LogCall
 
 typedef char LogStr[LOG_LEVEL_SIZE + 1];
 
-void writeLogVaList(uint32_t level, const char* filename, int line_number, const char* message, va_list args)
+// Formats message with preamble and indentation into 'buffer' of LOG_MAX_BUFFER + 2 bytes.
+// Returns message length including the null terminator, 'pPrefixOffset' receives offset of the level prefix
+static uint32_t formatLogMessage(char* buffer, const char* filename, int line_number, const char* message, va_list args,
+                                 uint32_t* pPrefixOffset)
+{
+    uint32_t preable_end = writeLogPreamble(buffer, LOG_PREAMBLE_SIZE, filename, line_number);
+
+    // Prepare indentation
+    uint32_t indentation = gLogger.mIndentation * INDENTATION_SIZE_LOG;
+    memset(buffer + preable_end, ' ', LOG_LEVEL_SIZE + indentation);
+
+    uint32_t offset = preable_end + LOG_LEVEL_SIZE + indentation;
+    offset += vsnprintf(buffer + offset, LOG_MAX_BUFFER - offset, message, args);
+
+    offset = (offset > LOG_MAX_BUFFER) ? LOG_MAX_BUFFER : offset;
+    buffer[offset] = '\n';
+    buffer[offset + 1] = 0;
+
+    *pPrefixOffset = preable_end;
+    return offset + 2;
+}
+
+static inline char* writeBinaryData(char* dst, const char* end, const void* data, size_t size)
 {
-    typedef struct Prefix
+    if (!dst || (size_t)(end - dst) < size)
+        return NULL;
+    memcpy(dst, data, size);
+    return dst + size;
+}
+
+static inline char* writeBinaryNumber(char* dst, const char* end, uint64_t value) { return writeBinaryData(dst, end, &value, sizeof(value)); }
+
+// Characters printf reads from a string argument, a precision stops it before the terminator
+static inline size_t logStringLength(const char* str, int32_t precision)
+{
+    return precision < 0 ? strlen(str) : strnlen(str, (size_t)precision);
+}
+
+static inline size_t logWideStringLength(const wchar_t* str, int32_t precision)
+{
+    size_t length = 0;
+    while ((precision < 0 || length < (size_t)precision) && str[length])
+        ++length;
+    return length;
+}
+
+// Encodes message as binary log records for binary log file 'generation' into 'buffer' of LOG_MAX_BUFFER + 2 bytes.
+// Thread name and format record precede the message record unless this thread already wrote them to that file.
+// Returns size of the records, 0 when they don't fit
+static uint32_t encodeBinaryMessage(char* buffer, uint32_t generation, uint32_t level, const char* filename, int line_number,
+                                    const char* message, va_list args)
+{
+    const char* end = buffer + LOG_MAX_BUFFER + 2;
+    char*       dst = buffer;
+
+    if (gBinaryLogGeneration != generation)
+    {
+        char name[MAX_THREAD_NAME_LENGTH + 1] = { 0 };
+        getCurrentThreadName(name, MAX_THREAD_NAME_LENGTH + 1);
+
+        BinaryLogThread thread;
+        memset(&thread, 0, sizeof(thread));
+        thread.mRecord.mType = BINARY_LOG_RECORD_THREAD;
+        thread.mThreadId = (uint64_t)getCurrentThreadID();
+        thread.mNameLength = (uint32_t)strlen(name);
+        thread.mRecord.mSize = (uint32_t)sizeof(thread) + thread.mNameLength;
+        dst = writeBinaryData(dst, end, &thread, sizeof(thread));
+        dst = writeBinaryData(dst, end, name, thread.mNameLength);
+    }
+
+    uintptr_t              site = (uintptr_t)message ^ ((uintptr_t)message >> 12) ^ (uint32_t)line_number * 2654435761u;
+    BinaryLogCachedFormat* pCached = &gBinaryLogFormats[site % BINARY_LOG_FORMAT_CACHE_SIZE];
+    if (pCached->pFormat != message || pCached->pFile != filename || pCached->mLine != line_number)
     {
-        uint32_t    first;
-        const char* second;
-    } Prefix;
+        // Only the file name is hashed, so that ids don't depend on the build directory
+        pCached->pFormat = message;
+        pCached->pFile = filename;
+        pCached->mLine = line_number;
+        pCached->mFormatId = binaryLogFormatId(message, getFilename(filename), line_number);
+        pCached->mGeneration = 0;
+    }
 
-    static Prefix logLevelPrefixes[] = { { eWARNING, "WARN| " }, { eINFO, "INFO| " }, { eDEBUG, " DBG| " }, { eERROR, " ERR| " } };
+    uint64_t formatId = pCached->mFormatId;
+    if (pCached->mGeneration != generation)
+    {
+        const char* file = getFilename(filename);
+        size_t      fileLength = strlen(file);
+        size_t      formatLength = strlen(message);
+        if (fileLength > UINT16_MAX || formatLength > UINT16_MAX)
+            return 0;
+
+        BinaryLogFormat format;
+        memset(&format, 0, sizeof(format));
+        format.mRecord.mType = BINARY_LOG_RECORD_FORMAT;
+        format.mRecord.mSize = (uint32_t)(sizeof(format) + fileLength + formatLength);
+        format.mFormatId = formatId;
+        format.mLine = line_number;
+        format.mFileLength = (uint16_t)fileLength;
+        format.mFormatLength = (uint16_t)formatLength;
+        dst = writeBinaryData(dst, end, &format, sizeof(format));
+        dst = writeBinaryData(dst, end, file, fileLength);
+        dst = writeBinaryData(dst, end, message, formatLength);
+    }
 
-    uint32_t log_levels[LEVELS_LOG];
-    uint32_t log_level_count = 0;
+    // Header is written once the size is known
+    char* pHeader = dst;
+    dst = (dst && (size_t)(end - dst) >= sizeof(BinaryLogMessage)) ? dst + sizeof(BinaryLogMessage) : NULL;
 
-    // Check flags
-    for (uint32_t i = 0; i < sizeof(logLevelPrefixes) / sizeof(logLevelPrefixes[0]); ++i)
+    BinaryLogSpec spec;
+    for (const char* p = message; dst && binaryLogNextSpec(p, &spec); p = spec.pEnd)
     {
-        Prefix* it = &logLevelPrefixes[i];
-        if ((it->first & level) && (gLogger.mLogLevel & level))
+        int32_t precision = spec.mPrecision;
+        for (uint32_t i = 0; i < spec.mStarCount; ++i)
         {
-            log_levels[log_level_count] = i;
-            ++log_level_count;
+            int star = va_arg(args, int);
+            // Negative precision is taken as if it was omitted
+            if (spec.mStarPrecision && i + 1 == spec.mStarCount)
+                precision = star < 0 ? -1 : star;
+            dst = writeBinaryNumber(dst, end, (uint64_t)(int64_t)star);
+        }
+
+        switch (spec.mType)
+        {
+        case BINARY_LOG_ARG_INT:
+            dst = writeBinaryNumber(dst, end, (uint64_t)(int64_t)va_arg(args, int));
+            break;
+        case BINARY_LOG_ARG_LONG:
+            dst = writeBinaryNumber(dst, end, (uint64_t)(int64_t)va_arg(args, long));
+            break;
+        case BINARY_LOG_ARG_LONG_LONG:
+            dst = writeBinaryNumber(dst, end, (uint64_t)va_arg(args, long long));
+            break;
+        case BINARY_LOG_ARG_INTMAX:
+            dst = writeBinaryNumber(dst, end, (uint64_t)va_arg(args, intmax_t));
+            break;
+        case BINARY_LOG_ARG_SIZE:
+            dst = writeBinaryNumber(dst, end, (uint64_t)va_arg(args, size_t));
+            break;
+        case BINARY_LOG_ARG_PTRDIFF:
+            dst = writeBinaryNumber(dst, end, (uint64_t)(int64_t)va_arg(args, ptrdiff_t));
+            break;
+        case BINARY_LOG_ARG_DOUBLE:
+        case BINARY_LOG_ARG_LONG_DOUBLE:
+        {
+            double value = spec.mType == BINARY_LOG_ARG_DOUBLE ? va_arg(args, double) : (double)va_arg(args, long double);
+            dst = writeBinaryData(dst, end, &value, sizeof(value));
+            break;
+        }
+        case BINARY_LOG_ARG_POINTER:
+            dst = writeBinaryNumber(dst, end, (uint64_t)(uintptr_t)va_arg(args, void*));
+            break;
+        case BINARY_LOG_ARG_COUNT:
+            (void)va_arg(args, int*);
+            break;
+        case BINARY_LOG_ARG_STRING:
+        {
+            const char* str = va_arg(args, const char*);
+            str = str ? str : "(null)";
+            uint32_t length = (uint32_t)logStringLength(str, precision);
+            dst = writeBinaryData(dst, end, &length, sizeof(length));
+            dst = writeBinaryData(dst, end, str, length);
+            break;
+        }
+        case BINARY_LOG_ARG_WIDE_STRING:
+        {
+            const wchar_t* str = va_arg(args, const wchar_t*);
+            str = str ? str : L"(null)";
+            uint32_t length = (uint32_t)logWideStringLength(str, precision);
+            dst = writeBinaryData(dst, end, &length, sizeof(length));
+            if (dst && (size_t)(end - dst) < length)
+                dst = NULL;
+            for (uint32_t i = 0; dst && i < length; ++i)
+                *dst++ = (uint32_t)str[i] < 128 ? (char)str[i] : '?';
+            break;
+        }
+        default:
+            break;
         }
     }
+    if (!dst)
+        return 0;
+
+    BinaryLogMessage header;
+    header.mRecord.mType = BINARY_LOG_RECORD_MESSAGE;
+    header.mRecord.mReserved = 0;
+    header.mRecord.mSize = (uint32_t)(dst - pHeader);
+    header.mFormatId = formatId;
+    header.mUSec = getUSec(false);
+    header.mThreadId = (uint64_t)getCurrentThreadID();
+    header.mLevel = level;
+    header.mIndentation = gLogger.mIndentation;
+    memcpy(pHeader, &header, sizeof(header));
+
+    // Records go to the file ahead of later messages of this thread, unless the file is replaced before and all of them are dropped
+    gBinaryLogGeneration = generation;
+    pCached->mGeneration = generation;
+    return (uint32_t)(dst - buffer);
+}
 
-    uint32_t preable_end = writeLogPreamble(gLogBuffer, LOG_PREAMBLE_SIZE, filename, line_number);
+static bool isLogThreadRunning(void) { return gIsLoggerInitialized && gLogger.mThreadRunning && !gLogDispatching; }
 
-    // Prepare indentation
-    uint32_t indentation = gLogger.mIndentation * INDENTATION_SIZE_LOG;
-    memset(gLogBuffer + preable_end, ' ', indentation);
+// Returns false when the message doesn't fit as binary records, it's formatted as text then
+static bool writeBinaryLog(LogRing* pRing, uint32_t level, const char* filename, int line_number, const char* message, va_list args)
+{
+    LogRecord* pRecord = pRing ? beginRecord(pRing) : NULL;
+    char*      buffer = pRecord ? (char*)(pRecord + 1) : gLogBuffer;
+    // File can be replaced before the message is dispatched, generation tells if the records still fit it
+    uint32_t   generation = tfrg_atomic32_load_acquire(&gLogger.mBinaryGeneration_Atomic);
+    uint32_t   size = encodeBinaryMessage(buffer, generation, level, filename, line_number, message, args);
+    if (!size)
+        return false;
+
+    if (!pRing)
+    {
+        acquireMutex(&gLogger.mLogMutex);
+        dispatchBinaryMessage(buffer, generation);
+        if (!gLogDispatching)
+            flushCallbacks();
+        releaseMutex(&gLogger.mLogMutex);
+        return true;
+    }
 
-    uint32_t offset = preable_end + LOG_LEVEL_SIZE + indentation;
-    offset += vsnprintf(gLogBuffer + offset, LOG_MAX_BUFFER - offset, message, args);
+    pRecord->mLevel = level;
+    pRecord->mPrefixOffset = LOG_RECORD_BINARY;
+    pRecord->mError = 0;
+    pRecord->mBinaryGeneration = generation;
+    commitRecord(pRing, pRecord, size);
+    return true;
+}
 
-    offset = (offset > LOG_MAX_BUFFER) ? LOG_MAX_BUFFER : offset;
-    gLogBuffer[offset] = '\n';
-    gLogBuffer[offset + 1] = 0;
+void writeLogVaList(uint32_t level, const char* filename, int line_number, const char* message, va_list args)
+{
+    if (!(gLogger.mLogLevel & level))
+        return;
 
-    // Log for each flag
-    for (uint32_t i = 0; i < log_level_count; ++i)
+    LogRing* pRing = isLogThreadRunning() ? getThreadRing() : NULL;
+    if (!(level & ~tfrg_atomic32_load_acquire(&gLogger.mBinaryLogLevel_Atomic)))
     {
-        strncpy(gLogBuffer + preable_end, logLevelPrefixes[log_levels[i]].second, LOG_LEVEL_SIZE);
-
-        if (gConsoleLogging)
+        va_list binaryArgs;
+        va_copy(binaryArgs, args);
+        bool written = writeBinaryLog(pRing, level, filename, line_number, message, binaryArgs);
+        va_end(binaryArgs);
+        if (written)
         {
-            _PrintUnicode(gLogBuffer, level & eERROR);
+            if (level & eERROR)
+                flushLog();
+            return;
         }
+    }
 
+    if (!pRing)
+    {
+        uint32_t prefixOffset = 0;
+        formatLogMessage(gLogBuffer, filename, line_number, message, args, &prefixOffset);
         acquireMutex(&gLogger.mLogMutex);
-        {
-            for (LogCallback* pCallback = gLogger.pCallbacks; pCallback != gLogger.pCallbacks + gLogger.mCallbacksSize; ++pCallback)
-            {
-                if (pCallback->mLevel & logLevelPrefixes[log_levels[i]].first)
-                    pCallback->mCallback(pCallback->mUserData, gLogBuffer);
-            }
-        }
+        dispatchMessage(gLogBuffer, level, prefixOffset, level & eERROR);
+        if (!gLogDispatching)
+            flushCallbacks();
         releaseMutex(&gLogger.mLogMutex);
+        return;
     }
+
+    LogRecord* pRecord = beginRecord(pRing);
+    uint32_t   prefixOffset = 0;
+    uint32_t   messageSize = formatLogMessage((char*)(pRecord + 1), filename, line_number, message, args, &prefixOffset);
+    pRecord->mLevel = level;
+    pRecord->mPrefixOffset = (uint16_t)prefixOffset;
+    pRecord->mError = (level & eERROR) != 0;
+    commitRecord(pRing, pRecord, messageSize);
+
+    // Errors often precede a crash, they are written before returning
+    if (level & eERROR)
+        flushLog();
 }
 
 void writeLog(uint32_t level, const char* filename, int line_number, const char* message, ...)
@@ -290,27 +1085,195 @@ void writeLog(uint32_t level, const char* filename, int line_number, const char*
     va_end(args);
 }
 
-void writeRawLog(uint32_t level, bool error, const char* message, ...)
+// Identifies message of a log site without formatting it, FNV-1a over format and arguments
+static uint64_t hashLogMessage(const char* message, va_list args)
 {
+    uint64_t hash = 0xcbf29ce484222325ull;
+#define LOG_HASH_BYTES(data, size)               \
+    for (size_t byte = 0; byte < (size); ++byte) \
+        hash = (hash ^ ((const uint8_t*)(data))[byte]) * 0x100000001b3ull
+
+    uintptr_t format = (uintptr_t)message;
+    LOG_HASH_BYTES(&format, sizeof(format));
+
+    BinaryLogSpec spec;
+    for (const char* p = message; binaryLogNextSpec(p, &spec); p = spec.pEnd)
+    {
+        uint64_t value = 0;
+        int32_t  precision = spec.mPrecision;
+        for (uint32_t i = 0; i < spec.mStarCount; ++i)
+        {
+            int star = va_arg(args, int);
+            if (spec.mStarPrecision && i + 1 == spec.mStarCount)
+                precision = star < 0 ? -1 : star;
+            value = (uint64_t)(int64_t)star;
+            LOG_HASH_BYTES(&value, sizeof(value));
+        }
+
+        switch (spec.mType)
+        {
+        case BINARY_LOG_ARG_INT:
+            value = (uint64_t)va_arg(args, int);
+            break;
+        case BINARY_LOG_ARG_LONG:
+            value = (uint64_t)va_arg(args, long);
+            break;
+        case BINARY_LOG_ARG_LONG_LONG:
+            value = (uint64_t)va_arg(args, long long);
+            break;
+        case BINARY_LOG_ARG_INTMAX:
+            value = (uint64_t)va_arg(args, intmax_t);
+            break;
+        case BINARY_LOG_ARG_SIZE:
+            value = (uint64_t)va_arg(args, size_t);
+            break;
+        case BINARY_LOG_ARG_PTRDIFF:
+            value = (uint64_t)va_arg(args, ptrdiff_t);
+            break;
+        case BINARY_LOG_ARG_DOUBLE:
+        case BINARY_LOG_ARG_LONG_DOUBLE:
+        {
+            double real = spec.mType == BINARY_LOG_ARG_DOUBLE ? va_arg(args, double) : (double)va_arg(args, long double);
+            memcpy(&value, &real, sizeof(value));
+            break;
+        }
+        case BINARY_LOG_ARG_POINTER:
+            value = (uint64_t)(uintptr_t)va_arg(args, void*);
+            break;
+        case BINARY_LOG_ARG_COUNT:
+            // Where the count is stored does not identify the message
+            (void)va_arg(args, int*);
+            break;
+        case BINARY_LOG_ARG_STRING:
+        {
+            const char* str = va_arg(args, const char*);
+            if (str)
+                LOG_HASH_BYTES(str, logStringLength(str, precision));
+            break;
+        }
+        case BINARY_LOG_ARG_WIDE_STRING:
+        {
+            const wchar_t* str = va_arg(args, const wchar_t*);
+            if (str)
+                LOG_HASH_BYTES(str, logWideStringLength(str, precision) * sizeof(wchar_t));
+            break;
+        }
+        default:
+            break;
+        }
+        LOG_HASH_BYTES(&value, sizeof(value));
+    }
+#undef LOG_HASH_BYTES
+    return hash;
+}
+
+void writeLogSite(LogSite* pSite, uint32_t level, const char* filename, int line_number, const char* message, ...)
+{
+    if (!(gLogger.mLogLevel & level))
+        return;
+
     va_list args;
     va_start(args, message);
-    vsnprintf(gLogBuffer, LOG_MAX_BUFFER, message, args);
+    va_list hashArgs;
+    va_copy(hashArgs, args);
+    uint64_t hash = hashLogMessage(message, hashArgs);
+    va_end(hashArgs);
+
+    uint32_t now = (uint32_t)(getUSec(false) / 1000);
+    uint32_t repeated = 0;
+    uint32_t suppressed = 0;
+    bool     write = true;
+
+    lockLogSite(pSite);
+    uint32_t    countedLevel = pSite->mLevel;
+    const char* countedFile = pSite->pFile;
+    int         countedLine = pSite->mLine;
+    bool        repeat = hash == pSite->mLastHash && pSite->mLastWritten;
+    if (!pSite->mIntervalStart)
+    {
+        // Site just used up its first burst, this is the last message of it
+        pSite->mIntervalStart = now ? now : 1;
+        pSite->mBurstUsed = true;
+    }
+    else if (now - pSite->mIntervalStart >= LOG_SITE_INTERVAL_MS)
+    {
+        // First message of a new interval, the burst starts over with this one
+        repeated = pSite->mRepeated;
+        suppressed = pSite->mSuppressed;
+        pSite->mIntervalStart = now ? now : 1;
+        pSite->mRepeated = 0;
+        pSite->mSuppressed = 0;
+        pSite->mBurstUsed = LOG_SITE_BURST <= 1;
+        tfrg_atomic32_store_relaxed(&pSite->mCount_Atomic, 1);
+    }
+    else if (!pSite->mBurstUsed)
+    {
+        // Last message of the burst, following ones are compared against it
+        pSite->mBurstUsed = true;
+    }
+    else if (repeat)
+    {
+        countLogSiteMessage(pSite, level, filename, line_number, true);
+        write = false;
+    }
+    else if (level & eERROR)
+    {
+        // Errors past the burst are still written, counts go first so that they refer to the right message
+        repeated = pSite->mRepeated;
+        suppressed = pSite->mSuppressed;
+        pSite->mRepeated = 0;
+        pSite->mSuppressed = 0;
+    }
+    else
+    {
+        countLogSiteMessage(pSite, level, filename, line_number, false);
+        write = false;
+    }
+    // Repeats of a message which wasn't written are suppressed as well
+    pSite->mLastWritten = write || repeat;
+    pSite->mLastHash = hash;
+    unlockLogSite(pSite);
+
+    writeLogSiteCounts(countedLevel, countedFile, countedLine, repeated, suppressed);
+    if (write)
+        writeLogVaList(level, filename, line_number, message, args);
     va_end(args);
+}
 
-    if (gConsoleLogging)
+void writeRawLog(uint32_t level, bool error, const char* message, ...)
+{
+    LogRing* pRing = isLogThreadRunning() ? getThreadRing() : NULL;
+    char*    buffer = gLogBuffer;
+    LogRecord* pRecord = NULL;
+    if (pRing)
     {
-        _PrintUnicode(gLogBuffer, error);
+        pRecord = beginRecord(pRing);
+        buffer = (char*)(pRecord + 1);
     }
 
-    acquireMutex(&gLogger.mLogMutex);
+    va_list args;
+    va_start(args, message);
+    int length = vsnprintf(buffer, LOG_MAX_BUFFER, message, args);
+    va_end(args);
+
+    if (!pRing)
     {
-        for (LogCallback* pCallback = gLogger.pCallbacks; pCallback != gLogger.pCallbacks + gLogger.mCallbacksSize; ++pCallback)
-        {
-            if (pCallback->mLevel & level)
-                pCallback->mCallback(pCallback->mUserData, gLogBuffer);
-        }
+        acquireMutex(&gLogger.mLogMutex);
+        dispatchMessage(buffer, level, LOG_RECORD_RAW, error);
+        if (!gLogDispatching)
+            flushCallbacks();
+        releaseMutex(&gLogger.mLogMutex);
+        return;
     }
-    releaseMutex(&gLogger.mLogMutex);
+
+    length = length < 0 ? 0 : (length >= LOG_MAX_BUFFER ? LOG_MAX_BUFFER - 1 : length);
+    pRecord->mLevel = level;
+    pRecord->mPrefixOffset = LOG_RECORD_RAW;
+    pRecord->mError = error;
+    commitRecord(pRing, pRecord, (uint32_t)length + 1);
+
+    if (error)
+        flushLog();
 }
 
 void _FailedAssert(const char* file, int line, const char* statement, const char* msgFmt, ...)
@@ -337,6 +1300,7 @@ void _FailedAssert(const char* file, int line, const char* statement, const char
     }
     else
     {
+        // eERROR messages are flushed before writeLog returns
         if (usrMsgBuf[0])
             writeLog(eERROR, file, line, "Assert failed: %s\nAssert message: %s", statement, usrMsgBuf);
         else
@@ -372,20 +1336,27 @@ static uint32_t writeLogPreamble(char* buffer, uint32_t buffer_size, const char*
     // Date and time
     if (pos < buffer_size)
     {
-        time_t    t = time(NULL);
-        struct tm time_info;
+#if defined(NX64)
+        time_t t = getTimeSinceStart();
+#else
+        time_t t = time(NULL);
+#endif
+        if (t != gLogTime || !gLogTimeLength)
+        {
+            struct tm time_info;
 #if defined(_WINDOWS) || defined(XBOX)
-        localtime_s(&time_info, &t);
+            localtime_s(&time_info, &t);
 #elif defined(ORBIS) || defined(PROSPERO)
-        localtime_s(&t, &time_info);
-#elif defined(NX64)
-        t = getTimeSinceStart();
-        localtime_r(&t, &time_info);
+            localtime_s(&t, &time_info);
 #else
-        localtime_r(&t, &time_info);
+            localtime_r(&t, &time_info);
 #endif
-        pos += snprintf(buffer + pos, buffer_size - pos, "%04d-%02d-%02d %02d:%02d:%02d ", 1900 + time_info.tm_year, 1 + time_info.tm_mon,
-                        time_info.tm_mday, time_info.tm_hour, time_info.tm_min, time_info.tm_sec);
+            gLogTimeLength = snprintf(gLogTimeString, sizeof(gLogTimeString), "%04d-%02d-%02d %02d:%02d:%02d ", 1900 + time_info.tm_year,
+                                      1 + time_info.tm_mon, time_info.tm_mday, time_info.tm_hour, time_info.tm_min, time_info.tm_sec);
+            gLogTime = t;
+        }
+        memcpy(buffer + pos, gLogTimeString, gLogTimeLength);
+        pos += gLogTimeLength;
     }
 
     if (pos < buffer_size)
@@ -426,8 +1397,14 @@ void exitLog(void) {}
 void addLogFile(const char* filename, FileMode file_mode, LogLevel log_level) {}
 void addLogCallback(const char* id, uint32_t log_level, void* user_data, LogCallbackFn callback, LogCloseFn close, LogFlushFn flush) {}
 
+void exitLogThread(void) {}
+void flushLog(void) {}
+void setLogConsoleOutput(bool enable) {}
+void addBinaryLogFile(const char* filename, uint32_t log_level) {}
+
 void writeLog(uint32_t level, const char* filename, int line_number, const char* message, va_list args) {}
 void writeLog(uint32_t level, const char* filename, int line_number, const char* message, ...) {}
+void writeLogSite(LogSite* pSite, uint32_t level, const char* filename, int line_number, const char* message, ...) {}
 void writeRawLog(uint32_t level, bool error, const char* message, ...) {}
 
 void _FailedAssert(const char* file, int line, const char* statement, const char* msgFmt, ...) {}
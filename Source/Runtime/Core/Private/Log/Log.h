@@ -28,6 +28,8 @@
 
 #include <Core/IFileSystem.h>
 
+#include "../Threading/Atomics.h"
+
 #include "stdbool.h"
 
 #ifndef FILENAME_NAME_LENGTH_LOG
@@ -42,6 +44,18 @@
 #define LEVELS_LOG 6
 #endif
 
+// Every LOGF call site writes up to LOG_SITE_BURST messages per LOG_SITE_INTERVAL_MS. Past that, messages identical to the previous
+// one are counted as repeats and other messages are suppressed, except eERROR ones which are always written.
+// Counts are written with the first message of the next interval or by flushLog, whichever comes first.
+// LOG_SITE_INTERVAL_MS 0 disables the limit.
+#ifndef LOG_SITE_INTERVAL_MS
+#define LOG_SITE_INTERVAL_MS 1000
+#endif
+
+#ifndef LOG_SITE_BURST
+#define LOG_SITE_BURST 8
+#endif
+
 #define CONCAT_STR_LOG_IMPL(a, b) a##b
 #define CONCAT_STR_LOG(a, b)      CONCAT_STR_LOG_IMPL(a, b)
 
@@ -61,6 +75,31 @@ typedef enum LogLevel
     eALL = ~0
 } LogLevel;
 
+// State of a LOGF call site, a zero initialized static
+typedef struct LogSite
+{
+    // Messages written by the site in the current interval
+    tfrg_atomic32_t mCount_Atomic;
+    tfrg_atomic32_t mLock_Atomic;
+    // Following are protected by mLock_Atomic
+    uint32_t        mIntervalStart;
+    // Repeats of the last written message
+    uint32_t        mRepeated;
+    // Other messages past the burst
+    uint32_t        mSuppressed;
+    uint64_t        mLastHash;
+    bool            mLastWritten;
+    // Last message of the burst went through writeLogSite, so that following ones have something to compare against
+    bool            mBurstUsed;
+    // Site is linked to the list of sites with counts, which flushLog writes
+    bool            mPending;
+    struct LogSite* pNextPending;
+    // Where counted messages came from
+    uint32_t        mLevel;
+    int             mLine;
+    const char*     pFile;
+} LogSite;
+
 typedef void (*LogCallbackFn)(void* user_data, const char* message);
 typedef void (*LogCloseFn)(void* user_data);
 typedef void (*LogFlushFn)(void* user_data);
@@ -74,20 +113,44 @@ extern "C"
     // level     mask of LogLevel bits. Log is ignored if its level is missing in mask. Use eALL to enable full log
     FORGE_API void initLog(const char* appName, LogLevel level);
     FORGE_API void exitLog(void);
+    // Releases the log buffer of the calling thread, called when threads created by initThread exit.
+    // Buffers of other threads are released by a thread exit destructor.
+    FORGE_API void exitLogThread(void);
+
+    // Messages are written to the callbacks by the log thread, flushLog writes all pending messages before returning.
+    // eERROR messages and failed asserts are flushed by the logging call.
+    FORGE_API void flushLog(void);
+
+    // Messages are printed to the console as well unless disabled
+    FORGE_API void setLogConsoleOutput(bool enable);
 
     FORGE_API void addLogFile(const char* filename, FileMode file_mode, LogLevel log_level);
     FORGE_API void addLogCallback(const char* id, uint32_t log_level, void* user_data, LogCallbackFn callback, LogCloseFn close,
                                   LogFlushFn flush);
+    // Messages of levels in 'log_level' are written to 'filename' unformatted, see BinaryLog.h. They are much cheaper to log
+    // but don't reach the console or callbacks, Tools/LogDecoder turns the file into text.
+    // Raw logs and messages which don't fit LOG_MAX_BUFFER as binary are still written as text.
+    // Format strings are told apart by address and line, contents of a format string must not change once used.
+    FORGE_API void addBinaryLogFile(const char* filename, uint32_t log_level);
 
     FORGE_API void writeLogVaList(uint32_t level, const char* filename, int line_number, const char* message, va_list args);
     //+V576, function:writeLog, format_arg:4, ellipsis_arg:5
     FORGE_API void writeLog(uint32_t level, const char* filename, int line_number, const char* message, ...);
+    // Used by LOGF once the site wrote LOG_SITE_BURST messages in the current interval
+    //+V576, function:writeLogSite, format_arg:5, ellipsis_arg:6
+    FORGE_API void writeLogSite(LogSite* pSite, uint32_t level, const char* filename, int line_number, const char* message, ...);
     //+V576, function:writeRawLog, format_arg:3, ellipsis_arg:4
     FORGE_API void writeRawLog(uint32_t level, bool error, const char* message, ...);
 
     //+V576, function:_FailedAssert, format_arg:4, ellipsis_arg:5
     FORGE_API void _FailedAssert(const char* file, int line, const char* statement, const char* msg, ...);
 
+    static inline bool logSiteWithinBurst(LogSite* pSite)
+    {
+        // Last message of the burst goes to writeLogSite, which compares following messages against it
+        return (uint32_t)tfrg_atomic32_add_relaxed(&pSite->mCount_Atomic, 1) + 1 < LOG_SITE_BURST;
+    }
+
     // Usage:
     // puts(humanReadableTime(ns).str);
     // printf("%s\n", humanReadableTime(ms * 1000).str);
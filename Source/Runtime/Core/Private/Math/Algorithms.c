@@ -94,9 +94,10 @@ static void simpleSortDouble(double* pArr, size_t memberCount)
                      PTR_INC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
 
-// INSERTION SORT (stable sort)
+// INSERTION SORT
+// Used by quick sort for small ranges
 
-void stableSort(void* pVoidData, size_t memberCount, size_t memberSize, LessFn less, void* pUserData)
+static void insertionSort(void* pVoidData, size_t memberCount, size_t memberSize, LessFn less, void* pUserData)
 {
 #define SIMPLE_SORT(pArr, memberCount) simpleSort(pArr, memberCount, memberSize, less, pUserData)
     INSERTION_SORT_IMPL(char, (char*)pVoidData, memberCount, SIMPLE_SORT, LESS_GENERIC, CREATE_TEMP_GENERIC, DESTROY_TEMP_GENERIC,
@@ -104,59 +105,120 @@ void stableSort(void* pVoidData, size_t memberCount, size_t memberSize, LessFn l
 #undef SIMPLE_SORT
 }
 
-void stableSortInt8(int8_t* pArr, size_t memberCount)
+static void insertionSortInt8(int8_t* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(int8_t, pArr, memberCount, simpleSortInt8, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
                         PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
-void stableSortInt16(int16_t* pArr, size_t memberCount)
+static void insertionSortInt16(int16_t* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(int16_t, pArr, memberCount, simpleSortInt16, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
                         PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
-void stableSortInt32(int32_t* pArr, size_t memberCount)
+static void insertionSortInt32(int32_t* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(int32_t, pArr, memberCount, simpleSortInt32, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
                         PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
-void stableSortInt64(int64_t* pArr, size_t memberCount)
+static void insertionSortInt64(int64_t* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(int64_t, pArr, memberCount, simpleSortInt64, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
                         PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
 
-void stableSortUInt8(uint8_t* pArr, size_t memberCount)
+static void insertionSortUInt8(uint8_t* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(uint8_t, pArr, memberCount, simpleSortUInt8, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
                         PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
-void stableSortUInt16(uint16_t* pArr, size_t memberCount)
+static void insertionSortUInt16(uint16_t* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(uint16_t, pArr, memberCount, simpleSortUInt16, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC,
                         COPY_NUMERIC, PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
-void stableSortUInt32(uint32_t* pArr, size_t memberCount)
+static void insertionSortUInt32(uint32_t* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(uint32_t, pArr, memberCount, simpleSortUInt32, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC,
                         COPY_NUMERIC, PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
-void stableSortUInt64(uint64_t* pArr, size_t memberCount)
+static void insertionSortUInt64(uint64_t* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(uint64_t, pArr, memberCount, simpleSortUInt64, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC,
                         COPY_NUMERIC, PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
 
-void stableSortFloat(float* pArr, size_t memberCount)
+static void insertionSortFloat(float* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(float, pArr, memberCount, simpleSortFloat, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
                         PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
-void stableSortDouble(double* pArr, size_t memberCount)
+static void insertionSortDouble(double* pArr, size_t memberCount)
 {
     INSERTION_SORT_IMPL(double, pArr, memberCount, simpleSortDouble, LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
                         PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)
 }
 
+// MERGE SORT (stable sort)
+
+void stableSort(void* pVoidData, size_t memberCount, size_t memberSize, LessFn less, void* pUserData)
+{
+    MERGE_SORT_IMPL(char, (char*)pVoidData, memberCount, memberSize, LESS_GENERIC, CREATE_TEMP_GENERIC, DESTROY_TEMP_GENERIC, COPY_GENERIC,
+                    MOVE_RANGE_GENERIC, PTR_ADD_GENERIC)
+}
+
+void stableSortInt8(int8_t* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(int8_t, pArr, memberCount, sizeof(int8_t), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+void stableSortInt16(int16_t* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(int16_t, pArr, memberCount, sizeof(int16_t), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+void stableSortInt32(int32_t* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(int32_t, pArr, memberCount, sizeof(int32_t), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+void stableSortInt64(int64_t* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(int64_t, pArr, memberCount, sizeof(int64_t), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+
+void stableSortUInt8(uint8_t* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(uint8_t, pArr, memberCount, sizeof(uint8_t), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+void stableSortUInt16(uint16_t* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(uint16_t, pArr, memberCount, sizeof(uint16_t), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+void stableSortUInt32(uint32_t* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(uint32_t, pArr, memberCount, sizeof(uint32_t), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+void stableSortUInt64(uint64_t* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(uint64_t, pArr, memberCount, sizeof(uint64_t), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+
+void stableSortFloat(float* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(float, pArr, memberCount, sizeof(float), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+void stableSortDouble(double* pArr, size_t memberCount)
+{
+    MERGE_SORT_IMPL(double, pArr, memberCount, sizeof(double), LESS_NUMERIC, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_NUMERIC,
+                    MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)
+}
+
 // PARTITION
 // V_RET_NOT_NULL, function:partitionImpl
 static char* partitionImpl(char* pBegin, char* pEnd, char* pPivot, size_t memberSize, LessFn less, void* pUserData){
@@ -280,7 +342,7 @@ static double* partitionImplDouble(double* pBegin, double* pEnd, double* pPivot)
 static void quickSort(char* pBegin, char* pEnd, char* tmp, size_t memberSize, LessFn less, void* pUserData)
 {
 #define QUICKSORT_IMPL_FN(pBegin, pEnd, tmp)    quickSort(pBegin, pEnd, tmp, memberSize, less, pUserData);
-#define FALLBACK_SORT(pArr, memberCount)        stableSort(pArr, memberCount, memberSize, less, pUserData)
+#define FALLBACK_SORT(pArr, memberCount)        insertionSort(pArr, memberCount, memberSize, less, pUserData)
 #define PARTITION_IMPL_FN(pBegin, pEnd, pPivot) partitionImpl(pBegin, pEnd, pPivot, memberSize, less, pUserData)
 
     QUICKSORT_IMPL(char, pBegin, pEnd, tmp, QUICKSORT_IMPL_FN, FALLBACK_SORT, PARTITION_IMPL_FN, LESS_GENERIC, COPY_GENERIC,
@@ -299,8 +361,8 @@ void sort(void* pData, size_t memberCount, size_t memberSize, LessFn less, void*
 
 static void quickSortInt8(int8_t* pBegin, int8_t* pEnd, int8_t* tmp)
 {
-    QUICKSORT_IMPL(int8_t, pBegin, pEnd, tmp, quickSortInt8, stableSortInt8, partitionImplInt8, LESS_NUMERIC, COPY_NUMERIC, PTR_ADD_NUMERIC,
-                   PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
+    QUICKSORT_IMPL(int8_t, pBegin, pEnd, tmp, quickSortInt8, insertionSortInt8, partitionImplInt8, LESS_NUMERIC, COPY_NUMERIC,
+                   PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortInt8(int8_t* pData, size_t memberCount)
 {
@@ -309,7 +371,7 @@ void sortInt8(int8_t* pData, size_t memberCount)
 }
 static void quickSortInt16(int16_t* pBegin, int16_t* pEnd, int16_t* tmp)
 {
-    QUICKSORT_IMPL(int16_t, pBegin, pEnd, tmp, quickSortInt16, stableSortInt16, partitionImplInt16, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(int16_t, pBegin, pEnd, tmp, quickSortInt16, insertionSortInt16, partitionImplInt16, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortInt16(int16_t* pData, size_t memberCount)
@@ -319,7 +381,7 @@ void sortInt16(int16_t* pData, size_t memberCount)
 }
 static void quickSortInt32(int32_t* pBegin, int32_t* pEnd, int32_t* tmp)
 {
-    QUICKSORT_IMPL(int32_t, pBegin, pEnd, tmp, quickSortInt32, stableSortInt32, partitionImplInt32, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(int32_t, pBegin, pEnd, tmp, quickSortInt32, insertionSortInt32, partitionImplInt32, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortInt32(int32_t* pData, size_t memberCount)
@@ -329,7 +391,7 @@ void sortInt32(int32_t* pData, size_t memberCount)
 }
 static void quickSortInt64(int64_t* pBegin, int64_t* pEnd, int64_t* tmp)
 {
-    QUICKSORT_IMPL(int64_t, pBegin, pEnd, tmp, quickSortInt64, stableSortInt64, partitionImplInt64, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(int64_t, pBegin, pEnd, tmp, quickSortInt64, insertionSortInt64, partitionImplInt64, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortInt64(int64_t* pData, size_t memberCount)
@@ -340,7 +402,7 @@ void sortInt64(int64_t* pData, size_t memberCount)
 
 static void quickSortUInt8(uint8_t* pBegin, uint8_t* pEnd, uint8_t* tmp)
 {
-    QUICKSORT_IMPL(uint8_t, pBegin, pEnd, tmp, quickSortUInt8, stableSortUInt8, partitionImplUInt8, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(uint8_t, pBegin, pEnd, tmp, quickSortUInt8, insertionSortUInt8, partitionImplUInt8, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortUInt8(uint8_t* pData, size_t memberCount)
@@ -350,7 +412,7 @@ void sortUInt8(uint8_t* pData, size_t memberCount)
 }
 static void quickSortUInt16(uint16_t* pBegin, uint16_t* pEnd, uint16_t* tmp)
 {
-    QUICKSORT_IMPL(uint16_t, pBegin, pEnd, tmp, quickSortUInt16, stableSortUInt16, partitionImplUInt16, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(uint16_t, pBegin, pEnd, tmp, quickSortUInt16, insertionSortUInt16, partitionImplUInt16, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortUInt16(uint16_t* pData, size_t memberCount)
@@ -360,7 +422,7 @@ void sortUInt16(uint16_t* pData, size_t memberCount)
 }
 static void quickSortUInt32(uint32_t* pBegin, uint32_t* pEnd, uint32_t* tmp)
 {
-    QUICKSORT_IMPL(uint32_t, pBegin, pEnd, tmp, quickSortUInt32, stableSortUInt32, partitionImplUInt32, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(uint32_t, pBegin, pEnd, tmp, quickSortUInt32, insertionSortUInt32, partitionImplUInt32, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortUInt32(uint32_t* pData, size_t memberCount)
@@ -370,7 +432,7 @@ void sortUInt32(uint32_t* pData, size_t memberCount)
 }
 static void quickSortUInt64(uint64_t* pBegin, uint64_t* pEnd, uint64_t* tmp)
 {
-    QUICKSORT_IMPL(uint64_t, pBegin, pEnd, tmp, quickSortUInt64, stableSortUInt64, partitionImplUInt64, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(uint64_t, pBegin, pEnd, tmp, quickSortUInt64, insertionSortUInt64, partitionImplUInt64, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortUInt64(uint64_t* pData, size_t memberCount)
@@ -381,7 +443,7 @@ void sortUInt64(uint64_t* pData, size_t memberCount)
 
 static void quickSortFloat(float* pBegin, float* pEnd, float* tmp)
 {
-    QUICKSORT_IMPL(float, pBegin, pEnd, tmp, quickSortFloat, stableSortFloat, partitionImplFloat, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(float, pBegin, pEnd, tmp, quickSortFloat, insertionSortFloat, partitionImplFloat, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortFloat(float* pData, size_t memberCount)
@@ -391,7 +453,7 @@ void sortFloat(float* pData, size_t memberCount)
 }
 static void quickSortDouble(double* pBegin, double* pEnd, double* tmp)
 {
-    QUICKSORT_IMPL(double, pBegin, pEnd, tmp, quickSortDouble, stableSortDouble, partitionImplDouble, LESS_NUMERIC, COPY_NUMERIC,
+    QUICKSORT_IMPL(double, pBegin, pEnd, tmp, quickSortDouble, insertionSortDouble, partitionImplDouble, LESS_NUMERIC, COPY_NUMERIC,
                    PTR_ADD_NUMERIC, PTR_SUB_NUMERIC, PTR_DIFF_NUMERIC)
 }
 void sortDouble(double* pData, size_t memberCount)
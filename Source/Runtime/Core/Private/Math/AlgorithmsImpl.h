@@ -26,9 +26,14 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define QUICKSORT_THRESHOLD  30
-#define SIMPLESORT_THRESHOLD 4
-#define TMP_BUF_STACK_SIZE   256
+#define QUICKSORT_THRESHOLD   30
+#define SIMPLESORT_THRESHOLD  4
+#define TMP_BUF_STACK_SIZE    256
+// Shorter arrays are sorted by stableSort with binary insertion sort alone
+#define MERGE_SORT_MIN_MERGE  32
+#define MERGE_SORT_MIN_GALLOP 7
+// Run lengths grow at least as fast as Fibonacci numbers, 96 runs cover any size_t count
+#define MERGE_SORT_MAX_RUNS   96
 
 // PVS-Studio warning suppression
 //-V:DEFINE_SORT_ALGORITHMS_FOR_TYPE:769
@@ -47,8 +52,8 @@
  *		use quick sort
  *
  * attrs void stableSort<type> (type* pArr, size_t memberCount)
- *	stable sort (uses insertion sort)
- *	NOTE: 2-3 times slower than regular sort for big arrays
+ *	stable sort (merge sort taking advantage of sorted runs, see MERGE_SORT_IMPL)
+ *	allocates up to memberCount / 2 elements, nothing for sorted, reversed or small arrays
  *
  * attrs size_t partition<type> (type* pArr, size_t pivot, size_t memberCount)
  *	partitions array around the pivot(similar to std::nth_element)
@@ -56,7 +61,10 @@
  * Implementation functions:
  *
  * attrs void simplSort<type> (type* pArr, size_t memberCount)
- *	sort used for small arrays (used in stableSort)
+ *	sort used for small arrays (used in insertionSort)
+ *
+ * attrs void insertionSort<type> (type* pArr, size_t memberCount)
+ *	stable sort used for small arrays (used in sort)
  *
  * attrs type* partitionImpl<type> (type* pBegin, type* pEnd, type* pPivot)
  *	implementation function for partition
@@ -65,13 +73,14 @@
  *	implementation function for sort
  *
  */
-#define DEFINE_SORT_ALGORITHMS_FOR_TYPE(attrs, type, lessFn)                                                    \
-    DEFINE_SIMPLE_SORT_FUNCTION(attrs, CONCAT(simpleSort, type), type, lessFn)                                  \
-    DEFINE_INSERTION_SORT_FUNCTION(attrs, CONCAT(stableSort, type), type, lessFn, CONCAT(simpleSort, type))     \
-    DEFINE_PARTITION_IMPL_FUNCTION(attrs, CONCAT(partitionImpl, type), type, lessFn)                            \
-    DEFINE_PARTITION_FUNCTION(attrs, CONCAT(partition, type), type, lessFn, CONCAT(partitionImpl, type))        \
-    DEFINE_QUICK_SORT_IMPL_FUNCTION(attrs, CONCAT(quickSortImpl, type), type, lessFn, CONCAT(stableSort, type), \
-                                    CONCAT(partitionImpl, type))                                                \
+#define DEFINE_SORT_ALGORITHMS_FOR_TYPE(attrs, type, lessFn)                                                       \
+    DEFINE_SIMPLE_SORT_FUNCTION(attrs, CONCAT(simpleSort, type), type, lessFn)                                     \
+    DEFINE_INSERTION_SORT_FUNCTION(attrs, CONCAT(insertionSort, type), type, lessFn, CONCAT(simpleSort, type))     \
+    DEFINE_MERGE_SORT_FUNCTION(attrs, CONCAT(stableSort, type), type, lessFn)                                      \
+    DEFINE_PARTITION_IMPL_FUNCTION(attrs, CONCAT(partitionImpl, type), type, lessFn)                               \
+    DEFINE_PARTITION_FUNCTION(attrs, CONCAT(partition, type), type, lessFn, CONCAT(partitionImpl, type))           \
+    DEFINE_QUICK_SORT_IMPL_FUNCTION(attrs, CONCAT(quickSortImpl, type), type, lessFn, CONCAT(insertionSort, type), \
+                                    CONCAT(partitionImpl, type))                                                   \
     DEFINE_QUICK_SORT_FUNCTION(attrs, CONCAT(sort, type), type, CONCAT(quickSortImpl, type))
 
 #define DEFINE_SIMPLE_SORT_FUNCTION(attrs, fnName, type, lessFn)                                                                           \
@@ -87,6 +96,12 @@
         INSERTION_SORT_IMPL(type, pArr, memberCount, simpleSortFn, lessFn, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_STRUCT, \
                             PTR_INC_NUMERIC, PTR_DEC_NUMERIC, PTR_ADD_NUMERIC, PTR_SUB_NUMERIC)                                    \
     }
+#define DEFINE_MERGE_SORT_FUNCTION(attrs, fnName, type, lessFn)                                                                \
+    attrs void fnName(type* pArr, size_t memberCount)                                                                          \
+    {                                                                                                                          \
+        MERGE_SORT_IMPL(type, pArr, memberCount, sizeof(type), lessFn, CREATE_TEMP_NUMERIC, DESTROY_TEMP_NUMERIC, COPY_STRUCT, \
+                        MOVE_RANGE_NUMERIC, PTR_ADD_NUMERIC)                                                                   \
+    }
 #define DEFINE_PARTITION_IMPL_FUNCTION(attrs, fnName, type, lessFn)                                                                 \
     attrs type* fnName(type* pBegin, type* pEnd, type* pPivot)                                                                      \
     {                                                                                                                               \
@@ -137,6 +152,9 @@
 #define COPY_GENERIC(pDst, pSrc)   (memcpy(pDst, pSrc, memberSize), (void)0)
 #define COPY_STRUCT(pDst, pSrc)    (memcpy(pDst, pSrc, sizeof(*pDst)), (void)0)
 
+#define MOVE_RANGE_GENERIC(pDst, pSrc, count) (memmove(pDst, pSrc, (count)*memberSize), (void)0)
+#define MOVE_RANGE_NUMERIC(pDst, pSrc, count) (memmove(pDst, pSrc, (count) * sizeof(*(pDst))), (void)0)
+
 #define SWAP(pX, pY, tmp, copy)    (copy((tmp), (pX)), copy((pX), (pY)), copy((pY), (tmp)), (void)0)
 
 #define PTR_INC_GENERIC(ptr)       ((ptr) += memberSize)
@@ -214,7 +232,7 @@
     DESTROY_TEMP(tmp);
 
 // INSERTION SORT (stable sort)
-// TODO: Optimize for large arrays (shell sort can be used)
+// Used for small arrays, see MERGE_SORT_IMPL for large ones
 #define INSERTION_SORT_IMPL(type, pArr, memberCount, SIMPLE_SORT, LESS, CREATE_TEMP, DESTROY_TEMP, COPY, PTR_INC, PTR_DEC, PTR_ADD, \
                             PTR_SUB)                                                                                                \
     CREATE_TEMP(type, tmp);                                                                                                         \
@@ -238,6 +256,320 @@
     }                                                                                                                               \
     DESTROY_TEMP(tmp);
 
+// MERGE SORT (stable sort)
+// Adaptive merge sort in the manner of TimSort. Ascending runs and strictly descending runs (reversed in place) are taken as they are,
+// shorter ones are extended with binary insertion sort. Runs are merged with the smaller one copied to scratch memory, merges switch to
+// galloping (exponential search) while one run keeps winning.
+
+// First index in [0, len) where PRED(LESS, pKey, element) holds or len, PRED has to be false then true along the range.
+// Exponential search starts from the end closest to the expected result.
+#define GALLOP_UPPER(LESS, pKey, p) LESS(pKey, p)
+#define GALLOP_LOWER(LESS, pKey, p) (!LESS(p, pKey))
+#define GALLOP(result, pBase, len, pKey, fromRight, PRED, LESS, PTR_ADD)                    \
+    {                                                                                       \
+        size_t gallopLo = 0;                                                                \
+        size_t gallopHi = (len);                                                            \
+        size_t gallopOfs = 1;                                                               \
+        if (!(fromRight))                                                                   \
+        {                                                                                   \
+            while (gallopOfs <= (len) && !PRED(LESS, pKey, PTR_ADD(pBase, gallopOfs - 1)))  \
+            {                                                                               \
+                gallopLo = gallopOfs;                                                       \
+                gallopOfs *= 2;                                                             \
+            }                                                                               \
+            if (gallopOfs <= (len))                                                         \
+                gallopHi = gallopOfs - 1;                                                   \
+        }                                                                                   \
+        else                                                                                \
+        {                                                                                   \
+            while (gallopOfs <= (len) && PRED(LESS, pKey, PTR_ADD(pBase, (len)-gallopOfs))) \
+            {                                                                               \
+                gallopHi = (len)-gallopOfs;                                                 \
+                gallopOfs *= 2;                                                             \
+            }                                                                               \
+            if (gallopOfs <= (len))                                                         \
+                gallopLo = (len)-gallopOfs + 1;                                             \
+        }                                                                                   \
+        while (gallopLo < gallopHi)                                                         \
+        {                                                                                   \
+            size_t gallopMid = gallopLo + (gallopHi - gallopLo) / 2;                        \
+            if (PRED(LESS, pKey, PTR_ADD(pBase, gallopMid)))                                \
+                gallopHi = gallopMid;                                                       \
+            else                                                                            \
+                gallopLo = gallopMid + 1;                                                   \
+        }                                                                                   \
+        result = gallopLo;                                                                  \
+    }                                                                                       \
+    (void)0
+
+// Merges runs [base, base + lenA) and [base + lenA, base + lenA + lenB), A is copied to scratch and the merge goes forward
+#define MERGE_LO(type, pArr, pScratch, base, lenA, lenB, minGallop, LESS, COPY, MOVE_RANGE, PTR_ADD)                      \
+    {                                                                                                                     \
+        MOVE_RANGE(pScratch, PTR_ADD(pArr, base), lenA);                                                                  \
+        size_t ia = 0;                                                                                                    \
+        size_t ib = (base) + (lenA);                                                                                      \
+        size_t ibEnd = ib + (lenB);                                                                                       \
+        size_t dst = (base);                                                                                              \
+        while (ia < (lenA) && ib < ibEnd)                                                                                 \
+        {                                                                                                                 \
+            size_t winsA = 0;                                                                                             \
+            size_t winsB = 0;                                                                                             \
+            while (ia < (lenA) && ib < ibEnd && winsA < minGallop && winsB < minGallop)                                   \
+            {                                                                                                             \
+                if (LESS(PTR_ADD(pArr, ib), PTR_ADD(pScratch, ia)))                                                       \
+                {                                                                                                         \
+                    COPY(PTR_ADD(pArr, dst), PTR_ADD(pArr, ib));                                                          \
+                    ++ib;                                                                                                 \
+                    ++winsB;                                                                                              \
+                    winsA = 0;                                                                                            \
+                }                                                                                                         \
+                else                                                                                                      \
+                {                                                                                                         \
+                    COPY(PTR_ADD(pArr, dst), PTR_ADD(pScratch, ia));                                                      \
+                    ++ia;                                                                                                 \
+                    ++winsA;                                                                                              \
+                    winsB = 0;                                                                                            \
+                }                                                                                                         \
+                ++dst;                                                                                                    \
+            }                                                                                                             \
+            while (ia < (lenA) && ib < ibEnd)                                                                             \
+            {                                                                                                             \
+                /* A elements not greater than B's next one */                                                            \
+                size_t countA;                                                                                            \
+                GALLOP(countA, PTR_ADD(pScratch, ia), (lenA)-ia, PTR_ADD(pArr, ib), false, GALLOP_UPPER, LESS, PTR_ADD);  \
+                MOVE_RANGE(PTR_ADD(pArr, dst), PTR_ADD(pScratch, ia), countA);                                            \
+                dst += countA;                                                                                            \
+                ia += countA;                                                                                             \
+                if (ia == (lenA))                                                                                         \
+                    break;                                                                                                \
+                /* B elements less than A's next one */                                                                   \
+                size_t countB;                                                                                            \
+                GALLOP(countB, PTR_ADD(pArr, ib), ibEnd - ib, PTR_ADD(pScratch, ia), false, GALLOP_LOWER, LESS, PTR_ADD); \
+                MOVE_RANGE(PTR_ADD(pArr, dst), PTR_ADD(pArr, ib), countB);                                                \
+                dst += countB;                                                                                            \
+                ib += countB;                                                                                             \
+                if (minGallop > 1)                                                                                        \
+                    --minGallop;                                                                                          \
+                if (countA < MERGE_SORT_MIN_GALLOP && countB < MERGE_SORT_MIN_GALLOP)                                     \
+                    break;                                                                                                \
+            }                                                                                                             \
+            minGallop += 2;                                                                                               \
+        }                                                                                                                 \
+        /* B leftovers are in place already */                                                                            \
+        MOVE_RANGE(PTR_ADD(pArr, dst), PTR_ADD(pScratch, ia), (lenA)-ia);                                                 \
+    }                                                                                                                     \
+    (void)0
+
+// Same as MERGE_LO with B copied to scratch and the merge going backward
+#define MERGE_HI(type, pArr, pScratch, base, lenA, lenB, minGallop, LESS, COPY, MOVE_RANGE, PTR_ADD)                            \
+    {                                                                                                                           \
+        MOVE_RANGE(pScratch, PTR_ADD(pArr, (base) + (lenA)), lenB);                                                             \
+        size_t ia = (base) + (lenA);                                                                                            \
+        size_t ib = (lenB);                                                                                                     \
+        size_t dst = ia + ib;                                                                                                   \
+        while (ia > (base) && ib > 0)                                                                                           \
+        {                                                                                                                       \
+            size_t winsA = 0;                                                                                                   \
+            size_t winsB = 0;                                                                                                   \
+            while (ia > (base) && ib > 0 && winsA < minGallop && winsB < minGallop)                                             \
+            {                                                                                                                   \
+                --dst;                                                                                                          \
+                if (LESS(PTR_ADD(pScratch, ib - 1), PTR_ADD(pArr, ia - 1)))                                                     \
+                {                                                                                                               \
+                    --ia;                                                                                                       \
+                    COPY(PTR_ADD(pArr, dst), PTR_ADD(pArr, ia));                                                                \
+                    ++winsA;                                                                                                    \
+                    winsB = 0;                                                                                                  \
+                }                                                                                                               \
+                else                                                                                                            \
+                {                                                                                                               \
+                    --ib;                                                                                                       \
+                    COPY(PTR_ADD(pArr, dst), PTR_ADD(pScratch, ib));                                                            \
+                    ++winsB;                                                                                                    \
+                    winsA = 0;                                                                                                  \
+                }                                                                                                               \
+            }                                                                                                                   \
+            while (ia > (base) && ib > 0)                                                                                       \
+            {                                                                                                                   \
+                /* A elements greater than B's last one */                                                                      \
+                size_t countA;                                                                                                  \
+                GALLOP(countA, PTR_ADD(pArr, base), ia - (base), PTR_ADD(pScratch, ib - 1), true, GALLOP_UPPER, LESS, PTR_ADD); \
+                countA = ia - (base)-countA;                                                                                    \
+                dst -= countA;                                                                                                  \
+                ia -= countA;                                                                                                   \
+                MOVE_RANGE(PTR_ADD(pArr, dst), PTR_ADD(pArr, ia), countA);                                                      \
+                if (ia == (base))                                                                                               \
+                    break;                                                                                                      \
+                /* B elements not less than A's last one */                                                                     \
+                size_t countB;                                                                                                  \
+                GALLOP(countB, pScratch, ib, PTR_ADD(pArr, ia - 1), true, GALLOP_LOWER, LESS, PTR_ADD);                         \
+                countB = ib - countB;                                                                                           \
+                dst -= countB;                                                                                                  \
+                ib -= countB;                                                                                                   \
+                MOVE_RANGE(PTR_ADD(pArr, dst), PTR_ADD(pScratch, ib), countB);                                                  \
+                if (minGallop > 1)                                                                                              \
+                    --minGallop;                                                                                                \
+                if (countA < MERGE_SORT_MIN_GALLOP && countB < MERGE_SORT_MIN_GALLOP)                                           \
+                    break;                                                                                                      \
+            }                                                                                                                   \
+            minGallop += 2;                                                                                                     \
+        }                                                                                                                       \
+        /* A leftovers are in place already */                                                                                  \
+        MOVE_RANGE(PTR_ADD(pArr, base), pScratch, ib);                                                                          \
+    }                                                                                                                           \
+    (void)0
+
+// Merge used when scratch memory can't be allocated, B elements are inserted into A one by one
+#define MERGE_IN_PLACE(pArr, tmp, base, lenA, lenB, LESS, COPY, MOVE_RANGE, PTR_ADD)                                                    \
+    {                                                                                                                                   \
+        size_t mergeLo = (base);                                                                                                        \
+        size_t mergeMid = (base) + (lenA);                                                                                              \
+        size_t mergeEnd = mergeMid + (lenB);                                                                                            \
+        for (; mergeLo < mergeMid && mergeMid < mergeEnd; ++mergeMid)                                                                   \
+        {                                                                                                                               \
+            size_t insertPos;                                                                                                           \
+            GALLOP(insertPos, PTR_ADD(pArr, mergeLo), mergeMid - mergeLo, PTR_ADD(pArr, mergeMid), false, GALLOP_UPPER, LESS, PTR_ADD); \
+            insertPos += mergeLo;                                                                                                       \
+            if (insertPos < mergeMid)                                                                                                   \
+            {                                                                                                                           \
+                COPY(tmp, PTR_ADD(pArr, mergeMid));                                                                                     \
+                MOVE_RANGE(PTR_ADD(pArr, insertPos + 1), PTR_ADD(pArr, insertPos), mergeMid - insertPos);                               \
+                COPY(PTR_ADD(pArr, insertPos), tmp);                                                                                    \
+            }                                                                                                                           \
+            /* Following B elements are not less than this one */                                                                       \
+            mergeLo = insertPos + 1;                                                                                                    \
+        }                                                                                                                               \
+    }                                                                                                                                   \
+    (void)0
+
+#define MERGE_SORT_IMPL(type, pArr, memberCount, ELEM_SIZE, LESS, CREATE_TEMP, DESTROY_TEMP, COPY, MOVE_RANGE, PTR_ADD)              \
+    if (memberCount < 2)                                                                                                             \
+        return;                                                                                                                      \
+    CREATE_TEMP(type, tmp);                                                                                                          \
+    type*  pScratch = NULL;                                                                                                          \
+    size_t scratchCount = 0;                                                                                                         \
+    size_t minGallop = MERGE_SORT_MIN_GALLOP;                                                                                        \
+    size_t runBase[MERGE_SORT_MAX_RUNS];                                                                                             \
+    size_t runLen[MERGE_SORT_MAX_RUNS];                                                                                              \
+    size_t runCount = 0;                                                                                                             \
+    /* Between MERGE_SORT_MIN_MERGE / 2 and MERGE_SORT_MIN_MERGE, picked so that memberCount / minRun is close to a power of 2 */    \
+    size_t minRun = memberCount;                                                                                                     \
+    {                                                                                                                                \
+        size_t oddBits = 0;                                                                                                          \
+        while (minRun >= MERGE_SORT_MIN_MERGE)                                                                                       \
+        {                                                                                                                            \
+            oddBits |= minRun & 1;                                                                                                   \
+            minRun >>= 1;                                                                                                            \
+        }                                                                                                                            \
+        minRun += oddBits;                                                                                                           \
+    }                                                                                                                                \
+                                                                                                                                     \
+    for (size_t lo = 0; lo < memberCount;)                                                                                           \
+    {                                                                                                                                \
+        size_t runEnd = lo + 1;                                                                                                      \
+        if (runEnd < memberCount)                                                                                                    \
+        {                                                                                                                            \
+            if (LESS(PTR_ADD(pArr, runEnd), PTR_ADD(pArr, lo)))                                                                      \
+            {                                                                                                                        \
+                /* Strictly descending, so reversing keeps equal elements in order */                                                \
+                while (runEnd + 1 < memberCount && LESS(PTR_ADD(pArr, runEnd + 1), PTR_ADD(pArr, runEnd)))                           \
+                    ++runEnd;                                                                                                        \
+                for (size_t i = lo, j = runEnd; i < j; ++i, --j)                                                                     \
+                    SWAP(PTR_ADD(pArr, i), PTR_ADD(pArr, j), tmp, COPY);                                                             \
+            }                                                                                                                        \
+            else                                                                                                                     \
+            {                                                                                                                        \
+                while (runEnd + 1 < memberCount && !LESS(PTR_ADD(pArr, runEnd + 1), PTR_ADD(pArr, runEnd)))                          \
+                    ++runEnd;                                                                                                        \
+            }                                                                                                                        \
+            ++runEnd;                                                                                                                \
+        }                                                                                                                            \
+                                                                                                                                     \
+        /* Short runs are extended with binary insertion sort */                                                                     \
+        size_t forcedEnd = memberCount - lo < minRun ? memberCount : lo + minRun;                                                    \
+        for (; runEnd < forcedEnd; ++runEnd)                                                                                         \
+        {                                                                                                                            \
+            size_t insertPos;                                                                                                        \
+            GALLOP(insertPos, PTR_ADD(pArr, lo), runEnd - lo, PTR_ADD(pArr, runEnd), true, GALLOP_UPPER, LESS, PTR_ADD);             \
+            insertPos += lo;                                                                                                         \
+            COPY(tmp, PTR_ADD(pArr, runEnd));                                                                                        \
+            MOVE_RANGE(PTR_ADD(pArr, insertPos + 1), PTR_ADD(pArr, insertPos), runEnd - insertPos);                                  \
+            COPY(PTR_ADD(pArr, insertPos), tmp);                                                                                     \
+        }                                                                                                                            \
+                                                                                                                                     \
+        runBase[runCount] = lo;                                                                                                      \
+        runLen[runCount] = runEnd - lo;                                                                                              \
+        ++runCount;                                                                                                                  \
+        lo = runEnd;                                                                                                                 \
+                                                                                                                                     \
+        /* Keeps runLen[i - 2] > runLen[i - 1] + runLen[i] and runLen[i - 1] > runLen[i], merges everything after the last run */    \
+        while (runCount > 1)                                                                                                         \
+        {                                                                                                                            \
+            size_t n = runCount - 2;                                                                                                 \
+            if (lo == memberCount)                                                                                                   \
+            {                                                                                                                        \
+                if (n > 0 && runLen[n - 1] < runLen[n + 1])                                                                          \
+                    --n;                                                                                                             \
+            }                                                                                                                        \
+            else if ((n > 0 && runLen[n - 1] <= runLen[n] + runLen[n + 1]) || (n > 1 && runLen[n - 2] <= runLen[n - 1] + runLen[n])) \
+            {                                                                                                                        \
+                if (runLen[n - 1] < runLen[n + 1])                                                                                   \
+                    --n;                                                                                                             \
+            }                                                                                                                        \
+            else if (runLen[n] > runLen[n + 1])                                                                                      \
+            {                                                                                                                        \
+                break;                                                                                                               \
+            }                                                                                                                        \
+                                                                                                                                     \
+            size_t base = runBase[n];                                                                                                \
+            size_t lenA = runLen[n];                                                                                                 \
+            size_t lenB = runLen[n + 1];                                                                                             \
+            runLen[n] = lenA + lenB;                                                                                                 \
+            if (n + 3 == runCount)                                                                                                   \
+            {                                                                                                                        \
+                runBase[n + 1] = runBase[n + 2];                                                                                     \
+                runLen[n + 1] = runLen[n + 2];                                                                                       \
+            }                                                                                                                        \
+            --runCount;                                                                                                              \
+                                                                                                                                     \
+            /* A elements not greater than B's first one and B elements not less than A's last one are in place */                   \
+            size_t skipA;                                                                                                            \
+            GALLOP(skipA, PTR_ADD(pArr, base), lenA, PTR_ADD(pArr, base + lenA), false, GALLOP_UPPER, LESS, PTR_ADD);                \
+            base += skipA;                                                                                                           \
+            lenA -= skipA;                                                                                                           \
+            if (lenA == 0)                                                                                                           \
+                continue;                                                                                                            \
+            GALLOP(lenB, PTR_ADD(pArr, base + lenA), lenB, PTR_ADD(pArr, base + lenA - 1), true, GALLOP_LOWER, LESS, PTR_ADD);       \
+            if (lenB == 0)                                                                                                           \
+                continue;                                                                                                            \
+                                                                                                                                     \
+            /* Scratch memory grows with merges up to memberCount / 2 elements */                                                    \
+            size_t mergeCount = lenA < lenB ? lenA : lenB;                                                                           \
+            if (scratchCount < mergeCount)                                                                                           \
+            {                                                                                                                        \
+                scratchCount = mergeCount * 2 < memberCount / 2 ? mergeCount * 2 : memberCount / 2;                                  \
+                tf_free(pScratch);                                                                                                   \
+                pScratch = (type*)tf_malloc(scratchCount * (ELEM_SIZE));                                                             \
+                if (!pScratch)                                                                                                       \
+                    scratchCount = 0;                                                                                                \
+            }                                                                                                                        \
+            if (!pScratch)                                                                                                           \
+            {                                                                                                                        \
+                MERGE_IN_PLACE(pArr, tmp, base, lenA, lenB, LESS, COPY, MOVE_RANGE, PTR_ADD);                                        \
+            }                                                                                                                        \
+            else if (lenA <= lenB)                                                                                                   \
+            {                                                                                                                        \
+                MERGE_LO(type, pArr, pScratch, base, lenA, lenB, minGallop, LESS, COPY, MOVE_RANGE, PTR_ADD);                        \
+            }                                                                                                                        \
+            else                                                                                                                     \
+            {                                                                                                                        \
+                MERGE_HI(type, pArr, pScratch, base, lenA, lenB, minGallop, LESS, COPY, MOVE_RANGE, PTR_ADD);                        \
+            }                                                                                                                        \
+        }                                                                                                                            \
+    }                                                                                                                                \
+    tf_free(pScratch);                                                                                                               \
+    DESTROY_TEMP(tmp);
+
 // PARTITION
 
 #define PARTITION_IMPL(type, pBegin, pEnd, pPivot, LESS, CREATE_TEMP, DESTROY_TEMP, COPY, PTR_INC) \
@@ -255,6 +587,9 @@
         if (LESS(pCurrent, pPivot))                                                                \
         {                                                                                          \
             SWAP(pCurrent, pNewPivot, tmp, COPY);                                                  \
+            /* pivot moves along when swapped */                                                   \
+            if (pNewPivot == pPivot)                                                               \
+                pPivot = pCurrent;                                                                 \
             PTR_INC(pNewPivot);                                                                    \
         }                                                                                          \
     }                                                                                              \
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "Arena.h"
+
+#include <string.h>
+
+#include <ThirdParty/stb/stb_ds.h>
+
+#include <Core/ILog.h>
+
+#include <Core/IMemory.h>
+
+// Data of every block starts at this alignment, larger alignments are handled by padding
+#define ARENA_BLOCK_ALIGNMENT    16
+#define ARENA_BLOCK_HEADER_SIZE  ((sizeof(ArenaBlock) + ARENA_BLOCK_ALIGNMENT - 1) & ~(size_t)(ARENA_BLOCK_ALIGNMENT - 1))
+#define ARENA_ROUND_UP(size, to) (((size) + (to)-1) / (to) * (to))
+
+struct ArenaBlock
+{
+    ArenaBlock* pNext;
+    size_t      size;
+};
+
+// All arenas, walked by memGetStatistics
+static tfrg_atomic32_t gArenaListLock_Atomic;
+static Arena*          gArenaList;
+
+// Arenas created by tf_arena_thread, the ones in gFreeThreadArenas belong to exited threads
+static Arena** gThreadArenas;
+static Arena** gFreeThreadArenas;
+
+static tfrg_atomic64_t     gArenaFrameIndex_Atomic;
+static THREAD_LOCAL Arena* gThreadArena;
+
+// Incremented by tf_arena_exit_threads. Threads still running keep a pointer to their freed arena, it is dropped
+// when the epoch it was taken in is over.
+static tfrg_atomic32_t       gThreadArenaEpoch_Atomic;
+static THREAD_LOCAL uint32_t gThreadArenaEpoch;
+
+static inline void lockArenaList(void)
+{
+    while (tfrg_atomic32_load_relaxed(&gArenaListLock_Atomic) || tfrg_atomic32_cas_relaxed(&gArenaListLock_Atomic, 0, 1) != 0)
+        tfrg_cpu_relax();
+}
+
+static inline void unlockArenaList(void) { tfrg_atomic32_store_release(&gArenaListLock_Atomic, 0); }
+
+// Arena of the calling thread, NULL if it has none yet or it was freed by tf_arena_exit_threads
+static inline Arena* currentThreadArena(void)
+{
+    if (gThreadArena && gThreadArenaEpoch != tfrg_atomic32_load_acquire(&gThreadArenaEpoch_Atomic))
+        gThreadArena = NULL;
+    return gThreadArena;
+}
+
+static inline uint8_t* blockData(ArenaBlock* pBlock) { return (uint8_t*)pBlock + ARENA_BLOCK_HEADER_SIZE; }
+
+static ArenaBlock* allocBlock(Arena* pArena, size_t size)
+{
+    ArenaBlock* pBlock = (ArenaBlock*)tf_memalign(ARENA_BLOCK_ALIGNMENT, ARENA_BLOCK_HEADER_SIZE + size);
+    if (!pBlock)
+        return NULL;
+    pBlock->pNext = NULL;
+    pBlock->size = size;
+    tfrg_atomic64_add_relaxed(&pArena->reservedMemory_Atomic, size);
+    return pBlock;
+}
+
+static void freeBlocks(Arena* pArena)
+{
+    ArenaBlock* pBlock = pArena->pFirst;
+    while (pBlock)
+    {
+        ArenaBlock* pNext = pBlock->pNext;
+        tfrg_atomic64_add_relaxed(&pArena->reservedMemory_Atomic, (uint64_t)0 - pBlock->size);
+        tf_free(pBlock);
+        pBlock = pNext;
+    }
+    pArena->pFirst = NULL;
+}
+
+static inline void setCurrentBlock(Arena* pArena, ArenaBlock* pBlock, uint8_t* pCursor)
+{
+    pArena->pCurrent = pBlock;
+    pArena->pCursor = pCursor;
+    pArena->pEnd = pBlock ? blockData(pBlock) + pBlock->size : NULL;
+}
+
+static inline void updateHighWaterMark(Arena* pArena) { tfrg_atomic64_max_relaxed(&pArena->highWaterMark_Atomic, tf_arena_used(pArena)); }
+
+void tf_arena_init(Arena* pArena, const ArenaDesc* pDesc)
+{
+    ASSERT(pArena && pDesc);
+    memset(pArena, 0, sizeof *pArena);
+    pArena->blockSize = pDesc->blockSize ? pDesc->blockSize : ARENA_DEFAULT_BLOCK_SIZE;
+    pArena->pName = pDesc->pName;
+
+    lockArenaList();
+    pArena->pNext = gArenaList;
+    gArenaList = pArena;
+    unlockArenaList();
+}
+
+void tf_arena_exit(Arena* pArena)
+{
+    lockArenaList();
+    Arena** ppArena = &gArenaList;
+    while (*ppArena && *ppArena != pArena)
+        ppArena = &(*ppArena)->pNext;
+    ASSERT(*ppArena && "Arena was not initialized");
+    if (*ppArena)
+        *ppArena = pArena->pNext;
+    unlockArenaList();
+
+    freeBlocks(pArena);
+    setCurrentBlock(pArena, NULL, NULL);
+    pArena->previousBlocksUsed = 0;
+}
+
+void* tf_arena_alloc_slow(Arena* pArena, size_t size, size_t align)
+{
+    ASSERT(align && !(align & (align - 1)) && "Alignment has to be a power of two");
+    updateHighWaterMark(pArena);
+
+    // Space needed at the start of an empty block
+    size_t required = size + (align > ARENA_BLOCK_ALIGNMENT ? align - ARENA_BLOCK_ALIGNMENT : 0);
+
+    // Blocks after the current one are left over from before the last pop or reset
+    ArenaBlock* pPrev = pArena->pCurrent;
+    ArenaBlock* pBlock = pPrev ? pPrev->pNext : pArena->pFirst;
+    if (!pBlock || pBlock->size < required)
+    {
+        ArenaBlock* pNewBlock = allocBlock(pArena, TF_MAX(pArena->blockSize, required));
+        if (!pNewBlock)
+            return NULL;
+        pNewBlock->pNext = pBlock;
+        if (pPrev)
+            pPrev->pNext = pNewBlock;
+        else
+            pArena->pFirst = pNewBlock;
+        pBlock = pNewBlock;
+    }
+
+    if (pPrev)
+        pArena->previousBlocksUsed += (size_t)(pArena->pCursor - blockData(pPrev));
+    setCurrentBlock(pArena, pBlock, blockData(pBlock));
+    return tf_arena_alloc(pArena, size, align);
+}
+
+void* tf_arena_calloc(Arena* pArena, size_t count, size_t size, size_t align)
+{
+    if (size && count > SIZE_MAX / size)
+        return NULL;
+    void* ptr = tf_arena_alloc(pArena, count * size, align);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void tf_arena_pop(Arena* pArena, ArenaMarker marker)
+{
+    updateHighWaterMark(pArena);
+    if (marker.pBlock)
+    {
+        setCurrentBlock(pArena, marker.pBlock, marker.pCursor);
+        pArena->previousBlocksUsed = marker.previousBlocksUsed;
+    }
+    else
+    {
+        // Marker was taken before anything was allocated
+        setCurrentBlock(pArena, pArena->pFirst, pArena->pFirst ? blockData(pArena->pFirst) : NULL);
+        pArena->previousBlocksUsed = 0;
+    }
+}
+
+void tf_arena_reset(Arena* pArena)
+{
+    updateHighWaterMark(pArena);
+    size_t used = tf_arena_used(pArena);
+
+    // Usage spilled over into other blocks, replace them with a single one so that the next use is contiguous
+    if (pArena->pFirst && pArena->pCurrent != pArena->pFirst)
+    {
+        freeBlocks(pArena);
+        pArena->pFirst = allocBlock(pArena, TF_MAX(ARENA_ROUND_UP(used, pArena->blockSize), pArena->blockSize));
+    }
+
+    setCurrentBlock(pArena, pArena->pFirst, pArena->pFirst ? blockData(pArena->pFirst) : NULL);
+    pArena->previousBlocksUsed = 0;
+}
+
+size_t tf_arena_used(const Arena* pArena)
+{
+    size_t used = pArena->previousBlocksUsed;
+    if (pArena->pCurrent)
+        used += (size_t)(pArena->pCursor - blockData(pArena->pCurrent));
+    return used;
+}
+
+Arena* tf_arena_thread(void)
+{
+    Arena* pArena = currentThreadArena();
+    if (!pArena)
+    {
+        lockArenaList();
+        uint32_t epoch = tfrg_atomic32_load_relaxed(&gThreadArenaEpoch_Atomic);
+        if (arrlen(gFreeThreadArenas))
+            pArena = arrpop(gFreeThreadArenas);
+        unlockArenaList();
+
+        if (!pArena)
+        {
+            pArena = (Arena*)tf_malloc(sizeof(Arena));
+            if (!pArena)
+                return NULL;
+            ArenaDesc desc = { "Thread arena", 0 };
+            tf_arena_init(pArena, &desc);
+            lockArenaList();
+            arrpush(gThreadArenas, pArena);
+            unlockArenaList();
+        }
+        gThreadArena = pArena;
+        gThreadArenaEpoch = epoch;
+    }
+
+    uint64_t frameIndex = tfrg_atomic64_load_relaxed(&gArenaFrameIndex_Atomic);
+    if (pArena->frameIndex != frameIndex)
+    {
+        tf_arena_reset(pArena);
+        pArena->frameIndex = frameIndex;
+    }
+    return pArena;
+}
+
+void tf_arena_next_frame(void) { tfrg_atomic64_add_relaxed(&gArenaFrameIndex_Atomic, 1); }
+
+void tf_arena_thread_exit(void)
+{
+    Arena* pArena = currentThreadArena();
+    if (!pArena)
+        return;
+    gThreadArena = NULL;
+    tf_arena_reset(pArena);
+
+    lockArenaList();
+    arrpush(gFreeThreadArenas, pArena);
+    unlockArenaList();
+}
+
+void tf_arena_exit_threads(void)
+{
+    lockArenaList();
+    tfrg_atomic32_add_relaxed(&gThreadArenaEpoch_Atomic, 1);
+    Arena** ppArenas = gThreadArenas;
+    gThreadArenas = NULL;
+    arrfree(gFreeThreadArenas);
+    unlockArenaList();
+
+    for (ptrdiff_t i = 0; i < arrlen(ppArenas); ++i)
+    {
+        tf_arena_exit(ppArenas[i]);
+        tf_free(ppArenas[i]);
+    }
+    arrfree(ppArenas);
+    gThreadArena = NULL;
+}
+
+void tf_arena_add_statistics(MemoryStatistics* pStats)
+{
+    lockArenaList();
+    for (Arena* pArena = gArenaList; pArena; pArena = pArena->pNext)
+    {
+        ++pStats->arenaCount;
+        pStats->arenaReservedMemory += tfrg_atomic64_load_relaxed(&pArena->reservedMemory_Atomic);
+        pStats->arenaPeakMemory += tfrg_atomic64_load_relaxed(&pArena->highWaterMark_Atomic);
+    }
+    unlockArenaList();
+}
@@ -0,0 +1,172 @@
+#pragma once
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <Core/IConfig.h>
+
+#include "../Threading/Atomics.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#else
+#include <stdbool.h>
+#endif
+
+    // Linear allocator for transient data.
+    // Allocation only bumps a pointer, memory is given back all at once with tf_arena_pop or tf_arena_reset.
+    // Arena is not thread safe, tf_arena_thread() returns scratch arena of the calling thread.
+
+    typedef struct ArenaBlock ArenaBlock;
+
+    typedef struct Arena
+    {
+        ArenaBlock* pFirst;
+        ArenaBlock* pCurrent;
+        // Free range of pCurrent
+        uint8_t*    pCursor;
+        uint8_t*    pEnd;
+        // Bytes used in blocks preceding pCurrent
+        size_t      previousBlocksUsed;
+        // Minimal size of a block, larger allocations get a block of their own
+        size_t      blockSize;
+        const char* pName;
+
+        // Frame of the last reset, only used by thread arenas
+        uint64_t      frameIndex;
+        struct Arena* pNext;
+
+        // Read by memGetStatistics from other threads
+        tfrg_atomic64_t reservedMemory_Atomic;
+        // Maximum of used memory since tf_arena_init. Updated when memory is given back or a new block is needed.
+        tfrg_atomic64_t highWaterMark_Atomic;
+    } Arena;
+
+    // Position in the arena, tf_arena_pop frees everything allocated after the marker was taken
+    typedef struct ArenaMarker
+    {
+        ArenaBlock* pBlock;
+        uint8_t*    pCursor;
+        size_t      previousBlocksUsed;
+    } ArenaMarker;
+
+    typedef struct ArenaDesc
+    {
+        // Shows up in memory statistics
+        const char* pName;
+        // 0 picks ARENA_DEFAULT_BLOCK_SIZE
+        size_t      blockSize;
+    } ArenaDesc;
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+    FORGE_API void tf_arena_init(Arena* pArena, const ArenaDesc* pDesc);
+    FORGE_API void tf_arena_exit(Arena* pArena);
+
+    // Called when the current block can't fit the allocation, use tf_arena_alloc instead
+    FORGE_API void* tf_arena_alloc_slow(Arena* pArena, size_t size, size_t align);
+
+    // 'align' has to be a power of two
+    static inline void* tf_arena_alloc(Arena* pArena, size_t size, size_t align)
+    {
+        uintptr_t ptr = ((uintptr_t)pArena->pCursor + (align - 1)) & ~(uintptr_t)(align - 1);
+        uintptr_t end = (uintptr_t)pArena->pEnd;
+        if (ptr > end || end - ptr < size)
+            return tf_arena_alloc_slow(pArena, size, align);
+        pArena->pCursor = (uint8_t*)(ptr + size);
+        return (void*)ptr;
+    }
+
+    FORGE_API void* tf_arena_calloc(Arena* pArena, size_t count, size_t size, size_t align);
+
+    static inline ArenaMarker tf_arena_push(Arena* pArena)
+    {
+        ArenaMarker marker = { pArena->pCurrent, pArena->pCursor, pArena->previousBlocksUsed };
+        return marker;
+    }
+
+    FORGE_API void tf_arena_pop(Arena* pArena, ArenaMarker marker);
+
+    // Frees everything allocated from the arena but keeps the memory for reuse.
+    // If the last use didn't fit a single block, blocks are merged into one large enough for it.
+    FORGE_API void tf_arena_reset(Arena* pArena);
+
+    // Bytes allocated since the last reset, including alignment padding
+    FORGE_API size_t tf_arena_used(const Arena* pArena);
+
+    // Scratch arena of the calling thread, it is reset on first use after tf_arena_next_frame.
+    // Memory allocated from it stays valid until the end of the frame. NULL if the arena can't be allocated.
+    FORGE_API Arena* tf_arena_thread(void);
+
+    // Marks the end of a frame for all thread arenas. Called once per frame by updateBaseSubsystems.
+    // Programs without the application loop (tools, tests) have to call it at their own reset point,
+    // otherwise thread arenas are never reset.
+    FORGE_API void tf_arena_next_frame(void);
+
+    // Hands arena of the calling thread over to the next thread which needs one, called on thread exit
+    FORGE_API void tf_arena_thread_exit(void);
+
+    // Frees all thread arenas, called by exitMemAlloc. Threads still running get a new arena from tf_arena_thread,
+    // they must not use memory of the old one or call tf_arena_thread concurrently with this.
+    FORGE_API void tf_arena_exit_threads(void);
+
+    struct MemoryStatistics;
+    // Adds arena counters to 'pStats', called by memGetStatistics
+    FORGE_API void tf_arena_add_statistics(struct MemoryStatistics* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+// Frees everything allocated from the arena within the scope
+class ArenaScope
+{
+    Arena*      pArena;
+    ArenaMarker marker;
+
+public:
+    explicit ArenaScope(Arena* arena): pArena(arena), marker(tf_arena_push(arena)) {}
+
+    ~ArenaScope() { tf_arena_pop(pArena, marker); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    Arena* arena() const { return pArena; }
+
+    template<typename T>
+    T* alloc(size_t count) const
+    {
+        return (T*)tf_arena_alloc(pArena, sizeof(T) * count, alignof(T));
+    }
+
+    template<typename T>
+    T* allocZeroed(size_t count) const
+    {
+        return (T*)tf_arena_calloc(pArena, count, sizeof(T), alignof(T));
+    }
+};
+#endif
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "Pool.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <Core/ILog.h>
+
+#include <Core/IMemory.h>
+
+// Element index is (chunk index << POOL_CHUNK_INDEX_SHIFT) | index in chunk
+#define POOL_CHUNK_INDEX_SHIFT   16
+#define POOL_MAX_CHUNK_ELEMENTS  (1u << POOL_CHUNK_INDEX_SHIFT)
+// Default chunk holds at least this many elements, and at least POOL_MIN_CHUNK_SIZE bytes
+#define POOL_MIN_CHUNK_ELEMENTS  64
+#define POOL_MIN_CHUNK_SIZE      (16 * 1024)
+#define POOL_DEFAULT_ALIGNMENT   16
+#define POOL_ALIGN_UP(size, to)  (((size) + (to)-1) & ~((size_t)(to)-1))
+
+// Stored at the start of every chunk
+typedef struct PoolChunk
+{
+    uint32_t index;
+} PoolChunk;
+
+// All pools, walked by memGetStatistics
+static tfrg_atomic32_t gPoolListLock_Atomic;
+static Pool*           gPoolList;
+
+static inline void spinLock(tfrg_atomic32_t* pLock)
+{
+    while (tfrg_atomic32_load_relaxed(pLock) || tfrg_atomic32_cas_relaxed(pLock, 0, 1) != 0)
+        tfrg_cpu_relax();
+}
+
+static inline void spinUnlock(tfrg_atomic32_t* pLock) { tfrg_atomic32_store_release(pLock, 0); }
+
+static inline size_t nextPowerOfTwo(size_t value)
+{
+    size_t result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+static inline uint8_t* getElement(Pool* pPool, uint32_t index)
+{
+    uint8_t* pChunk = pPool->ppChunks[index >> POOL_CHUNK_INDEX_SHIFT];
+    return pChunk + pPool->chunkHeaderSize + (size_t)(index & (POOL_MAX_CHUNK_ELEMENTS - 1)) * pPool->elementStride;
+}
+
+// Free elements store index + 1 of the next free element in their first bytes
+static inline uint32_t loadNext(const uint8_t* pElement) { return *(const volatile uint32_t*)pElement; }
+
+static inline void storeNext(uint8_t* pElement, uint32_t next) { *(volatile uint32_t*)pElement = next; }
+
+// Pushes list of elements starting at 'first' (index + 1) and ending with 'pLast'
+static void pushFreeList(Pool* pPool, uint32_t first, uint8_t* pLast)
+{
+    for (;;)
+    {
+        uint64_t head = tfrg_atomic64_load_relaxed(&pPool->freeList_Atomic);
+        storeNext(pLast, (uint32_t)head);
+        uint64_t newHead = (((head >> 32) + 1) << 32) | first;
+        if ((uint64_t)tfrg_atomic64_cas_relaxed(&pPool->freeList_Atomic, head, newHead) == head)
+            return;
+    }
+}
+
+static bool addChunk(Pool* pPool)
+{
+    spinLock(&pPool->chunkLock_Atomic);
+
+    // Another thread might have added a chunk or freed elements in the meantime
+    if ((uint32_t)tfrg_atomic64_load_relaxed(&pPool->freeList_Atomic))
+    {
+        spinUnlock(&pPool->chunkLock_Atomic);
+        return true;
+    }
+
+    uint32_t chunkIndex = tfrg_atomic32_load_relaxed(&pPool->chunkCount_Atomic);
+    if (chunkIndex == pPool->maxChunkCount)
+    {
+        spinUnlock(&pPool->chunkLock_Atomic);
+        return false;
+    }
+
+    uint8_t* pChunk = (uint8_t*)tf_memalign(pPool->chunkSize, pPool->chunkSize);
+    if (!pChunk)
+    {
+        spinUnlock(&pPool->chunkLock_Atomic);
+        return false;
+    }
+    ((PoolChunk*)pChunk)->index = chunkIndex;
+    pPool->ppChunks[chunkIndex] = pChunk;
+    tfrg_atomic32_store_release(&pPool->chunkCount_Atomic, chunkIndex + 1);
+
+    // Link elements of the chunk and publish them all at once
+    uint32_t firstIndex = chunkIndex << POOL_CHUNK_INDEX_SHIFT;
+    for (uint32_t i = 0; i + 1 < pPool->elementsPerChunk; ++i)
+        storeNext(getElement(pPool, firstIndex + i), firstIndex + i + 2);
+    pushFreeList(pPool, firstIndex + 1, getElement(pPool, firstIndex + pPool->elementsPerChunk - 1));
+
+    spinUnlock(&pPool->chunkLock_Atomic);
+    return true;
+}
+
+bool tf_pool_init(Pool* pPool, const PoolDesc* pDesc)
+{
+    ASSERT(pPool && pDesc && pDesc->elementSize);
+    memset(pPool, 0, sizeof *pPool);
+
+    uint32_t alignment = pDesc->elementAlignment ? pDesc->elementAlignment : POOL_DEFAULT_ALIGNMENT;
+    ASSERT(!(alignment & (alignment - 1)) && "Alignment has to be a power of two");
+    // Free elements hold index of the next one
+    pPool->elementSize = pDesc->elementSize;
+    pPool->elementStride = (uint32_t)POOL_ALIGN_UP(TF_MAX(pDesc->elementSize, (uint32_t)sizeof(uint32_t)), alignment);
+    pPool->chunkHeaderSize = (uint32_t)POOL_ALIGN_UP(sizeof(PoolChunk), alignment);
+
+    size_t elementsPerChunk = pDesc->elementsPerChunk;
+    if (!elementsPerChunk)
+        elementsPerChunk = TF_MAX(POOL_MIN_CHUNK_ELEMENTS, POOL_MIN_CHUNK_SIZE / pPool->elementStride);
+    elementsPerChunk = TF_MIN(elementsPerChunk, POOL_MAX_CHUNK_ELEMENTS);
+    pPool->chunkSize = nextPowerOfTwo(pPool->chunkHeaderSize + elementsPerChunk * pPool->elementStride);
+    // Rest of the power of two chunk is filled with elements as well
+    pPool->elementsPerChunk =
+        (uint32_t)TF_MIN((pPool->chunkSize - pPool->chunkHeaderSize) / pPool->elementStride, (size_t)POOL_MAX_CHUNK_ELEMENTS);
+
+    pPool->maxChunkCount = POOL_MAX_CHUNK_COUNT;
+    if (pDesc->maxElementCount)
+        pPool->maxChunkCount =
+            TF_MIN((pDesc->maxElementCount + pPool->elementsPerChunk - 1) / pPool->elementsPerChunk, (uint32_t)POOL_MAX_CHUNK_COUNT);
+    pPool->ppChunks = (uint8_t**)tf_calloc(pPool->maxChunkCount, sizeof(uint8_t*));
+    if (!pPool->ppChunks)
+    {
+        // tf_pool_alloc of a pool which failed to initialize returns NULL
+        pPool->maxChunkCount = 0;
+        return false;
+    }
+    pPool->pName = pDesc->pName;
+
+    spinLock(&gPoolListLock_Atomic);
+    pPool->pNext = gPoolList;
+    gPoolList = pPool;
+    spinUnlock(&gPoolListLock_Atomic);
+    return true;
+}
+
+void tf_pool_exit(Pool* pPool)
+{
+    if (!pPool->ppChunks)
+        return;
+
+    spinLock(&gPoolListLock_Atomic);
+    Pool** ppPool = &gPoolList;
+    while (*ppPool && *ppPool != pPool)
+        ppPool = &(*ppPool)->pNext;
+    if (*ppPool)
+        *ppPool = pPool->pNext;
+    spinUnlock(&gPoolListLock_Atomic);
+
+    uint32_t chunkCount = tfrg_atomic32_load_relaxed(&pPool->chunkCount_Atomic);
+    for (uint32_t i = 0; i < chunkCount; ++i)
+        tf_free(pPool->ppChunks[i]);
+    tf_free(pPool->ppChunks);
+    pPool->ppChunks = NULL;
+    pPool->freeList_Atomic = 0;
+    pPool->chunkCount_Atomic = 0;
+    pPool->usedCount_Atomic = 0;
+}
+
+void* tf_pool_alloc(Pool* pPool)
+{
+    for (;;)
+    {
+        uint64_t head = tfrg_atomic64_load_acquire(&pPool->freeList_Atomic);
+        uint32_t first = (uint32_t)head;
+        if (!first)
+        {
+            if (!addChunk(pPool))
+                return NULL;
+            continue;
+        }
+
+        // Element might be taken by another thread before the exchange, the tag makes the exchange fail then
+        uint8_t* pElement = getElement(pPool, first - 1);
+        uint64_t newHead = (((head >> 32) + 1) << 32) | loadNext(pElement);
+        if ((uint64_t)tfrg_atomic64_cas_relaxed(&pPool->freeList_Atomic, head, newHead) == head)
+        {
+            uint32_t usedCount = tfrg_atomic32_add_relaxed(&pPool->usedCount_Atomic, 1) + 1;
+            if (usedCount > tfrg_atomic32_load_relaxed(&pPool->peakUsedCount_Atomic))
+                tfrg_atomic32_max_relaxed(&pPool->peakUsedCount_Atomic, usedCount);
+            return pElement;
+        }
+    }
+}
+
+void tf_pool_free(Pool* pPool, void* ptr)
+{
+    if (!ptr)
+        return;
+
+    uint8_t*  pElement = (uint8_t*)ptr;
+    uint8_t*  pChunk = (uint8_t*)((uintptr_t)pElement & ~(uintptr_t)(pPool->chunkSize - 1));
+    uint32_t  chunkIndex = ((PoolChunk*)pChunk)->index;
+    ptrdiff_t offset = pElement - pChunk - pPool->chunkHeaderSize;
+    ASSERT(chunkIndex < tfrg_atomic32_load_relaxed(&pPool->chunkCount_Atomic) && pPool->ppChunks[chunkIndex] == pChunk &&
+           "Element doesn't belong to the pool");
+    ASSERT(offset >= 0 && offset % pPool->elementStride == 0 && "Pointer to the middle of an element");
+
+    uint32_t index = (chunkIndex << POOL_CHUNK_INDEX_SHIFT) | (uint32_t)(offset / pPool->elementStride);
+    tfrg_atomic32_add_relaxed(&pPool->usedCount_Atomic, -1);
+    pushFreeList(pPool, index + 1, pElement);
+}
+
+void tf_pool_add_statistics(MemoryStatistics* pStats)
+{
+    spinLock(&gPoolListLock_Atomic);
+    for (Pool* pPool = gPoolList; pPool; pPool = pPool->pNext)
+    {
+        uint32_t chunkCount = tfrg_atomic32_load_relaxed(&pPool->chunkCount_Atomic);
+        pStats->poolReservedMemory += (uint64_t)chunkCount * pPool->chunkSize;
+        if (pStats->poolCount < MEMORY_STATISTICS_MAX_POOLS)
+        {
+            PoolStatistics* pPoolStats = &pStats->pools[pStats->poolCount];
+            pPoolStats->pName = pPool->pName;
+            pPoolStats->elementSize = pPool->elementSize;
+            pPoolStats->usedCount = tfrg_atomic32_load_relaxed(&pPool->usedCount_Atomic);
+            pPoolStats->peakUsedCount = tfrg_atomic32_load_relaxed(&pPool->peakUsedCount_Atomic);
+            pPoolStats->capacity = chunkCount * pPool->elementsPerChunk;
+        }
+        ++pStats->poolCount;
+    }
+    spinUnlock(&gPoolListLock_Atomic);
+}
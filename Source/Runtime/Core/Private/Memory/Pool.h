@@ -0,0 +1,144 @@
+#pragma once
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <Core/IConfig.h>
+
+#include "../Threading/Atomics.h"
+
+#ifdef __cplusplus
+#include <new>
+#include <utility> // std::forward only
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#else
+#include <stdbool.h>
+#endif
+
+    // Allocator of elements of a single size.
+    // Elements are carved from chunks which are never moved or freed before tf_pool_exit.
+    // tf_pool_alloc and tf_pool_free are lock-free and can be called from any thread,
+    // a lock is only taken when all chunks are full and a new one has to be allocated.
+    typedef struct Pool
+    {
+        // (tag << 32) | (index + 1) of the first free element, tag changes on every update
+        tfrg_atomic64_t freeList_Atomic;
+        tfrg_atomic32_t usedCount_Atomic;
+        tfrg_atomic32_t peakUsedCount_Atomic;
+
+        // Guards chunk allocation
+        tfrg_atomic32_t chunkLock_Atomic;
+        tfrg_atomic32_t chunkCount_Atomic;
+        uint8_t**       ppChunks;
+        uint32_t        maxChunkCount;
+
+        // Chunks are aligned to their size, so that the chunk of an element is found by masking its address
+        size_t   chunkSize;
+        uint32_t chunkHeaderSize;
+        uint32_t elementsPerChunk;
+        uint32_t elementSize;
+        uint32_t elementStride;
+
+        const char*  pName;
+        struct Pool* pNext;
+    } Pool;
+
+    typedef struct PoolDesc
+    {
+        // Shows up in memory statistics
+        const char* pName;
+        uint32_t    elementSize;
+        // 0 picks default alignment of tf_malloc
+        uint32_t    elementAlignment;
+        // Elements allocated at once, rounded up to fill the chunk. 0 picks a count based on element size.
+        uint32_t    elementsPerChunk;
+        // Limits the number of chunks, rounded up so that whole chunks fit: tf_pool_alloc fails once the pool holds
+        // maxElementCount rounded up to a multiple of elements per chunk. 0 means no limit besides POOL_MAX_CHUNK_COUNT chunks.
+        uint32_t    maxElementCount;
+    } PoolDesc;
+
+#define POOL_MAX_CHUNK_COUNT 4096
+
+    FORGE_API bool tf_pool_init(Pool* pPool, const PoolDesc* pDesc);
+    // All elements are freed, destructors of elements are not called
+    FORGE_API void tf_pool_exit(Pool* pPool);
+
+    // Returns NULL if the pool is full or failed to initialize
+    FORGE_API void* tf_pool_alloc(Pool* pPool);
+    FORGE_API void  tf_pool_free(Pool* pPool, void* ptr);
+
+    struct MemoryStatistics;
+    // Adds pool counters to 'pStats', called by memGetStatistics
+    FORGE_API void tf_pool_add_statistics(struct MemoryStatistics* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+// Pool of objects of type T, constructors and destructors are called by create and destroy
+template<typename T>
+class ObjectPool
+{
+    Pool pool;
+    bool initialized;
+
+public:
+    explicit ObjectPool(const char* name, uint32_t elementsPerChunk = 0, uint32_t maxElementCount = 0)
+    {
+        PoolDesc desc = { name, (uint32_t)sizeof(T), (uint32_t)alignof(T), elementsPerChunk, maxElementCount };
+        initialized = tf_pool_init(&pool, &desc);
+    }
+
+    ~ObjectPool() { tf_pool_exit(&pool); }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    template<typename... Args>
+    T* create(Args&&... args)
+    {
+        void* ptr = tf_pool_alloc(&pool);
+        return ptr ? new (ptr) T(std::forward<Args>(args)...) : NULL;
+    }
+
+    void destroy(T* ptr)
+    {
+        if (ptr)
+        {
+            ptr->~T();
+            tf_pool_free(&pool, ptr);
+        }
+    }
+
+    // create always returns NULL when the pool failed to initialize
+    bool isInitialized() const { return initialized; }
+
+    uint32_t usedCount() const { return tfrg_atomic32_load_relaxed(&pool.usedCount_Atomic); }
+};
+#endif
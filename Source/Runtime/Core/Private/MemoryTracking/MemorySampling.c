@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "MemorySampling.h"
+
+#if defined(ENABLE_MEMORY_SAMPLING) && !defined(ENABLE_MEMORY_TRACKING)
+
+#include <math.h>
+#include <string.h>
+
+#if defined(_WINDOWS) || defined(XBOX)
+#include <windows.h>
+#define MEMORY_SAMPLING_WINDOWS_CALLSTACK
+#elif defined(__linux__) || defined(__APPLE__) || defined(__ANDROID__)
+#include <unwind.h>
+#define MEMORY_SAMPLING_UNWIND_CALLSTACK
+#endif
+
+#include <Core/IThread.h>
+
+#include "../Threading/Atomics.h"
+
+#include <Core/IMemory.h>
+// Sampler tables come from the system allocator, tf_malloc would sample itself
+#include "NoMemoryDefines.h"
+
+// Live sampled allocations, samples past this count are dropped
+#define MEMORY_SAMPLING_MAX_SAMPLES (1u << 16)
+#define MEMORY_SAMPLING_BUCKETS     (1u << MEMORY_SAMPLING_FILTER_BITS)
+#define MEMORY_SAMPLING_MAX_SITES   4096u
+// Frames of memSamplingAllocSlow and tf_*_internal
+#define MEMORY_SAMPLING_SKIP_FRAMES 2u
+#define MEMORY_SAMPLING_INVALID     UINT32_MAX
+
+typedef struct MemorySample
+{
+    void*    ptr;
+    uint64_t estimatedMemory;
+    uint64_t estimatedCount;
+    uint32_t siteIndex;
+    // Next sample in the same bucket, or next free sample
+    uint32_t next;
+} MemorySample;
+
+typedef struct MemorySamplingSite
+{
+    MemorySampleSite info;
+    uint64_t         hash;
+} MemorySamplingSite;
+
+typedef struct MemorySampler
+{
+    Mutex mutex;
+
+    MemorySample* pSamples;
+    uint32_t*     pSampleBuckets;
+    uint32_t      freeSample;
+
+    // Open addressing by site hash, info.frameCount == UINT32_MAX marks empty slots
+    MemorySamplingSite* pSites;
+    uint32_t            siteCount;
+
+    uint64_t liveMemory;
+    uint64_t accumulatedMemory;
+    uint64_t droppedSampleCount;
+} MemorySampler;
+
+THREAD_LOCAL int64_t gMemSamplingBytesLeft;
+uint64_t             gMemSamplingFilter[(1 << MEMORY_SAMPLING_FILTER_BITS) / 64];
+
+static THREAD_LOCAL uint64_t gSamplingRandom;
+
+static MemorySampler*  gSampler;
+static tfrg_atomic64_t gSamplingInterval_Atomic = MEMORY_SAMPLING_INTERVAL;
+
+// Distance to the next sample, exponentially distributed with mean 'interval'
+static int64_t nextSampleDistance(uint64_t interval)
+{
+    if (!gSamplingRandom)
+        gSamplingRandom = ((uint64_t)(uintptr_t)&gSamplingRandom * 0x9E3779B97F4A7C15ull) | 1;
+    // xorshift64*
+    gSamplingRandom ^= gSamplingRandom >> 12;
+    gSamplingRandom ^= gSamplingRandom << 25;
+    gSamplingRandom ^= gSamplingRandom >> 27;
+    // Uniform in (0, 1]
+    double uniform = (double)((gSamplingRandom * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+    return (int64_t)(-log(1.0 - uniform) * (double)interval) + 1;
+}
+
+static uint32_t captureCallstack(void** pFrames, uint32_t maxFrameCount);
+
+#if defined(MEMORY_SAMPLING_UNWIND_CALLSTACK)
+typedef struct UnwindState
+{
+    void**   pFrames;
+    uint32_t frameCount;
+    uint32_t skipCount;
+    uint32_t maxFrameCount;
+} UnwindState;
+
+static _Unwind_Reason_Code unwindCallback(struct _Unwind_Context* pContext, void* pData)
+{
+    UnwindState* pState = (UnwindState*)pData;
+    uintptr_t    pc = _Unwind_GetIP(pContext);
+    if (!pc)
+        return _URC_END_OF_STACK;
+    if (pState->skipCount)
+    {
+        --pState->skipCount;
+        return _URC_NO_REASON;
+    }
+    pState->pFrames[pState->frameCount++] = (void*)pc;
+    return pState->frameCount == pState->maxFrameCount ? _URC_END_OF_STACK : _URC_NO_REASON;
+}
+
+static uint32_t captureCallstack(void** pFrames, uint32_t maxFrameCount)
+{
+    // One more frame for captureCallstack itself
+    UnwindState state = { pFrames, 0, MEMORY_SAMPLING_SKIP_FRAMES + 1, maxFrameCount };
+    _Unwind_Backtrace(unwindCallback, &state);
+    return state.frameCount;
+}
+#elif defined(MEMORY_SAMPLING_WINDOWS_CALLSTACK)
+static uint32_t captureCallstack(void** pFrames, uint32_t maxFrameCount)
+{
+    return RtlCaptureStackBackTrace(MEMORY_SAMPLING_SKIP_FRAMES + 1, maxFrameCount, pFrames, NULL);
+}
+#else
+// Sites are told apart by tf_malloc call site only
+static uint32_t captureCallstack(void** pFrames, uint32_t maxFrameCount)
+{
+    UNREF_PARAM(pFrames);
+    UNREF_PARAM(maxFrameCount);
+    return 0;
+}
+#endif
+
+static inline uint32_t sampleBucket(const void* ptr) { return memSamplingFilterIndex(ptr); }
+
+static uint64_t hashSite(const MemorySampleSite* pSite)
+{
+    // FNV-1a over the call site and the frames
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint64_t values[MEMORY_SAMPLE_MAX_FRAMES + 2] = { (uint64_t)(uintptr_t)pSite->pFile, pSite->line };
+    for (uint32_t i = 0; i < pSite->frameCount; ++i)
+        values[i + 2] = (uint64_t)(uintptr_t)pSite->pFrames[i];
+    const uint8_t* pBytes = (const uint8_t*)values;
+    for (size_t i = 0; i < (pSite->frameCount + 2) * sizeof(uint64_t); ++i)
+        hash = (hash ^ pBytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+static bool sameSite(const MemorySampleSite* pA, const MemorySampleSite* pB)
+{
+    return pA->pFile == pB->pFile && pA->line == pB->line && pA->frameCount == pB->frameCount &&
+           !memcmp(pA->pFrames, pB->pFrames, pA->frameCount * sizeof(void*));
+}
+
+// Returns index of the site matching 'pKey', adding it when missing. Called with the sampler mutex locked
+static uint32_t findSite(MemorySampler* pS, const MemorySampleSite* pKey, uint64_t hash)
+{
+    uint32_t index = (uint32_t)hash & (MEMORY_SAMPLING_MAX_SITES - 1);
+    for (uint32_t probe = 0; probe < MEMORY_SAMPLING_MAX_SITES; ++probe)
+    {
+        MemorySamplingSite* pSite = &pS->pSites[index];
+        if (pSite->info.frameCount == UINT32_MAX)
+        {
+            // Table is kept at most 3/4 full to keep probe sequences short
+            if (pS->siteCount >= MEMORY_SAMPLING_MAX_SITES / 4 * 3)
+                return MEMORY_SAMPLING_INVALID;
+            pSite->info = *pKey;
+            pSite->hash = hash;
+            ++pS->siteCount;
+            return index;
+        }
+        if (pSite->hash == hash && sameSite(&pSite->info, pKey))
+            return index;
+        index = (index + 1) & (MEMORY_SAMPLING_MAX_SITES - 1);
+    }
+    return MEMORY_SAMPLING_INVALID;
+}
+
+bool memSamplingInit(void)
+{
+    MemorySampler* pS = (MemorySampler*)calloc(1, sizeof(MemorySampler));
+    if (!pS)
+        return false;
+    pS->pSamples = (MemorySample*)malloc(MEMORY_SAMPLING_MAX_SAMPLES * sizeof(MemorySample));
+    pS->pSampleBuckets = (uint32_t*)malloc(MEMORY_SAMPLING_BUCKETS * sizeof(uint32_t));
+    pS->pSites = (MemorySamplingSite*)malloc(MEMORY_SAMPLING_MAX_SITES * sizeof(MemorySamplingSite));
+    if (!pS->pSamples || !pS->pSampleBuckets || !pS->pSites || !initMutex(&pS->mutex))
+    {
+        free(pS->pSamples);
+        free(pS->pSampleBuckets);
+        free(pS->pSites);
+        free(pS);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < MEMORY_SAMPLING_MAX_SAMPLES; ++i)
+        pS->pSamples[i].next = i + 1 < MEMORY_SAMPLING_MAX_SAMPLES ? i + 1 : MEMORY_SAMPLING_INVALID;
+    memset(pS->pSampleBuckets, 0xff, MEMORY_SAMPLING_BUCKETS * sizeof(uint32_t));
+    for (uint32_t i = 0; i < MEMORY_SAMPLING_MAX_SITES; ++i)
+        pS->pSites[i].info.frameCount = UINT32_MAX;
+
+    memset(gMemSamplingFilter, 0, sizeof(gMemSamplingFilter));
+    gSampler = pS;
+    return true;
+}
+
+void memSamplingExit(void)
+{
+    MemorySampler* pS = gSampler;
+    if (!pS)
+        return;
+    gSampler = NULL;
+    memset(gMemSamplingFilter, 0, sizeof(gMemSamplingFilter));
+    destroyMutex(&pS->mutex);
+    free(pS->pSamples);
+    free(pS->pSampleBuckets);
+    free(pS->pSites);
+    free(pS);
+}
+
+void memSamplingAllocSlow(void* ptr, size_t size, const char* f, int l, const char* sf)
+{
+    uint64_t interval = tfrg_atomic64_load_relaxed(&gSamplingInterval_Atomic);
+    if (!interval)
+    {
+        // Sampling stopped, check again after the default interval
+        gMemSamplingBytesLeft = MEMORY_SAMPLING_INTERVAL;
+        return;
+    }
+
+    // First allocation of the thread, countdown wasn't started yet
+    bool firstAlloc = !gSamplingRandom;
+    gMemSamplingBytesLeft += nextSampleDistance(interval);
+    if (firstAlloc && gMemSamplingBytesLeft >= 0)
+        return;
+    // Single sample even if the block covers several intervals, its weight accounts for that
+    if (gMemSamplingBytesLeft < 0)
+        gMemSamplingBytesLeft = nextSampleDistance(interval);
+
+    MemorySampler* pS = gSampler;
+    if (!pS)
+        return;
+
+    MemorySampleSite key;
+    memset(&key, 0, sizeof(key));
+    key.pFile = f;
+    key.pFunction = sf;
+    key.line = (uint32_t)l;
+    key.frameCount = captureCallstack(key.pFrames, MEMORY_SAMPLE_MAX_FRAMES);
+    uint64_t hash = hashSite(&key);
+
+    // Block of 'size' bytes is sampled with probability 1 - exp(-size / interval)
+    double   probability = -expm1(-(double)size / (double)interval);
+    uint64_t estimatedCount = probability > 0.0 ? (uint64_t)(1.0 / probability + 0.5) : 1;
+    uint64_t estimatedMemory = probability > 0.0 ? (uint64_t)((double)size / probability + 0.5) : size;
+
+    acquireMutex(&pS->mutex);
+    uint32_t siteIndex = findSite(pS, &key, hash);
+    uint32_t sampleIndex = pS->freeSample;
+    if (siteIndex == MEMORY_SAMPLING_INVALID || sampleIndex == MEMORY_SAMPLING_INVALID)
+    {
+        ++pS->droppedSampleCount;
+        releaseMutex(&pS->mutex);
+        return;
+    }
+
+    MemorySample* pSample = &pS->pSamples[sampleIndex];
+    pS->freeSample = pSample->next;
+    uint32_t bucket = sampleBucket(ptr);
+    pSample->ptr = ptr;
+    pSample->estimatedMemory = estimatedMemory;
+    pSample->estimatedCount = estimatedCount;
+    pSample->siteIndex = siteIndex;
+    pSample->next = pS->pSampleBuckets[bucket];
+    pS->pSampleBuckets[bucket] = sampleIndex;
+    // Only written with the mutex locked, tf_free reads it without
+    gMemSamplingFilter[bucket / 64] |= 1ull << (bucket % 64);
+
+    MemorySampleSite* pSite = &pS->pSites[siteIndex].info;
+    ++pSite->liveSampleCount;
+    pSite->liveMemory += estimatedMemory;
+    pSite->liveAllocCount += estimatedCount;
+    pSite->accumulatedMemory += estimatedMemory;
+    pS->liveMemory += estimatedMemory;
+    pS->accumulatedMemory += estimatedMemory;
+    releaseMutex(&pS->mutex);
+}
+
+void memSamplingFreeSlow(void* ptr)
+{
+    MemorySampler* pS = gSampler;
+    if (!pS)
+        return;
+
+    uint32_t bucket = sampleBucket(ptr);
+    acquireMutex(&pS->mutex);
+    // Filter entries are shared, the block might not be sampled.
+    // After a moved realloc another thread can sample the old address before its sample is removed,
+    // new samples go to the front of the bucket so the oldest one is removed.
+    uint32_t* pFound = NULL;
+    for (uint32_t* pIndex = &pS->pSampleBuckets[bucket]; *pIndex != MEMORY_SAMPLING_INVALID; pIndex = &pS->pSamples[*pIndex].next)
+    {
+        if (pS->pSamples[*pIndex].ptr == ptr)
+            pFound = pIndex;
+    }
+
+    if (pFound)
+    {
+        MemorySample*     pSample = &pS->pSamples[*pFound];
+        MemorySampleSite* pSite = &pS->pSites[pSample->siteIndex].info;
+        --pSite->liveSampleCount;
+        pSite->liveMemory -= pSample->estimatedMemory;
+        pSite->liveAllocCount -= pSample->estimatedCount;
+        pS->liveMemory -= pSample->estimatedMemory;
+
+        uint32_t sampleIndex = *pFound;
+        *pFound = pSample->next;
+        pSample->next = pS->freeSample;
+        pS->freeSample = sampleIndex;
+        if (pS->pSampleBuckets[bucket] == MEMORY_SAMPLING_INVALID)
+            gMemSamplingFilter[bucket / 64] &= ~(1ull << (bucket % 64));
+    }
+    releaseMutex(&pS->mutex);
+}
+
+void memSamplingAddStatistics(MemoryStatistics* pStats)
+{
+    MemorySampler* pS = gSampler;
+    if (!pS)
+        return;
+
+    acquireMutex(&pS->mutex);
+    pStats->sampledLiveMemory = pS->liveMemory;
+    pStats->sampledAccumulatedMemory = pS->accumulatedMemory;
+    pStats->sampledSiteCount = pS->siteCount;
+    pStats->droppedSampleCount = pS->droppedSampleCount;
+    releaseMutex(&pS->mutex);
+}
+
+static int compareSites(const void* pA, const void* pB)
+{
+    uint64_t a = ((const MemorySampleSite*)pA)->liveMemory;
+    uint64_t b = ((const MemorySampleSite*)pB)->liveMemory;
+    return a < b ? 1 : (a > b ? -1 : 0);
+}
+
+uint32_t memGetSampledSites(MemorySampleSite* pSites, uint32_t maxSiteCount)
+{
+    MemorySampler* pS = gSampler;
+    if (!pS || !pSites || !maxSiteCount)
+        return 0;
+
+    // Sort a copy so that the mutex isn't held while sorting
+    MemorySampleSite* pSorted = (MemorySampleSite*)malloc(MEMORY_SAMPLING_MAX_SITES * sizeof(MemorySampleSite));
+    if (!pSorted)
+        return 0;
+    uint32_t siteCount = 0;
+    acquireMutex(&pS->mutex);
+    for (uint32_t i = 0; i < MEMORY_SAMPLING_MAX_SITES; ++i)
+    {
+        if (pS->pSites[i].info.frameCount != UINT32_MAX)
+            pSorted[siteCount++] = pS->pSites[i].info;
+    }
+    releaseMutex(&pS->mutex);
+
+    qsort(pSorted, siteCount, sizeof(MemorySampleSite), compareSites);
+    siteCount = siteCount < maxSiteCount ? siteCount : maxSiteCount;
+    memcpy(pSites, pSorted, siteCount * sizeof(MemorySampleSite));
+    free(pSorted);
+    return siteCount;
+}
+
+void memSetSamplingInterval(uint64_t bytes) { tfrg_atomic64_store_relaxed(&gSamplingInterval_Atomic, bytes); }
+
+#else
+
+#include <Core/IMemory.h>
+
+uint32_t memGetSampledSites(MemorySampleSite* pSites, uint32_t maxSiteCount)
+{
+    UNREF_PARAM(pSites);
+    UNREF_PARAM(maxSiteCount);
+    return 0;
+}
+
+void memSetSamplingInterval(uint64_t bytes) { UNREF_PARAM(bytes); }
+
+#endif
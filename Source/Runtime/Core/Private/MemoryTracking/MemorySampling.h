@@ -0,0 +1,85 @@
+#pragma once
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Sampled heap profile, used by MemoryTracking.c with ENABLE_MEMORY_SAMPLING.
+//
+// Every thread counts down allocated bytes, the allocation crossing zero is sampled and the countdown restarts
+// from an exponentially distributed value with mean equal to the sampling interval. Allocations are thereby
+// sampled with probability 1 - exp(-size / interval), every sample stands for 1 / probability allocations of its size.
+// Sampled pointers are marked in a bitmap filter so that tf_free only takes the lock for (likely) sampled blocks.
+
+#include <Core/IConfig.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#else
+#include <stdbool.h>
+#endif
+
+// Default mean number of bytes between two samples
+#ifndef MEMORY_SAMPLING_INTERVAL
+#define MEMORY_SAMPLING_INTERVAL (512 * 1024)
+#endif
+
+#define MEMORY_SAMPLING_FILTER_BITS 16
+
+    struct MemoryStatistics;
+
+    extern THREAD_LOCAL int64_t gMemSamplingBytesLeft;
+    // Bit is set while any sampled block hashes to it, small enough to stay in L1
+    extern uint64_t             gMemSamplingFilter[(1 << MEMORY_SAMPLING_FILTER_BITS) / 64];
+
+    bool memSamplingInit(void);
+    void memSamplingExit(void);
+
+    void memSamplingAllocSlow(void* ptr, size_t size, const char* f, int l, const char* sf);
+    void memSamplingFreeSlow(void* ptr);
+
+    void memSamplingAddStatistics(struct MemoryStatistics* pStats);
+
+    static inline uint32_t memSamplingFilterIndex(const void* ptr)
+    {
+        return (uint32_t)((((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull) >> (64 - MEMORY_SAMPLING_FILTER_BITS));
+    }
+
+    static inline void memSamplingAlloc(void* ptr, size_t size, const char* f, int l, const char* sf)
+    {
+        gMemSamplingBytesLeft -= (int64_t)size;
+        if (gMemSamplingBytesLeft < 0 && ptr)
+            memSamplingAllocSlow(ptr, size, f, l, sf);
+    }
+
+    // Has to be called before the block is released, except by realloc which only knows afterwards whether it was released
+    static inline void memSamplingFree(void* ptr)
+    {
+        uint32_t index = memSamplingFilterIndex(ptr);
+        if (ptr && (gMemSamplingFilter[index / 64] & (1ull << (index % 64))))
+            memSamplingFreeSlow(ptr);
+    }
+
+#ifdef __cplusplus
+}
+#endif
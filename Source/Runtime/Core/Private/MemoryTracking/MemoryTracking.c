@@ -32,6 +32,13 @@
 #include <memory.h>
 #include <stdlib.h>
 
+#include <Core/IMemory.h>
+#include "NoMemoryDefines.h"
+
+#include "../Memory/Arena.h"
+#include "../Memory/Pool.h"
+#include "MemorySampling.h"
+
 //#include <Core/IMath.h>
 
 #define MEM_MAX(a, b)             ((a) > (b) ? (a) : (b))
@@ -69,6 +76,14 @@
 #define MTUNER_FREE(_handle, _ptr)
 #endif
 
+#if defined(ENABLE_MEMORY_SAMPLING) && !defined(ENABLE_MEMORY_TRACKING)
+#define MEM_SAMPLE_ALLOC(_ptr, _size, _f, _l, _sf) memSamplingAlloc((_ptr), (_size), (_f), (_l), (_sf))
+#define MEM_SAMPLE_FREE(_ptr)                      memSamplingFree(_ptr)
+#else
+#define MEM_SAMPLE_ALLOC(_ptr, _size, _f, _l, _sf)
+#define MEM_SAMPLE_FREE(_ptr)
+#endif
+
 #if defined(ENABLE_MEMORY_TRACKING)
 
 #define _CRT_SECURE_NO_WARNINGS 1
@@ -150,16 +165,73 @@ void tf_free_internal(void* ptr, const char* f, int l, const char* sf)
 
 #include "stdbool.h"
 
+#if defined(ENABLE_MIMALLOC)
+
+// mimalloc serves every thread from its own heap, so allocations don't contend with each other.
+// Blocks freed by another thread are handed back to the owning heap without taking a lock.
+#include <ThirdParty/mimalloc/include/mimalloc.h>
+
+#define MEM_MEMALIGN(align, size)               mi_malloc_aligned((size), (align))
+#define MEM_CALLOC_MEMALIGN(count, align, size) mi_calloc_aligned((count), (size), (align))
+#define MEM_REALLOC(ptr, size)                  mi_realloc_aligned((ptr), (size), MIN_ALLOC_ALIGNMENT)
+#define MEM_FREE(ptr)                           mi_free(ptr)
+
+#elif defined(_MSC_VER)
+
+#define MEM_MEMALIGN(align, size) _aligned_malloc((size), (align))
+#define MEM_REALLOC(ptr, size)    _aligned_realloc((ptr), (size), MIN_ALLOC_ALIGNMENT)
+#define MEM_FREE(ptr)             _aligned_free(ptr)
+
+#else
+
+static void* alignedAlloc(size_t align, size_t size)
+{
+    void* ptr = NULL;
+    // posix_memalign requires alignment to be a multiple of sizeof(void*)
+    return posix_memalign(&ptr, MEM_MAX(align, sizeof(void*)), size) == 0 ? ptr : NULL;
+}
+
+#define MEM_MEMALIGN(align, size) alignedAlloc((align), (size))
+#define MEM_REALLOC(ptr, size)    realloc((ptr), (size))
+#define MEM_FREE(ptr)             free(ptr)
+
+#endif
+
+#ifndef MEM_CALLOC_MEMALIGN
+static void* allocZeroed(size_t count, size_t align, size_t size)
+{
+    if (size && count > SIZE_MAX / size)
+        return NULL;
+    void* ptr = MEM_MEMALIGN(align, count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+#define MEM_CALLOC_MEMALIGN(count, align, size) allocZeroed((count), (align), (size))
+#endif
+
 bool initMemAlloc(const char* appName)
 {
     UNREF_PARAM(appName);
     // No op but this is where you would initialize your memory allocator and bookkeeping data in a real world scenario
+#if defined(ENABLE_MEMORY_SAMPLING)
+    return memSamplingInit();
+#else
     return true;
+#endif
 }
 
 void exitMemAlloc(void)
 {
     // Return all allocated memory to the OS. Analyze memory usage, dump memory leaks, ...
+    tf_arena_exit_threads();
+#if defined(ENABLE_MEMORY_SAMPLING)
+    memSamplingExit();
+#endif
+#if defined(ENABLE_MIMALLOC)
+    mi_collect(true);
+#endif
 }
 
 void* tf_malloc_internal(size_t size, const char* f, int l, const char* sf)
@@ -167,7 +239,9 @@ void* tf_malloc_internal(size_t size, const char* f, int l, const char* sf)
     UNREF_PARAM(f);
     UNREF_PARAM(l);
     UNREF_PARAM(sf);
-    return tf_malloc(size);
+    void* ptr = MEM_MEMALIGN(MIN_ALLOC_ALIGNMENT, size);
+    MEM_SAMPLE_ALLOC(ptr, size, f, l, sf);
+    return ptr;
 }
 
 void* tf_memalign_internal(size_t align, size_t size, const char* f, int l, const char* sf)
@@ -175,7 +249,9 @@ void* tf_memalign_internal(size_t align, size_t size, const char* f, int l, cons
     UNREF_PARAM(f);
     UNREF_PARAM(l);
     UNREF_PARAM(sf);
-    return tf_memalign(align, size);
+    void* ptr = MEM_MEMALIGN(MEM_MAX(align, MIN_ALLOC_ALIGNMENT), size);
+    MEM_SAMPLE_ALLOC(ptr, size, f, l, sf);
+    return ptr;
 }
 
 void* tf_calloc_internal(size_t count, size_t size, const char* f, int l, const char* sf)
@@ -183,7 +259,9 @@ void* tf_calloc_internal(size_t count, size_t size, const char* f, int l, const
     UNREF_PARAM(f);
     UNREF_PARAM(l);
     UNREF_PARAM(sf);
-    return tf_calloc(count, size);
+    void* ptr = MEM_CALLOC_MEMALIGN(count, MIN_ALLOC_ALIGNMENT, size);
+    MEM_SAMPLE_ALLOC(ptr, count * size, f, l, sf);
+    return ptr;
 }
 
 void* tf_calloc_memalign_internal(size_t count, size_t align, size_t size, const char* f, int l, const char* sf)
@@ -191,7 +269,9 @@ void* tf_calloc_memalign_internal(size_t count, size_t align, size_t size, const
     UNREF_PARAM(f);
     UNREF_PARAM(l);
     UNREF_PARAM(sf);
-    return tf_calloc_memalign(count, align, size);
+    void* ptr = MEM_CALLOC_MEMALIGN(count, MEM_MAX(align, MIN_ALLOC_ALIGNMENT), size);
+    MEM_SAMPLE_ALLOC(ptr, count * size, f, l, sf);
+    return ptr;
 }
 
 void* tf_realloc_internal(void* ptr, size_t size, const char* f, int l, const char* sf)
@@ -199,7 +279,13 @@ void* tf_realloc_internal(void* ptr, size_t size, const char* f, int l, const ch
     UNREF_PARAM(f);
     UNREF_PARAM(l);
     UNREF_PARAM(sf);
-    return tf_realloc(ptr, size);
+    void* newPtr = MEM_REALLOC(ptr, size);
+    // Sampled as release of the old block and allocation of the new one. Old block and its sample stay when realloc fails,
+    // realloc(ptr, 0) may release the block and return NULL.
+    if (newPtr || !size)
+        MEM_SAMPLE_FREE(ptr);
+    MEM_SAMPLE_ALLOC(newPtr, size, f, l, sf);
+    return newPtr;
 }
 
 void tf_free_internal(void* ptr, const char* f, int l, const char* sf)
@@ -207,7 +293,32 @@ void tf_free_internal(void* ptr, const char* f, int l, const char* sf)
     UNREF_PARAM(f);
     UNREF_PARAM(l);
     UNREF_PARAM(sf);
-    tf_free(ptr);
+    // Before releasing, another thread could get and sample the same address otherwise
+    MEM_SAMPLE_FREE(ptr);
+    MEM_FREE(ptr);
 }
 
 #endif // defined(ENABLE_MEMORY_TRACKING) || defined(ENABLE_MTUNER)
+
+MemoryStatistics memGetStatistics(void)
+{
+    MemoryStatistics stats = { 0 };
+#if defined(ENABLE_MEMORY_TRACKING)
+    sMStats mmgrStats = mmgrGetMemoryStatistics();
+    stats.totalReportedMemory = mmgrStats.totalReportedMemory;
+    stats.totalActualMemory = mmgrStats.totalActualMemory;
+    stats.peakReportedMemory = mmgrStats.peakReportedMemory;
+    stats.peakActualMemory = mmgrStats.peakActualMemory;
+    stats.accumulatedReportedMemory = mmgrStats.accumulatedReportedMemory;
+    stats.accumulatedActualMemory = mmgrStats.accumulatedActualMemory;
+    stats.accumulatedAllocUnitCount = mmgrStats.accumulatedAllocUnitCount;
+    stats.totalAllocUnitCount = mmgrStats.totalAllocUnitCount;
+    stats.peakAllocUnitCount = mmgrStats.peakAllocUnitCount;
+#endif
+#if defined(ENABLE_MEMORY_SAMPLING) && !defined(ENABLE_MEMORY_TRACKING)
+    memSamplingAddStatistics(&stats);
+#endif
+    tf_arena_add_statistics(&stats);
+    tf_pool_add_statistics(&stats);
+    return stats;
+}
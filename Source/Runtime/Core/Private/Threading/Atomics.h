@@ -36,6 +36,10 @@ typedef volatile ALIGNAS(PTR_SIZE) uintptr_t tfrg_atomicptr_t;
 
 #define tfrg_memorybarrier_acquire()                     _ReadWriteBarrier()
 #define tfrg_memorybarrier_release()                     _ReadWriteBarrier()
+#define tfrg_memorybarrier_full()                        MemoryBarrier()
+
+// Hint for the body of a spin-wait loop, lets the other hyperthread run and saves power
+#define tfrg_cpu_relax()                                 YieldProcessor()
 
 #define tfrg_atomic32_load_relaxed(pVar)                 (*(pVar))
 #define tfrg_atomic32_store_relaxed(dst, val)            (uint32_t) InterlockedExchange((volatile long*)(dst), val)
@@ -51,6 +55,15 @@ typedef volatile ALIGNAS(PTR_SIZE) uintptr_t tfrg_atomicptr_t;
 #else
 #define tfrg_memorybarrier_acquire()                     __asm__ __volatile__("" : : : "memory")
 #define tfrg_memorybarrier_release()                     __asm__ __volatile__("" : : : "memory")
+#define tfrg_memorybarrier_full()                        __sync_synchronize()
+
+#if defined(__x86_64__) || defined(__i386__)
+#define tfrg_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define tfrg_cpu_relax() __asm__ __volatile__("yield")
+#else
+#define tfrg_cpu_relax() ((void)0)
+#endif
 
 #define tfrg_atomic32_load_relaxed(pVar)                 (*(pVar))
 #define tfrg_atomic32_store_relaxed(dst, val)            __sync_lock_test_and_set((volatile int32_t*)(dst), val)
@@ -22,6 +22,7 @@
  * under the License.
  */
 
+
 #include "ThreadSystem.h"
 
 #include <ThirdParty/stb/stb_ds.h>
@@ -32,14 +33,97 @@
 
 #include "Atomics.h"
 
+// Initial capacity of the injection queue and of every worker deque.
 #define OPTIMAL_TASK_SLOTS_COUNT 128
+// Upper bound of tasks a worker moves from the injection queue into its own deque at once.
+#define INJECTED_TASKS_BATCH_MAX 32
+// Number of unsuccessful task searches before a worker goes to sleep.
+#define WORKER_SPIN_COUNT        64
+#define CACHE_LINE_SIZE          64
+// Task batch slots are allocated in chunks which are never moved, so that handles stay valid without locking.
+#define TASK_GROUP_CHUNK_SHIFT   8
+#define TASK_GROUP_CHUNK_SIZE    (1u << TASK_GROUP_CHUNK_SHIFT)
+// Upper bound of task batches in flight is TASK_GROUP_CHUNK_COUNT * TASK_GROUP_CHUNK_SIZE
+#define TASK_GROUP_CHUNK_COUNT   1024
+// Upper bound of ranges threadSystemParallelFor hands over to other threads
+#define PARALLEL_FOR_MAX_SPLITS  256
+// Automatic grain aims for this many calls of ParallelForFunc per thread
+#define PARALLEL_FOR_AUTO_SPLITS 8
 
 struct ThreadSystemTask
 {
     TaskFunc func;
     void*    user;
+    // index of ThreadSystemTaskGroup the task belongs to
+    uint32_t group;
+};
+
+// Completion state of tasks added with a single call.
+// Handle is (generation << 32) | (index + 1), it is complete as soon as generation of the slot changes.
+struct ThreadSystemTaskGroup
+{
+    tfrg_atomic32_t generation_Atomic;
+    // index + 1 of the next free slot, valid while the slot is in the free list
+    uint32_t        nextFree;
+    // Guards successors against concurrent completion
+    tfrg_atomic32_t lock_Atomic;
+    tfrg_atomic32_t remainingDependencyCount_Atomic;
+    tfrg_atomic64_t remainingTaskCount_Atomic;
+
+    // Tasks scheduled once all dependencies are complete
+    TaskFunc     func;
+    uint64_t     count;
+    uint64_t     userSize;
+    void*        users;
+    TaskPriority priority;
+
+    // Indices of groups depending on this one
+    uint32_t* successors;
+};
+
+// Growable ring buffer of a Chase-Lev deque.
+// Replaced buffers are kept alive until the thread system is destroyed,
+// because thieves may still read from them.
+struct ThreadSystemDequeBuffer
+{
+    struct ThreadSystemDequeBuffer* pPrev;
+    uint64_t                        mask;
+    struct ThreadSystemTask         tasks[];
+};
+
+// Chase-Lev work stealing deque.
+// Owner pushes and pops at the bottom, any other thread steals from the top.
+struct ThreadSystemDeque
+{
+    ALIGNAS(CACHE_LINE_SIZE) tfrg_atomic64_t top;
+    ALIGNAS(CACHE_LINE_SIZE) tfrg_atomic64_t bottom;
+    tfrg_atomicptr_t buffer;
+};
+
+struct ThreadSystemWorker
+{
+    // One deque per priority
+    struct ThreadSystemDeque deques[TASK_PRIORITY_COUNT];
+    // xorshift state used to pick steal victims, accessed by owner only
+    uint64_t                 stealSeed;
 };
 
+// Tasks added from threads which are not part of the thread system.
+// Protected by ThreadSystemData::mutex
+struct ThreadSystemInjectedQueue
+{
+    struct ThreadSystemTask* tasks;
+    uint64_t                 taken;
+    uint64_t                 queued;
+};
+
+typedef enum StealResult
+{
+    STEAL_EMPTY = 0,
+    STEAL_SUCCESS,
+    STEAL_RETRY,
+} StealResult;
+
 struct ThreadSystemData
 {
     Mutex mutex;
@@ -49,25 +133,172 @@ struct ThreadSystemData
     uint64_t    threadCount;
 
     // [threadCount]
-    ThreadHandle* threads;
-
-    // Protected by mutex
-    // TODO optimize queued task IO
-    struct ThreadSystemTask* tasks;
-    uint64_t                 tasksTaken;
-    uint64_t                 tasksQueued;
-    ConditionVariable        conditionTasks;
-    ConditionVariable        conditionIsIdle;
-    tfrg_atomic32_t          activatedThreadCount_Atomic;
-    uint32_t                 idleThreadCount;
-    //
+    ThreadHandle*              threads;
+    // [threadCount]
+    struct ThreadSystemWorker* workers;
+
+    struct ThreadSystemInjectedQueue injected[TASK_PRIORITY_COUNT];
+
+    // Lock-free hint so that workers don't take the mutex when nothing was injected
+    tfrg_atomic64_t injectedTaskCount_Atomic[TASK_PRIORITY_COUNT];
+    // Non-zero when tasks of the priority might be queued anywhere.
+    // Lets workers skip empty priorities with a single load instead of scanning all deques.
+    tfrg_atomic32_t queuedHint_Atomic[TASK_PRIORITY_COUNT];
+    // Threads executing TASK_PRIORITY_LOW tasks, limited by backgroundThreadLimit
+    tfrg_atomic32_t backgroundThreadCount_Atomic;
+    uint32_t        backgroundThreadLimit;
+    // Scheduled and executing tasks
+    tfrg_atomic64_t pendingTaskCount_Atomic;
+    tfrg_atomic32_t sleepingThreadCount_Atomic;
+    tfrg_atomic32_t idleWaiterCount_Atomic;
+
+    // Lock-free stack of free task group slots, (tag << 32) | (index + 1)
+    tfrg_atomic64_t               taskGroupFreeList_Atomic;
+    tfrg_atomic32_t               taskGroupChunkCount_Atomic;
+    tfrg_atomic32_t               taskGroupWaiterCount_Atomic;
+    struct ThreadSystemTaskGroup* taskGroupChunks[TASK_GROUP_CHUNK_COUNT];
+
+    ConditionVariable conditionTasks;
+    ConditionVariable conditionIsIdle;
+    ConditionVariable conditionTaskGroup;
+    tfrg_atomic32_t   activatedThreadCount_Atomic;
 
     tfrg_atomic32_t references_Atomic;
 
-    bool stopAbandon; // stop even if tasks are scheduled
-    bool stop;
+    volatile bool stopAbandon; // stop even if tasks are scheduled
+    volatile bool stop;
 };
 
+// Thread system and deque index of current worker thread
+static THREAD_LOCAL struct ThreadSystemData* gCurrentThreadSystem = NULL;
+static THREAD_LOCAL uint64_t                 gCurrentWorkerIndex = UINT64_MAX;
+// Priority of the task executed by current thread, inherited by parallel-for ranges
+static THREAD_LOCAL TaskPriority             gCurrentTaskPriority = TASK_PRIORITY_NORMAL;
+
+static bool dequeInit(struct ThreadSystemDeque* d, uint64_t capacity)
+{
+    struct ThreadSystemDequeBuffer* buffer = tf_malloc(sizeof(*buffer) + sizeof(struct ThreadSystemTask) * capacity);
+    if (!buffer)
+        return false;
+
+    buffer->pPrev = NULL;
+    buffer->mask = capacity - 1;
+    d->top = 0;
+    d->bottom = 0;
+    d->buffer = (uintptr_t)buffer;
+    return true;
+}
+
+static void dequeExit(struct ThreadSystemDeque* d)
+{
+    struct ThreadSystemDequeBuffer* buffer = (struct ThreadSystemDequeBuffer*)d->buffer;
+    while (buffer)
+    {
+        struct ThreadSystemDequeBuffer* prev = buffer->pPrev;
+        tf_free(buffer);
+        buffer = prev;
+    }
+    d->buffer = 0;
+}
+
+static inline uint64_t dequeSize(struct ThreadSystemDeque* d)
+{
+    int64_t size = (int64_t)(tfrg_atomic64_load_relaxed(&d->bottom) - tfrg_atomic64_load_relaxed(&d->top));
+    return size > 0 ? (uint64_t)size : 0;
+}
+
+// Owner only. Returns NULL and keeps the current buffer when out of memory.
+static struct ThreadSystemDequeBuffer* dequeGrow(struct ThreadSystemDeque* d, struct ThreadSystemDequeBuffer* buffer, uint64_t top,
+                                                 uint64_t bottom, uint64_t minSize)
+{
+    uint64_t capacity = (buffer->mask + 1) * 2;
+    while (capacity < minSize)
+        capacity *= 2;
+
+    struct ThreadSystemDequeBuffer* newBuffer = tf_malloc(sizeof(*newBuffer) + sizeof(struct ThreadSystemTask) * capacity);
+    if (!newBuffer)
+    {
+        LOGF(eERROR, "Failed to grow task deque to %llu tasks", (unsigned long long)capacity);
+        return NULL;
+    }
+    newBuffer->pPrev = buffer;
+    newBuffer->mask = capacity - 1;
+    for (uint64_t i = top; i != bottom; ++i)
+        newBuffer->tasks[i & newBuffer->mask] = buffer->tasks[i & buffer->mask];
+
+    tfrg_memorybarrier_release();
+    tfrg_atomicptr_store_release(&d->buffer, (uintptr_t)newBuffer);
+    return newBuffer;
+}
+
+// Owner only. Returns buffer with room for 'count' more tasks at 'bottom', NULL when out of memory.
+// Tasks become visible to thieves once dequePublish is called.
+static struct ThreadSystemDequeBuffer* dequeReserve(struct ThreadSystemDeque* d, uint64_t count, uint64_t* outBottom)
+{
+    uint64_t                        bottom = tfrg_atomic64_load_relaxed(&d->bottom);
+    uint64_t                        top = tfrg_atomic64_load_acquire(&d->top);
+    struct ThreadSystemDequeBuffer* buffer = (struct ThreadSystemDequeBuffer*)tfrg_atomicptr_load_relaxed(&d->buffer);
+
+    uint64_t size = bottom - top;
+    if (size + count > buffer->mask + 1)
+        buffer = dequeGrow(d, buffer, top, bottom, size + count);
+
+    *outBottom = bottom;
+    return buffer;
+}
+
+// Owner only. Publishes all reserved tasks with a single store of 'bottom'
+static inline void dequePublish(struct ThreadSystemDeque* d, uint64_t bottom)
+{
+    tfrg_memorybarrier_release();
+    tfrg_atomic64_store_release(&d->bottom, bottom);
+}
+
+// Owner only
+static bool dequePop(struct ThreadSystemDeque* d, struct ThreadSystemTask* outTask)
+{
+    uint64_t                        bottom = tfrg_atomic64_load_relaxed(&d->bottom) - 1;
+    struct ThreadSystemDequeBuffer* buffer = (struct ThreadSystemDequeBuffer*)tfrg_atomicptr_load_relaxed(&d->buffer);
+    // Only owner writes 'bottom', but it has to be visible to thieves before 'top' is read
+    d->bottom = bottom;
+    tfrg_memorybarrier_full();
+    uint64_t top = tfrg_atomic64_load_relaxed(&d->top);
+
+    int64_t size = (int64_t)(bottom - top);
+    if (size < 0)
+    {
+        d->bottom = bottom + 1;
+        return false;
+    }
+
+    *outTask = buffer->tasks[bottom & buffer->mask];
+    if (size > 0)
+        return true;
+
+    // Last task in the deque, race against thieves
+    bool taken = (uint64_t)tfrg_atomic64_cas_relaxed(&d->top, top, top + 1) == top;
+    d->bottom = bottom + 1;
+    return taken;
+}
+
+static StealResult dequeSteal(struct ThreadSystemDeque* d, struct ThreadSystemTask* outTask)
+{
+    uint64_t top = tfrg_atomic64_load_acquire(&d->top);
+    tfrg_memorybarrier_full();
+    uint64_t bottom = tfrg_atomic64_load_acquire(&d->bottom);
+
+    if ((int64_t)(bottom - top) <= 0)
+        return STEAL_EMPTY;
+
+    struct ThreadSystemDequeBuffer* buffer = (struct ThreadSystemDequeBuffer*)tfrg_atomicptr_load_acquire(&d->buffer);
+    struct ThreadSystemTask         task = buffer->tasks[top & buffer->mask];
+    if ((uint64_t)tfrg_atomic64_cas_relaxed(&d->top, top, top + 1) != top)
+        return STEAL_RETRY;
+
+    *outTask = task;
+    return STEAL_SUCCESS;
+}
+
 static void threadSystemCleanup(struct ThreadSystemData* t)
 {
     ASSERT(tfrg_atomic32_load_relaxed(&t->references_Atomic) == 0);
@@ -75,8 +306,27 @@ static void threadSystemCleanup(struct ThreadSystemData* t)
     destroyMutex(&t->mutex);
     destroyConditionVariable(&t->conditionTasks);
     destroyConditionVariable(&t->conditionIsIdle);
+    destroyConditionVariable(&t->conditionTaskGroup);
+
+    for (uint32_t ci = 0; ci < t->taskGroupChunkCount_Atomic; ++ci)
+    {
+        for (uint32_t gi = 0; gi < TASK_GROUP_CHUNK_SIZE; ++gi)
+            arrfree(t->taskGroupChunks[ci][gi].successors);
+        tf_free(t->taskGroupChunks[ci]);
+    }
+
+    if (t->workers)
+    {
+        for (uint64_t wi = 0; wi < t->threadCount; ++wi)
+        {
+            for (uint32_t p = 0; p < TASK_PRIORITY_COUNT; ++p)
+                dequeExit(&t->workers[wi].deques[p]);
+        }
+        tf_free(t->workers);
+    }
 
-    arrfree(t->tasks);
+    for (uint32_t p = 0; p < TASK_PRIORITY_COUNT; ++p)
+        arrfree(t->injected[p].tasks);
     tf_free(t);
 }
 
@@ -89,59 +339,470 @@ static inline void releaseThreadSystemHandle(struct ThreadSystemData* t)
         threadSystemCleanup(t);
 }
 
-static struct ThreadSystemTask getTask(struct ThreadSystemData* t, uint64_t tid)
+static bool hasQueuedTasks(struct ThreadSystemData* t, TaskPriority priority)
 {
-    struct ThreadSystemTask task = { 0 };
+    if (tfrg_atomic64_load_relaxed(&t->injectedTaskCount_Atomic[priority]))
+        return true;
 
-    if (t->stopAbandon)
-        return task;
+    for (uint64_t wi = 0; wi < t->threadCount; ++wi)
+    {
+        if (dequeSize(&t->workers[wi].deques[priority]))
+            return true;
+    }
+    return false;
+}
+
+static inline bool acquireBackgroundThread(struct ThreadSystemData* t)
+{
+    if (tfrg_atomic32_load_relaxed(&t->backgroundThreadCount_Atomic) >= t->backgroundThreadLimit)
+        return false;
+    if ((uint32_t)tfrg_atomic32_add_relaxed(&t->backgroundThreadCount_Atomic, 1) < t->backgroundThreadLimit)
+        return true;
+    tfrg_atomic32_add_relaxed(&t->backgroundThreadCount_Atomic, -1);
+    return false;
+}
+
+static inline void releaseBackgroundThread(struct ThreadSystemData* t) { tfrg_atomic32_add_relaxed(&t->backgroundThreadCount_Atomic, -1); }
+
+// Background tasks over the thread limit don't count, workers can't take them anyway
+static bool hasScheduledTasks(struct ThreadSystemData* t)
+{
+    for (uint32_t p = 0; p < TASK_PRIORITY_LOW; ++p)
+    {
+        if (hasQueuedTasks(t, (TaskPriority)p))
+            return true;
+    }
+
+    return tfrg_atomic32_load_relaxed(&t->backgroundThreadCount_Atomic) < t->backgroundThreadLimit && hasQueuedTasks(t, TASK_PRIORITY_LOW);
+}
+
+// Wakes up sleeping workers and threads waiting for task groups after tasks were scheduled.
+// Expects the caller to own t->mutex when 'locked' is true.
+static void notifyWorkers(struct ThreadSystemData* t, TaskPriority priority, uint64_t taskCount, bool locked)
+{
+    // Pairs with the increments of sleepingThreadCount_Atomic in waitForTasks, of taskGroupWaiterCount_Atomic in
+    // threadSystemWaitTaskTimeout and with clearing the hint in findTaskPriority
+    tfrg_memorybarrier_full();
+    if (!tfrg_atomic32_load_relaxed(&t->queuedHint_Atomic[priority]))
+        tfrg_atomic32_store_relaxed(&t->queuedHint_Atomic[priority], 1);
+
+    bool wakeWorkers = tfrg_atomic32_load_relaxed(&t->sleepingThreadCount_Atomic) != 0;
+    // Waiting threads help with new tasks, a worker waiting inside a task might be the only one able to run them
+    bool wakeWaiters = tfrg_atomic32_load_relaxed(&t->taskGroupWaiterCount_Atomic) != 0;
+    if (!wakeWorkers && !wakeWaiters)
+        return;
+
+    if (!locked)
+        acquireMutex(&t->mutex);
+
+    if (wakeWorkers && taskCount == 1)
+        wakeOneConditionVariable(&t->conditionTasks);
+    else if (wakeWorkers)
+        wakeAllConditionVariable(&t->conditionTasks);
+    if (wakeWaiters)
+        wakeAllConditionVariable(&t->conditionTaskGroup);
+
+    if (!locked)
+        releaseMutex(&t->mutex);
+}
+
+// Takes tasks added from outside of the thread system.
+// Worker threads move a batch of them into their own deque so that other workers can steal it without touching the mutex.
+static bool takeInjectedTask(struct ThreadSystemData* t, uint64_t workerIndex, TaskPriority priority, struct ThreadSystemTask* outTask)
+{
+    if (!tfrg_atomic64_load_relaxed(&t->injectedTaskCount_Atomic[priority]))
+        return false;
+
+    struct ThreadSystemInjectedQueue* q = &t->injected[priority];
 
     acquireMutex(&t->mutex);
 
-    bool idleSet = false;
+    uint64_t scheduledCount = q->queued - q->taken;
+    if (!scheduledCount)
+    {
+        releaseMutex(&t->mutex);
+        return false;
+    }
+
+    *outTask = q->tasks[q->taken++];
+    --scheduledCount;
+
+    uint64_t batchCount = 0;
+    if (workerIndex != UINT64_MAX && scheduledCount)
+    {
+        // Leave a fair share for the other workers
+        batchCount = scheduledCount / t->threadCount;
+        batchCount = TF_MAX(batchCount, 1);
+        batchCount = TF_MIN(batchCount, INJECTED_TASKS_BATCH_MAX);
+
+        struct ThreadSystemDeque*       d = &t->workers[workerIndex].deques[priority];
+        uint64_t                        bottom = 0;
+        struct ThreadSystemDequeBuffer* buffer = dequeReserve(d, batchCount, &bottom);
+        // Out of memory, the batch stays in the injected queue
+        if (!buffer)
+            batchCount = 0;
+        for (uint64_t ti = 0; ti < batchCount; ++ti)
+            buffer->tasks[(bottom + ti) & buffer->mask] = q->tasks[q->taken + ti];
+        if (batchCount)
+            dequePublish(d, bottom + batchCount);
+        q->taken += batchCount;
+        scheduledCount -= batchCount;
+    }
+
+    tfrg_atomic64_add_relaxed(&t->injectedTaskCount_Atomic[priority], -(int64_t)(batchCount + 1));
+
+    if (q->taken > scheduledCount * 3)
+    {
+        if (scheduledCount)
+        {
+            memmove(q->tasks, q->tasks + q->taken, scheduledCount * sizeof *outTask); //-V595
+        }
+
+        q->queued -= q->taken;
+        q->taken = 0;
+    }
+
+    size_t arrayLimit = arrlenu(q->tasks); //-V595
+    if (arrayLimit > OPTIMAL_TASK_SLOTS_COUNT * 2 && q->queued <= OPTIMAL_TASK_SLOTS_COUNT)
+        arrsetlen(q->tasks, OPTIMAL_TASK_SLOTS_COUNT);
+
+    // Batch became stealable, let sleeping workers know
+    if (batchCount)
+        notifyWorkers(t, priority, batchCount, true);
+
+    releaseMutex(&t->mutex);
+    return true;
+}
+
+static bool stealTask(struct ThreadSystemData* t, uint64_t workerIndex, TaskPriority priority, struct ThreadSystemTask* outTask)
+{
+    // Most of the time there is nothing to steal, check without barriers first
+    bool found = false;
+    for (uint64_t wi = 0; wi < t->threadCount && !found; ++wi)
+        found = wi != workerIndex && dequeSize(&t->workers[wi].deques[priority]);
+    if (!found)
+        return false;
+
+    uint64_t start = 0;
+    if (workerIndex != UINT64_MAX)
+    {
+        // xorshift64
+        uint64_t* seed = &t->workers[workerIndex].stealSeed;
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 7;
+        *seed ^= *seed << 17;
+        start = *seed % t->threadCount;
+    }
 
     for (;;)
     {
-        if (t->tasksTaken < t->tasksQueued)
+        bool     retry = false;
+        uint64_t victim = start;
+        for (uint64_t i = 0; i < t->threadCount; ++i, ++victim)
         {
-            task = t->tasks[t->tasksTaken++];
-            break;
+            if (victim == t->threadCount)
+                victim = 0;
+            if (victim == workerIndex)
+                continue;
+
+            struct ThreadSystemDeque* d = &t->workers[victim].deques[priority];
+            // Cheap check first, dequeSteal needs a full barrier
+            if (!dequeSize(d))
+                continue;
+
+            StealResult result = dequeSteal(d, outTask);
+            if (result == STEAL_SUCCESS)
+                return true;
+            retry |= result == STEAL_RETRY;
         }
 
-        if (t->stop)
-            break;
+        if (!retry)
+            return false;
+    }
+}
+
+static bool findTaskPriorityUnhinted(struct ThreadSystemData* t, uint64_t workerIndex, TaskPriority priority, struct ThreadSystemTask* outTask)
+{
+    if (workerIndex != UINT64_MAX)
+    {
+        struct ThreadSystemDeque* d = &t->workers[workerIndex].deques[priority];
+        if (dequeSize(d) && dequePop(d, outTask))
+            return true;
+    }
+
+    if (takeInjectedTask(t, workerIndex, priority, outTask))
+        return true;
 
-        if (!idleSet && tid != UINT64_MAX)
+    return stealTask(t, workerIndex, priority, outTask);
+}
+
+static bool findTaskPriority(struct ThreadSystemData* t, uint64_t workerIndex, TaskPriority priority, struct ThreadSystemTask* outTask)
+{
+    if (!tfrg_atomic32_load_relaxed(&t->queuedHint_Atomic[priority]))
+        return false;
+
+    if (findTaskPriorityUnhinted(t, workerIndex, priority, outTask))
+        return true;
+
+    // Nothing found, clear the hint unless tasks were scheduled in the meantime.
+    // Store has to be visible before queues are checked, pairs with the barrier in notifyWorkers:
+    // either the producer sees the cleared hint and sets it, or the queued task is seen here.
+    tfrg_atomic32_store_relaxed(&t->queuedHint_Atomic[priority], 0);
+    tfrg_memorybarrier_full();
+    if (!hasQueuedTasks(t, priority))
+        return false;
+
+    tfrg_atomic32_store_relaxed(&t->queuedHint_Atomic[priority], 1);
+    return findTaskPriorityUnhinted(t, workerIndex, priority, outTask);
+}
+
+static inline bool holdsBackgroundThread(void) { return gCurrentTaskPriority == TASK_PRIORITY_LOW; }
+
+// Higher priorities are always drained first.
+// TASK_PRIORITY_LOW task holds a background thread slot until executeTask is done with it.
+static bool findTask(struct ThreadSystemData* t, uint64_t workerIndex, struct ThreadSystemTask* outTask, TaskPriority* outPriority)
+{
+    if (t->stopAbandon)
+        return false;
+
+    for (uint32_t p = 0; p < TASK_PRIORITY_LOW; ++p)
+    {
+        if (findTaskPriority(t, workerIndex, (TaskPriority)p, outTask))
         {
-            idleSet = true;
-            ++t->idleThreadCount;
+            *outPriority = (TaskPriority)p;
+            return true;
         }
+    }
+
+    // Background tasks are throttled, so that some threads are always ready for higher priorities.
+    // Background task waiting for other tasks already owns a slot, otherwise it could wait forever.
+    bool nested = holdsBackgroundThread();
+    if (!tfrg_atomic32_load_relaxed(&t->queuedHint_Atomic[TASK_PRIORITY_LOW]) || (!nested && !acquireBackgroundThread(t)))
+        return false;
+
+    if (findTaskPriority(t, workerIndex, TASK_PRIORITY_LOW, outTask))
+    {
+        *outPriority = TASK_PRIORITY_LOW;
+        return true;
+    }
+
+    if (!nested)
+        releaseBackgroundThread(t);
+    return false;
+}
+
+// Runs task found by findTask, does not report completion
+static void executeTask(struct ThreadSystemData* t, const struct ThreadSystemTask* task, TaskPriority priority, uint64_t threadId)
+{
+    TaskPriority prevPriority = gCurrentTaskPriority;
+    gCurrentTaskPriority = priority;
+    task->func(task->user, threadId);
+    gCurrentTaskPriority = prevPriority;
+
+    if (priority != TASK_PRIORITY_LOW || prevPriority == TASK_PRIORITY_LOW)
+        return;
+
+    releaseBackgroundThread(t);
+    // Background task might have been held back by the limit
+    if (hasQueuedTasks(t, TASK_PRIORITY_LOW))
+        notifyWorkers(t, TASK_PRIORITY_LOW, 1, false);
+}
+
+static void completeTasks(struct ThreadSystemData* t, uint64_t count)
+{
+    if ((uint64_t)tfrg_atomic64_add_relaxed(&t->pendingTaskCount_Atomic, -(int64_t)count) != count)
+        return;
+
+    // Last pending task is done
+    if (tfrg_atomic32_load_relaxed(&t->idleWaiterCount_Atomic))
+    {
+        acquireMutex(&t->mutex);
         wakeAllConditionVariable(&t->conditionIsIdle);
-        waitConditionVariable(&t->conditionTasks, &t->mutex, TIMEOUT_INFINITE);
+        releaseMutex(&t->mutex);
     }
+}
 
-    if (idleSet)
-        --t->idleThreadCount;
+static inline void lockTaskGroup(struct ThreadSystemTaskGroup* group)
+{
+    while (tfrg_atomic32_load_relaxed(&group->lock_Atomic) || tfrg_atomic32_cas_relaxed(&group->lock_Atomic, 0, 1) != 0)
+        ;
+}
+
+static inline void unlockTaskGroup(struct ThreadSystemTaskGroup* group) { tfrg_atomic32_store_release(&group->lock_Atomic, 0); }
+
+static inline ThreadSystemTaskHandle makeTaskHandle(uint32_t generation, uint32_t index)
+{
+    return ((uint64_t)generation << 32) | (index + 1);
+}
 
-    uint64_t scheduledCount = t->tasksQueued - t->tasksTaken;
-    if (t->tasksTaken > scheduledCount * 3)
+static inline struct ThreadSystemTaskGroup* getTaskGroup(struct ThreadSystemData* t, uint32_t index)
+{
+    ASSERT((index >> TASK_GROUP_CHUNK_SHIFT) < tfrg_atomic32_load_relaxed(&t->taskGroupChunkCount_Atomic));
+    return &t->taskGroupChunks[index >> TASK_GROUP_CHUNK_SHIFT][index & (TASK_GROUP_CHUNK_SIZE - 1)];
+}
+
+static inline bool isTaskGroupComplete(struct ThreadSystemData* t, ThreadSystemTaskHandle handle)
+{
+    if (handle == THREAD_SYSTEM_NULL_TASK_HANDLE)
+        return true;
+    struct ThreadSystemTaskGroup* group = getTaskGroup(t, (uint32_t)handle - 1);
+    return tfrg_atomic32_load_acquire(&group->generation_Atomic) != (uint32_t)(handle >> 32);
+}
+
+// Pushes chain of slots linked through nextFree, from 'first' to 'last'
+static void pushFreeTaskGroups(struct ThreadSystemData* t, uint32_t first, uint32_t last)
+{
+    struct ThreadSystemTaskGroup* lastGroup = getTaskGroup(t, last);
+    for (;;)
     {
-        if (scheduledCount)
+        uint64_t head = tfrg_atomic64_load_relaxed(&t->taskGroupFreeList_Atomic);
+        lastGroup->nextFree = (uint32_t)head;
+        // Tag is incremented on every change to avoid ABA
+        uint64_t newHead = ((head >> 32) + 1) << 32 | (first + 1);
+        tfrg_memorybarrier_release();
+        if ((uint64_t)tfrg_atomic64_cas_relaxed(&t->taskGroupFreeList_Atomic, head, newHead) == head)
+            return;
+    }
+}
+
+// Expects t->mutex to be owned by the caller
+static bool addTaskGroupChunk(struct ThreadSystemData* t)
+{
+    uint32_t chunkIndex = tfrg_atomic32_load_relaxed(&t->taskGroupChunkCount_Atomic);
+    if (chunkIndex == TASK_GROUP_CHUNK_COUNT)
+        return false;
+
+    struct ThreadSystemTaskGroup* chunk = tf_calloc(TASK_GROUP_CHUNK_SIZE, sizeof(struct ThreadSystemTaskGroup));
+    if (!chunk)
+        return false;
+
+    uint32_t first = chunkIndex << TASK_GROUP_CHUNK_SHIFT;
+    for (uint32_t gi = 0; gi < TASK_GROUP_CHUNK_SIZE - 1; ++gi)
+        chunk[gi].nextFree = first + gi + 2;
+
+    t->taskGroupChunks[chunkIndex] = chunk;
+    tfrg_atomic32_store_release(&t->taskGroupChunkCount_Atomic, chunkIndex + 1);
+    pushFreeTaskGroups(t, first, first + TASK_GROUP_CHUNK_SIZE - 1);
+    return true;
+}
+
+static uint32_t allocTaskGroup(struct ThreadSystemData* t)
+{
+    for (;;)
+    {
+        uint64_t head = tfrg_atomic64_load_acquire(&t->taskGroupFreeList_Atomic);
+        uint32_t index = (uint32_t)head;
+        if (index)
         {
-            memcpy(t->tasks, t->tasks + t->tasksTaken, scheduledCount * sizeof task); //-V595
+            // Slot memory is never released, reading nextFree of a slot taken by another thread is harmless
+            uint64_t newHead = ((head >> 32) + 1) << 32 | getTaskGroup(t, index - 1)->nextFree;
+            if ((uint64_t)tfrg_atomic64_cas_relaxed(&t->taskGroupFreeList_Atomic, head, newHead) == head)
+                return index - 1;
+            continue;
         }
 
-        t->tasksQueued -= t->tasksTaken;
-        t->tasksTaken = 0;
+        acquireMutex(&t->mutex);
+        // Another thread might have added a chunk already
+        bool added = (uint32_t)tfrg_atomic64_load_relaxed(&t->taskGroupFreeList_Atomic) || addTaskGroupChunk(t);
+        releaseMutex(&t->mutex);
+
+        // Out of slots, help completing batches in flight
+        if (!added && !threadSystemAssist(t))
+            threadSleep(0);
     }
+}
 
-    size_t arrayLimit = arrlenu(t->tasks); //-V595
-    if (arrayLimit > OPTIMAL_TASK_SLOTS_COUNT * 2)
-        arrsetlen(t->tasks, OPTIMAL_TASK_SLOTS_COUNT);
+// Returns false if dependency is already complete
+static bool addTaskGroupSuccessor(struct ThreadSystemData* t, ThreadSystemTaskHandle dependency, uint32_t successor)
+{
+    if (isTaskGroupComplete(t, dependency))
+        return false;
 
+    struct ThreadSystemTaskGroup* group = getTaskGroup(t, (uint32_t)dependency - 1);
+    lockTaskGroup(group);
+    bool added = tfrg_atomic32_load_relaxed(&group->generation_Atomic) == (uint32_t)(dependency >> 32);
+    if (added)
+        arrpush(group->successors, successor);
+    unlockTaskGroup(group);
+    return added;
+}
+
+static void scheduleTasks(struct ThreadSystemData* t, uint32_t group, TaskPriority priority, TaskFunc func, uint64_t count, uint64_t userSize,
+                          void* users);
+static void releaseTaskGroupDependencies(struct ThreadSystemData* t, uint32_t index, uint32_t count);
+
+static void completeTaskGroup(struct ThreadSystemData* t, uint32_t index)
+{
+    struct ThreadSystemTaskGroup* group = getTaskGroup(t, index);
+
+    // Invalidates handles, successors can't be added past this point
+    lockTaskGroup(group);
+    tfrg_atomic32_add_relaxed(&group->generation_Atomic, 1);
+    unlockTaskGroup(group);
+
+    // Successors are scheduled before tasks of this group stop being pending, so that idle state is never observed in between
+    for (ptrdiff_t si = 0; si < arrlen(group->successors); ++si)
+        releaseTaskGroupDependencies(t, group->successors[si], 1);
+    arrsetlen(group->successors, 0);
+
+    pushFreeTaskGroups(t, index, index);
+
+    if (tfrg_atomic32_load_relaxed(&t->taskGroupWaiterCount_Atomic))
+    {
+        acquireMutex(&t->mutex);
+        wakeAllConditionVariable(&t->conditionTaskGroup);
+        releaseMutex(&t->mutex);
+    }
+}
+
+static void releaseTaskGroupDependencies(struct ThreadSystemData* t, uint32_t index, uint32_t count)
+{
+    struct ThreadSystemTaskGroup* group = getTaskGroup(t, index);
+    if ((uint32_t)tfrg_atomic32_add_relaxed(&group->remainingDependencyCount_Atomic, -(int32_t)count) != count)
+        return;
+
+    if (group->count)
+        scheduleTasks(t, index, group->priority, group->func, group->count, group->userSize, group->users);
+    else
+        completeTaskGroup(t, index);
+}
+
+static inline void completeGroupTasks(struct ThreadSystemData* t, uint32_t index, uint64_t count)
+{
+    if ((uint64_t)tfrg_atomic64_add_relaxed(&getTaskGroup(t, index)->remainingTaskCount_Atomic, -(int64_t)count) == count)
+        completeTaskGroup(t, index);
+}
+
+// returns false if worker has to exit
+static bool waitForTasks(struct ThreadSystemData* t)
+{
+    bool keepRunning = true;
+
+    acquireMutex(&t->mutex);
+    tfrg_atomic32_add_relaxed(&t->sleepingThreadCount_Atomic, 1);
+    for (;;)
+    {
+        if (t->stopAbandon)
+        {
+            keepRunning = false;
+            break;
+        }
+
+        if (hasScheduledTasks(t))
+            break;
+
+        if (t->stop)
+        {
+            keepRunning = false;
+            break;
+        }
+
+        waitConditionVariable(&t->conditionTasks, &t->mutex, TIMEOUT_INFINITE);
+    }
+    tfrg_atomic32_add_relaxed(&t->sleepingThreadCount_Atomic, -1);
     releaseMutex(&t->mutex);
 
-    return task;
+    return keepRunning;
 }
 
 static void taskThreadFunc(void* threadUserData)
@@ -156,20 +817,51 @@ static void taskThreadFunc(void* threadUserData)
         setCurrentThreadName(buffer);
     }
 
+    gCurrentThreadSystem = t;
+    gCurrentWorkerIndex = tid;
+
     struct ThreadSystemTask task = { 0 };
+    TaskPriority            priority = TASK_PRIORITY_NORMAL;
+    uint32_t                spinCount = 0;
+    // Completed tasks are reported in batches per group, worker is busy until it runs out of tasks anyway
+    uint64_t                completedTaskCount = 0;
+    uint32_t                completedGroup = 0;
     while (!t->stopAbandon)
     {
-        if (task.func)
+        if (findTask(t, tid, &task, &priority))
+        {
+            if (completedTaskCount && task.group != completedGroup)
+            {
+                completeGroupTasks(t, completedGroup, completedTaskCount);
+                completeTasks(t, completedTaskCount);
+                completedTaskCount = 0;
+            }
+
+            executeTask(t, &task, priority, tid);
+            completedGroup = task.group;
+            ++completedTaskCount;
+            spinCount = 0;
+            continue;
+        }
+
+        if (completedTaskCount)
         {
-            task.func(task.user, tid);
-            memset(&task, 0, sizeof task);
+            completeGroupTasks(t, completedGroup, completedTaskCount);
+            completeTasks(t, completedTaskCount);
+            completedTaskCount = 0;
         }
 
-        task = getTask(t, tid);
-        if (t->stop && !task.func)
+        if (++spinCount < WORKER_SPIN_COUNT)
+            continue;
+
+        spinCount = 0;
+        if (!waitForTasks(t))
             break;
     }
 
+    gCurrentThreadSystem = NULL;
+    gCurrentWorkerIndex = UINT64_MAX;
+
     releaseThreadSystemHandle(t);
 }
 
@@ -194,6 +886,8 @@ bool threadSystemInit(ThreadSystem* out, const struct ThreadSystemInitDesc* desc
 
     t->threads = (ThreadHandle*)(t + 1);
     t->name = desc->threadName ? desc->threadName : "ThreadSystem";
+    // By default one worker is always left for higher priorities
+    t->backgroundThreadLimit = (uint32_t)(desc->backgroundThreadCount ? TF_MIN(desc->backgroundThreadCount, count) : TF_MAX(count - 1, 1));
 
     bool success = false;
 
@@ -217,12 +911,35 @@ bool threadSystemInit(ThreadSystem* out, const struct ThreadSystemInitDesc* desc
             break;
         }
 
+        if (!initConditionVariable(&t->conditionTaskGroup))
+        {
+            memset(&t->conditionTaskGroup, 0, sizeof t->conditionTaskGroup);
+            break;
+        }
+
+        if (!addTaskGroupChunk(t))
+            break;
+
+        t->workers = tf_calloc_memalign(count, ALIGNOF(struct ThreadSystemWorker), sizeof(struct ThreadSystemWorker));
+        if (!t->workers)
+            break;
+
+        // Cleanup skips deques which failed to initialize, their buffer is NULL
+        t->threadCount = count;
         success = true;
+        for (uint64_t wi = 0; wi < count && success; ++wi)
+        {
+            struct ThreadSystemWorker* worker = &t->workers[wi];
+            for (uint32_t p = 0; p < TASK_PRIORITY_COUNT && success; ++p)
+                success = dequeInit(&worker->deques[p], OPTIMAL_TASK_SLOTS_COUNT);
+            worker->stealSeed = 0x9E3779B97F4A7C15ull * (wi + 1);
+        }
     } while (false);
 
     if (!success)
     {
         threadSystemCleanup(t);
+        return false;
     }
 
     ThreadDesc threadDesc = { 0 };
@@ -241,9 +958,8 @@ bool threadSystemInit(ThreadSystem* out, const struct ThreadSystemInitDesc* desc
         memcpy(threadDesc.affinityMask, desc->affinityMask, sizeof threadDesc.affinityMask);
     }
 
-    arrsetlen(t->tasks, OPTIMAL_TASK_SLOTS_COUNT);
-
-    t->threadCount = count;
+    for (uint32_t p = 0; p < TASK_PRIORITY_COUNT; ++p)
+        arrsetlen(t->injected[p].tasks, OPTIMAL_TASK_SLOTS_COUNT);
 
     for (uint64_t ti = 0; ti < count; ++ti)
     {
@@ -292,54 +1008,113 @@ void threadSystemExit(ThreadSystem* thandle, const struct ThreadSystemExitDesc*
     releaseThreadSystemHandle(t);
 }
 
-void threadSystemAddTasks(ThreadSystem thandle, TaskFunc func, uint64_t count, uint64_t userSize, void* users)
+static void scheduleTasks(struct ThreadSystemData* t, uint32_t group, TaskPriority priority, TaskFunc func, uint64_t count, uint64_t userSize,
+                          void* users)
 {
-    if (count == 0)
-        return;
-    if (!VERIFY(func))
-        return;
-
-    struct ThreadSystemData* t = thandle;
-
-    if (!t) // dummy run
+    tfrg_atomic64_add_relaxed(&t->pendingTaskCount_Atomic, count);
+
+    // Tasks spawned by a worker go to its own deque, no locking required.
+    // When the deque can't grow they are injected like tasks added from outside.
+    struct ThreadSystemDequeBuffer* buffer = NULL;
+    uint64_t                        bottom = 0;
+    if (gCurrentThreadSystem == t)
+        buffer = dequeReserve(&t->workers[gCurrentWorkerIndex].deques[priority], count, &bottom);
+    if (buffer)
     {
+        struct ThreadSystemDeque* d = &t->workers[gCurrentWorkerIndex].deques[priority];
         for (uint64_t ti = 0; ti < count; ++ti)
-            func((uint8_t*)users + ti * userSize, 0);
+        {
+            buffer->tasks[(bottom + ti) & buffer->mask] = (struct ThreadSystemTask){
+                func,
+                users ? ((uint8_t*)users + ti * userSize) : NULL,
+                group,
+            };
+        }
+        dequePublish(d, bottom + count);
+        notifyWorkers(t, priority, count, false);
         return;
     }
 
+    struct ThreadSystemInjectedQueue* q = &t->injected[priority];
+
     acquireMutex(&t->mutex);
 
-    uint64_t offset = t->tasksQueued;
+    uint64_t offset = q->queued;
 
-    t->tasksQueued += count;
+    q->queued += count;
 
-    uint64_t len = arrlenu(t->tasks);
+    uint64_t len = arrlenu(q->tasks);
 
-    if (t->tasksQueued > len)
+    if (q->queued > len)
     {
         // Resize the task array to a multiple of OPTIMAL_TASK_SLOTS_COUNT that is large enough to contain all of the requested tasks.
-        uint64_t newTasksLength = t->tasksQueued / OPTIMAL_TASK_SLOTS_COUNT;
-        newTasksLength += (t->tasksQueued % OPTIMAL_TASK_SLOTS_COUNT) == 0 ? 0 : 1;
+        uint64_t newTasksLength = q->queued / OPTIMAL_TASK_SLOTS_COUNT;
+        newTasksLength += (q->queued % OPTIMAL_TASK_SLOTS_COUNT) == 0 ? 0 : 1;
         newTasksLength *= OPTIMAL_TASK_SLOTS_COUNT;
-        arrsetlen(t->tasks, newTasksLength);
+        arrsetlen(q->tasks, newTasksLength);
     }
 
     for (uint64_t ti = 0; ti < count; ++ti)
     {
-        t->tasks[offset + ti] = (struct ThreadSystemTask){
+        q->tasks[offset + ti] = (struct ThreadSystemTask){
             func,
             users ? ((uint8_t*)users + ti * userSize) : NULL,
+            group,
         };
     }
 
-    if (count == 1)
-        wakeOneConditionVariable(&t->conditionTasks);
-    else
-        wakeAllConditionVariable(&t->conditionTasks);
+    tfrg_atomic64_add_relaxed(&t->injectedTaskCount_Atomic[priority], count);
+    notifyWorkers(t, priority, count, true);
 
     releaseMutex(&t->mutex);
-    return;
+}
+
+ThreadSystemTaskHandle threadSystemAddTasks(ThreadSystem thandle, TaskFunc func, uint64_t count, uint64_t userSize, void* users)
+{
+    if (count == 0)
+        return THREAD_SYSTEM_NULL_TASK_HANDLE;
+    return threadSystemAddTasksAfter(thandle, TASK_PRIORITY_NORMAL, NULL, 0, func, count, userSize, users);
+}
+
+ThreadSystemTaskHandle threadSystemAddTasksAfter(ThreadSystem thandle, TaskPriority priority, const ThreadSystemTaskHandle* dependencies,
+                                                 uint32_t dependencyCount, TaskFunc func, uint64_t count, uint64_t userSize, void* users)
+{
+    if (count && !VERIFY(func))
+        return THREAD_SYSTEM_NULL_TASK_HANDLE;
+    if (!VERIFY((uint32_t)priority < TASK_PRIORITY_COUNT))
+        priority = TASK_PRIORITY_NORMAL;
+
+    struct ThreadSystemData* t = thandle;
+
+    if (!t) // dummy run, dependencies are executed already
+    {
+        for (uint64_t ti = 0; ti < count; ++ti)
+            func((uint8_t*)users + ti * userSize, 0);
+        return THREAD_SYSTEM_NULL_TASK_HANDLE;
+    }
+
+    uint32_t                      index = allocTaskGroup(t);
+    struct ThreadSystemTaskGroup* group = getTaskGroup(t, index);
+    ThreadSystemTaskHandle        handle = makeTaskHandle(tfrg_atomic32_load_relaxed(&group->generation_Atomic), index);
+
+    group->func = func;
+    group->count = count;
+    group->userSize = userSize;
+    group->users = users;
+    group->priority = priority;
+    tfrg_atomic64_store_relaxed(&group->remainingTaskCount_Atomic, count);
+    // Extra dependency keeps the group from starting while dependencies are registered
+    tfrg_atomic32_store_relaxed(&group->remainingDependencyCount_Atomic, dependencyCount + 1);
+
+    uint32_t releasedCount = 1;
+    for (uint32_t di = 0; di < dependencyCount; ++di)
+    {
+        if (!addTaskGroupSuccessor(t, dependencies[di], index))
+            ++releasedCount;
+    }
+
+    releaseTaskGroupDependencies(t, index, releasedCount);
+    return handle;
 }
 
 bool threadSystemAssist(ThreadSystem thandle)
@@ -348,10 +1123,16 @@ bool threadSystemAssist(ThreadSystem thandle)
     if (!t)
         return false;
 
-    struct ThreadSystemTask task = getTask(t, UINT64_MAX);
-    if (task.func)
-        task.func(task.user, UINT64_MAX);
-    return task.func;
+    uint64_t                workerIndex = gCurrentThreadSystem == t ? gCurrentWorkerIndex : UINT64_MAX;
+    struct ThreadSystemTask task = { 0 };
+    TaskPriority            priority = TASK_PRIORITY_NORMAL;
+    if (!findTask(t, workerIndex, &task, &priority))
+        return false;
+
+    executeTask(t, &task, priority, UINT64_MAX);
+    completeGroupTasks(t, task.group, 1);
+    completeTasks(t, 1);
+    return true;
 }
 
 bool threadSystemWaitIdleTimeout(ThreadSystem thandle, uint32_t timeout_ms)
@@ -360,15 +1141,21 @@ bool threadSystemWaitIdleTimeout(ThreadSystem thandle, uint32_t timeout_ms)
     if (!t)
         return true;
 
+    if (!tfrg_atomic64_load_relaxed(&t->pendingTaskCount_Atomic))
+        return true;
+    if (timeout_ms == 0)
+        return false;
+
     Timer timer;
     initTimer(&timer);
 
     bool idle = false;
     acquireMutex(&t->mutex);
+    tfrg_atomic32_add_relaxed(&t->idleWaiterCount_Atomic, 1);
     for (;;)
     {
-        idle = (t->tasksTaken >= t->tasksQueued) && (t->idleThreadCount >= tfrg_atomic32_load_relaxed(&t->references_Atomic) - 1);
-        if (idle || timeout_ms == 0)
+        idle = tfrg_atomic64_load_relaxed(&t->pendingTaskCount_Atomic) == 0;
+        if (idle)
             break;
 
         if (timeout_ms != UINT32_MAX)
@@ -383,10 +1170,186 @@ bool threadSystemWaitIdleTimeout(ThreadSystem thandle, uint32_t timeout_ms)
             waitConditionVariable(&t->conditionIsIdle, &t->mutex, TIMEOUT_INFINITE);
         }
     }
+    tfrg_atomic32_add_relaxed(&t->idleWaiterCount_Atomic, -1);
     releaseMutex(&t->mutex);
     return idle;
 }
 
+bool threadSystemIsTaskComplete(ThreadSystem thandle, ThreadSystemTaskHandle handle)
+{
+    struct ThreadSystemData* t = thandle;
+    if (!t)
+        return true;
+    return isTaskGroupComplete(t, handle);
+}
+
+bool threadSystemWaitTaskTimeout(ThreadSystem thandle, ThreadSystemTaskHandle handle, uint32_t timeout_ms)
+{
+    struct ThreadSystemData* t = thandle;
+    if (!t || isTaskGroupComplete(t, handle))
+        return true;
+    if (timeout_ms == 0)
+        return false;
+
+    Timer timer;
+    initTimer(&timer);
+
+    for (;;)
+    {
+        // Execute whatever is scheduled, tasks of the batch might be among them
+        while (threadSystemAssist(t))
+        {
+            if (isTaskGroupComplete(t, handle))
+                return true;
+            if (timeout_ms != UINT32_MAX && getTimerMSec(&timer, false) > timeout_ms)
+                return false;
+        }
+
+        // Nothing to help with, sleep until some batch completes or new tasks are scheduled
+        bool timedOut = false;
+        acquireMutex(&t->mutex);
+        tfrg_atomic32_add_relaxed(&t->taskGroupWaiterCount_Atomic, 1);
+        // Pairs with the barrier in notifyWorkers, either new tasks are seen here or the waiter count there
+        tfrg_memorybarrier_full();
+        if (!isTaskGroupComplete(t, handle) && !hasScheduledTasks(t))
+        {
+            if (timeout_ms != UINT32_MAX)
+            {
+                uint32_t ms = getTimerMSec(&timer, false);
+                timedOut = ms > timeout_ms;
+                if (!timedOut)
+                    waitConditionVariable(&t->conditionTaskGroup, &t->mutex, timeout_ms - ms);
+            }
+            else
+            {
+                waitConditionVariable(&t->conditionTaskGroup, &t->mutex, TIMEOUT_INFINITE);
+            }
+        }
+        tfrg_atomic32_add_relaxed(&t->taskGroupWaiterCount_Atomic, -1);
+        releaseMutex(&t->mutex);
+
+        if (isTaskGroupComplete(t, handle))
+            return true;
+        if (timedOut)
+            return false;
+    }
+}
+
+struct ParallelForContext;
+
+struct ParallelForRange
+{
+    struct ParallelForContext* context;
+    uint64_t                   begin;
+    uint64_t                   end;
+};
+
+// Lives on the stack of threadSystemParallelFor caller, which waits for all ranges
+struct ParallelForContext
+{
+    struct ThreadSystemData* t;
+    ParallelForFunc          func;
+    void*                    user;
+    uint64_t                 grain;
+    uint32_t                 group;
+    TaskPriority             priority;
+    tfrg_atomic32_t          splitCount_Atomic;
+    struct ParallelForRange  ranges[PARALLEL_FOR_MAX_SPLITS];
+};
+
+// Splitting pays off only if some thread is going to pick up the other half
+static bool parallelForShouldSplit(struct ThreadSystemData* t)
+{
+    if (tfrg_atomic32_load_relaxed(&t->sleepingThreadCount_Atomic))
+        return true;
+    if (gCurrentThreadSystem == t)
+        return dequeSize(&t->workers[gCurrentWorkerIndex].deques[gCurrentTaskPriority]) == 0;
+    return tfrg_atomic64_load_relaxed(&t->injectedTaskCount_Atomic[gCurrentTaskPriority]) == 0;
+}
+
+static void parallelForTask(void* user, uint64_t threadId);
+
+static bool parallelForSplit(struct ParallelForContext* context, uint64_t begin, uint64_t end)
+{
+    uint32_t index = tfrg_atomic32_add_relaxed(&context->splitCount_Atomic, 1);
+    if (index >= PARALLEL_FOR_MAX_SPLITS)
+        return false;
+
+    struct ParallelForRange* range = &context->ranges[index];
+    range->context = context;
+    range->begin = begin;
+    range->end = end;
+
+    // Group is kept alive by the range being processed, so it can't complete in between
+    tfrg_atomic64_add_relaxed(&getTaskGroup(context->t, context->group)->remainingTaskCount_Atomic, 1);
+    scheduleTasks(context->t, context->group, context->priority, parallelForTask, 1, 0, range);
+    return true;
+}
+
+static void parallelForRun(struct ParallelForContext* context, uint64_t begin, uint64_t end, uint64_t threadId)
+{
+    while (begin < end)
+    {
+        // Lazy binary splitting: hand over the upper half while there are idle threads
+        while (end - begin > context->grain && parallelForShouldSplit(context->t))
+        {
+            uint64_t middle = begin + (end - begin) / 2;
+            if (!parallelForSplit(context, middle, end))
+                break;
+            end = middle;
+        }
+
+        uint64_t chunkEnd = TF_MIN(begin + context->grain, end);
+        context->func(context->user, begin, chunkEnd, threadId);
+        begin = chunkEnd;
+    }
+}
+
+static void parallelForTask(void* user, uint64_t threadId)
+{
+    struct ParallelForRange* range = user;
+    parallelForRun(range->context, range->begin, range->end, threadId);
+}
+
+void threadSystemParallelFor(ThreadSystem thandle, uint64_t begin, uint64_t end, uint64_t grain, ParallelForFunc func, void* user)
+{
+    if (begin >= end || !VERIFY(func))
+        return;
+
+    struct ThreadSystemData* t = thandle;
+    uint64_t                 threadCount = t ? t->threadCount + 1 : 1;
+    if (grain == 0)
+        grain = TF_MAX((end - begin) / (threadCount * PARALLEL_FOR_AUTO_SPLITS), 1);
+
+    if (!t) // dummy run
+    {
+        for (; begin < end; begin += TF_MIN(grain, end - begin))
+            func(user, begin, begin + TF_MIN(grain, end - begin), 0);
+        return;
+    }
+
+    struct ParallelForContext context;
+    context.t = t;
+    context.func = func;
+    context.user = user;
+    context.grain = grain;
+    context.priority = gCurrentTaskPriority;
+    context.splitCount_Atomic = 0;
+    context.group = allocTaskGroup(t);
+
+    // Calling thread holds the group open while it works on its part of the range
+    struct ThreadSystemTaskGroup* group = getTaskGroup(t, context.group);
+    ThreadSystemTaskHandle        handle = makeTaskHandle(tfrg_atomic32_load_relaxed(&group->generation_Atomic), context.group);
+    group->count = 0;
+    tfrg_atomic32_store_relaxed(&group->remainingDependencyCount_Atomic, 0);
+    tfrg_atomic64_store_relaxed(&group->remainingTaskCount_Atomic, 1);
+
+    parallelForRun(&context, begin, end, gCurrentThreadSystem == t ? gCurrentWorkerIndex : UINT64_MAX);
+
+    completeGroupTasks(t, context.group, 1);
+    threadSystemWaitTask(t, handle);
+}
+
 void threadSystemGetInfo(ThreadSystem thandle, struct ThreadSystemInfo* outInfo)
 {
     memset(outInfo, 0, sizeof *outInfo);
@@ -399,4 +1362,12 @@ void threadSystemGetInfo(ThreadSystem thandle, struct ThreadSystemInfo* outInfo)
     outInfo->executedThreadCount = tfrg_atomic32_load_relaxed(&t->activatedThreadCount_Atomic);
     outInfo->activeThreadCount = tfrg_atomic32_load_relaxed(&t->references_Atomic) - 1;
     outInfo->threadName = t->name;
+
+    for (uint32_t p = 0; p < TASK_PRIORITY_COUNT; ++p)
+    {
+        outInfo->queuedTaskCount[p] = tfrg_atomic64_load_relaxed(&t->injectedTaskCount_Atomic[p]);
+        for (uint64_t wi = 0; wi < t->threadCount; ++wi)
+            outInfo->queuedTaskCount[p] += dequeSize(&t->workers[wi].deques[p]);
+    }
+    outInfo->backgroundThreadCount = tfrg_atomic32_load_relaxed(&t->backgroundThreadCount_Atomic);
 }
@@ -36,6 +36,21 @@ extern "C"
     // e.g. when threadSystemAssist() is used
     typedef void (*TaskFunc)(void* user, uint64_t threadId);
 
+    // Workers always take tasks of higher priority first
+    typedef enum TaskPriority
+    {
+        // Work the current frame is waiting for
+        TASK_PRIORITY_HIGH = 0,
+        TASK_PRIORITY_NORMAL,
+        // Streaming, decompression and other long running work.
+        // Executed by at most ThreadSystemInitDesc::backgroundThreadCount threads at once
+        TASK_PRIORITY_LOW,
+        TASK_PRIORITY_COUNT,
+    } TaskPriority;
+
+    // Processes iterations [begin, end) of threadSystemParallelFor
+    typedef void (*ParallelForFunc)(void* user, uint64_t begin, uint64_t end, uint64_t threadId);
+
     struct ThreadSystemInitDesc
     {
         // same as affinity mask from struct ThreadDesc, but for all threads in pool
@@ -53,6 +68,10 @@ extern "C"
         // Thread namings are "ThreadName 1", "ThreadName 2", ...
         // pointer must be valid until threadSystemExit
         const char* threadName;
+
+        // Limit of threads executing TASK_PRIORITY_LOW tasks at once, clamped to threadCount.
+        // 0 leaves one thread free for higher priorities.
+        uint64_t backgroundThreadCount;
     };
 
     struct ThreadSystemExitDesc
@@ -86,15 +105,29 @@ extern "C"
 
         // Copy of pointer from 'ThreadSystemInitDesc::threadName'
         const char* threadName;
+
+        // Tasks waiting to be executed, indexed by TaskPriority.
+        // Tasks waiting for dependencies are not included.
+        uint64_t queuedTaskCount[TASK_PRIORITY_COUNT];
+        // Threads executing TASK_PRIORITY_LOW tasks
+        uint64_t backgroundThreadCount;
     };
 
     typedef void* ThreadSystem;
 
+    // Identifies a batch of tasks added with a single call.
+    // Handle stays valid after completion, it's safe to wait on it or to use it as a dependency at any time.
+    typedef uint64_t ThreadSystemTaskHandle;
+
+    // Handle which is always complete, returned in dummy mode or when no tasks were added
+#define THREAD_SYSTEM_NULL_TASK_HANDLE ((ThreadSystemTaskHandle)0)
+
     static const struct ThreadSystemInitDesc gThreadSystemInitDescDefault = {
         0,
         { 0 },
         UINT64_MAX,
         NULL,
+        0,
     };
 
     static const struct ThreadSystemExitDesc gThreadSystemExitDescDefault = {
@@ -105,9 +138,17 @@ extern "C"
     bool threadSystemInit(ThreadSystem* out, const struct ThreadSystemInitDesc* desc);
     void threadSystemExit(ThreadSystem* ts, const struct ThreadSystemExitDesc* desc);
 
-    void threadSystemAddTasks(ThreadSystem ts, TaskFunc func, uint64_t count, uint64_t userSize, void* userArray);
+    // Returns handle which is complete once all 'count' tasks are executed.
+    // Tasks are added with TASK_PRIORITY_NORMAL
+    ThreadSystemTaskHandle threadSystemAddTasks(ThreadSystem ts, TaskFunc func, uint64_t count, uint64_t userSize, void* userArray);
+
+    // Tasks are scheduled once all dependencies are complete.
+    // 'count' can be 0, returned handle is then complete when all dependencies are, useful to join several batches.
+    ThreadSystemTaskHandle threadSystemAddTasksAfter(ThreadSystem ts, TaskPriority priority, const ThreadSystemTaskHandle* dependencies,
+                                                     uint32_t dependencyCount, TaskFunc func, uint64_t count, uint64_t userSize,
+                                                     void* userArray);
 
-#define threadSystemAddTaskGroup(ts, func, count, userArray) threadSystemAddTasks(ts, func, count, sizeof *userArray, userArray)
+#define threadSystemAddTaskGroup(ts, func, count, userArray) threadSystemAddTasks(ts, func, count, sizeof *(userArray), userArray)
 
     // returns result of expression "task is executed"
     bool threadSystemAssist(ThreadSystem ts);
@@ -116,14 +157,47 @@ extern "C"
     // returns result of expression "no tasks scheduled and no tasks executed"
     bool threadSystemWaitIdleTimeout(ThreadSystem ts, uint32_t msTimeout);
 
+    bool threadSystemIsTaskComplete(ThreadSystem ts, ThreadSystemTaskHandle handle);
+
+    // Use threadSystemWaitTask for infinite timeout.
+    // Calling thread executes scheduled tasks while waiting.
+    // returns result of expression "all tasks of the batch are executed"
+    bool threadSystemWaitTaskTimeout(ThreadSystem ts, ThreadSystemTaskHandle handle, uint32_t msTimeout);
+
+    // Executes func over [begin, end) and returns once all iterations are done.
+    // Range is split in halves while other threads are idle, calling thread works on it too.
+    // Split ranges have priority of the task calling threadSystemParallelFor, TASK_PRIORITY_NORMAL outside of tasks.
+    // Every call of func gets at most 'grain' iterations, 0 picks grain based on thread count.
+    void threadSystemParallelFor(ThreadSystem ts, uint64_t begin, uint64_t end, uint64_t grain, ParallelForFunc func, void* user);
+
     void threadSystemGetInfo(ThreadSystem ts, struct ThreadSystemInfo* outInfo);
 
-    static inline void threadSystemAddTask(ThreadSystem ts, TaskFunc func, void* user) { threadSystemAddTasks(ts, func, 1, 0, user); }
+    static inline ThreadSystemTaskHandle threadSystemAddTask(ThreadSystem ts, TaskFunc func, void* user)
+    {
+        return threadSystemAddTasks(ts, func, 1, 0, user);
+    }
+
+    static inline ThreadSystemTaskHandle threadSystemAddTasksPriority(ThreadSystem ts, TaskPriority priority, TaskFunc func, uint64_t count,
+                                                                      uint64_t userSize, void* userArray)
+    {
+        return threadSystemAddTasksAfter(ts, priority, NULL, 0, func, count, userSize, userArray);
+    }
+
+    // Single task executed after 'handle' is complete
+    static inline ThreadSystemTaskHandle threadSystemAddContinuation(ThreadSystem ts, ThreadSystemTaskHandle handle, TaskFunc func, void* user)
+    {
+        return threadSystemAddTasksAfter(ts, TASK_PRIORITY_NORMAL, &handle, 1, func, 1, 0, user);
+    }
 
     static inline bool threadSystemIsIdle(ThreadSystem ts) { return threadSystemWaitIdleTimeout(ts, 0); }
 
     static inline void threadSystemWaitIdle(ThreadSystem ts) { threadSystemWaitIdleTimeout(ts, UINT32_MAX); }
 
+    static inline void threadSystemWaitTask(ThreadSystem ts, ThreadSystemTaskHandle handle)
+    {
+        threadSystemWaitTaskTimeout(ts, handle, UINT32_MAX);
+    }
+
 #ifdef __cplusplus
 }
 #endif
@@ -149,12 +223,35 @@ public:
 
     void exit(const struct ThreadSystemExitDesc* desc) { threadSystemExit(&threadSystem, desc); }
 
-    void addTask(TaskFunc func, void* data) const { threadSystemAddTask(threadSystem, func, data); }
+    ThreadSystemTaskHandle addTask(TaskFunc func, void* data) const { return threadSystemAddTask(threadSystem, func, data); }
+
+    template<typename T>
+    ThreadSystemTaskHandle addTasks(TaskFunc func, uint64_t count, T* dataArray) const
+    {
+        return threadSystemAddTaskGroup(threadSystem, func, count, dataArray);
+    }
+
+    template<typename T>
+    ThreadSystemTaskHandle addTasks(TaskPriority priority, TaskFunc func, uint64_t count, T* dataArray) const
+    {
+        return threadSystemAddTasksPriority(threadSystem, priority, func, count, sizeof *dataArray, dataArray);
+    }
 
     template<typename T>
-    void addTasks(TaskFunc func, uint64_t count, T* dataArray) const
+    ThreadSystemTaskHandle addTasksAfter(TaskPriority priority, const ThreadSystemTaskHandle* dependencies, uint32_t dependencyCount,
+                                         TaskFunc func, uint64_t count, T* dataArray) const
     {
-        threadSystemAddTaskGroup(threadSystem, func, count, dataArray);
+        return threadSystemAddTasksAfter(threadSystem, priority, dependencies, dependencyCount, func, count, sizeof *dataArray, dataArray);
+    }
+
+    ThreadSystemTaskHandle addContinuation(ThreadSystemTaskHandle handle, TaskFunc func, void* data) const
+    {
+        return threadSystemAddContinuation(threadSystem, handle, func, data);
+    }
+
+    void parallelFor(uint64_t begin, uint64_t end, uint64_t grain, ParallelForFunc func, void* user) const
+    {
+        threadSystemParallelFor(threadSystem, begin, end, grain, func, user);
     }
 
     bool assist() const { return threadSystemAssist(threadSystem); }
@@ -170,5 +267,11 @@ public:
     bool waitIdle(uint32_t msTimeout) const { return threadSystemWaitIdleTimeout(threadSystem, msTimeout); }
 
     bool isIdle() const { return threadSystemIsIdle(threadSystem); }
+
+    void waitTask(ThreadSystemTaskHandle handle) const { threadSystemWaitTask(threadSystem, handle); }
+
+    bool waitTask(ThreadSystemTaskHandle handle, uint32_t msTimeout) const { return threadSystemWaitTaskTimeout(threadSystem, handle, msTimeout); }
+
+    bool isTaskComplete(ThreadSystemTaskHandle handle) const { return threadSystemIsTaskComplete(threadSystem, handle); }
 };
 #endif
@@ -349,6 +349,9 @@ COMPILE_ASSERT(sizeof(ssize_t) == sizeof(int64_t));
 #if !defined(NDEBUG)
 #define ENABLE_MEMORY_TRACKING
 #endif
+// Records callstacks of about one allocation per MEMORY_SAMPLING_INTERVAL bytes, cheap enough for release builds.
+// See memGetSampledSites. Ignored with ENABLE_MEMORY_TRACKING
+// #define ENABLE_MEMORY_SAMPLING
 // #define ENABLE_FORGE_STACKTRACE_DUMP
 
 #ifdef AUTOMATED_TESTING
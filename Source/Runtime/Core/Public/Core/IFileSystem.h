@@ -231,6 +231,11 @@ extern "C"
         // This function does read-only memory map.
         bool (*MemoryMap)(FileStream* fs, size_t* outSize, void const** outData);
 
+        /// Reads at most `bufferSizeInBytes` bytes starting at `offset` without using or changing the seek position.
+        /// Several threads can read from the same stream at the same time.
+        /// Returns the number of bytes read. Optional, see fsStreamCanReadAt.
+        size_t (*ReadAt)(FileStream* pFile, void* outputBuffer, size_t bufferSizeInBytes, ssize_t offset);
+
         void* pUser;
     };
 
@@ -249,6 +254,22 @@ extern "C"
     // MARK: - Archive file system
     /************************************************************************/
 
+#ifndef BUNYAR_BLOCK_CACHE_DEFAULT_SIZE
+#define BUNYAR_BLOCK_CACHE_DEFAULT_SIZE (32ull << 20)
+#endif
+
+#ifndef BUNYAR_READ_AHEAD_DEFAULT_DEPTH
+#define BUNYAR_READ_AHEAD_DEFAULT_DEPTH 2
+#endif
+
+#ifndef BUNYAR_READ_AHEAD_MAX_DEPTH
+#define BUNYAR_READ_AHEAD_MAX_DEPTH 8
+#endif
+
+#ifndef BUNYAR_READ_AHEAD_DEFAULT_SIZE
+#define BUNYAR_READ_AHEAD_DEFAULT_SIZE (8ull << 20)
+#endif
+
     struct ArchiveOpenDesc
     {
         // Binary search "strcmp" is used as an alternative to hash table.
@@ -272,6 +293,7 @@ extern "C"
         // Makes archive stream thread-safe
         // It allows to read several files from archive asynchronously.
         // Not used for fsArchiveOpenFromMemory
+        // Streams supporting (*ReadAt) are read without locking.
         //
         // Allows: (if this flag is set)
         // Thread1: reads file "A"
@@ -289,6 +311,31 @@ extern "C"
 
         // Try to memory map stream using fsStreamMemoryMap
         bool mmap;
+
+        // Decompressed blocks are kept in a cache shared by all archives,
+        // streams reading blocks decompressed before copy them from the cache, see fsArchiveSetBlockCacheBudget.
+        // Blocks of this archive are decompressed by every stream reading them if set.
+        bool disableBlockCache;
+
+        // ThreadSystem (Threading/ThreadSystem.h) decompressing blocks of large reads in parallel,
+        // straight into the output buffer. Must be valid until fsArchiveClose.
+        // Reads are decompressed by the reading thread if NULL.
+        void* threadSystem;
+
+        // Streams read sequentially get following blocks decompressed to the block cache by threadSystem tasks.
+        // Number of blocks ahead of the reader grows up to readAheadDepth while reads stay sequential,
+        // BUNYAR_READ_AHEAD_DEFAULT_DEPTH if 0, clamped to BUNYAR_READ_AHEAD_MAX_DEPTH.
+        // Blocks being decompressed ahead by all streams of the archive take at most readAheadSize bytes,
+        // BUNYAR_READ_AHEAD_DEFAULT_SIZE if 0.
+        // Requires threadSystem and the block cache.
+        uint32_t readAheadDepth;
+        uint64_t readAheadSize;
+        bool     disableReadAhead;
+
+        // Records order in which files are opened for the first time, see fsArchiveWriteAccessTrace.
+        // Use it to profile a session (e.g. loading a level) and feed the trace to the archive tool,
+        // so data of files is laid out in first-access order and cold loads read the archive sequentially.
+        bool recordAccessTrace;
     };
 
     /// 'desc' can be NULL
@@ -316,6 +363,49 @@ extern "C"
 
     FORGE_API bool fsArchiveClose(IFileSystem* pArchive);
 
+    /************************************************************************/
+    // MARK: - Mount stack
+    /************************************************************************/
+
+    // Mount stack combines several file systems into one, e.g. base archive, patch archives and a directory of loose files.
+    // Files of higher priority layers override files of lower priority layers,
+    // tombstones (BUNYAR_FILE_FORMAT_TOMBSTONE) of archive layers hide files of lower priority layers.
+    //
+    // Node names of all archive layers are merged into one hash table when the stack is opened,
+    // so resolving a file is a single hash probe regardless of layer count.
+    // Other layers are probed by (*Open), only if their priority is higher than priority of the archive layer holding the file.
+    //
+    // Mount stack is used as any other file system:
+    //     fsMountStackOpen(&desc, &stackFs);
+    //     fsSetPathForResourceDir(&stackFs, RM_CONTENT, RD_TEXTURES, "Textures");
+    //
+    // Only FM_READ is supported. (*GetFileUid) and (*OpenByUid) resolve files of archive layers only.
+    // Layers must be valid until fsMountStackClose, stack does not see changes made to layers after it was opened.
+
+    struct MountLayerDesc
+    {
+        // Archive opened by fsArchiveOpen* or any other file system, e.g. pSystemFileIO
+        IFileSystem* pIO;
+
+        // Higher priority layers override lower ones. Later layers override earlier layers of the same priority.
+        int32_t priority;
+
+        // Not used for archive layers.
+        // Files are opened from this resource directory, by the same names as in archives,
+        // e.g. "Textures/a.dds" is opened for RD_TEXTURES of the example above.
+        ResourceDirectory rootDirectory;
+    };
+
+    struct MountStackDesc
+    {
+        uint32_t                     layerCount;
+        const struct MountLayerDesc* pLayers;
+    };
+
+    FORGE_API bool fsMountStackOpen(const struct MountStackDesc* pDesc, IFileSystem* pOut);
+
+    FORGE_API bool fsMountStackClose(IFileSystem* pStack);
+
     /************************************************************************/
     // MARK: - File IO
     /************************************************************************/
@@ -383,6 +473,18 @@ extern "C"
         return fs->pIO->Write(fs, pSourceBuffer, byteCount);
     }
 
+    /// Reads at most `bufferSizeInBytes` bytes starting at `offset`, the seek position is left unchanged.
+    /// Returns the number of bytes read.
+    static inline size_t fsReadFromStreamAt(FileStream* fs, void* pOutputBuffer, size_t bufferSizeInBytes, ssize_t offset)
+    {
+        if (!fs->pIO->ReadAt)
+            return 0;
+        return fs->pIO->ReadAt(fs, pOutputBuffer, bufferSizeInBytes, offset);
+    }
+
+    /// Returns whether fsReadFromStreamAt is supported by the stream.
+    static inline bool fsStreamCanReadAt(FileStream* fs) { return fs->pIO->ReadAt != NULL; }
+
     /// Seeks to the specified position in the file, using `baseOffset` as the reference offset.
     static inline bool fsSeekStream(FileStream* fs, SeekBaseOffset baseOffset, ssize_t seekOffset)
     {
@@ -434,6 +536,45 @@ extern "C"
         return fs->pIO->MemoryMap(fs, outSize, outData);
     }
 
+    /************************************************************************/
+    // MARK: - Asynchronous reads
+    /************************************************************************/
+#ifndef FS_MAX_ASYNC_READS
+#define FS_MAX_ASYNC_READS 256
+#endif
+
+    /// Identifies a read started by fsReadAsync.
+    typedef uint64_t FsReadToken;
+
+#define FS_READ_TOKEN_NONE ((FsReadToken)0)
+
+    /// Called once the read is done, by an IO thread unless no IO thread could be started.
+    /// `bytesRead` is less than requested at the end of the file or on errors.
+    /// Callbacks can start more reads, e.g. to stream the next part of a file.
+    typedef void (*FsReadCallback)(void* pUserData, FileStream* pStream, void* pDst, size_t bytesRead);
+
+    /// Reads at most `size` bytes starting at `offset` into `pDst` in the background.
+    /// Stream and `pDst` have to stay valid until the read is done.
+    ///
+    /// Streams supporting (*ReadAt) are read concurrently, with io_uring on Linux and by IO threads elsewhere.
+    /// Other streams are read by IO threads with seek and read, one read of the stream at a time.
+    /// Their seek position changes, don't use such a stream while its reads are in flight.
+    ///
+    /// Either pass a callback or wait for the returned token with fsWaitRead.
+    /// Reads with a callback are released before the callback is called, their token is only good for fsIsReadDone.
+    /// Blocks while FS_MAX_ASYNC_READS reads are in flight, except in callbacks:
+    /// reads started by a callback then are done by the same IO thread after the callback returned,
+    /// reads without a callback are done before fsReadAsync returns. FS_READ_TOKEN_NONE is returned for both.
+    FORGE_API FsReadToken fsReadAsync(FileStream* pStream, ssize_t offset, size_t size, void* pDst, FsReadCallback callback,
+                                      void* pUserData);
+
+    /// Returns whether the read is done, doesn't block.
+    FORGE_API bool fsIsReadDone(FsReadToken token);
+
+    /// Blocks until the read is done, then releases the token.
+    /// Returns the number of bytes read.
+    FORGE_API size_t fsWaitRead(FsReadToken token);
+
     /************************************************************************/
     // MARK: - Directory queries
     /************************************************************************/
@@ -488,6 +629,10 @@ extern "C"
         // is large enough for compression to be effective.
         BUNYAR_FILE_FORMAT_LZ4_BLOCKS = 3,
         BUNYAR_FILE_FORMAT_ZSTD_BLOCKS = 5,
+
+        // File has no data, it is deleted.
+        // Patch archives use it to hide files of lower layers of a mount stack.
+        BUNYAR_FILE_FORMAT_TOMBSTONE = 255,
     };
 
     static const uint8_t BUNYAR_MAGIC[16] = {
@@ -515,6 +660,12 @@ extern "C"
         uint32_t size;   // exact size
     };
 
+// Version of archives written and read by this implementation
+// 1: BunyArHeader::dictionariesPointer
+// 2: BUNYAR_FILE_FORMAT_TOMBSTONE nodes
+// 3: BunyArHeader::nodeSourcesPointer
+#define BUNYAR_VERSION 3
+
     // Reader can still use archive,
     // if condition "compatible <= X <= actual" is met, where X is reader version.
     struct BunyArVersion
@@ -544,6 +695,17 @@ extern "C"
         // Hash table present, if size >= sizeof(BunyArHashTable)
         struct BunyArPointer64 hashTablePointer;
 
+        // Since version 1, zeroed when read from older archives.
+        // Location of BunyArPointer64 table, each pointer locates a zstd dictionary.
+        // dictionaryCount = dictionariesPointer.size / sizeof(BunyArPointer64)
+        // ZSTD blocks compressed with a dictionary have its ID in the frame header.
+        struct BunyArPointer64 dictionariesPointer;
+
+        // Since version 3, zeroed when read from older archives.
+        // Location of BunyArNodeSource table, one per node in the order of nodes.
+        // Optional, used by archive creation tools to rebuild archive incrementally.
+        struct BunyArPointer64 nodeSourcesPointer;
+
         // header can be extended in the future by new variables or pointers
     };
 
@@ -566,6 +728,20 @@ extern "C"
         struct BunyArPointer64 filePointer;
     };
 
+    // What node was created from
+    struct BunyArNodeSource
+    {
+        // XXH64 of file content, seed 0
+        uint64_t contentHash;
+        int32_t  compressionLevel;
+        // ID of zstd dictionary used to compress node, 0 if none
+        uint32_t dictionaryId;
+        // XXH64 of whole zstd dictionary used to compress node, seed 0. 0 if none
+        uint64_t dictionaryHash;
+        // BunyArFileFormat requested for the file, BunyArNode::format can differ, e.g. it's RAW for empty files
+        uint64_t requestedFormat;
+    };
+
     struct BunyArBlockFormatHeader
     {
         // size of all uncompressed blocks except the last one
@@ -650,6 +826,7 @@ extern "C"
     {
         uint64_t                      nodeCount;
         const struct BunyArHashTable* hashTable;
+        uint64_t                      dictionaryCount;
     };
 
     struct BunyArNodeDescription
@@ -658,10 +835,31 @@ extern "C"
         uint64_t              fileSize;
         uint64_t              compressedSize;
         enum BunyArFileFormat format;
+        // Location of file data within archive, deduplicated files share it
+        uint64_t              offset;
+    };
+
+    // Counters are totals since start, of all archives
+    struct BunyArBlockCacheStats
+    {
+        uint64_t hitCount;
+        uint64_t missCount;
+        uint64_t evictionCount;
+        uint64_t blockCount;
+        uint64_t usedSize;
+        uint64_t budget;
+        // Blocks decompressed ahead of sequential readers
+        uint64_t readAheadCount;
     };
 
     FORGE_API const char* bunyArFormatName(enum BunyArFileFormat format);
 
+    FORGE_API void fsArchiveGetBlockCacheStats(struct BunyArBlockCacheStats* outStats);
+
+    // Sets memory budget in bytes of the block cache shared by all archives, BUNYAR_BLOCK_CACHE_DEFAULT_SIZE until set.
+    // Least recently used blocks past the budget are evicted, blocks larger than the budget are not cached.
+    FORGE_API void fsArchiveSetBlockCacheBudget(uint64_t budget);
+
     FORGE_API void fsArchiveGetDescription(IFileSystem* pArchive, struct BunyArDescription* outInfo);
 
     FORGE_API bool fsArchiveGetNodeDescription(IFileSystem* pArchive, uint64_t nodeId, struct BunyArNodeDescription* outInfo);
@@ -674,6 +872,10 @@ extern "C"
     FORGE_API bool fsArchiveGetFileBlockMetadata(FileStream* pFile, struct BunyArBlockFormatHeader* outHeader,
                                                  const BunyArBlockPointer** outBlockPtrs);
 
+    // Writes names of files opened since the archive was opened, one per line, in first-open order.
+    // Archive must be opened with ArchiveOpenDesc::recordAccessTrace.
+    FORGE_API bool fsArchiveWriteAccessTrace(IFileSystem* pArchive, ResourceDirectory rd, const char* fileName);
+
     /************************************************************************/
     /************************************************************************/
 
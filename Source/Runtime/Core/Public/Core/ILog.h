@@ -96,7 +96,7 @@ extern "C"
     {                             \
         ((void)sizeof(b));        \
     } while (0)
-#define VERIFYMSG(b, msgFmt, ...) ((b) || (LOGF(eERROR, "VERIFY(" #b ") failed. " msgFmt, ##__VA_ARGS__), false))
+#define VERIFYMSG(b, msgFmt, ...) ((b) || (writeLog(eERROR, __FILE__, __LINE__, "VERIFY(" #b ") failed. " msgFmt, ##__VA_ARGS__), false))
 
 #endif
 
@@ -114,11 +114,28 @@ extern "C"
 #endif
 
 // Usage: LOGF(LogLevel::eINFO | LogLevel::eDEBUG, "Whatever string %s, this is an int %d", "This is a string", 1)
+// Messages are rate limited and repeats collapsed per call site, see LOG_SITE_BURST
+#if LOG_SITE_INTERVAL_MS > 0
+#define LOGF(log_level, ...)                                                       \
+    do                                                                             \
+    {                                                                              \
+        static LogSite logSite_;                                                   \
+        if (logSiteWithinBurst(&logSite_))                                         \
+            writeLog((log_level), __FILE__, __LINE__, __VA_ARGS__);                \
+        else                                                                       \
+            writeLogSite(&logSite_, (log_level), __FILE__, __LINE__, __VA_ARGS__); \
+    } while (0)
+#else
 #define LOGF(log_level, ...) writeLog((log_level), __FILE__, __LINE__, __VA_ARGS__)
+#endif
 // Usage: LOGF_IF(LogLevel::eINFO | LogLevel::eDEBUG, boolean_value && integer_value == 5, "Whatever string %s, this is an int %d", "This is
 // a string", 1)
-#define LOGF_IF(log_level, condition, ...) \
-    ((condition) ? writeLog((log_level), __FILE__, __LINE__, __VA_ARGS__) : (void)sizeof(condition)) //-V568
+#define LOGF_IF(log_level, condition, ...)  \
+    do                                      \
+    {                                       \
+        if (condition)                      \
+            LOGF((log_level), __VA_ARGS__); \
+    } while (0)
 //
 // #define LOGF_SCOPE(log_level, ...) LogLogScope ANONIMOUS_VARIABLE_LOG(scope_log_){ (log_level), __FILE__, __LINE__, __VA_ARGS__ }
 
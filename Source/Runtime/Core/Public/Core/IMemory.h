@@ -41,28 +41,81 @@
 #include <stdint.h>
 #endif
 
+#ifdef __cplusplus
 constexpr uint64 BD_KB = 1024u;
 constexpr uint64 BD_MB = 1024u * BD_KB;
 constexpr uint64 BD_GB = 1024u * BD_MB;
+#endif
 
 #define TF_KB (1024)
 #define TF_MB (1024 * TF_KB)
 #define TF_GB (1024 * TF_MB)
 
-#ifdef ENABLE_MEMORY_TRACKING
+// Pools past this count are only included in MemoryStatistics::poolCount and poolReservedMemory
+#define MEMORY_STATISTICS_MAX_POOLS 32
+
+typedef struct PoolStatistics
+{
+    const char* pName;
+    uint32_t    elementSize;
+    uint32_t    usedCount;
+    uint32_t    peakUsedCount;
+    // Elements in allocated chunks
+    uint32_t    capacity;
+} PoolStatistics;
+
+// Callstack depth recorded for sampled allocations
+#define MEMORY_SAMPLE_MAX_FRAMES 16
+
+// Allocation site of the sampled heap profile, see ENABLE_MEMORY_SAMPLING.
+// Allocations are identified by the tf_malloc call site and the callstack leading to it.
+typedef struct MemorySampleSite
+{
+    const char* pFile;
+    const char* pFunction;
+    uint32_t    line;
+    uint32_t    frameCount;
+    void*       pFrames[MEMORY_SAMPLE_MAX_FRAMES];
+
+    // Sampled allocations of the site which are still alive
+    uint64_t liveSampleCount;
+    // Extrapolated from the samples
+    uint64_t liveMemory;
+    uint64_t liveAllocCount;
+    uint64_t accumulatedMemory;
+} MemorySampleSite;
+
 typedef struct MemoryStatistics
 {
-    uint32_t totalReportedMemory;
-    uint32_t totalActualMemory;
-    uint32_t peakReportedMemory;
-    uint32_t peakActualMemory;
-    uint32_t accumulatedReportedMemory;
-    uint32_t accumulatedActualMemory;
-    uint32_t accumulatedAllocUnitCount;
-    uint32_t totalAllocUnitCount;
-    uint32_t peakAllocUnitCount;
+    // Allocations made with tf_malloc, only counted with ENABLE_MEMORY_TRACKING
+    uint64_t totalReportedMemory;
+    uint64_t totalActualMemory;
+    uint64_t peakReportedMemory;
+    uint64_t peakActualMemory;
+    uint64_t accumulatedReportedMemory;
+    uint64_t accumulatedActualMemory;
+    uint64_t accumulatedAllocUnitCount;
+    uint64_t totalAllocUnitCount;
+    uint64_t peakAllocUnitCount;
+
+    // Extrapolated from sampled allocations, only counted with ENABLE_MEMORY_SAMPLING
+    uint64_t sampledLiveMemory;
+    uint64_t sampledAccumulatedMemory;
+    uint32_t sampledSiteCount;
+    // Samples which didn't fit into the sample table, estimates are low when this isn't 0
+    uint64_t droppedSampleCount;
+
+    // Linear arenas, see Memory/Arena.h
+    uint32_t arenaCount;
+    uint64_t arenaReservedMemory;
+    // Sum of high-water marks of all arenas
+    uint64_t arenaPeakMemory;
+
+    // Fixed-size pools, see Memory/Pool.h
+    uint32_t       poolCount;
+    uint64_t       poolReservedMemory;
+    PoolStatistics pools[MEMORY_STATISTICS_MAX_POOLS];
 } MemoryStatistics;
-#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -72,9 +125,13 @@ extern "C"
     FORGE_API bool initMemAlloc(const char* appName);
     FORGE_API void exitMemAlloc(void);
 
-#ifdef ENABLE_MEMORY_TRACKING
     FORGE_API MemoryStatistics memGetStatistics(void);
-#endif
+
+    // Copies at most 'maxSiteCount' sites of the sampled heap profile with the largest liveMemory first.
+    // Returns number of sites written, always 0 without ENABLE_MEMORY_SAMPLING.
+    FORGE_API uint32_t memGetSampledSites(MemorySampleSite* pSites, uint32_t maxSiteCount);
+    // Average number of allocated bytes between two samples, 0 stops sampling
+    FORGE_API void     memSetSamplingInterval(uint64_t bytes);
 
     FORGE_API void* tf_malloc_internal(size_t size, const char* f, int l, const char* sf);
     FORGE_API void* tf_memalign_internal(size_t align, size_t size, const char* f, int l, const char* sf);
@@ -129,6 +129,15 @@ extern "C"
 #elif defined(NX64)
     MutexTypeNX             mMutexPlatformNX;
     uint32_t                mSpinCount;
+#elif defined(__linux__) && !defined(__ANDROID__)
+    // futex word: 0 - unlocked, 1 - locked, 2 - locked and there might be sleeping threads
+    uint32_t                mState;
+    // Upper bound of spins before sleeping, actual count adapts to how long the lock is usually held
+    uint32_t                mSpinCount;
+    uint32_t                mSpinAverage;
+    // Mutex is recursive
+    uint32_t                mRecursionCount;
+    ThreadID                mOwner;
 #else
     pthread_mutex_t pHandle;
     uint32_t        mSpinCount;
@@ -150,6 +159,12 @@ extern "C"
         void* pHandle;
 #elif defined(NX64)
     ConditionVariableTypeNX mCondPlatformNX;
+#elif defined(__linux__) && !defined(__ANDROID__)
+    // futex word, incremented on every wake
+    uint32_t                mSequence;
+    uint32_t                mWaiterCount;
+    // Mutex of the last waiter, wakeAllConditionVariable moves waiters to its futex
+    struct Mutex*           pMutex;
 #else
     pthread_cond_t  pHandle;
 #endif
@@ -62,6 +62,8 @@
 #include "../Quest/VrApi.h"
 #endif
 
+#include <Runtime/Core/Private/Memory/Arena.h>
+
 #include <Core/IMemory.h>
 
 static IApp*       pApp = NULL;
@@ -334,6 +336,9 @@ void updateBaseSubsystems(float deltaTime, bool appDrawn)
     extern void platformUpdateUserInterface(float deltaTime);
     extern void platformUpdateWindowSystem();
 
+    // Scratch arenas of all threads are reset on their first use in the new frame
+    tf_arena_next_frame();
+
     platformUpdateWindowSystem();
 
 #ifdef ENABLE_FORGE_SCRIPTING
@@ -39,6 +39,8 @@ extern "C"
 {
     bool fsIsBundledResourceDir(ResourceDirectory resourceDir);
     bool fsMergeDirAndFileName(const char* dir, const char* path, char separator, size_t dstSize, char* dst);
+    bool fsInitAsyncRead(void);
+    void fsExitAsyncRead(void);
 }
 
 static ANativeActivity* pNativeActivity = NULL;
@@ -191,8 +193,15 @@ bool initFileSystem(FileSystemInitDesc* pDesc)
             gResourceMounts[i] = pDesc->pResourceMounts[i];
     }
 
+    if (!fsInitAsyncRead())
+        return false;
+
     gInitialized = true;
     return true;
 }
 
-void exitFileSystem() { gInitialized = false; }
+void exitFileSystem()
+{
+    fsExitAsyncRead();
+    gInitialized = false;
+}
@@ -37,6 +37,8 @@
 
 #include "../../Utilities/Threading/UnixThreadID.h"
 
+#include <Runtime/Core/Private/Memory/Arena.h>
+
 #include <Core/IMemory.h>
 
 #define NSEC_PER_USEC 1000ull
@@ -184,6 +186,8 @@ void* ThreadFunctionStatic(void* data)
     }
 
     item.pFunc(item.pData);
+    tf_arena_thread_exit();
+    exitLogThread();
     return 0;
 }
 
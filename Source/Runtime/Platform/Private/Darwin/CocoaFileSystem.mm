@@ -46,6 +46,8 @@ static char gDebugUrl[FS_MAX_PATH] = {};
 extern "C"
 {
     void fsGetParentPath(const char* path, char* output);
+    bool fsInitAsyncRead(void);
+    void fsExitAsyncRead(void);
 }
 
 bool initFileSystem(FileSystemInitDesc* pDesc)
@@ -123,8 +125,15 @@ bool initFileSystem(FileSystemInitDesc* pDesc)
             gResourceMounts[i] = pDesc->pResourceMounts[i];
     }
 
+    if (!fsInitAsyncRead())
+        return false;
+
     gInitialized = true;
     return true;
 }
 
-void exitFileSystem() { gInitialized = false; }
+void exitFileSystem()
+{
+    fsExitAsyncRead();
+    gInitialized = false;
+}
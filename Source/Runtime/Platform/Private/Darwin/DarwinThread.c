@@ -35,6 +35,8 @@
 
 #include "../../Utilities/Threading/UnixThreadID.h"
 
+#include <Runtime/Core/Private/Memory/Arena.h>
+
 #include <Core/IMemory.h>
 
 #if defined(ENABLE_THREAD_PERFORMANCE_STATS)
@@ -157,6 +159,8 @@ void* ThreadFunctionStatic(void* data)
     // TODO: implement affinity mask, if Apple at some point allows to set it.
 
     item.pFunc(item.pData);
+    tf_arena_thread_exit();
+    exitLogThread();
     return 0;
 }
 
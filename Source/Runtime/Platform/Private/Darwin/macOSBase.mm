@@ -57,6 +57,8 @@
 #endif
 #include <Core/IMath.h>
 
+#include <Runtime/Core/Private/Memory/Arena.h>
+
 #include <Core/IMemory.h>
 
 #define FORGE_WINDOW_CLASS L"The Forge"
@@ -277,6 +279,9 @@ void updateBaseSubsystems(float deltaTime, bool appDrawn)
     extern void platformUpdateUserInterface(float deltaTime);
     extern void platformUpdateWindowSystem();
 
+    // Scratch arenas of all threads are reset on their first use in the new frame
+    tf_arena_next_frame();
+
     platformUpdateWindowSystem();
 
 #ifdef ENABLE_FORGE_SCRIPTING
@@ -57,6 +57,8 @@
 #include <Core/IMath.h>
 #include "../CPUConfig.h"
 
+#include <Runtime/Core/Private/Memory/Arena.h>
+
 #include <Core/IMemory.h>
 
 static IApp*       pApp = NULL;
@@ -184,6 +186,9 @@ void updateBaseSubsystems(float deltaTime, bool appDrawn)
     extern void platformUpdateUserInterface(float deltaTime);
     extern void platformUpdateWindowSystem();
 
+    // Scratch arenas of all threads are reset on their first use in the new frame
+    tf_arena_next_frame();
+
     platformUpdateWindowSystem();
 
 #ifdef ENABLE_FORGE_SCRIPTING
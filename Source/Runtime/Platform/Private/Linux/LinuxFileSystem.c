@@ -44,6 +44,8 @@ static char gApplicationPath[FS_MAX_PATH] = { 0 };
 static const char* gHomedir;
 
 void fsGetParentPath(const char* path, char* output);
+bool fsInitAsyncRead(void);
+void fsExitAsyncRead(void);
 
 bool initFileSystem(FileSystemInitDesc* pDesc)
 {
@@ -94,8 +96,15 @@ bool initFileSystem(FileSystemInitDesc* pDesc)
     //}
     // fsAppendPathComponent(tempdir, "tmp", gTempDirectory);
 
+    if (!fsInitAsyncRead())
+        return false;
+
     gInitialized = true;
     return true;
 }
 
-void exitFileSystem(void) { gInitialized = false; }
+void exitFileSystem(void)
+{
+    fsExitAsyncRead();
+    gInitialized = false;
+}
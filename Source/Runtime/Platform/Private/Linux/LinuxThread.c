@@ -34,6 +34,8 @@
 
 #include "../../Utilities/Threading/UnixThreadID.h"
 
+#include <Runtime/Core/Private/Memory/Arena.h>
+
 #include <Core/IMemory.h>
 
 #if defined(ENABLE_THREAD_PERFORMANCE_STATS)
@@ -72,7 +74,12 @@ size_t GetActiveTime(const CPUData* e)
 
 #endif
 
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 #define NSEC_PER_USEC 1000ull
 #define USEC_PER_SEC  1000000ull
@@ -81,67 +88,193 @@ size_t GetActiveTime(const CPUData* e)
 
 void callOnce(CallOnceGuard* pGuard, CallOnceFn pFn) { pthread_once(pGuard, pFn); }
 
-bool initMutex(Mutex* pMutex)
+// Mutex and ConditionVariable are built directly on futexes.
+// Uncontended lock and unlock are a single atomic operation each, no syscalls are made unless some thread has to sleep.
+
+#define MUTEX_UNLOCKED  0u
+#define MUTEX_LOCKED    1u
+#define MUTEX_CONTENDED 2u
+
+// Owner of a mutex is queried on every lock, getCurrentThreadID is too slow for that
+static THREAD_LOCAL ThreadID gMutexThreadID = INVALID_THREAD_ID;
+
+static inline ThreadID getMutexThreadID(void)
 {
-    pMutex->mSpinCount = MUTEX_DEFAULT_SPIN_COUNT;
-    pMutex->pHandle = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
-    pthread_mutexattr_t attr;
-    int                 status = pthread_mutexattr_init(&attr);
-    status |= pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-    status |= pthread_mutex_init(&pMutex->pHandle, &attr);
-    status |= pthread_mutexattr_destroy(&attr);
-    return status == 0;
+    if (gMutexThreadID == INVALID_THREAD_ID)
+        gMutexThreadID = getCurrentThreadID();
+    return gMutexThreadID;
 }
 
-void destroyMutex(Mutex* pMutex) { pthread_mutex_destroy(&pMutex->pHandle); }
+static inline long futexWait(uint32_t* address, uint32_t expected, uint32_t ms)
+{
+    struct timespec  timeout;
+    struct timespec* pTimeout = NULL;
+    if (ms != TIMEOUT_INFINITE)
+    {
+        timeout.tv_sec = ms / 1000;
+        timeout.tv_nsec = (long)(ms % 1000) * (long)NSEC_PER_MSEC;
+        pTimeout = &timeout;
+    }
+    return syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, pTimeout, NULL, 0);
+}
 
-void acquireMutex(Mutex* pMutex)
+static inline void futexWake(uint32_t* address, int count) { syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0); }
+
+// Spinning is pointless when the owner can't run at the same time
+static uint32_t getMutexSpinCount(void)
 {
-    uint32_t count = 0;
+    static uint32_t spinCount = UINT32_MAX;
+    if (spinCount == UINT32_MAX)
+        spinCount = getNumCPUCores() > 1 ? MUTEX_DEFAULT_SPIN_COUNT : 0;
+    return spinCount;
+}
 
-    while (count < pMutex->mSpinCount && pthread_mutex_trylock(&pMutex->pHandle) != 0)
-        ++count;
+// Threads which had to sleep take the lock as contended,
+// this way every unlock wakes the next sleeper, including the ones requeued from a condition variable.
+static void lockMutexSleeping(Mutex* pMutex)
+{
+    uint32_t state = __atomic_exchange_n(&pMutex->mState, MUTEX_CONTENDED, __ATOMIC_ACQUIRE);
+    while (state != MUTEX_UNLOCKED)
+    {
+        futexWait(&pMutex->mState, MUTEX_CONTENDED, TIMEOUT_INFINITE);
+        state = __atomic_exchange_n(&pMutex->mState, MUTEX_CONTENDED, __ATOMIC_ACQUIRE);
+    }
+}
 
-    if (count == pMutex->mSpinCount)
+static void lockMutexContended(Mutex* pMutex)
+{
+    // Adaptive spinning, similar to PTHREAD_MUTEX_ADAPTIVE_NP:
+    // spin a bit longer than it took to get the lock recently, but never more than mSpinCount
+    uint32_t spinAverage = pMutex->mSpinAverage;
+    uint32_t maxSpin = TF_MIN(pMutex->mSpinCount, spinAverage * 2 + 16);
+    uint32_t spin = 0;
+    for (; spin < maxSpin; ++spin)
     {
-        int r = pthread_mutex_lock(&pMutex->pHandle);
-        ASSERT(r == 0 && "Mutex::Acquire failed to take the lock");
+        tfrg_cpu_relax();
+        uint32_t expected = MUTEX_UNLOCKED;
+        if (__atomic_load_n(&pMutex->mState, __ATOMIC_RELAXED) == MUTEX_UNLOCKED &&
+            __atomic_compare_exchange_n(&pMutex->mState, &expected, MUTEX_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            pMutex->mSpinAverage = spinAverage + ((int32_t)(spin - spinAverage) / 8);
+            return;
+        }
     }
+
+    pMutex->mSpinAverage = spinAverage + ((int32_t)(spin - spinAverage) / 8);
+    lockMutexSleeping(pMutex);
 }
 
-bool tryAcquireMutex(Mutex* pMutex) { return pthread_mutex_trylock(&pMutex->pHandle) == 0; }
+bool initMutex(Mutex* pMutex)
+{
+    pMutex->mState = MUTEX_UNLOCKED;
+    pMutex->mSpinCount = getMutexSpinCount();
+    pMutex->mSpinAverage = 0;
+    pMutex->mRecursionCount = 0;
+    pMutex->mOwner = INVALID_THREAD_ID;
+    return true;
+}
 
-void releaseMutex(Mutex* pMutex) { pthread_mutex_unlock(&pMutex->pHandle); }
+void destroyMutex(Mutex* pMutex) { ASSERT(pMutex->mState == MUTEX_UNLOCKED && "Mutex is destroyed while locked"); }
 
-bool initConditionVariable(ConditionVariable* pCv)
+void acquireMutex(Mutex* pMutex)
 {
-    pCv->pHandle = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
-    int res = pthread_cond_init(&pCv->pHandle, NULL);
-    ASSERT(res == 0);
-    return res == 0;
+    ThreadID threadID = getMutexThreadID();
+    if (pMutex->mOwner == threadID)
+    {
+        ++pMutex->mRecursionCount;
+        return;
+    }
+
+    uint32_t expected = MUTEX_UNLOCKED;
+    if (!__atomic_compare_exchange_n(&pMutex->mState, &expected, MUTEX_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        lockMutexContended(pMutex);
+    pMutex->mOwner = threadID;
 }
 
-void destroyConditionVariable(ConditionVariable* pCv) { pthread_cond_destroy(&pCv->pHandle); }
+bool tryAcquireMutex(Mutex* pMutex)
+{
+    ThreadID threadID = getMutexThreadID();
+    if (pMutex->mOwner == threadID)
+    {
+        ++pMutex->mRecursionCount;
+        return true;
+    }
+
+    uint32_t expected = MUTEX_UNLOCKED;
+    if (!__atomic_compare_exchange_n(&pMutex->mState, &expected, MUTEX_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return false;
+    pMutex->mOwner = threadID;
+    return true;
+}
 
-void waitConditionVariable(ConditionVariable* pCv, Mutex* mutex, uint32_t ms)
+void releaseMutex(Mutex* pMutex)
 {
-    pthread_mutex_t* mutexHandle = (pthread_mutex_t*)&mutex->pHandle;
-    if (ms == TIMEOUT_INFINITE)
+    ASSERT(pMutex->mOwner == getMutexThreadID() && "Mutex is released by a thread which doesn't own it");
+    if (pMutex->mRecursionCount)
     {
-        pthread_cond_wait(&pCv->pHandle, mutexHandle);
+        --pMutex->mRecursionCount;
         return;
     }
 
-    // pthread_cond_timedwait won't do because it doesn't work as you expected!
-    // Read docs please!
-    releaseMutex(mutex);
-    usleep(200);
-    acquireMutex(mutex);
+    pMutex->mOwner = INVALID_THREAD_ID;
+    if (__atomic_exchange_n(&pMutex->mState, MUTEX_UNLOCKED, __ATOMIC_RELEASE) == MUTEX_CONTENDED)
+        futexWake(&pMutex->mState, 1);
+}
+
+bool initConditionVariable(ConditionVariable* pCv)
+{
+    pCv->mSequence = 0;
+    pCv->mWaiterCount = 0;
+    pCv->pMutex = NULL;
+    return true;
+}
+
+void destroyConditionVariable(ConditionVariable* pCv) { ASSERT(pCv->mWaiterCount == 0); }
+
+void waitConditionVariable(ConditionVariable* pCv, Mutex* pMutex, uint32_t ms)
+{
+    __atomic_store_n(&pCv->pMutex, pMutex, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pCv->mWaiterCount, 1, __ATOMIC_SEQ_CST);
+    uint32_t sequence = __atomic_load_n(&pCv->mSequence, __ATOMIC_SEQ_CST);
+
+    // Mutex is released completely even if it was locked recursively
+    uint32_t recursionCount = pMutex->mRecursionCount;
+    pMutex->mRecursionCount = 0;
+    releaseMutex(pMutex);
+
+    // Returns immediately if the condition variable was signaled after 'sequence' was read
+    futexWait(&pCv->mSequence, sequence, ms);
+
+    __atomic_sub_fetch(&pCv->mWaiterCount, 1, __ATOMIC_RELAXED);
+
+    lockMutexSleeping(pMutex);
+    pMutex->mOwner = getMutexThreadID();
+    pMutex->mRecursionCount = recursionCount;
+}
+
+void wakeOneConditionVariable(ConditionVariable* pCv)
+{
+    __atomic_add_fetch(&pCv->mSequence, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pCv->mWaiterCount, __ATOMIC_SEQ_CST))
+        futexWake(&pCv->mSequence, 1);
 }
 
-void wakeOneConditionVariable(ConditionVariable* pCv) { pthread_cond_signal(&pCv->pHandle); }
+void wakeAllConditionVariable(ConditionVariable* pCv)
+{
+    uint32_t sequence = __atomic_add_fetch(&pCv->mSequence, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&pCv->mWaiterCount, __ATOMIC_SEQ_CST))
+        return;
 
-void wakeAllConditionVariable(ConditionVariable* pCv) { pthread_cond_broadcast(&pCv->pHandle); }
+    // Instead of waking every waiter just to have them fight over the mutex,
+    // wake one and move the rest to the mutex futex. They are woken one by one as the mutex gets unlocked.
+    Mutex* pMutex = __atomic_load_n(&pCv->pMutex, __ATOMIC_RELAXED);
+    while (syscall(SYS_futex, &pCv->mSequence, FUTEX_CMP_REQUEUE_PRIVATE, 1, (void*)(uintptr_t)INT_MAX, &pMutex->mState, sequence) < 0 &&
+           errno == EAGAIN)
+    {
+        // Signaled again in the meantime
+        sequence = __atomic_load_n(&pCv->mSequence, __ATOMIC_SEQ_CST);
+    }
+}
 
 static ThreadID mainThreadID;
 
@@ -198,6 +331,8 @@ static void* ThreadFunctionStatic(void* data)
     }
 
     item.pFunc(item.pData);
+    tf_arena_thread_exit();
+    exitLogThread();
     return 0;
 }
 
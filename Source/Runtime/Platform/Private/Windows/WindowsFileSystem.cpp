@@ -59,6 +59,8 @@ extern "C"
 {
     bool fsMergeDirAndFileName(const char* dir, const char* path, char separator, size_t dstSize, char* dst);
     void fsGetParentPath(const char* path, char* output);
+    bool fsInitAsyncRead(void);
+    void fsExitAsyncRead(void);
 }
 
 #ifndef XBOX
@@ -113,11 +115,18 @@ bool initFileSystem(FileSystemInitDesc* pDesc)
     // WideCharToMultiByte(CP_UTF8, 0, localAppdata, (int)pathLength, appData, utf8Length, NULL, NULL);
     // CoTaskMemFree(localAppdata);
 
+    if (!fsInitAsyncRead())
+        return false;
+
     gInitialized = true;
     return true;
 }
 
-void exitFileSystem(void) { gInitialized = false; }
+void exitFileSystem(void)
+{
+    fsExitAsyncRead();
+    gInitialized = false;
+}
 #endif
 
 static bool fsDirectoryExists(const char* path)
@@ -173,6 +182,8 @@ struct WindowsFileStream
     HANDLE handle;
     HANDLE fileMapping;
     LPVOID mapView;
+    // Opened by the first positional read, see ioWindowsFsReadAt
+    HANDLE readAtHandle;
 };
 
 #define WSD(name, fs) struct WindowsFileStream* name = (struct WindowsFileStream*)(fs)->mUser.data
@@ -384,6 +395,12 @@ static bool ioWindowsFsClose(FileStream* fs)
         stream->fileMapping = INVALID_HANDLE_VALUE;
     }
 
+    if (stream->readAtHandle)
+    {
+        CloseHandle(stream->readAtHandle);
+        stream->readAtHandle = NULL;
+    }
+
     if (fclose(stream->file) == EOF)
     {
         LOGF(LogLevel::eERROR, "Error closing system FileStream: %s (%x)", strerror(errno), errno);
@@ -404,6 +421,69 @@ static size_t ioWindowsFsRead(FileStream* fs, void* dst, size_t size)
     return read;
 }
 
+#if !defined(XBOX)
+// ReadFile with an offset moves the file pointer used by the C runtime, positional reads use a handle of their own.
+// Reads of a handle opened without FILE_FLAG_OVERLAPPED are serialized by the system.
+static HANDLE ioWindowsFsGetReadAtHandle(struct WindowsFileStream* stream)
+{
+    HANDLE handle = InterlockedCompareExchangePointer(&stream->readAtHandle, NULL, NULL);
+    if (handle)
+        return handle;
+
+    handle = ReOpenFile(stream->handle, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        LOGF(eERROR, "Failed to reopen file for positional reads: %s", WindowsErrorString().c_str());
+        return NULL;
+    }
+
+    // Another thread may have opened it meanwhile
+    HANDLE previous = InterlockedCompareExchangePointer(&stream->readAtHandle, handle, NULL);
+    if (previous)
+    {
+        CloseHandle(handle);
+        return previous;
+    }
+    return handle;
+}
+
+static size_t ioWindowsFsReadAt(FileStream* fs, void* dst, size_t size, ssize_t offset)
+{
+    WSD(stream, fs);
+    HANDLE handle = ioWindowsFsGetReadAtHandle(stream);
+    if (!handle)
+        return 0;
+
+    size_t bytesRead = 0;
+    while (bytesRead < size)
+    {
+        // ReadFile size is 32 bit
+        size_t     remaining = size - bytesRead;
+        DWORD      toRead = (DWORD)(remaining < (1u << 30) ? remaining : (1u << 30));
+        uint64_t   position = (uint64_t)offset + bytesRead;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)position;
+        overlapped.OffsetHigh = (DWORD)(position >> 32);
+        DWORD read = 0;
+        if (!ReadFile(handle, (uint8_t*)dst + bytesRead, toRead, &read, &overlapped))
+        {
+            if (GetLastError() != ERROR_HANDLE_EOF)
+            {
+                LOGF(eERROR, "Error reading %s bytes from file at offset %lld: %s", humanReadableSize(toRead).str, (long long)position,
+                     WindowsErrorString().c_str());
+            }
+            break;
+        }
+        if (read == 0)
+            break;
+        bytesRead += read;
+    }
+    return bytesRead;
+}
+#else
+#define ioWindowsFsReadAt NULL
+#endif
+
 static size_t ioWindowsFsWrite(FileStream* fs, const void* src, size_t size)
 {
     if ((fs->mMode & (FM_WRITE | FM_APPEND)) == 0)
@@ -491,6 +571,7 @@ static IFileSystem gWindowsFileIO = {
     NULL,
     NULL,
     ioWindowsFsMemoryMap,
+    ioWindowsFsReadAt,
     NULL,
 };
 
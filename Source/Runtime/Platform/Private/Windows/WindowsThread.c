@@ -30,6 +30,8 @@
 #include <Core/IThread.h>
 #include <Platform/IOperatingSystem.h>
 
+#include <Runtime/Core/Private/Memory/Arena.h>
+
 #include <Core/IMemory.h>
 
 #if defined(ENABLE_THREAD_PERFORMANCE_STATS)
@@ -194,6 +196,8 @@ unsigned WINAPI ThreadFunctionStatic(void* data)
     }
 
     item.pFunc(item.pData);
+    tf_arena_thread_exit();
+    exitLogThread();
     return 0;
 }
 
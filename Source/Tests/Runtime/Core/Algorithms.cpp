@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Sort benchmark.
+// Stable sort is compared against sort and qsort on draw keys (sort key and submission index) and on plain 32 bit keys.
+// Inputs are random, presorted, reversed and presorted with a few random swaps. Random keys repeat, stable sort results are
+// checked to keep submission order for equal keys.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Core/ITime.h>
+
+#include <Core/IAlgorithm.h>
+
+#include <Core/IMemory.h>
+
+#define BENCH_MAX_COUNT  (1u << 18)
+// Elements sorted by every measurement, small arrays are sorted several times
+#define BENCH_PASS_COUNT (1u << 20)
+
+typedef struct DrawKey
+{
+    uint32_t mKey;
+    uint32_t mIndex;
+} DrawKey;
+
+typedef enum BenchInput
+{
+    BENCH_INPUT_RANDOM = 0,
+    BENCH_INPUT_PRESORTED,
+    BENCH_INPUT_REVERSED,
+    BENCH_INPUT_NEARLY_SORTED,
+    BENCH_INPUT_COUNT,
+} BenchInput;
+
+static const char*    gInputNames[BENCH_INPUT_COUNT] = { "random", "presorted", "reversed", "nearly sorted" };
+static const uint32_t gCounts[] = { 1u << 6, 1u << 10, 1u << 14, 1u << 18 };
+
+static DrawKey  gSourceKeys[BENCH_MAX_COUNT];
+static DrawKey  gKeys[BENCH_MAX_COUNT];
+static uint32_t gSourceValues[BENCH_MAX_COUNT];
+static uint32_t gValues[BENCH_MAX_COUNT];
+static uint32_t gFailedChecks;
+
+static bool lessDrawKey(const void* pLhs, const void* pRhs, void*) { return ((const DrawKey*)pLhs)->mKey < ((const DrawKey*)pRhs)->mKey; }
+
+static int compareDrawKey(const void* pLhs, const void* pRhs)
+{
+    uint32_t lhs = ((const DrawKey*)pLhs)->mKey;
+    uint32_t rhs = ((const DrawKey*)pRhs)->mKey;
+    return lhs < rhs ? -1 : lhs > rhs;
+}
+
+static void createInput(BenchInput input, uint32_t count)
+{
+    // Random keys are used about 4 times each
+    uint32_t seed = 0x2545F491u;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t key = (seed >> 8) % (count / 4 + 1);
+        if (input == BENCH_INPUT_PRESORTED || input == BENCH_INPUT_NEARLY_SORTED)
+            key = i;
+        else if (input == BENCH_INPUT_REVERSED)
+            key = count - 1 - i;
+        gSourceKeys[i].mKey = key;
+        gSourceKeys[i].mIndex = i;
+        gSourceValues[i] = key;
+    }
+
+    if (input == BENCH_INPUT_NEARLY_SORTED)
+    {
+        for (uint32_t i = 0; i < count / 64 + 1; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            uint32_t a = (seed >> 8) % count;
+            seed = seed * 1664525u + 1013904223u;
+            uint32_t b = (seed >> 8) % count;
+            uint32_t key = gSourceKeys[a].mKey;
+            gSourceKeys[a].mKey = gSourceKeys[b].mKey;
+            gSourceKeys[b].mKey = key;
+            gSourceValues[a] = gSourceKeys[a].mKey;
+            gSourceValues[b] = gSourceKeys[b].mKey;
+        }
+    }
+}
+
+static void checkKeys(uint32_t count, bool stable)
+{
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        const DrawKey* pPrev = &gKeys[i - 1];
+        const DrawKey* pCurrent = &gKeys[i];
+        if (pCurrent->mKey < pPrev->mKey || (stable && pCurrent->mKey == pPrev->mKey && pCurrent->mIndex < pPrev->mIndex))
+        {
+            ++gFailedChecks;
+            return;
+        }
+    }
+}
+
+static void checkValues(uint32_t count)
+{
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        if (gValues[i] < gValues[i - 1])
+        {
+            ++gFailedChecks;
+            return;
+        }
+    }
+}
+
+static double elementsPerMicrosecond(uint64_t elements, int64_t usec) { return usec > 0 ? (double)elements / (double)usec : 0.0; }
+
+typedef enum BenchSort
+{
+    BENCH_SORT_STABLE = 0,
+    BENCH_SORT_QUICK,
+    BENCH_SORT_QSORT,
+    BENCH_SORT_COUNT,
+} BenchSort;
+
+static double benchKeys(BenchSort sortType, uint32_t count)
+{
+    uint32_t passCount = BENCH_PASS_COUNT / count;
+    int64_t  elapsed = 0;
+    for (uint32_t pass = 0; pass < passCount; ++pass)
+    {
+        memcpy(gKeys, gSourceKeys, count * sizeof(DrawKey));
+        int64_t start = getUSec(true);
+        if (sortType == BENCH_SORT_STABLE)
+            stableSort(gKeys, count, sizeof(DrawKey), lessDrawKey, NULL);
+        else if (sortType == BENCH_SORT_QUICK)
+            sort(gKeys, count, sizeof(DrawKey), lessDrawKey, NULL);
+        else
+            qsort(gKeys, count, sizeof(DrawKey), compareDrawKey);
+        elapsed += getUSec(true) - start;
+    }
+    checkKeys(count, sortType == BENCH_SORT_STABLE);
+    return elementsPerMicrosecond((uint64_t)passCount * count, elapsed);
+}
+
+static double benchValues(BenchSort sortType, uint32_t count)
+{
+    uint32_t passCount = BENCH_PASS_COUNT / count;
+    int64_t  elapsed = 0;
+    for (uint32_t pass = 0; pass < passCount; ++pass)
+    {
+        memcpy(gValues, gSourceValues, count * sizeof(uint32_t));
+        int64_t start = getUSec(true);
+        if (sortType == BENCH_SORT_STABLE)
+            stableSortUInt32(gValues, count);
+        else
+            sortUInt32(gValues, count);
+        elapsed += getUSec(true) - start;
+    }
+    checkValues(count);
+    return elementsPerMicrosecond((uint64_t)passCount * count, elapsed);
+}
+
+int main(int, char**)
+{
+    initMemAlloc(NULL);
+
+    printf("Sort throughput (million elements/s)\n");
+    printf("%-14s %8s %14s %14s %14s %18s %14s\n", "input", "count", "stableSort", "sort", "qsort", "stableSortUInt32", "sortUInt32");
+    for (uint32_t input = 0; input < BENCH_INPUT_COUNT; ++input)
+    {
+        for (uint32_t c = 0; c < TF_ARRAY_COUNT(gCounts); ++c)
+        {
+            uint32_t count = gCounts[c];
+            createInput((BenchInput)input, count);
+            printf("%-14s %8u", gInputNames[input], count);
+            for (uint32_t s = 0; s < BENCH_SORT_COUNT; ++s)
+                printf(" %14.1f", benchKeys((BenchSort)s, count));
+            printf(" %18.1f %14.1f\n", benchValues(BENCH_SORT_STABLE, count), benchValues(BENCH_SORT_QUICK, count));
+        }
+    }
+    if (gFailedChecks)
+        printf("\n%u sorts returned wrong order\n", gFailedChecks);
+
+    exitMemAlloc();
+    return gFailedChecks ? 1 : 0;
+}
@@ -0,0 +1,1195 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Asynchronous read benchmark.
+// Random blocks of a file are read one at a time with blocking reads (queue depth 1), then with fsReadAsync keeping
+// 8 and 32 reads in flight. On Linux the file is dropped from the page cache before the cold passes so reads reach the device.
+// Every word of the file holds its own offset, reads are checked against it.
+// Reads are chained from callbacks with every slot in use, each callback starts two more reads. The file is read
+// through its own IO and through a copy of the IO without (*ReadAt), which is read with seek and read.
+//
+// Archive round trip test.
+// Files around block boundaries are packed into LZ4 and zstd archives with the archive tool library, then read back
+// by the reading thread and with a ThreadSystem decompressing blocks, in small, block sized and multi-block chunks
+// and at random offsets. Reads are compared to the source files.
+// A patch archive deleting, replacing and adding files is mounted over the base archive, lookups through the mount stack
+// must not find deleted files.
+// Blocks of the largest file read in half block chunks are decompressed to the block cache, reading them again must
+// hit the cache. Lowering the cache budget evicts blocks down to it, archives opened without the cache never hit it.
+// Read sequentially with a ThreadSystem, blocks past the first are decompressed ahead of the reader and found in the
+// cache. Streams are closed right after reads starting read-ahead tasks, reads afterwards must return the file.
+// Many small similar files are packed with a zstd dictionary, frames of their blocks must carry its ID and reads must
+// return the files.
+// Identical files must share their data, files of the same size with other content and files packed with
+// deduplication disabled must not.
+// Files opened from an archive recording accesses are written to a trace, the archive rebuilt from the trace must lay
+// data of traced files out in first-open order ahead of other files.
+// Adaptive formats store random data raw and compress repetitive data for slow storage. Rebuilt for storage fast enough
+// to store everything raw, an unchanged file keeps its previous format while a changed one is stored raw.
+// Archive benchmarks run a single round on every archive and must report each file under its format.
+
+#include <stdio.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#define BENCH_DROP_CACHE 1
+#endif
+
+#include <Core/IFileSystem.h>
+#include <Core/ILog.h>
+#include <Core/IThread.h>
+#include <Core/ITime.h>
+
+#include <Runtime/Core/Private/Threading/Atomics.h>
+#include <Runtime/Core/Private/Threading/ThreadSystem.h>
+#include <Tools/BunyArchive/Buny.h>
+
+#include <ThirdParty/zstd/lib/zstd.h>
+
+#include <Core/IMemory.h>
+
+#define BENCH_FILE_NAME       "TestFileSystem.bin"
+#define BENCH_FILE_SIZE       (64u << 20)
+// Bytes read by every pass
+#define BENCH_PASS_SIZE       (64u << 20)
+#define BENCH_MAX_READ_COUNT  4096u
+#define BENCH_MAX_QUEUE_DEPTH 32u
+
+#define CHAIN_READ_SIZE  4096u
+// Reads of the first levels start two reads each, every slot starts a tree of reads
+#define CHAIN_DEPTH      3u
+#define CHAIN_READ_COUNT (FS_MAX_ASYNC_READS * ((2u << CHAIN_DEPTH) - 1u))
+#define CHAIN_TIMEOUT_MS 30000u
+
+#define ARCHIVE_BLOCK_SIZE_KB   256u
+#define ARCHIVE_BLOCK_SIZE      (ARCHIVE_BLOCK_SIZE_KB << 10)
+#define ARCHIVE_SEEK_COUNT      64u
+// Files of the patch archive, see createArchives
+#define ARCHIVE_DELETED_FILE    3u
+#define ARCHIVE_REPLACED_FILE   5u
+#define ARCHIVE_REPLACED_SOURCE "TestFileSystemReplaced.bin"
+#define ARCHIVE_NEW_FILE        "TestFileSystemNew.bin"
+// Largest file, see checkBlockCache
+#define ARCHIVE_CACHE_FILE      (ARCHIVE_FILE_COUNT - 1u)
+#define ARCHIVE_CACHE_BUDGET    (2u * ARCHIVE_BLOCK_SIZE)
+// Streams closed with read-ahead in flight, see checkReadAhead
+#define ARCHIVE_READ_AHEAD_CLOSE_COUNT 16u
+// Small files sharing a zstd dictionary, see checkDictionary
+#define ARCHIVE_DICTIONARY_FILE_COUNT   128u
+#define ARCHIVE_DICTIONARY_FILE_SIZE    4096u
+#define ARCHIVE_DICTIONARY_SIZE_KB      4u
+#define ARCHIVE_DICTIONARY_NAME         "TestFileSystemDictionary.bunyar"
+#define ARCHIVE_DUPLICATES_NAME         "TestFileSystemDuplicates.bunyar"
+#define ARCHIVE_TRACE_NAME              "TestFileSystemTrace.txt"
+#define ARCHIVE_TRACED_NAME             "TestFileSystemTraced.bunyar"
+#define ARCHIVE_ADAPTIVE_NAME           "TestFileSystemAdaptive.bunyar"
+// Storage speeds favouring compression and raw storage, see checkAdaptiveFormat
+#define ARCHIVE_SLOW_READ_SPEED_MBPS    1u
+#define ARCHIVE_FAST_READ_SPEED_MBPS    1000000u
+
+static const uint32_t gBlockSizes[] = { 4u << 10, 64u << 10, 1u << 20 };
+static const uint32_t gQueueDepths[] = { 8u, 32u };
+
+// Empty, single byte, sizes around block boundaries and multi-block files with a partial last block
+static const uint32_t gArchiveFileSizes[] = {
+    0u,
+    1u,
+    100u,
+    4095u,
+    64u << 10,
+    ARCHIVE_BLOCK_SIZE - 1u,
+    ARCHIVE_BLOCK_SIZE,
+    ARCHIVE_BLOCK_SIZE + 1u,
+    (1u << 20) + 123u,
+    (4u << 20) + 7u,
+};
+static const uint32_t gArchiveChunkSizes[] = { 7u, ARCHIVE_BLOCK_SIZE, 3u * ARCHIVE_BLOCK_SIZE + 13u };
+
+#define ARCHIVE_FILE_COUNT TF_ARRAY_COUNT(gArchiveFileSizes)
+
+typedef struct ChainRead
+{
+    FileStream* pStream;
+    uint64_t    mOffset;
+    uint32_t    mDepth;
+    uint8_t     mBuffer[CHAIN_READ_SIZE];
+} ChainRead;
+
+static char     gFilePath[FS_MAX_PATH];
+static uint64_t gOffsets[BENCH_MAX_READ_COUNT];
+static uint32_t gCorruptReads;
+
+static ChainRead*      gChainReads;
+static tfrg_atomic32_t gChainStartedReads;
+static tfrg_atomic32_t gChainDoneReads;
+static tfrg_atomic32_t gChainCorruptReads;
+
+static uint8_t* gArchiveFiles[ARCHIVE_FILE_COUNT];
+static uint8_t* gReplacedFile;
+static uint8_t* gNewFile;
+static uint8_t* gReadBuffer;
+static uint32_t gFailedChecks;
+
+static bool createBenchFile(void)
+{
+    FileStream stream = {};
+    if (!fsOpenStreamFromPath(RD_OTHER_FILES, BENCH_FILE_NAME, FM_WRITE, &stream))
+        return false;
+
+    const uint32_t chunkSize = 1u << 20;
+    uint64_t*      pChunk = (uint64_t*)tf_malloc(chunkSize);
+    bool           success = true;
+    for (uint64_t offset = 0; offset < BENCH_FILE_SIZE && success; offset += chunkSize)
+    {
+        for (uint32_t i = 0; i < chunkSize / sizeof(uint64_t); ++i)
+            pChunk[i] = offset + i * sizeof(uint64_t);
+        success = fsWriteToStream(&stream, pChunk, chunkSize) == chunkSize;
+    }
+    tf_free(pChunk);
+    fsCloseStream(&stream);
+    return success;
+}
+
+static void dropCache(void)
+{
+#if defined(BENCH_DROP_CACHE)
+    int fd = open(gFilePath, O_RDONLY);
+    if (fd < 0)
+        return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+#endif
+}
+
+static void checkRead(const void* pBuffer, uint64_t offset, size_t bytesRead, uint32_t blockSize)
+{
+    if (bytesRead != blockSize || *(const uint64_t*)pBuffer != offset)
+        ++gCorruptReads;
+}
+
+static double megabytesPerSecond(uint64_t bytes, int64_t usec) { return usec > 0 ? (double)bytes / (double)usec : 0.0; }
+
+static double benchBlocking(FileStream* pStream, uint32_t blockSize, uint32_t readCount, uint8_t* pBuffer)
+{
+    int64_t start = getUSec(true);
+    for (uint32_t i = 0; i < readCount; ++i)
+    {
+        size_t bytesRead = 0;
+        if (fsSeekStream(pStream, SBO_START_OF_FILE, (ssize_t)gOffsets[i]))
+            bytesRead = fsReadFromStream(pStream, pBuffer, blockSize);
+        checkRead(pBuffer, gOffsets[i], bytesRead, blockSize);
+    }
+    return megabytesPerSecond((uint64_t)blockSize * readCount, getUSec(true) - start);
+}
+
+static double benchQueued(FileStream* pStream, uint32_t blockSize, uint32_t readCount, uint32_t queueDepth, uint8_t* pBuffer)
+{
+    FsReadToken tokens[BENCH_MAX_QUEUE_DEPTH];
+    int64_t     start = getUSec(true);
+    for (uint32_t i = 0; i < readCount + queueDepth; ++i)
+    {
+        uint32_t slot = i % queueDepth;
+        uint8_t* pSlotBuffer = pBuffer + (size_t)slot * blockSize;
+        // Slot is reused once the read issued queueDepth reads ago is done
+        if (i >= queueDepth)
+            checkRead(pSlotBuffer, gOffsets[i - queueDepth], fsWaitRead(tokens[slot]), blockSize);
+        if (i < readCount)
+            tokens[slot] = fsReadAsync(pStream, (ssize_t)gOffsets[i], blockSize, pSlotBuffer, NULL, NULL);
+    }
+    return megabytesPerSecond((uint64_t)blockSize * readCount, getUSec(true) - start);
+}
+
+static void runPasses(FileStream* pStream, bool cold, uint8_t* pBuffer)
+{
+    printf("\nRandom reads, %s (MB/s)\n", cold ? "cold cache" : "warm cache");
+    printf("%8s %8s %16s", "block", "reads", "QD 1 blocking");
+    for (uint32_t q = 0; q < TF_ARRAY_COUNT(gQueueDepths); ++q)
+        printf("        QD %2u", gQueueDepths[q]);
+    printf("\n");
+
+    for (uint32_t b = 0; b < TF_ARRAY_COUNT(gBlockSizes); ++b)
+    {
+        uint32_t blockSize = gBlockSizes[b];
+        uint32_t readCount = BENCH_PASS_SIZE / blockSize;
+        if (readCount > BENCH_MAX_READ_COUNT)
+            readCount = BENCH_MAX_READ_COUNT;
+
+        uint64_t seed = 0x9E3779B97F4A7C15ull * (b + 1);
+        for (uint32_t i = 0; i < readCount; ++i)
+        {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            gOffsets[i] = ((seed >> 33) % (BENCH_FILE_SIZE / blockSize)) * blockSize;
+        }
+
+        if (cold)
+            dropCache();
+        printf("%8s %8u %16.1f", humanReadableSize(blockSize).str, readCount, benchBlocking(pStream, blockSize, readCount, pBuffer));
+        for (uint32_t q = 0; q < TF_ARRAY_COUNT(gQueueDepths); ++q)
+        {
+            if (cold)
+                dropCache();
+            printf(" %12.1f", benchQueued(pStream, blockSize, readCount, gQueueDepths[q], pBuffer));
+        }
+        printf("\n");
+    }
+}
+
+static ChainRead* nextChainRead(FileStream* pStream, uint32_t depth)
+{
+    uint32_t   index = tfrg_atomic32_add_relaxed(&gChainStartedReads, 1);
+    ChainRead* pRead = &gChainReads[index];
+    pRead->pStream = pStream;
+    pRead->mOffset = (uint64_t)((index * 2654435761u) % (BENCH_FILE_SIZE / CHAIN_READ_SIZE)) * CHAIN_READ_SIZE;
+    pRead->mDepth = depth;
+    return pRead;
+}
+
+static void chainCallback(void* pUserData, FileStream*, void* pDst, size_t bytesRead)
+{
+    ChainRead* pRead = (ChainRead*)pUserData;
+    if (bytesRead != CHAIN_READ_SIZE || *(const uint64_t*)pDst != pRead->mOffset)
+        tfrg_atomic32_add_relaxed(&gChainCorruptReads, 1);
+
+    for (uint32_t i = 0; i < 2 && pRead->mDepth < CHAIN_DEPTH; ++i)
+    {
+        ChainRead* pNext = nextChainRead(pRead->pStream, pRead->mDepth + 1);
+        fsReadAsync(pNext->pStream, (ssize_t)pNext->mOffset, CHAIN_READ_SIZE, pNext->mBuffer, chainCallback, pNext);
+    }
+    // Reads started above are counted before this one is done
+    tfrg_atomic32_add_relaxed(&gChainDoneReads, 1);
+}
+
+// Returns false if reads are still in flight after CHAIN_TIMEOUT_MS
+static bool runChainedReads(FileStream* pStream, const char* pName)
+{
+    tfrg_atomic32_store_relaxed(&gChainStartedReads, 0);
+    tfrg_atomic32_store_relaxed(&gChainDoneReads, 0);
+    tfrg_atomic32_store_relaxed(&gChainCorruptReads, 0);
+
+    int64_t start = getUSec(true);
+    for (uint32_t i = 0; i < FS_MAX_ASYNC_READS; ++i)
+    {
+        ChainRead* pRead = nextChainRead(pStream, 0);
+        fsReadAsync(pStream, (ssize_t)pRead->mOffset, CHAIN_READ_SIZE, pRead->mBuffer, chainCallback, pRead);
+    }
+    while (tfrg_atomic32_load_acquire(&gChainDoneReads) < CHAIN_READ_COUNT)
+    {
+        if (getUSec(true) - start > (int64_t)CHAIN_TIMEOUT_MS * 1000)
+        {
+            printf("%s: %u of %u chained reads done after %u ms\n", pName, tfrg_atomic32_load_acquire(&gChainDoneReads), CHAIN_READ_COUNT,
+                   CHAIN_TIMEOUT_MS);
+            return false;
+        }
+        threadSleep(1);
+    }
+
+    uint32_t corruptReads = tfrg_atomic32_load_acquire(&gChainCorruptReads);
+    gCorruptReads += corruptReads;
+    printf("%-16s %8u reads %10.1f MB/s %s\n", pName, CHAIN_READ_COUNT,
+           megabytesPerSecond((uint64_t)CHAIN_READ_COUNT * CHAIN_READ_SIZE, getUSec(true) - start), corruptReads ? "failed" : "ok");
+    return true;
+}
+
+/************************************************************************/
+// Archive round trip
+/************************************************************************/
+
+static uint8_t* createArchiveFileContent(uint32_t size, uint64_t seed)
+{
+    static const char text[] = "Blocks of this file are compressed, every fourth 64KB range is random. ";
+
+    uint8_t* pContent = (uint8_t*)tf_malloc(size + 1);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        if ((i >> 16) % 4 == 3)
+            pContent[i] = (uint8_t)(seed >> 56);
+        else
+            pContent[i] = (uint8_t)text[(i + (i >> 12)) % (sizeof(text) - 1)];
+    }
+    return pContent;
+}
+
+static void getArchiveFileName(uint32_t index, char* pOut, size_t size) { snprintf(pOut, size, "TestFileSystem%u.bin", index); }
+
+static bool writeArchiveSource(const char* fileName, const uint8_t* pContent, uint32_t size)
+{
+    FileStream stream = {};
+    if (!fsOpenStreamFromPath(RD_OTHER_FILES, fileName, FM_WRITE, &stream))
+        return false;
+    bool success = fsWriteToStream(&stream, pContent, size) == size;
+    fsCloseStream(&stream);
+    return success;
+}
+
+static void removeArchiveSource(const char* fileName)
+{
+    char path[FS_MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s", fsGetResourceDirectory(RD_OTHER_FILES), fileName);
+    remove(path);
+}
+
+static void checkArchive(bool condition, const char* pMessage, const char* pFileName)
+{
+    if (condition)
+        return;
+    printf("%s: %s\n", pFileName, pMessage);
+    ++gFailedChecks;
+}
+
+// Base archive holds every file, patch archive deletes ARCHIVE_DELETED_FILE, replaces ARCHIVE_REPLACED_FILE and adds ARCHIVE_NEW_FILE
+static bool createArchives(enum BunyArFileFormat format, const char* pBaseName, const char* pPatchName)
+{
+    char                            names[ARCHIVE_FILE_COUNT][64];
+    struct BunyArLibEntryCreateDesc entries[ARCHIVE_FILE_COUNT];
+    for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+    {
+        getArchiveFileName(i, names[i], sizeof(names[i]));
+        entries[i] = BUNYAR_LIB_FUNC_CREATE_DEFAULT_ENTRY_DESC;
+        entries[i].inputRd = RD_OTHER_FILES;
+        entries[i].inputPath = names[i];
+        entries[i].format = format;
+        entries[i].blockSizeKb = ARCHIVE_BLOCK_SIZE_KB;
+    }
+
+    struct BunyArLibCreateDesc desc = {};
+    desc.entryCount = ARCHIVE_FILE_COUNT;
+    desc.entries = entries;
+    desc.threadPoolSize = -1;
+    if (!bunyArLibCreate(RD_OTHER_FILES, pBaseName, &desc))
+        return false;
+
+    struct BunyArLibEntryCreateDesc patchEntries[3];
+    for (uint32_t i = 0; i < TF_ARRAY_COUNT(patchEntries); ++i)
+    {
+        patchEntries[i] = entries[0];
+        patchEntries[i].outputName = NULL;
+    }
+    patchEntries[0].inputPath = names[ARCHIVE_DELETED_FILE];
+    patchEntries[0].format = BUNYAR_FILE_FORMAT_TOMBSTONE;
+    patchEntries[1].inputPath = ARCHIVE_REPLACED_SOURCE;
+    patchEntries[1].outputName = names[ARCHIVE_REPLACED_FILE];
+    patchEntries[2].inputPath = ARCHIVE_NEW_FILE;
+
+    desc.entryCount = TF_ARRAY_COUNT(patchEntries);
+    desc.entries = patchEntries;
+    return bunyArLibCreate(RD_OTHER_FILES, pPatchName, &desc);
+}
+
+static void checkArchiveFile(ResourceDirectory rd, const char* pFileName, const uint8_t* pContent, uint32_t size)
+{
+    FileStream stream = {};
+    if (!fsOpenStreamFromPath(rd, pFileName, FM_READ, &stream))
+    {
+        checkArchive(false, "failed to open", pFileName);
+        return;
+    }
+    checkArchive(fsGetStreamFileSize(&stream) == (ssize_t)size, "wrong size", pFileName);
+
+    for (uint32_t c = 0; c < TF_ARRAY_COUNT(gArchiveChunkSizes); ++c)
+    {
+        uint32_t chunkSize = gArchiveChunkSizes[c];
+        uint32_t offset = 0;
+        fsSeekStream(&stream, SBO_START_OF_FILE, 0);
+        for (;;)
+        {
+            size_t bytesRead = fsReadFromStream(&stream, gReadBuffer, chunkSize);
+            uint32_t expected = size - offset < chunkSize ? size - offset : chunkSize;
+            if (bytesRead != expected || memcmp(gReadBuffer, pContent + offset, expected) != 0)
+            {
+                checkArchive(false, "sequential read returned wrong data", pFileName);
+                break;
+            }
+            offset += expected;
+            if (expected < chunkSize)
+                break;
+        }
+    }
+
+    uint64_t seed = 0x9E3779B97F4A7C15ull ^ size;
+    for (uint32_t i = 0; i < ARCHIVE_SEEK_COUNT && size; ++i)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t offset = (uint32_t)((seed >> 33) % size);
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t length = 1u + (uint32_t)((seed >> 33) % (2u * ARCHIVE_BLOCK_SIZE));
+        if (length > size - offset)
+            length = size - offset;
+        size_t bytesRead = 0;
+        if (fsSeekStream(&stream, SBO_START_OF_FILE, (ssize_t)offset))
+            bytesRead = fsReadFromStream(&stream, gReadBuffer, length);
+        if (bytesRead != length || memcmp(gReadBuffer, pContent + offset, length) != 0)
+        {
+            checkArchive(false, "random read returned wrong data", pFileName);
+            break;
+        }
+    }
+    fsCloseStream(&stream);
+}
+
+static void checkArchiveReads(const char* pBaseName, const char* pPatchName, ThreadSystem threadSystem)
+{
+    struct ArchiveOpenDesc desc = {};
+    desc.protectStreamCriticalSection = true;
+    desc.threadSystem = threadSystem;
+
+    IFileSystem base = {};
+    IFileSystem patch = {};
+    if (!fsArchiveOpen(RD_OTHER_FILES, pBaseName, &desc, &base))
+    {
+        checkArchive(false, "failed to open archive", pBaseName);
+        return;
+    }
+    if (!fsArchiveOpen(RD_OTHER_FILES, pPatchName, &desc, &patch))
+    {
+        checkArchive(false, "failed to open archive", pPatchName);
+        fsArchiveClose(&base);
+        return;
+    }
+
+    char fileName[64];
+    fsSetPathForResourceDir(&base, RM_CONTENT, RD_MIDDLEWARE_0, "");
+    for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+    {
+        getArchiveFileName(i, fileName, sizeof(fileName));
+        checkArchiveFile(RD_MIDDLEWARE_0, fileName, gArchiveFiles[i], gArchiveFileSizes[i]);
+    }
+
+    struct MountLayerDesc layers[2] = {};
+    layers[0].pIO = &base;
+    layers[1].pIO = &patch;
+    layers[1].priority = 1;
+    struct MountStackDesc stackDesc = { TF_ARRAY_COUNT(layers), layers };
+    IFileSystem           stack = {};
+    if (fsMountStackOpen(&stackDesc, &stack))
+    {
+        fsSetPathForResourceDir(&stack, RM_CONTENT, RD_MIDDLEWARE_1, "");
+        for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+        {
+            getArchiveFileName(i, fileName, sizeof(fileName));
+            if (i == ARCHIVE_DELETED_FILE)
+            {
+                FileStream stream = {};
+                uint64_t   uid = 0;
+                bool       opened = fsOpenStreamFromPath(RD_MIDDLEWARE_1, fileName, FM_READ, &stream);
+                if (opened)
+                    fsCloseStream(&stream);
+                checkArchive(!opened, "deleted file was opened", fileName);
+                checkArchive(!fsIoGetFileUid(&stack, RD_MIDDLEWARE_1, fileName, &uid), "deleted file was found", fileName);
+            }
+            else if (i == ARCHIVE_REPLACED_FILE)
+                checkArchiveFile(RD_MIDDLEWARE_1, fileName, gReplacedFile, gArchiveFileSizes[i]);
+            else
+                checkArchiveFile(RD_MIDDLEWARE_1, fileName, gArchiveFiles[i], gArchiveFileSizes[i]);
+        }
+        checkArchiveFile(RD_MIDDLEWARE_1, ARCHIVE_NEW_FILE, gNewFile, ARCHIVE_BLOCK_SIZE + 1u);
+        fsMountStackClose(&stack);
+    }
+    else
+        checkArchive(false, "failed to mount", pPatchName);
+
+    fsArchiveClose(&patch);
+    fsArchiveClose(&base);
+}
+
+// Reads file front to back in 'chunkSize' pieces, returns false if data doesn't match 'pContent'
+static bool readArchiveFile(ResourceDirectory rd, const char* pFileName, const uint8_t* pContent, uint32_t size, uint32_t chunkSize)
+{
+    FileStream stream = {};
+    if (!fsOpenStreamFromPath(rd, pFileName, FM_READ, &stream))
+        return false;
+
+    bool success = true;
+    for (uint32_t offset = 0; offset < size && success; offset += chunkSize)
+    {
+        uint32_t expected = size - offset < chunkSize ? size - offset : chunkSize;
+        success = fsReadFromStream(&stream, gReadBuffer, chunkSize) == expected && memcmp(gReadBuffer, pContent + offset, expected) == 0;
+    }
+    fsCloseStream(&stream);
+    return success;
+}
+
+static void checkBlockCache(const char* pBaseName)
+{
+    char fileName[64];
+    getArchiveFileName(ARCHIVE_CACHE_FILE, fileName, sizeof(fileName));
+    const uint8_t* pContent = gArchiveFiles[ARCHIVE_CACHE_FILE];
+    uint32_t       size = gArchiveFileSizes[ARCHIVE_CACHE_FILE];
+    // Short last block is read whole by the last chunk and isn't cached
+    uint32_t       blockCount = size / ARCHIVE_BLOCK_SIZE;
+
+    struct ArchiveOpenDesc desc = {};
+    IFileSystem            archive = {};
+    if (!fsArchiveOpen(RD_OTHER_FILES, pBaseName, &desc, &archive))
+    {
+        checkArchive(false, "failed to open archive", pBaseName);
+        return;
+    }
+    fsSetPathForResourceDir(&archive, RM_CONTENT, RD_MIDDLEWARE_0, "");
+
+    // Half block reads go through the staging buffer, which caches every block
+    struct BunyArBlockCacheStats before = {};
+    struct BunyArBlockCacheStats after = {};
+    checkArchive(readArchiveFile(RD_MIDDLEWARE_0, fileName, pContent, size, ARCHIVE_BLOCK_SIZE / 2u), "read returned wrong data", fileName);
+    fsArchiveGetBlockCacheStats(&before);
+    checkArchive(readArchiveFile(RD_MIDDLEWARE_0, fileName, pContent, size, ARCHIVE_BLOCK_SIZE / 2u), "cached read returned wrong data",
+                 fileName);
+    fsArchiveGetBlockCacheStats(&after);
+    checkArchive(after.hitCount - before.hitCount >= blockCount, "re-read blocks were not served by the cache", fileName);
+    checkArchive(after.missCount == before.missCount, "re-read blocks missed the cache", fileName);
+
+    before = after;
+    fsArchiveSetBlockCacheBudget(ARCHIVE_CACHE_BUDGET);
+    fsArchiveGetBlockCacheStats(&after);
+    checkArchive(after.budget == ARCHIVE_CACHE_BUDGET && after.usedSize <= ARCHIVE_CACHE_BUDGET, "cache exceeds lowered budget", fileName);
+    checkArchive(after.evictionCount > before.evictionCount, "lowered budget evicted no blocks", fileName);
+    checkArchive(readArchiveFile(RD_MIDDLEWARE_0, fileName, pContent, size, ARCHIVE_BLOCK_SIZE / 2u), "read returned wrong data", fileName);
+    fsArchiveGetBlockCacheStats(&after);
+    checkArchive(after.usedSize <= ARCHIVE_CACHE_BUDGET, "cache grew past budget", fileName);
+    fsArchiveSetBlockCacheBudget(BUNYAR_BLOCK_CACHE_DEFAULT_SIZE);
+    fsArchiveClose(&archive);
+
+    desc.disableBlockCache = true;
+    if (!fsArchiveOpen(RD_OTHER_FILES, pBaseName, &desc, &archive))
+    {
+        checkArchive(false, "failed to open archive", pBaseName);
+        return;
+    }
+    fsSetPathForResourceDir(&archive, RM_CONTENT, RD_MIDDLEWARE_0, "");
+    fsArchiveGetBlockCacheStats(&before);
+    for (uint32_t i = 0; i < 2; ++i)
+        checkArchive(readArchiveFile(RD_MIDDLEWARE_0, fileName, pContent, size, ARCHIVE_BLOCK_SIZE / 2u), "uncached read returned wrong data",
+                     fileName);
+    fsArchiveGetBlockCacheStats(&after);
+    checkArchive(after.hitCount == before.hitCount && after.blockCount == before.blockCount, "archive without cache used it", fileName);
+    fsArchiveClose(&archive);
+}
+
+static void checkReadAhead(const char* pBaseName, ThreadSystem threadSystem)
+{
+    char fileName[64];
+    getArchiveFileName(ARCHIVE_CACHE_FILE, fileName, sizeof(fileName));
+    const uint8_t* pContent = gArchiveFiles[ARCHIVE_CACHE_FILE];
+    uint32_t       size = gArchiveFileSizes[ARCHIVE_CACHE_FILE];
+
+    struct ArchiveOpenDesc desc = {};
+    desc.threadSystem = threadSystem;
+    desc.readAheadDepth = BUNYAR_READ_AHEAD_MAX_DEPTH;
+    IFileSystem archive = {};
+    if (!fsArchiveOpen(RD_OTHER_FILES, pBaseName, &desc, &archive))
+    {
+        checkArchive(false, "failed to open archive", pBaseName);
+        return;
+    }
+    fsSetPathForResourceDir(&archive, RM_CONTENT, RD_MIDDLEWARE_0, "");
+
+    // Reader waits for blocks being read ahead, only the first block misses the cache
+    struct BunyArBlockCacheStats before = {};
+    struct BunyArBlockCacheStats after = {};
+    fsArchiveGetBlockCacheStats(&before);
+    checkArchive(readArchiveFile(RD_MIDDLEWARE_0, fileName, pContent, size, ARCHIVE_BLOCK_SIZE / 2u), "read returned wrong data", fileName);
+    fsArchiveGetBlockCacheStats(&after);
+    uint64_t readAheadCount = after.readAheadCount - before.readAheadCount;
+    checkArchive(readAheadCount > 0, "no blocks were read ahead", fileName);
+    checkArchive(after.hitCount - before.hitCount >= readAheadCount, "blocks read ahead were not served by the cache", fileName);
+    checkArchive(after.missCount - before.missCount <= 1u, "blocks following the first one were not read ahead", fileName);
+    fsArchiveClose(&archive);
+
+    // Every close waits for tasks still decompressing blocks for the stream
+    if (!fsArchiveOpen(RD_OTHER_FILES, pBaseName, &desc, &archive))
+    {
+        checkArchive(false, "failed to open archive", pBaseName);
+        return;
+    }
+    fsSetPathForResourceDir(&archive, RM_CONTENT, RD_MIDDLEWARE_0, "");
+    fsArchiveGetBlockCacheStats(&before);
+    for (uint32_t i = 0; i < ARCHIVE_READ_AHEAD_CLOSE_COUNT; ++i)
+    {
+        FileStream stream = {};
+        if (!fsOpenStreamFromPath(RD_MIDDLEWARE_0, fileName, FM_READ, &stream))
+        {
+            checkArchive(false, "failed to open", fileName);
+            break;
+        }
+        // Reads stay sequential so read-ahead grows, start of the file is moved by one block every time
+        fsSeekStream(&stream, SBO_START_OF_FILE, (ssize_t)(i % (size / ARCHIVE_BLOCK_SIZE)) * ARCHIVE_BLOCK_SIZE);
+        for (uint32_t r = 0; r < 2; ++r)
+            fsReadFromStream(&stream, gReadBuffer, ARCHIVE_BLOCK_SIZE / 2u);
+        fsCloseStream(&stream);
+    }
+    fsArchiveGetBlockCacheStats(&after);
+    checkArchive(after.readAheadCount > before.readAheadCount, "no blocks were read ahead before close", fileName);
+    checkArchive(readArchiveFile(RD_MIDDLEWARE_0, fileName, pContent, size, ARCHIVE_BLOCK_SIZE / 2u),
+                 "read after closing streams with read-ahead returned wrong data", fileName);
+    fsArchiveClose(&archive);
+}
+
+// Text files which differ only by numbers, returns size of the file written to 'pOut'
+static uint32_t createDictionaryFileContent(uint32_t index, char* pOut, uint32_t size)
+{
+    static const char* materials[] = { "stone", "metal", "wood", "glass" };
+
+    uint64_t seed = 0x9E3779B97F4A7C15ull * (index + 1);
+    uint32_t length = (uint32_t)snprintf(pOut, size, "{\n    \"name\": \"object%u\",\n    \"children\": [\n", index);
+    for (uint32_t i = 0; length + 256u < size && i < 12u; ++i)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        length += (uint32_t)snprintf(pOut + length, size - length,
+                                     "        { \"position\": [%d, %d, %d], \"scale\": %u.%02u, \"material\": \"%s\", \"visible\": %s },\n",
+                                     (int)(seed >> 40) % 1000, (int)(seed >> 24) % 1000, (int)(seed >> 52) % 100, (uint32_t)(seed >> 60),
+                                     (uint32_t)(seed >> 33) % 100u, materials[(seed >> 20) % TF_ARRAY_COUNT(materials)],
+                                     (seed >> 19) & 1 ? "true" : "false");
+    }
+    length += (uint32_t)snprintf(pOut + length, size - length, "    ]\n}\n");
+    return length;
+}
+
+static void getDictionaryFileName(uint32_t index, char* pOut, size_t size)
+{
+    snprintf(pOut, size, "TestFileSystemDictionary%u.json", index);
+}
+
+static bool getArchiveNodeOffset(IFileSystem* pArchive, const char* pFileName, uint64_t* pOutOffset)
+{
+    uint64_t                     nodeId = 0;
+    struct BunyArNodeDescription node = {};
+    if (!fsArchiveGetNodeId(pArchive, pFileName, &nodeId) || !fsArchiveGetNodeDescription(pArchive, nodeId, &node))
+        return false;
+    *pOutOffset = node.offset;
+    return true;
+}
+
+// Returns dictionary ID of the frame of the first block of the file, 0 if it has none
+static uint32_t getArchiveFileDictionaryId(IFileSystem* pArchive, FileStream* pArchiveStream, ResourceDirectory rd, const char* pFileName)
+{
+    uint64_t                       nodeOffset = 0;
+    FileStream                     stream = {};
+    struct BunyArBlockFormatHeader header = {};
+    const BunyArBlockPointer*      pBlocks = NULL;
+    if (!getArchiveNodeOffset(pArchive, pFileName, &nodeOffset) || !fsOpenStreamFromPath(rd, pFileName, FM_READ, &stream))
+        return 0;
+    struct BunyArBlockInfo block = {};
+    if (fsArchiveGetFileBlockMetadata(&stream, &header, &pBlocks) && header.blockCount)
+        block = bunyArDecodeBlockPointer(pBlocks[0]);
+    fsCloseStream(&stream);
+    if (!block.isCompressed)
+        return 0;
+
+    // Block data follows the header and the block pointer table
+    uint8_t frameHeader[32];
+    size_t  frameHeaderSize = block.size < sizeof(frameHeader) ? block.size : sizeof(frameHeader);
+    ssize_t offset = (ssize_t)(nodeOffset + sizeof(header) + sizeof(BunyArBlockPointer) * header.blockCount + block.offset);
+    if (!fsSeekStream(pArchiveStream, SBO_START_OF_FILE, offset) ||
+        fsReadFromStream(pArchiveStream, frameHeader, frameHeaderSize) != frameHeaderSize)
+        return 0;
+    return ZSTD_getDictID_fromFrame(frameHeader, frameHeaderSize);
+}
+
+static void checkDictionary(void)
+{
+    char                             names[ARCHIVE_DICTIONARY_FILE_COUNT][64];
+    uint32_t                         sizes[ARCHIVE_DICTIONARY_FILE_COUNT];
+    char*                            pContents = (char*)tf_malloc(ARCHIVE_DICTIONARY_FILE_COUNT * ARCHIVE_DICTIONARY_FILE_SIZE);
+    struct BunyArLibEntryCreateDesc* pEntries =
+        (struct BunyArLibEntryCreateDesc*)tf_malloc(ARCHIVE_DICTIONARY_FILE_COUNT * sizeof(struct BunyArLibEntryCreateDesc));
+    bool success = true;
+    for (uint32_t i = 0; i < ARCHIVE_DICTIONARY_FILE_COUNT; ++i)
+    {
+        char* pContent = pContents + i * ARCHIVE_DICTIONARY_FILE_SIZE;
+        getDictionaryFileName(i, names[i], sizeof(names[i]));
+        sizes[i] = createDictionaryFileContent(i, pContent, ARCHIVE_DICTIONARY_FILE_SIZE);
+        success = writeArchiveSource(names[i], (const uint8_t*)pContent, sizes[i]) && success;
+
+        pEntries[i] = BUNYAR_LIB_FUNC_CREATE_DEFAULT_ENTRY_DESC;
+        pEntries[i].inputRd = RD_OTHER_FILES;
+        pEntries[i].inputPath = names[i];
+        pEntries[i].format = BUNYAR_FILE_FORMAT_ZSTD_BLOCKS;
+        pEntries[i].blockSizeKb = ARCHIVE_BLOCK_SIZE_KB;
+    }
+
+    struct BunyArLibCreateDesc desc = {};
+    desc.entryCount = ARCHIVE_DICTIONARY_FILE_COUNT;
+    desc.entries = pEntries;
+    desc.threadPoolSize = -1;
+    desc.zstdDictionarySizeKb = ARCHIVE_DICTIONARY_SIZE_KB;
+    struct ArchiveOpenDesc openDesc = {};
+    IFileSystem            archive = {};
+    FileStream             archiveStream = {};
+    if (!success || !bunyArLibCreate(RD_OTHER_FILES, ARCHIVE_DICTIONARY_NAME, &desc))
+        checkArchive(false, "failed to create archive", ARCHIVE_DICTIONARY_NAME);
+    else if (!fsArchiveOpen(RD_OTHER_FILES, ARCHIVE_DICTIONARY_NAME, &openDesc, &archive) ||
+             !fsOpenStreamFromPath(RD_OTHER_FILES, ARCHIVE_DICTIONARY_NAME, FM_READ, &archiveStream))
+    {
+        checkArchive(false, "failed to open archive", ARCHIVE_DICTIONARY_NAME);
+        fsArchiveClose(&archive);
+    }
+    else
+    {
+        struct BunyArDescription info = {};
+        fsArchiveGetDescription(&archive, &info);
+        checkArchive(info.dictionaryCount == 1, "archive has no dictionary", ARCHIVE_DICTIONARY_NAME);
+
+        fsSetPathForResourceDir(&archive, RM_CONTENT, RD_MIDDLEWARE_0, "");
+        for (uint32_t i = 0; i < ARCHIVE_DICTIONARY_FILE_COUNT; ++i)
+        {
+            const uint8_t* pContent = (const uint8_t*)pContents + i * ARCHIVE_DICTIONARY_FILE_SIZE;
+            checkArchive(getArchiveFileDictionaryId(&archive, &archiveStream, RD_MIDDLEWARE_0, names[i]) != 0,
+                         "frame has no dictionary ID", names[i]);
+            checkArchive(readArchiveFile(RD_MIDDLEWARE_0, names[i], pContent, sizes[i], 7u), "read returned wrong data", names[i]);
+            checkArchive(readArchiveFile(RD_MIDDLEWARE_0, names[i], pContent, sizes[i], ARCHIVE_DICTIONARY_FILE_SIZE),
+                         "whole file read returned wrong data", names[i]);
+        }
+        fsCloseStream(&archiveStream);
+        fsArchiveClose(&archive);
+    }
+
+    for (uint32_t i = 0; i < ARCHIVE_DICTIONARY_FILE_COUNT; ++i)
+        removeArchiveSource(names[i]);
+    removeArchiveSource(ARCHIVE_DICTIONARY_NAME);
+    tf_free(pEntries);
+    tf_free(pContents);
+}
+
+// Packs 'count' source files with 'format' and options of 'pDesc'
+static bool createArchive(const char* pArchiveName, const char* const* ppNames, uint32_t count, enum BunyArFileFormat format,
+                          struct BunyArLibCreateDesc* pDesc)
+{
+    struct BunyArLibEntryCreateDesc* pEntries =
+        (struct BunyArLibEntryCreateDesc*)tf_malloc(count * sizeof(struct BunyArLibEntryCreateDesc));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        pEntries[i] = BUNYAR_LIB_FUNC_CREATE_DEFAULT_ENTRY_DESC;
+        pEntries[i].inputRd = RD_OTHER_FILES;
+        pEntries[i].inputPath = ppNames[i];
+        pEntries[i].format = format;
+        pEntries[i].blockSizeKb = ARCHIVE_BLOCK_SIZE_KB;
+    }
+    pDesc->entryCount = count;
+    pDesc->entries = pEntries;
+    pDesc->threadPoolSize = -1;
+    bool success = bunyArLibCreate(RD_OTHER_FILES, pArchiveName, pDesc);
+    tf_free(pEntries);
+    return success;
+}
+
+// Copies of the first file and a file of the same size with other content
+static void checkDeduplication(void)
+{
+    static const char* names[] = {
+        "TestFileSystemDuplicate0.bin",
+        "TestFileSystemDuplicate1.bin",
+        "TestFileSystemDuplicate2.bin",
+        "TestFileSystemDuplicate3.bin",
+    };
+    static const bool duplicates[TF_ARRAY_COUNT(names)] = { true, true, false, true };
+
+    const uint32_t size = ARCHIVE_BLOCK_SIZE + 1u;
+    uint8_t*       pDuplicate = createArchiveFileContent(size, ARCHIVE_FILE_COUNT + 3);
+    uint8_t*       pOther = createArchiveFileContent(size, ARCHIVE_FILE_COUNT + 4);
+    bool           success = true;
+    for (uint32_t i = 0; i < TF_ARRAY_COUNT(names); ++i)
+        success = writeArchiveSource(names[i], duplicates[i] ? pDuplicate : pOther, size) && success;
+
+    for (uint32_t d = 0; d < 2 && success; ++d)
+    {
+        bool                       skipDeduplication = d == 1;
+        struct BunyArLibCreateDesc desc = {};
+        desc.skipDeduplication = skipDeduplication;
+        if (!createArchive(ARCHIVE_DUPLICATES_NAME, names, TF_ARRAY_COUNT(names), BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, &desc))
+        {
+            checkArchive(false, "failed to create archive", ARCHIVE_DUPLICATES_NAME);
+            break;
+        }
+
+        struct ArchiveOpenDesc openDesc = {};
+        IFileSystem            archive = {};
+        if (!fsArchiveOpen(RD_OTHER_FILES, ARCHIVE_DUPLICATES_NAME, &openDesc, &archive))
+        {
+            checkArchive(false, "failed to open archive", ARCHIVE_DUPLICATES_NAME);
+            break;
+        }
+        fsSetPathForResourceDir(&archive, RM_CONTENT, RD_MIDDLEWARE_0, "");
+
+        uint64_t offsets[TF_ARRAY_COUNT(names)] = {};
+        for (uint32_t i = 0; i < TF_ARRAY_COUNT(names); ++i)
+        {
+            checkArchive(getArchiveNodeOffset(&archive, names[i], &offsets[i]), "failed to find node", names[i]);
+            checkArchive(readArchiveFile(RD_MIDDLEWARE_0, names[i], duplicates[i] ? pDuplicate : pOther, size, 7u),
+                         "read returned wrong data", names[i]);
+        }
+        for (uint32_t i = 1; i < TF_ARRAY_COUNT(names); ++i)
+        {
+            bool shared = offsets[i] == offsets[0];
+            if (duplicates[i] && !skipDeduplication)
+                checkArchive(shared, "duplicate doesn't share data", names[i]);
+            else
+                checkArchive(!shared, skipDeduplication ? "data is shared with deduplication disabled" : "other content shares data",
+                             names[i]);
+        }
+        fsArchiveClose(&archive);
+    }
+    if (!success)
+        checkArchive(false, "failed to write source files", fsGetResourceDirectory(RD_OTHER_FILES));
+
+    for (uint32_t i = 0; i < TF_ARRAY_COUNT(names); ++i)
+        removeArchiveSource(names[i]);
+    removeArchiveSource(ARCHIVE_DUPLICATES_NAME);
+    tf_free(pDuplicate);
+    tf_free(pOther);
+}
+
+static void checkAccessTrace(enum BunyArFileFormat format, const char* pBaseName)
+{
+    // Neither name nor size order, last file is opened again
+    static const uint32_t traceOrder[] = { 8u, 2u, 6u, 4u, 8u };
+    static const uint32_t tracedCount = TF_ARRAY_COUNT(traceOrder) - 1u;
+
+    struct ArchiveOpenDesc openDesc = {};
+    openDesc.recordAccessTrace = true;
+    IFileSystem archive = {};
+    if (!fsArchiveOpen(RD_OTHER_FILES, pBaseName, &openDesc, &archive))
+    {
+        checkArchive(false, "failed to open archive", pBaseName);
+        return;
+    }
+    fsSetPathForResourceDir(&archive, RM_CONTENT, RD_MIDDLEWARE_0, "");
+
+    char fileName[64];
+    for (uint32_t i = 0; i < TF_ARRAY_COUNT(traceOrder); ++i)
+    {
+        getArchiveFileName(traceOrder[i], fileName, sizeof(fileName));
+        FileStream stream = {};
+        if (fsOpenStreamFromPath(RD_MIDDLEWARE_0, fileName, FM_READ, &stream))
+            fsCloseStream(&stream);
+        else
+            checkArchive(false, "failed to open", fileName);
+    }
+    bool written = fsArchiveWriteAccessTrace(&archive, RD_OTHER_FILES, ARCHIVE_TRACE_NAME);
+    fsArchiveClose(&archive);
+    if (!written)
+    {
+        checkArchive(false, "failed to write access trace", ARCHIVE_TRACE_NAME);
+        return;
+    }
+
+    char        names[ARCHIVE_FILE_COUNT][64];
+    const char* pNames[ARCHIVE_FILE_COUNT];
+    for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+    {
+        getArchiveFileName(i, names[i], sizeof(names[i]));
+        pNames[i] = names[i];
+    }
+    struct BunyArLibCreateDesc desc = {};
+    desc.accessTracePath = ARCHIVE_TRACE_NAME;
+    if (!createArchive(ARCHIVE_TRACED_NAME, pNames, ARCHIVE_FILE_COUNT, format, &desc))
+        checkArchive(false, "failed to create archive", ARCHIVE_TRACED_NAME);
+    else if (!fsArchiveOpen(RD_OTHER_FILES, ARCHIVE_TRACED_NAME, &openDesc, &archive))
+        checkArchive(false, "failed to open archive", ARCHIVE_TRACED_NAME);
+    else
+    {
+        uint64_t offsets[ARCHIVE_FILE_COUNT] = {};
+        for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+            checkArchive(getArchiveNodeOffset(&archive, names[i], &offsets[i]), "failed to find node", names[i]);
+
+        // Data of every untraced file with content follows the last traced file
+        uint64_t tracedEnd = 0;
+        for (uint32_t i = 0; i < tracedCount; ++i)
+        {
+            uint64_t offset = offsets[traceOrder[i]];
+            checkArchive(offset > tracedEnd, "data isn't in trace order", names[traceOrder[i]]);
+            tracedEnd = offset;
+        }
+        for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+        {
+            bool traced = false;
+            for (uint32_t t = 0; t < tracedCount; ++t)
+                traced = traced || traceOrder[t] == i;
+            if (!traced && gArchiveFileSizes[i])
+                checkArchive(offsets[i] > tracedEnd, "untraced data precedes traced data", names[i]);
+        }
+        fsArchiveClose(&archive);
+    }
+    removeArchiveSource(ARCHIVE_TRACE_NAME);
+    removeArchiveSource(ARCHIVE_TRACED_NAME);
+}
+
+static enum BunyArFileFormat getArchiveNodeFormat(IFileSystem* pArchive, const char* pFileName)
+{
+    uint64_t                     nodeId = 0;
+    struct BunyArNodeDescription node = {};
+    if (!fsArchiveGetNodeId(pArchive, pFileName, &nodeId) || !fsArchiveGetNodeDescription(pArchive, nodeId, &node))
+        return BUNYAR_FILE_FORMAT_TOMBSTONE;
+    return node.format;
+}
+
+// Random, unchanged repetitive and changed repetitive file
+static void checkAdaptiveFormat(void)
+{
+    static const char* names[] = {
+        "TestFileSystemAdaptive0.bin",
+        "TestFileSystemAdaptive1.bin",
+        "TestFileSystemAdaptive2.bin",
+    };
+
+    const uint32_t size = 2u * ARCHIVE_BLOCK_SIZE;
+    uint8_t*       pContents[TF_ARRAY_COUNT(names)];
+    uint64_t       seed = 0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < TF_ARRAY_COUNT(names); ++i)
+        pContents[i] = (uint8_t*)tf_malloc(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        pContents[0][i] = (uint8_t)(seed >> 56);
+        pContents[1][i] = (uint8_t)(i >> 10);
+        pContents[2][i] = (uint8_t)(i >> 12);
+    }
+
+    bool success = true;
+    for (uint32_t i = 0; i < TF_ARRAY_COUNT(names); ++i)
+        success = writeArchiveSource(names[i], pContents[i], size) && success;
+
+    struct ArchiveOpenDesc     openDesc = {};
+    IFileSystem                archive = {};
+    struct BunyArLibCreateDesc desc = {};
+    desc.adaptiveFormat.readSpeedMBps = ARCHIVE_SLOW_READ_SPEED_MBPS;
+    if (!success || !createArchive(ARCHIVE_ADAPTIVE_NAME, names, TF_ARRAY_COUNT(names), BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, &desc))
+        checkArchive(false, "failed to create archive", ARCHIVE_ADAPTIVE_NAME);
+    else if (!fsArchiveOpen(RD_OTHER_FILES, ARCHIVE_ADAPTIVE_NAME, &openDesc, &archive))
+        checkArchive(false, "failed to open archive", ARCHIVE_ADAPTIVE_NAME);
+    else
+    {
+        enum BunyArFileFormat formats[TF_ARRAY_COUNT(names)];
+        for (uint32_t i = 0; i < TF_ARRAY_COUNT(names); ++i)
+            formats[i] = getArchiveNodeFormat(&archive, names[i]);
+        fsArchiveClose(&archive);
+        checkArchive(formats[0] == BUNYAR_FILE_FORMAT_RAW, "random data is compressed", names[0]);
+        for (uint32_t i = 1; i < TF_ARRAY_COUNT(names); ++i)
+            checkArchive(formats[i] == BUNYAR_FILE_FORMAT_LZ4_BLOCKS || formats[i] == BUNYAR_FILE_FORMAT_ZSTD_BLOCKS,
+                         "repetitive data isn't compressed for slow storage", names[i]);
+
+        // Changed file is picked again, for storage faster than any decompression
+        pContents[2][0] ^= 1;
+        desc = {};
+        desc.adaptiveFormat.readSpeedMBps = ARCHIVE_FAST_READ_SPEED_MBPS;
+        desc.previousArchivePath = ARCHIVE_ADAPTIVE_NAME;
+        if (!writeArchiveSource(names[2], pContents[2], size) ||
+            !createArchive(ARCHIVE_ADAPTIVE_NAME, names, TF_ARRAY_COUNT(names), BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, &desc))
+            checkArchive(false, "failed to rebuild archive", ARCHIVE_ADAPTIVE_NAME);
+        else if (!fsArchiveOpen(RD_OTHER_FILES, ARCHIVE_ADAPTIVE_NAME, &openDesc, &archive))
+            checkArchive(false, "failed to open archive", ARCHIVE_ADAPTIVE_NAME);
+        else
+        {
+            fsSetPathForResourceDir(&archive, RM_CONTENT, RD_MIDDLEWARE_0, "");
+            checkArchive(getArchiveNodeFormat(&archive, names[0]) == BUNYAR_FILE_FORMAT_RAW, "random data is compressed", names[0]);
+            checkArchive(getArchiveNodeFormat(&archive, names[1]) == formats[1], "unchanged file didn't keep its format", names[1]);
+            checkArchive(getArchiveNodeFormat(&archive, names[2]) == BUNYAR_FILE_FORMAT_RAW, "changed file kept its format", names[2]);
+            for (uint32_t i = 0; i < TF_ARRAY_COUNT(names); ++i)
+                checkArchive(readArchiveFile(RD_MIDDLEWARE_0, names[i], pContents[i], size, ARCHIVE_BLOCK_SIZE / 2u),
+                             "read returned wrong data", names[i]);
+            fsArchiveClose(&archive);
+        }
+    }
+
+    for (uint32_t i = 0; i < TF_ARRAY_COUNT(names); ++i)
+    {
+        removeArchiveSource(names[i]);
+        tf_free(pContents[i]);
+    }
+    removeArchiveSource(ARCHIVE_ADAPTIVE_NAME);
+}
+
+static void checkBenchmarks(enum BunyArFileFormat format, const char* pBaseName)
+{
+    struct BunyArLibBenchmarkDesc    desc = {};
+    struct BunyArLibBenchmarkResults results = {};
+    desc.roundCount = 1;
+    desc.threadCount = 1;
+    if (!bunyArLibArchiveBenchmarks(RD_OTHER_FILES, pBaseName, &desc, &results))
+    {
+        checkArchive(false, "benchmarks failed", pBaseName);
+        return;
+    }
+
+    // Empty file is stored raw
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+        size += gArchiveFileSizes[i];
+    uint64_t fileCount = 0;
+    for (uint32_t i = 0; i < BUNYAR_LIB_BENCH_FORMAT_COUNT; ++i)
+    {
+        const struct BunyArLibFormatBenchmarkResult* pResult = &results.formats[i];
+        fileCount += pResult->fileCount;
+        checkArchive(pResult->multiThreadSpeed == 0.0, "single thread run has multithreaded results", bunyArFormatName(pResult->format));
+        if (pResult->format != format)
+            continue;
+        checkArchive(pResult->fileCount == ARCHIVE_FILE_COUNT - 1u && pResult->fileSize == size, "wrong files of format",
+                     bunyArFormatName(format));
+        checkArchive(pResult->compressedSize && pResult->compressedSize < size, "wrong compressed size", bunyArFormatName(format));
+        checkArchive(pResult->singleThreadSpeed > 0.0, "decompression speed isn't measured", bunyArFormatName(format));
+    }
+    checkArchive(fileCount == ARCHIVE_FILE_COUNT, "files are missing from results", pBaseName);
+}
+
+static void runArchiveRoundTrip(void)
+{
+    static const struct
+    {
+        enum BunyArFileFormat format;
+        const char*           pName;
+        const char*           pBaseName;
+        const char*           pPatchName;
+    } formats[] = {
+        { BUNYAR_FILE_FORMAT_LZ4_BLOCKS, "LZ4", "TestFileSystemLz4.bunyar", "TestFileSystemLz4Patch.bunyar" },
+        { BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, "zstd", "TestFileSystemZstd.bunyar", "TestFileSystemZstdPatch.bunyar" },
+    };
+
+    char fileName[64];
+    bool success = true;
+    for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+    {
+        getArchiveFileName(i, fileName, sizeof(fileName));
+        gArchiveFiles[i] = createArchiveFileContent(gArchiveFileSizes[i], i + 1);
+        success = writeArchiveSource(fileName, gArchiveFiles[i], gArchiveFileSizes[i]) && success;
+    }
+    gReplacedFile = createArchiveFileContent(gArchiveFileSizes[ARCHIVE_REPLACED_FILE], ARCHIVE_FILE_COUNT + 1);
+    gNewFile = createArchiveFileContent(ARCHIVE_BLOCK_SIZE + 1u, ARCHIVE_FILE_COUNT + 2);
+    success = writeArchiveSource(ARCHIVE_REPLACED_SOURCE, gReplacedFile, gArchiveFileSizes[ARCHIVE_REPLACED_FILE]) && success;
+    success = writeArchiveSource(ARCHIVE_NEW_FILE, gNewFile, ARCHIVE_BLOCK_SIZE + 1u) && success;
+    // Largest chunk, random reads are at most 2 blocks
+    gReadBuffer = (uint8_t*)tf_malloc(gArchiveChunkSizes[TF_ARRAY_COUNT(gArchiveChunkSizes) - 1]);
+
+    ThreadSystem threadSystem = NULL;
+    threadSystemInit(&threadSystem, &gThreadSystemInitDescDefault);
+
+    printf("Archive round trip\n");
+    for (uint32_t f = 0; f < TF_ARRAY_COUNT(formats) && success; ++f)
+    {
+        if (!createArchives(formats[f].format, formats[f].pBaseName, formats[f].pPatchName))
+        {
+            checkArchive(false, "failed to create archive", formats[f].pBaseName);
+            continue;
+        }
+        uint32_t failedChecks = gFailedChecks;
+        checkArchiveReads(formats[f].pBaseName, formats[f].pPatchName, NULL);
+        printf("%-6s %-16s %s\n", formats[f].pName, "single threaded", failedChecks == gFailedChecks ? "ok" : "failed");
+        failedChecks = gFailedChecks;
+        checkArchiveReads(formats[f].pBaseName, formats[f].pPatchName, threadSystem);
+        printf("%-6s %-16s %s\n", formats[f].pName, "thread system", failedChecks == gFailedChecks ? "ok" : "failed");
+        failedChecks = gFailedChecks;
+        checkBlockCache(formats[f].pBaseName);
+        printf("%-6s %-16s %s\n", formats[f].pName, "block cache", failedChecks == gFailedChecks ? "ok" : "failed");
+        failedChecks = gFailedChecks;
+        checkReadAhead(formats[f].pBaseName, threadSystem);
+        printf("%-6s %-16s %s\n", formats[f].pName, "read-ahead", failedChecks == gFailedChecks ? "ok" : "failed");
+        failedChecks = gFailedChecks;
+        checkAccessTrace(formats[f].format, formats[f].pBaseName);
+        printf("%-6s %-16s %s\n", formats[f].pName, "access trace", failedChecks == gFailedChecks ? "ok" : "failed");
+        failedChecks = gFailedChecks;
+        checkBenchmarks(formats[f].format, formats[f].pBaseName);
+        printf("%-6s %-16s %s\n", formats[f].pName, "benchmarks", failedChecks == gFailedChecks ? "ok" : "failed");
+        removeArchiveSource(formats[f].pBaseName);
+        removeArchiveSource(formats[f].pPatchName);
+    }
+    if (!success)
+        checkArchive(false, "failed to write source files", fsGetResourceDirectory(RD_OTHER_FILES));
+
+    uint32_t failedChecks = gFailedChecks;
+    checkDictionary();
+    printf("%-6s %-16s %s\n", "zstd", "dictionary", failedChecks == gFailedChecks ? "ok" : "failed");
+    failedChecks = gFailedChecks;
+    checkDeduplication();
+    printf("%-6s %-16s %s\n", "zstd", "deduplication", failedChecks == gFailedChecks ? "ok" : "failed");
+    failedChecks = gFailedChecks;
+    checkAdaptiveFormat();
+    printf("%-6s %-16s %s\n", "auto", "adaptive format", failedChecks == gFailedChecks ? "ok" : "failed");
+
+    threadSystemExit(&threadSystem, &gThreadSystemExitDescDefault);
+    for (uint32_t i = 0; i < ARCHIVE_FILE_COUNT; ++i)
+    {
+        getArchiveFileName(i, fileName, sizeof(fileName));
+        removeArchiveSource(fileName);
+        tf_free(gArchiveFiles[i]);
+    }
+    removeArchiveSource(ARCHIVE_REPLACED_SOURCE);
+    removeArchiveSource(ARCHIVE_NEW_FILE);
+    tf_free(gReplacedFile);
+    tf_free(gNewFile);
+    tf_free(gReadBuffer);
+}
+
+int main(int, char**)
+{
+    initMemAlloc(NULL);
+    initLog(NULL, eALL);
+    setLogConsoleOutput(false);
+
+    FileSystemInitDesc fsDesc = {};
+    fsDesc.pAppName = "TestFileSystem";
+    initFileSystem(&fsDesc);
+    fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_OTHER_FILES, "");
+    snprintf(gFilePath, sizeof(gFilePath), "%s/%s", fsGetResourceDirectory(RD_OTHER_FILES), BENCH_FILE_NAME);
+
+    runArchiveRoundTrip();
+    if (gFailedChecks)
+        printf("%u archive checks failed\n", gFailedChecks);
+
+    if (!createBenchFile())
+    {
+        printf("Failed to create %s\n", gFilePath);
+        return 1;
+    }
+
+    FileStream stream = {};
+    fsOpenStreamFromPath(RD_OTHER_FILES, BENCH_FILE_NAME, FM_READ, &stream);
+    uint8_t* pBuffer = (uint8_t*)tf_malloc((size_t)BENCH_MAX_QUEUE_DEPTH << 20);
+
+    // Same file read with seek and read by IO threads
+    IFileSystem seekIO = *stream.pIO;
+    seekIO.ReadAt = NULL;
+    FileStream seekStream = stream;
+    seekStream.pIO = &seekIO;
+
+    printf("\nChained reads from callbacks\n");
+    gChainReads = (ChainRead*)tf_malloc(CHAIN_READ_COUNT * sizeof(ChainRead));
+    if (!runChainedReads(&stream, "read at") || !runChainedReads(&seekStream, "seek and read"))
+        return 1;
+    tf_free(gChainReads);
+
+    runPasses(&stream, false, pBuffer);
+#if defined(BENCH_DROP_CACHE)
+    runPasses(&stream, true, pBuffer);
+#endif
+    if (gCorruptReads)
+        printf("\n%u reads returned wrong data\n", gCorruptReads);
+
+    tf_free(pBuffer);
+    fsCloseStream(&stream);
+    remove(gFilePath);
+
+    exitFileSystem();
+    exitLog();
+    exitMemAlloc();
+    return gCorruptReads || gFailedChecks ? 1 : 0;
+}
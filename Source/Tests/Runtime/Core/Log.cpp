@@ -1 +1,415 @@
-#include <Core/ILog.h>
\ No newline at end of file
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Logging throughput benchmark.
+// First a fixed set of messages is logged as text and to TestLog.binlog, which is decoded and compared to the text.
+// Threads log short formatted messages to a file callback at the same time. The log thread is compared against
+// the previous scheme where every message took the log mutex, then wrote and flushed the file.
+// Then verbose messages are logged to a text log file and to a binary log file, which defers formatting to LogDecoder.
+// Last one call site logs the same or distinct messages over and over, LOGF rate limits the site and collapses repeats.
+// Lines written by the site are checked against the burst and the count lines, errors are never suppressed.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Core/IFileSystem.h>
+#include <Core/ILog.h>
+#include <Core/IThread.h>
+#include <Core/ITime.h>
+
+#include <Tools/LogDecoder/LogDecoder.h>
+
+#include <Core/IMemory.h>
+
+#define BENCH_MESSAGE_COUNT  (1u << 16)
+#define BENCH_MAX_THREADS    8u
+#define CHECK_ERROR_COUNT    64u
+#define ROUND_TRIP_MAX_LINES 16u
+#define ROUND_TRIP_LINE_SIZE 1100u
+
+static FILE*    gLogFile;
+static Mutex    gLegacyMutex;
+static uint64_t gLinesWritten;
+static uint32_t gFailedChecks;
+
+// Lines of a rate limited call site, by kind
+struct SiteLines
+{
+    uint64_t messages;
+    uint64_t repeatedLines;
+    uint64_t suppressedLines;
+    // Sum of counts in repeated and suppressed lines
+    uint64_t counted;
+};
+
+static bool      gCountSiteLines;
+static SiteLines gSiteLines;
+
+static void countSiteLine(const char* message)
+{
+    const char* repeated = strstr(message, "Last message from here was repeated ");
+    const char* suppressed = strstr(message, " more messages from here were suppressed");
+    if (repeated)
+    {
+        ++gSiteLines.repeatedLines;
+        gSiteLines.counted += strtoul(repeated + strlen("Last message from here was repeated "), NULL, 10);
+    }
+    else if (suppressed)
+    {
+        while (suppressed > message && suppressed[-1] >= '0' && suppressed[-1] <= '9')
+            --suppressed;
+        ++gSiteLines.suppressedLines;
+        gSiteLines.counted += strtoul(suppressed, NULL, 10);
+    }
+    else
+    {
+        ++gSiteLines.messages;
+    }
+}
+
+static void check(bool condition, const char* pMessage)
+{
+    if (condition)
+        return;
+    printf("%s\n", pMessage);
+    ++gFailedChecks;
+}
+
+// Text lines of the round trip messages, without date and time
+static bool     gCaptureRoundTrip;
+static char     gRoundTripLines[ROUND_TRIP_MAX_LINES][ROUND_TRIP_LINE_SIZE];
+static uint32_t gRoundTripLineCount;
+
+// Date and time are left out of comparisons, text and binary messages aren't logged in the same second
+#define LOG_TIME_LENGTH 20
+
+static void roundTripCallback(void*, const char* message)
+{
+    if (!gCaptureRoundTrip || gRoundTripLineCount == ROUND_TRIP_MAX_LINES || strlen(message) <= LOG_TIME_LENGTH ||
+        strncmp(message + LOG_TIME_LENGTH, "[LogRoundTrip", 13) != 0)
+        return;
+    strncpy(gRoundTripLines[gRoundTripLineCount], message + LOG_TIME_LENGTH, ROUND_TRIP_LINE_SIZE - 1);
+    ++gRoundTripLineCount;
+}
+
+static void fileCallback(void* user, const char* message)
+{
+    fputs(message, (FILE*)user);
+    ++gLinesWritten;
+    if (gCountSiteLines)
+        countSiteLine(message);
+}
+static void fileFlush(void* user) { fflush((FILE*)user); }
+
+// Previous writeLog and defaultCallback, with the same preamble
+static void legacyLog(const char* file, int line, const char* message, ...)
+{
+    char      buffer[1024];
+    time_t    t = time(NULL);
+    struct tm timeInfo;
+#if defined(_WINDOWS)
+    localtime_s(&timeInfo, &t);
+#else
+    localtime_r(&t, &timeInfo);
+#endif
+    char threadName[MAX_THREAD_NAME_LENGTH + 1] = { 0 };
+    getCurrentThreadName(threadName, MAX_THREAD_NAME_LENGTH + 1);
+    int offset = snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d [%-15s] %23.*s:%-5i INFO| ", 1900 + timeInfo.tm_year,
+                          1 + timeInfo.tm_mon, timeInfo.tm_mday, timeInfo.tm_hour, timeInfo.tm_min, timeInfo.tm_sec,
+                          threadName[0] ? threadName : "NoName", 23, file, line);
+
+    va_list args;
+    va_start(args, message);
+    vsnprintf(buffer + offset, sizeof(buffer) - offset, message, args);
+    va_end(args);
+
+    acquireMutex(&gLegacyMutex);
+    fputs(buffer, gLogFile);
+    fflush(gLogFile);
+    releaseMutex(&gLegacyMutex);
+}
+
+static void benchLogThread(void* data)
+{
+    uint32_t count = *(uint32_t*)data;
+    for (uint32_t i = 0; i < count; ++i)
+        LOGF(eINFO, "Message %u of %u, value %f", i, count, (double)i * 0.5);
+}
+
+// Messages of eDEBUG go to the text log file, eINFO to the binary log file
+static uint32_t gVerboseLevel;
+
+static void benchVerboseThread(void* data)
+{
+    uint32_t count = *(uint32_t*)data;
+    for (uint32_t i = 0; i < count; ++i)
+        LOGF(gVerboseLevel, "Frame %u object %s position (%f, %f, %f) flags 0x%08x", i / 64, "Sponza/Curtain", (double)i * 0.25,
+             (double)count * 0.5, -1.0, i * 2654435761u);
+}
+
+static void benchLegacyThread(void* data)
+{
+    uint32_t count = *(uint32_t*)data;
+    for (uint32_t i = 0; i < count; ++i)
+        legacyLog(__FILE__, __LINE__, "Message %u of %u, value %f\n", i, count, (double)i * 0.5);
+}
+
+// Covers conversions which the binary encoder and LogDecoder handle differently from plain numbers
+static void logRoundTripMessages(void*)
+{
+    const char* name = "Textures/Curtain.dds";
+    int         value = -42;
+    LOGF(eINFO, "Precision [%.*s] literal [%.8s] negative [%.*s] literal %s", 8, name, name, -1, name, "%s");
+    LOGF(eINFO, "Wide [%ls] precision [%.4ls] padded [%12ls]", L"Textures", L"Textures", L"Wide");
+    LOGF(eINFO, "Pointer %p null %p", (void*)&gRoundTripLineCount, (void*)NULL);
+    LOGF(eINFO, "Width [%*d] [%-*d] [%*.*f] [%5s]", 8, value, 8, value, 10, 3, 3.14159, "ab");
+    LOGF(eINFO, "Percent 100%% of %d%%, %%s stays", 7);
+    LOGF(eINFO, "Sizes %zu %lld %llu %hhd %ld %jd", (size_t)123456789, -1234567890123ll, 18446744073709551615ull, (signed char)-5, -77L,
+         (intmax_t)-9);
+    LOGF(eINFO, "Chars %c%c hex %#x %08X float %g %e", 'o', 'k', 255u, 48879u, 0.1, -2.5e10);
+    LOGF(eINFO, "Null string %s", (const char*)NULL);
+}
+
+static void runRoundTripThread()
+{
+    ThreadDesc desc = {};
+    desc.pFunc = logRoundTripMessages;
+    strncpy(desc.mThreadName, "LogRoundTrip", sizeof(desc.mThreadName) - 1);
+    ThreadHandle handle;
+    initThread(&desc, &handle);
+    joinThread(handle);
+    flushLog();
+}
+
+// Messages logged to the binary log file decode to the same lines as text messages from the same call sites
+static void checkBinaryRoundTrip()
+{
+    addLogCallback("RoundTrip", eINFO, NULL, roundTripCallback, NULL, NULL);
+    gCaptureRoundTrip = true;
+    runRoundTripThread();
+    gCaptureRoundTrip = false;
+    check(gRoundTripLineCount > 0, "round trip messages weren't written as text");
+
+    addBinaryLogFile("TestLog.binlog", eINFO);
+    runRoundTripThread();
+    // Closes TestLog.binlog, the rest of the test logs to the new file
+    addBinaryLogFile("TestLogBench.binlog", eINFO);
+
+    FileStream fs = {};
+    if (!fsOpenStreamFromPath(RD_LOG, "TestLog.binlog", FM_READ, &fs))
+    {
+        check(false, "failed to open TestLog.binlog");
+        return;
+    }
+    ssize_t size = fsGetStreamFileSize(&fs);
+    char*   data = (char*)tf_malloc(size > 0 ? (size_t)size : 1);
+    size_t  read = fsReadFromStream(&fs, data, size > 0 ? (size_t)size : 0);
+    fsCloseStream(&fs);
+
+    FILE* pDecoded = tmpfile();
+    check(decodeBinaryLog(data, read, pDecoded), "failed to decode TestLog.binlog");
+    tf_free(data);
+    rewind(pDecoded);
+
+    // Decoded file also has the header and the message of addBinaryLogFile, only lines of the round trip thread are compared
+    char     line[ROUND_TRIP_LINE_SIZE];
+    uint32_t lineCount = 0;
+    while (fgets(line, sizeof(line), pDecoded))
+    {
+        if (strlen(line) <= LOG_TIME_LENGTH || strncmp(line + LOG_TIME_LENGTH, "[LogRoundTrip", 13) != 0)
+            continue;
+        if (lineCount < gRoundTripLineCount && strcmp(line + LOG_TIME_LENGTH, gRoundTripLines[lineCount]) != 0)
+        {
+            printf("decoded: %s", line + LOG_TIME_LENGTH);
+            printf("text:    %s", gRoundTripLines[lineCount]);
+            check(false, "decoded binary message doesn't match the text message");
+        }
+        ++lineCount;
+    }
+    fclose(pDecoded);
+    check(lineCount == gRoundTripLineCount, "decoded binary log has a different number of messages than the text log");
+}
+
+static double opsPerSecond(uint64_t opCount, int64_t usec) { return usec > 0 ? (double)opCount * 1e6 / (double)usec : 0.0; }
+
+// Returns messages per second until all threads returned, 'pFlushed' receives messages per second until they were written
+static double runThreads(ThreadFunction func, uint32_t threadCount, double* pFlushed)
+{
+    uint32_t     count = BENCH_MESSAGE_COUNT / threadCount;
+    ThreadHandle handles[BENCH_MAX_THREADS];
+    int64_t      start = getUSec(true);
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        ThreadDesc desc = {};
+        desc.pFunc = func;
+        desc.pData = &count;
+        initThread(&desc, &handles[i]);
+    }
+    for (uint32_t i = 0; i < threadCount; ++i)
+        joinThread(handles[i]);
+    double result = opsPerSecond(BENCH_MESSAGE_COUNT, getUSec(true) - start);
+
+    flushLog();
+    if (pFlushed)
+        *pFlushed = opsPerSecond(BENCH_MESSAGE_COUNT, getUSec(true) - start);
+    return result;
+}
+
+
+// Every message of the site has to be either written or counted, after the burst of each interval only count lines are written
+static void checkSiteLines(uint32_t messageCount, bool repeated, int64_t usec)
+{
+#if LOG_SITE_INTERVAL_MS > 0
+    uint64_t intervals = (uint64_t)usec / 1000 / LOG_SITE_INTERVAL_MS + 1;
+    uint64_t countLines = repeated ? gSiteLines.repeatedLines : gSiteLines.suppressedLines;
+    uint64_t otherLines = repeated ? gSiteLines.suppressedLines : gSiteLines.repeatedLines;
+    check(gSiteLines.messages + gSiteLines.counted == messageCount, "messages of the site are neither written nor counted");
+    check(gSiteLines.messages >= TF_MIN(LOG_SITE_BURST, messageCount) && gSiteLines.messages <= LOG_SITE_BURST * intervals,
+              "site wrote more messages than its burst allows");
+    check(countLines >= 1 && countLines <= intervals && otherLines == 0, "count lines of the site don't match its messages");
+#else
+    (void)repeated;
+    (void)usec;
+    check(gSiteLines.messages == messageCount, "messages of the site were dropped");
+#endif
+}
+
+// Returns messages per second until written, 'pLines' receives number of lines written
+static double benchRepeatedSite(bool limited, bool repeated, uint64_t* pLines)
+{
+    flushLog();
+    gLinesWritten = 0;
+    gSiteLines = {};
+    gCountSiteLines = true;
+    int64_t start = getUSec(true);
+    for (uint32_t i = 0; i < BENCH_MESSAGE_COUNT; ++i)
+    {
+        uint32_t material = repeated ? 7u : i;
+        // Each run has its own call site, so that it starts with a full burst
+        if (!limited)
+            writeLog(eWARNING, __FILE__, __LINE__, "Missing texture %s for material %u", "Sponza/Curtain.dds", material);
+        else if (repeated)
+            LOGF(eWARNING, "Missing texture %s for material %u", "Sponza/Curtain.dds", material);
+        else
+            LOGF(eWARNING, "Missing texture %s for material %u", "Sponza/Curtain.dds", material);
+    }
+    flushLog();
+    int64_t usec = getUSec(true) - start;
+    gCountSiteLines = false;
+    *pLines = gLinesWritten;
+
+    if (limited)
+        checkSiteLines(BENCH_MESSAGE_COUNT, repeated, usec);
+    else
+        check(gSiteLines.messages == BENCH_MESSAGE_COUNT && gSiteLines.counted == 0, "writeLog dropped messages");
+    return opsPerSecond(BENCH_MESSAGE_COUNT, usec);
+}
+
+// Distinct errors from one site are all written, repeated ones are collapsed
+static void checkErrorSite()
+{
+    flushLog();
+    gSiteLines = {};
+    gCountSiteLines = true;
+    for (uint32_t i = 0; i < CHECK_ERROR_COUNT; ++i)
+        LOGF(eERROR, "Failed to load Textures/Missing_%u.dds", i);
+    flushLog();
+    check(gSiteLines.messages == CHECK_ERROR_COUNT && gSiteLines.counted == 0, "distinct errors from one site were suppressed");
+
+    gSiteLines = {};
+    int64_t start = getUSec(true);
+    for (uint32_t i = 0; i < CHECK_ERROR_COUNT; ++i)
+        LOGF(eERROR, "Failed to load %s", "Textures/Missing.dds");
+    flushLog();
+    checkSiteLines(CHECK_ERROR_COUNT, true, getUSec(true) - start);
+    gCountSiteLines = false;
+}
+
+int main(int, char**)
+{
+    initMemAlloc(NULL);
+    initLog(NULL, eALL);
+    setLogConsoleOutput(false);
+    initMutex(&gLegacyMutex);
+
+    FileSystemInitDesc fsDesc = {};
+    fsDesc.pAppName = "TestLog";
+    initFileSystem(&fsDesc);
+    fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_LOG, "");
+
+    checkBinaryRoundTrip();
+
+    gLogFile = tmpfile();
+    addLogCallback("Bench", eINFO | eWARNING | eERROR, gLogFile, fileCallback, NULL, fileFlush);
+
+    printf("Logging throughput (messages/s)\n");
+    printf("%8s %16s %16s %16s\n", "threads", "log thread", "until written", "mutex + flush");
+    for (uint32_t threadCount = 1; threadCount <= BENCH_MAX_THREADS; threadCount *= 2)
+    {
+        double flushed = 0.0;
+        double logged = runThreads(benchLogThread, threadCount, &flushed);
+        double legacy = runThreads(benchLegacyThread, threadCount, NULL);
+        printf("%8u %16.0f %16.0f %16.0f\n", threadCount, logged, flushed, legacy);
+    }
+
+    addLogFile("TestLog.log", FM_WRITE, eDEBUG);
+
+    printf("\nVerbose logging to a file (messages/s until written)\n");
+    printf("%8s %16s %16s\n", "threads", "text", "binary");
+    for (uint32_t threadCount = 1; threadCount <= BENCH_MAX_THREADS; threadCount *= 2)
+    {
+        double text = 0.0;
+        double binary = 0.0;
+        gVerboseLevel = eDEBUG;
+        runThreads(benchVerboseThread, threadCount, &text);
+        gVerboseLevel = eINFO;
+        runThreads(benchVerboseThread, threadCount, &binary);
+        printf("%8u %16.0f %16.0f\n", threadCount, text, binary);
+    }
+
+    printf("\nOne call site (messages/s, lines written)\n");
+    printf("%10s %16s %10s %16s %10s\n", "messages", "writeLog", "lines", "LOGF", "lines");
+    for (uint32_t repeated = 0; repeated < 2; ++repeated)
+    {
+        uint64_t unlimitedLines = 0;
+        uint64_t limitedLines = 0;
+        double   unlimited = benchRepeatedSite(false, repeated, &unlimitedLines);
+        double   limited = benchRepeatedSite(true, repeated, &limitedLines);
+        printf("%10s %16.0f %10llu %16.0f %10llu\n", repeated ? "repeated" : "distinct", unlimited, (unsigned long long)unlimitedLines,
+               limited, (unsigned long long)limitedLines);
+    }
+    checkErrorSite();
+    if (gFailedChecks)
+        printf("\n%u log checks failed\n", gFailedChecks);
+
+    exitLog();
+    exitFileSystem();
+    fclose(gLogFile);
+    destroyMutex(&gLegacyMutex);
+    exitMemAlloc();
+    return gFailedChecks ? 1 : 0;
+}
@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Allocation throughput benchmark.
+// Compares tf_malloc against the system allocator for patterns common in the engine:
+// short lived small blocks, stb_ds style array growth, and blocks freed by a different thread than the one allocating them.
+// Per-frame scratch allocations are also compared against the thread arena, fixed size objects against a pool.
+// Before the benchmark arena markers and arena statistics are checked, pool statistics are checked against a known
+// sequence and pool elements handed out by concurrent threads are checked for overlap.
+// With ENABLE_MEMORY_SAMPLING the extrapolated heap profile is checked against known live allocations.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Core/IThread.h>
+#include <Core/ITime.h>
+
+#include <Runtime/Core/Private/Memory/Arena.h>
+#include <Runtime/Core/Private/Memory/Pool.h>
+#include <Runtime/Core/Private/MemoryTracking/MemorySampling.h>
+#include <Runtime/Core/Private/Threading/Atomics.h>
+
+#include <Core/IMemory.h>
+
+#define BENCH_ALLOC_COUNT     (1u << 20)
+#define BENCH_LIVE_COUNT      1024u
+#define BENCH_GROW_COUNT      (1u << 12)
+#define BENCH_GROW_SIZE       (1u << 16)
+#define BENCH_MAX_THREADS     8u
+#define BENCH_FRAME_COUNT     256u
+#define BENCH_OBJECT_SIZE     64u
+#define CHECK_POOL_LIVE_COUNT 256u
+#define CHECK_POOL_ITERATIONS (1u << 16)
+
+static uint32_t gFailedChecks;
+
+static void check(bool condition, const char* pMessage)
+{
+    if (condition)
+        return;
+    printf("FAILED: %s\n", pMessage);
+    ++gFailedChecks;
+}
+
+typedef struct BenchAllocator
+{
+    void* (*alloc)(size_t size);
+    void* (*resize)(void* ptr, size_t size);
+    void (*release)(void* ptr);
+} BenchAllocator;
+
+static void* tfAlloc(size_t size) { return tf_malloc(size); }
+static void* tfResize(void* ptr, size_t size) { return tf_realloc(ptr, size); }
+static void  tfRelease(void* ptr) { tf_free(ptr); }
+
+// Parentheses keep IMemory.h macros from replacing the system allocator
+static void* systemAlloc(size_t size) { return (malloc)(size); }
+static void* systemResize(void* ptr, size_t size) { return (realloc)(ptr, size); }
+static void  systemRelease(void* ptr) { (free)(ptr); }
+
+// Every block is BENCH_OBJECT_SIZE bytes, no resize
+static Pool  gObjectPool;
+static void* poolAlloc(size_t) { return tf_pool_alloc(&gObjectPool); }
+static void  poolRelease(void* ptr) { tf_pool_free(&gObjectPool, ptr); }
+
+static const BenchAllocator gTfAllocator = { tfAlloc, tfResize, tfRelease };
+static const BenchAllocator gSystemAllocator = { systemAlloc, systemResize, systemRelease };
+static const BenchAllocator gPoolAllocator = { poolAlloc, NULL, poolRelease };
+
+// Sizes between 16 and 512 bytes, same sequence for every allocator
+static inline size_t benchSize(uint32_t* seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return 16u + ((*seed >> 8) & 511u);
+}
+
+struct AllocThreadData
+{
+    const BenchAllocator* allocator;
+    uint32_t              allocCount;
+    uint32_t              seed;
+};
+
+// Ring of live blocks, every allocation replaces the oldest one
+static void benchSmallBlocks(void* data)
+{
+    AllocThreadData* thread = (AllocThreadData*)data;
+    void*            live[BENCH_LIVE_COUNT] = {};
+    for (uint32_t i = 0; i < thread->allocCount; ++i)
+    {
+        uint32_t slot = i % BENCH_LIVE_COUNT;
+        thread->allocator->release(live[slot]);
+        live[slot] = thread->allocator->alloc(benchSize(&thread->seed));
+        *(uint8_t*)live[slot] = (uint8_t)i;
+    }
+    for (uint32_t i = 0; i < BENCH_LIVE_COUNT; ++i)
+        thread->allocator->release(live[i]);
+}
+
+// Same as benchSmallBlocks with BENCH_OBJECT_SIZE blocks, like commands or descriptor sets created every frame
+static void benchFixedBlocks(void* data)
+{
+    AllocThreadData* thread = (AllocThreadData*)data;
+    void*            live[BENCH_LIVE_COUNT] = {};
+    for (uint32_t i = 0; i < thread->allocCount; ++i)
+    {
+        uint32_t slot = (i * 7u) % BENCH_LIVE_COUNT;
+        thread->allocator->release(live[slot]);
+        live[slot] = thread->allocator->alloc(BENCH_OBJECT_SIZE);
+        *(uint8_t*)live[slot] = (uint8_t)i;
+    }
+    for (uint32_t i = 0; i < BENCH_LIVE_COUNT; ++i)
+        thread->allocator->release(live[i]);
+}
+
+// Arrays growing by 1.5x until BENCH_GROW_SIZE, like arrpush on a fresh stb_ds array
+static void benchArrayGrowth(void* data)
+{
+    AllocThreadData* thread = (AllocThreadData*)data;
+    for (uint32_t i = 0; i < thread->allocCount; ++i)
+    {
+        void* array = NULL;
+        for (size_t size = 64; size < BENCH_GROW_SIZE; size += size / 2)
+        {
+            array = thread->allocator->resize(array, size);
+            ((uint8_t*)array)[size - 1] = (uint8_t)i;
+        }
+        thread->allocator->release(array);
+    }
+}
+
+// Single producer hands blocks to a consumer through a ring, consumer frees them
+struct CrossThreadRing
+{
+    const BenchAllocator* allocator;
+    void*                 blocks[BENCH_LIVE_COUNT];
+    tfrg_atomic32_t       produced;
+    tfrg_atomic32_t       consumed;
+    uint32_t              allocCount;
+};
+
+static void benchCrossThreadConsumer(void* data)
+{
+    CrossThreadRing* ring = (CrossThreadRing*)data;
+    for (uint32_t i = 0; i < ring->allocCount; ++i)
+    {
+        while (tfrg_atomic32_load_acquire(&ring->produced) == i)
+            threadSleep(0);
+        ring->allocator->release(ring->blocks[i % BENCH_LIVE_COUNT]);
+        tfrg_atomic32_store_release(&ring->consumed, i + 1);
+    }
+}
+
+static void benchCrossThreadProducer(void* data)
+{
+    CrossThreadRing* ring = (CrossThreadRing*)data;
+    uint32_t         seed = 1;
+    for (uint32_t i = 0; i < ring->allocCount; ++i)
+    {
+        while (i - tfrg_atomic32_load_acquire(&ring->consumed) >= BENCH_LIVE_COUNT)
+            threadSleep(0);
+        ring->blocks[i % BENCH_LIVE_COUNT] = ring->allocator->alloc(benchSize(&seed));
+        tfrg_atomic32_store_release(&ring->produced, i + 1);
+    }
+}
+
+// Scratch memory of a frame, everything is released at the end of the frame
+static void benchFrameScratchMalloc(void* data)
+{
+    AllocThreadData* thread = (AllocThreadData*)data;
+    void**           blocks = (void**)tf_malloc(sizeof(void*) * thread->allocCount);
+    for (uint32_t frame = 0; frame < BENCH_FRAME_COUNT; ++frame)
+    {
+        for (uint32_t i = 0; i < thread->allocCount; ++i)
+        {
+            blocks[i] = tf_malloc(benchSize(&thread->seed));
+            *(uint8_t*)blocks[i] = (uint8_t)i;
+        }
+        for (uint32_t i = 0; i < thread->allocCount; ++i)
+            tf_free(blocks[i]);
+    }
+    tf_free(blocks);
+}
+
+static void benchFrameScratchArena(void* data)
+{
+    AllocThreadData* thread = (AllocThreadData*)data;
+    Arena            arena;
+    ArenaDesc        desc = { "Bench", 0 };
+    tf_arena_init(&arena, &desc);
+    for (uint32_t frame = 0; frame < BENCH_FRAME_COUNT; ++frame)
+    {
+        for (uint32_t i = 0; i < thread->allocCount; ++i)
+        {
+            uint8_t* block = (uint8_t*)tf_arena_alloc(&arena, benchSize(&thread->seed), 16);
+            *block = (uint8_t)i;
+        }
+        tf_arena_reset(&arena);
+    }
+    tf_arena_exit(&arena);
+}
+
+#if defined(ENABLE_MEMORY_SAMPLING)
+#define BENCH_SAMPLED_SMALL_COUNT (1u << 18)
+#define BENCH_SAMPLED_SMALL_SIZE  256u
+#define BENCH_SAMPLED_LARGE_COUNT 256u
+#define BENCH_SAMPLED_LARGE_SIZE  (1u << 16)
+// Smaller than the default interval so that the estimate is within a few percent, checks allow 15%
+#define CHECK_SAMPLING_INTERVAL   (64u * 1024u)
+#define CHECK_SAMPLING_TOLERANCE  0.15
+
+static void** sampledSmallBlocks(void)
+{
+    void** blocks = (void**)tf_malloc(sizeof(void*) * BENCH_SAMPLED_SMALL_COUNT);
+    for (uint32_t i = 0; i < BENCH_SAMPLED_SMALL_COUNT; ++i)
+        blocks[i] = tf_malloc(BENCH_SAMPLED_SMALL_SIZE);
+    return blocks;
+}
+
+static void** sampledLargeBlocks(void)
+{
+    void** blocks = (void**)tf_malloc(sizeof(void*) * BENCH_SAMPLED_LARGE_COUNT);
+    for (uint32_t i = 0; i < BENCH_SAMPLED_LARGE_COUNT; ++i)
+        blocks[i] = tf_malloc(BENCH_SAMPLED_LARGE_SIZE);
+    return blocks;
+}
+
+static void checkSampledProfile(void)
+{
+    memSetSamplingInterval(CHECK_SAMPLING_INTERVAL);
+    uint64_t liveBefore = memGetStatistics().sampledLiveMemory;
+    uint64_t liveTotal = (uint64_t)BENCH_SAMPLED_SMALL_COUNT * (BENCH_SAMPLED_SMALL_SIZE + sizeof(void*)) +
+                         (uint64_t)BENCH_SAMPLED_LARGE_COUNT * (BENCH_SAMPLED_LARGE_SIZE + sizeof(void*));
+
+    void** smallBlocks = sampledSmallBlocks();
+    void** largeBlocks = sampledLargeBlocks();
+
+    MemorySampleSite sites[4];
+    uint32_t         siteCount = memGetSampledSites(sites, 4);
+    printf("\nSampled heap profile (64MB of 256 byte blocks, 16MB of 64KB blocks live)\n");
+    printf("%-40s %16s %16s %10s\n", "site", "live memory", "live allocs", "samples");
+    for (uint32_t i = 0; i < siteCount; ++i)
+    {
+        char site[64];
+        snprintf(site, sizeof(site), "%s:%u", sites[i].pFunction, sites[i].line);
+        printf("%-40s %16llu %16llu %10llu\n", site, (unsigned long long)sites[i].liveMemory, (unsigned long long)sites[i].liveAllocCount,
+               (unsigned long long)sites[i].liveSampleCount);
+    }
+
+    MemoryStatistics stats = memGetStatistics();
+    double           liveSampled = (double)stats.sampledLiveMemory - (double)liveBefore;
+    check(stats.droppedSampleCount == 0, "memory samples were dropped");
+    check(fabs(liveSampled - (double)liveTotal) <= CHECK_SAMPLING_TOLERANCE * (double)liveTotal,
+          "sampled live memory is not within tolerance of the live allocations");
+
+    for (uint32_t i = 0; i < BENCH_SAMPLED_SMALL_COUNT; ++i)
+        tf_free(smallBlocks[i]);
+    for (uint32_t i = 0; i < BENCH_SAMPLED_LARGE_COUNT; ++i)
+        tf_free(largeBlocks[i]);
+    tf_free(smallBlocks);
+    tf_free(largeBlocks);
+    stats = memGetStatistics();
+    printf("%-40s %16llu\n", "live after release", (unsigned long long)stats.sampledLiveMemory);
+    // Every sample taken above is removed by tf_free, whatever remains was live before
+    check(stats.sampledLiveMemory <= liveBefore + (uint64_t)(0.01 * (double)liveTotal),
+          "sampled live memory didn't return to the previous value after freeing");
+    memSetSamplingInterval(MEMORY_SAMPLING_INTERVAL);
+}
+#endif
+
+// Popping a marker gives back everything allocated after it, also when allocations spilled into new blocks
+static void checkArena(void)
+{
+    uint64_t peakBefore = memGetStatistics().arenaPeakMemory;
+
+    Arena     arena;
+    ArenaDesc desc = { "Check", 4096 };
+    tf_arena_init(&arena, &desc);
+    tf_arena_alloc(&arena, 100, 16);
+    size_t used = tf_arena_used(&arena);
+    check(used == 100, "arena used size doesn't match the allocation");
+
+    ArenaMarker marker = tf_arena_push(&arena);
+    for (uint32_t i = 0; i < 16; ++i)
+        tf_arena_alloc(&arena, 1000, 16);
+    tf_arena_alloc(&arena, 3 * desc.blockSize, 64);
+    size_t peak = tf_arena_used(&arena);
+    check(peak >= used + 16 * 1000 + 3 * desc.blockSize, "arena used size is less than the allocations");
+    tf_arena_pop(&arena, marker);
+    check(tf_arena_used(&arena) == used, "tf_arena_pop didn't restore the used size");
+
+    // Nested marker taken before anything was allocated
+    Arena emptyArena;
+    tf_arena_init(&emptyArena, &desc);
+    ArenaMarker emptyMarker = tf_arena_push(&emptyArena);
+    tf_arena_alloc(&emptyArena, 10 * desc.blockSize, 16);
+    tf_arena_pop(&emptyArena, emptyMarker);
+    check(tf_arena_used(&emptyArena) == 0, "tf_arena_pop didn't restore the used size of an empty arena");
+
+    // High-water marks are kept after pop and reset
+    tf_arena_reset(&arena);
+    check(tf_arena_used(&arena) == 0, "tf_arena_reset didn't free everything");
+    MemoryStatistics stats = memGetStatistics();
+    check(stats.arenaPeakMemory >= peakBefore + peak + 10 * desc.blockSize, "arena high-water mark is missing from memGetStatistics");
+
+    tf_arena_exit(&emptyArena);
+    tf_arena_exit(&arena);
+    check(memGetStatistics().arenaPeakMemory == peakBefore, "arena statistics weren't removed by tf_arena_exit");
+}
+
+struct ArenaExitThread
+{
+    tfrg_atomic32_t step;
+    uint32_t        arenaCount;
+};
+
+// Keeps using its thread arena while tf_arena_exit_threads frees it
+static void arenaExitThread(void* data)
+{
+    ArenaExitThread* thread = (ArenaExitThread*)data;
+    tf_arena_alloc(tf_arena_thread(), 64, 16);
+    tfrg_atomic32_store_release(&thread->step, 1);
+    while (tfrg_atomic32_load_acquire(&thread->step) != 2)
+        threadSleep(0);
+    tf_arena_alloc(tf_arena_thread(), 64, 16);
+    thread->arenaCount = memGetStatistics().arenaCount;
+}
+
+// Thread arenas freed by tf_arena_exit_threads are replaced, not used through a stale pointer
+static void checkThreadArenaExit(void)
+{
+    ArenaExitThread thread = {};
+    ThreadDesc      desc = {};
+    ThreadHandle    handle;
+    desc.pFunc = arenaExitThread;
+    desc.pData = &thread;
+    initThread(&desc, &handle);
+    while (tfrg_atomic32_load_acquire(&thread.step) != 1)
+        threadSleep(0);
+    tf_arena_exit_threads();
+    uint32_t arenaCount = memGetStatistics().arenaCount;
+    tfrg_atomic32_store_release(&thread.step, 2);
+    joinThread(handle);
+    check(thread.arenaCount == arenaCount + 1, "thread kept using its arena after tf_arena_exit_threads");
+}
+
+static const PoolStatistics* findPoolStatistics(const MemoryStatistics* pStats, const char* pName)
+{
+    for (uint32_t i = 0; i < pStats->poolCount && i < MEMORY_STATISTICS_MAX_POOLS; ++i)
+    {
+        if (pStats->pools[i].pName == pName)
+            return &pStats->pools[i];
+    }
+    return NULL;
+}
+
+static void checkPoolStatistics(const char* pName, uint32_t used, uint32_t peak, uint32_t capacity, const char* pMessage)
+{
+    MemoryStatistics      stats = memGetStatistics();
+    const PoolStatistics* pPoolStats = findPoolStatistics(&stats, pName);
+    check(pPoolStats && pPoolStats->usedCount == used && pPoolStats->peakUsedCount == peak && pPoolStats->capacity == capacity, pMessage);
+}
+
+static void checkPoolSequence(void)
+{
+    static const char* pName = "Check sequence";
+    Pool               pool;
+    PoolDesc           desc = { pName, 48, 0, 16, 0 };
+    if (!tf_pool_init(&pool, &desc))
+    {
+        check(false, "tf_pool_init failed");
+        return;
+    }
+    // Element count is rounded up to fill the chunk
+    uint32_t perChunk = pool.elementsPerChunk;
+    check(perChunk >= 16, "pool has less elements per chunk than requested");
+    checkPoolStatistics(pName, 0, 0, 0, "pool statistics of an empty pool");
+
+    void* elements[64] = {};
+    for (uint32_t i = 0; i < 10; ++i)
+        elements[i] = tf_pool_alloc(&pool);
+    checkPoolStatistics(pName, 10, 10, perChunk, "pool statistics after 10 allocations");
+
+    for (uint32_t i = 0; i < 4; ++i)
+        tf_pool_free(&pool, elements[i]);
+    checkPoolStatistics(pName, 6, 10, perChunk, "pool statistics after freeing 4 elements");
+
+    // Fills the first chunk and spills into a second one
+    uint32_t count = perChunk + 4;
+    for (uint32_t i = 0; i < 4; ++i)
+        elements[i] = tf_pool_alloc(&pool);
+    for (uint32_t i = 10; i < count; ++i)
+        elements[i] = tf_pool_alloc(&pool);
+    checkPoolStatistics(pName, count, count, 2 * perChunk, "pool statistics after growing into a second chunk");
+
+    for (uint32_t i = 0; i < count; ++i)
+        tf_pool_free(&pool, elements[i]);
+    checkPoolStatistics(pName, 0, count, 2 * perChunk, "pool statistics after freeing every element");
+
+    tf_pool_exit(&pool);
+    MemoryStatistics stats = memGetStatistics();
+    check(!findPoolStatistics(&stats, pName), "pool statistics weren't removed by tf_pool_exit");
+}
+
+struct PoolStressThread
+{
+    Pool*    pPool;
+    uint32_t id;
+    uint32_t seed;
+    // Elements held when the thread returns
+    void*    live[CHECK_POOL_LIVE_COUNT];
+    bool     overlapped;
+};
+
+// Every element is stamped with its owner, another owner's stamp means the element was handed out twice
+static void poolStressThread(void* data)
+{
+    PoolStressThread* thread = (PoolStressThread*)data;
+    for (uint32_t i = 0; i < CHECK_POOL_ITERATIONS; ++i)
+    {
+        thread->seed = thread->seed * 1664525u + 1013904223u;
+        uint32_t  slot = (thread->seed >> 8) % CHECK_POOL_LIVE_COUNT;
+        uint32_t* element = (uint32_t*)thread->live[slot];
+        if (element)
+        {
+            if (element[0] != thread->id || element[1] != slot)
+                thread->overlapped = true;
+            tf_pool_free(thread->pPool, element);
+            thread->live[slot] = NULL;
+        }
+        else if ((element = (uint32_t*)tf_pool_alloc(thread->pPool)) != NULL)
+        {
+            element[0] = thread->id;
+            element[1] = slot;
+            thread->live[slot] = element;
+        }
+    }
+    for (uint32_t slot = 0; slot < CHECK_POOL_LIVE_COUNT; ++slot)
+    {
+        uint32_t* element = (uint32_t*)thread->live[slot];
+        if (!element)
+            thread->live[slot] = element = (uint32_t*)tf_pool_alloc(thread->pPool);
+        else if (element[0] != thread->id || element[1] != slot)
+            thread->overlapped = true;
+        if (element)
+        {
+            element[0] = thread->id;
+            element[1] = slot;
+        }
+    }
+}
+
+static int comparePointers(const void* pA, const void* pB)
+{
+    uintptr_t a = *(const uintptr_t*)pA;
+    uintptr_t b = *(const uintptr_t*)pB;
+    return a < b ? -1 : a > b;
+}
+
+static void checkPoolThreads(void)
+{
+    Pool     pool;
+    PoolDesc desc = { "Check threads", 2 * sizeof(uint32_t), 0, 64, 0 };
+    if (!tf_pool_init(&pool, &desc))
+    {
+        check(false, "tf_pool_init failed");
+        return;
+    }
+
+    PoolStressThread* threads = (PoolStressThread*)tf_calloc(BENCH_MAX_THREADS, sizeof(PoolStressThread));
+    ThreadHandle      handles[BENCH_MAX_THREADS];
+    for (uint32_t i = 0; i < BENCH_MAX_THREADS; ++i)
+    {
+        threads[i].pPool = &pool;
+        threads[i].id = i + 1;
+        threads[i].seed = i + 1;
+        ThreadDesc desc = {};
+        desc.pFunc = poolStressThread;
+        desc.pData = &threads[i];
+        initThread(&desc, &handles[i]);
+    }
+    for (uint32_t i = 0; i < BENCH_MAX_THREADS; ++i)
+        joinThread(handles[i]);
+
+    // Elements still held by all threads have to be distinct
+    uint32_t liveCount = BENCH_MAX_THREADS * CHECK_POOL_LIVE_COUNT;
+    void**   live = (void**)tf_malloc(sizeof(void*) * liveCount);
+    bool     overlapped = false;
+    for (uint32_t i = 0; i < BENCH_MAX_THREADS; ++i)
+    {
+        overlapped |= threads[i].overlapped;
+        memcpy(live + i * CHECK_POOL_LIVE_COUNT, threads[i].live, sizeof(threads[i].live));
+    }
+    qsort(live, liveCount, sizeof(void*), comparePointers);
+    for (uint32_t i = 0; i < liveCount; ++i)
+        overlapped |= !live[i] || (i && live[i] == live[i - 1]);
+    check(!overlapped, "pool handed out an element which was in use");
+    check(tfrg_atomic32_load_relaxed(&pool.usedCount_Atomic) == liveCount, "pool used count doesn't match the live elements");
+
+    for (uint32_t i = 0; i < liveCount; ++i)
+        tf_pool_free(&pool, live[i]);
+    check(tfrg_atomic32_load_relaxed(&pool.usedCount_Atomic) == 0, "pool used count isn't 0 after freeing every element");
+
+    tf_free(live);
+    tf_free(threads);
+    tf_pool_exit(&pool);
+}
+
+static double opsPerSecond(uint64_t opCount, int64_t usec) { return usec > 0 ? (double)opCount * 1e6 / (double)usec : 0.0; }
+
+// Every thread does its share of 'totalCount' operations, returns operations per second
+static double runAllocThreads(const BenchAllocator* allocator, ThreadFunction func, uint32_t threadCount, uint32_t totalCount)
+{
+    AllocThreadData threads[BENCH_MAX_THREADS];
+    ThreadHandle    handles[BENCH_MAX_THREADS];
+    for (uint32_t i = 0; i < threadCount; ++i)
+        threads[i] = { allocator, totalCount / threadCount, i + 1 };
+
+    int64_t start = getUSec(true);
+    if (threadCount == 1)
+    {
+        func(&threads[0]);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            ThreadDesc desc = {};
+            desc.pFunc = func;
+            desc.pData = &threads[i];
+            initThread(&desc, &handles[i]);
+        }
+        for (uint32_t i = 0; i < threadCount; ++i)
+            joinThread(handles[i]);
+    }
+    return opsPerSecond(totalCount, getUSec(true) - start);
+}
+
+static double runCrossThread(const BenchAllocator* allocator)
+{
+    CrossThreadRing* ring = (CrossThreadRing*)tf_calloc(1, sizeof(CrossThreadRing));
+    ring->allocator = allocator;
+    ring->allocCount = BENCH_ALLOC_COUNT / 4;
+
+    ThreadDesc   desc = {};
+    ThreadHandle consumer;
+    desc.pFunc = benchCrossThreadConsumer;
+    desc.pData = ring;
+    int64_t start = getUSec(true);
+    initThread(&desc, &consumer);
+    benchCrossThreadProducer(ring);
+    joinThread(consumer);
+    double result = opsPerSecond(ring->allocCount, getUSec(true) - start);
+    tf_free(ring);
+    return result;
+}
+
+int main(int, char**)
+{
+    initMemAlloc(NULL);
+
+    checkArena();
+    checkThreadArenaExit();
+    checkPoolSequence();
+    checkPoolThreads();
+
+
+    printf("Allocation throughput (allocations/s, arrays/s for array growth)\n");
+    printf("%-24s %8s %16s %16s\n", "pattern", "threads", "tf_malloc", "system");
+    for (uint32_t threadCount = 1; threadCount <= BENCH_MAX_THREADS; threadCount *= 2)
+    {
+        printf("%-24s %8u %16.0f %16.0f\n", "small blocks", threadCount,
+               runAllocThreads(&gTfAllocator, benchSmallBlocks, threadCount, BENCH_ALLOC_COUNT),
+               runAllocThreads(&gSystemAllocator, benchSmallBlocks, threadCount, BENCH_ALLOC_COUNT));
+    }
+    for (uint32_t threadCount = 1; threadCount <= BENCH_MAX_THREADS; threadCount *= 2)
+    {
+        printf("%-24s %8u %16.0f %16.0f\n", "array growth", threadCount,
+               runAllocThreads(&gTfAllocator, benchArrayGrowth, threadCount, BENCH_GROW_COUNT),
+               runAllocThreads(&gSystemAllocator, benchArrayGrowth, threadCount, BENCH_GROW_COUNT));
+    }
+    printf("%-24s %8u %16.0f %16.0f\n", "freed by other thread", 2u, runCrossThread(&gTfAllocator), runCrossThread(&gSystemAllocator));
+
+    printf("\nFrame scratch (allocations/s)\n");
+    printf("%-24s %8s %16s %16s\n", "pattern", "threads", "tf_malloc", "arena");
+    for (uint32_t threadCount = 1; threadCount <= BENCH_MAX_THREADS; threadCount *= 2)
+    {
+        uint32_t allocCount = BENCH_ALLOC_COUNT / BENCH_FRAME_COUNT;
+        printf("%-24s %8u %16.0f %16.0f\n", "frame scratch", threadCount,
+               runAllocThreads(&gTfAllocator, benchFrameScratchMalloc, threadCount, allocCount) * BENCH_FRAME_COUNT,
+               runAllocThreads(&gTfAllocator, benchFrameScratchArena, threadCount, allocCount) * BENCH_FRAME_COUNT);
+    }
+
+    printf("\nFixed size objects (allocations/s)\n");
+    printf("%-24s %8s %16s %16s\n", "pattern", "threads", "tf_malloc", "pool");
+    PoolDesc poolDesc = { "Bench", BENCH_OBJECT_SIZE, 0, 0, 0 };
+    tf_pool_init(&gObjectPool, &poolDesc);
+    for (uint32_t threadCount = 1; threadCount <= BENCH_MAX_THREADS; threadCount *= 2)
+    {
+        printf("%-24s %8u %16.0f %16.0f\n", "fixed blocks", threadCount,
+               runAllocThreads(&gTfAllocator, benchFixedBlocks, threadCount, BENCH_ALLOC_COUNT),
+               runAllocThreads(&gPoolAllocator, benchFixedBlocks, threadCount, BENCH_ALLOC_COUNT));
+    }
+    tf_pool_exit(&gObjectPool);
+
+#if defined(ENABLE_MEMORY_SAMPLING)
+    checkSampledProfile();
+#endif
+
+    exitMemAlloc();
+    if (gFailedChecks)
+        printf("\n%u memory checks failed\n", gFailedChecks);
+    return gFailedChecks ? 1 : 0;
+}
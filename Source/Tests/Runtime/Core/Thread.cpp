@@ -0,0 +1,657 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+// Fine-grained task throughput benchmark.
+// Compares ThreadSystem against a reference queue that mirrors the previous implementation:
+// a single array of tasks guarded by one mutex and one condition variable.
+//
+// Mutex contention benchmark.
+// Compares Mutex and ConditionVariable against raw pthread primitives on platforms which have them.
+//
+// Scheduling checks.
+// Verify task priorities, the limit of threads executing background tasks, dependencies between batches,
+// continuations and waiting on task handles.
+
+#include <stdio.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#define BENCH_PTHREAD 1
+#endif
+
+#include <Core/ILog.h>
+#include <Core/IThread.h>
+#include <Core/ITime.h>
+
+#include <Runtime/Core/Private/Threading/Atomics.h>
+#include <Runtime/Core/Private/Threading/ThreadSystem.h>
+
+#include <Core/IMemory.h>
+
+#define BENCH_TASK_COUNT  (1u << 18)
+#define BENCH_BATCH_COUNT 256u
+#define BENCH_SPAWN_DEPTH 16u
+#define BENCH_LOOP_COUNT  (1u << 16)
+
+#define BENCH_MUTEX_LOCK_COUNT (1u << 20)
+#define BENCH_MUTEX_ROUNDS     1024u
+
+#define CHECK_PRIORITY_TASK_COUNT   8u
+#define CHECK_BACKGROUND_TASK_COUNT 64u
+#define CHECK_DEPENDENCY_TASK_COUNT 16u
+#define CHECK_CONTINUATION_COUNT    64u
+#define CHECK_WAIT_TIMEOUT_MS       20u
+#define CHECK_TIMEOUT_MS            10000u
+
+static tfrg_atomic64_t gExecutedTasks;
+static uint32_t        gFailedChecks;
+
+// Small amount of work so that scheduling overhead dominates
+static void benchLeafTask(void* user, uint64_t)
+{
+    volatile uint32_t* value = (volatile uint32_t*)user;
+    for (uint32_t i = 0; i < 16; ++i)
+        *value = *value * 1664525u + 1013904223u;
+    tfrg_atomic64_add_relaxed(&gExecutedTasks, 1);
+}
+
+struct LegacyTaskQueue
+{
+    struct Task
+    {
+        TaskFunc func;
+        void*    user;
+    };
+
+    Mutex             mutex;
+    ConditionVariable conditionTasks;
+    ConditionVariable conditionIsIdle;
+    Task*             tasks;
+    uint64_t          capacity;
+    uint64_t          taken;
+    uint64_t          queued;
+    uint32_t          busyThreadCount;
+    bool              stop;
+    ThreadHandle      threads[64];
+    uint32_t          threadCount;
+};
+
+static void legacyThreadFunc(void* data)
+{
+    LegacyTaskQueue* q = (LegacyTaskQueue*)data;
+    acquireMutex(&q->mutex);
+    for (;;)
+    {
+        while (q->taken == q->queued && !q->stop)
+            waitConditionVariable(&q->conditionTasks, &q->mutex, TIMEOUT_INFINITE);
+        if (q->taken == q->queued)
+            break;
+
+        LegacyTaskQueue::Task task = q->tasks[q->taken++];
+        ++q->busyThreadCount;
+        releaseMutex(&q->mutex);
+        task.func(task.user, 0);
+        acquireMutex(&q->mutex);
+        --q->busyThreadCount;
+        if (q->taken == q->queued && !q->busyThreadCount)
+            wakeAllConditionVariable(&q->conditionIsIdle);
+    }
+    releaseMutex(&q->mutex);
+}
+
+static void legacyInit(LegacyTaskQueue* q, uint32_t threadCount)
+{
+    memset(q, 0, sizeof *q);
+    initMutex(&q->mutex);
+    initConditionVariable(&q->conditionTasks);
+    initConditionVariable(&q->conditionIsIdle);
+    q->capacity = BENCH_TASK_COUNT;
+    q->tasks = (LegacyTaskQueue::Task*)tf_malloc(sizeof(LegacyTaskQueue::Task) * q->capacity);
+    q->threadCount = TF_MIN(threadCount, (uint32_t)TF_ARRAY_COUNT(q->threads));
+
+    ThreadDesc desc = {};
+    desc.pFunc = legacyThreadFunc;
+    desc.pData = q;
+    for (uint32_t i = 0; i < q->threadCount; ++i)
+        initThread(&desc, &q->threads[i]);
+}
+
+static void legacyExit(LegacyTaskQueue* q)
+{
+    acquireMutex(&q->mutex);
+    q->stop = true;
+    wakeAllConditionVariable(&q->conditionTasks);
+    releaseMutex(&q->mutex);
+    for (uint32_t i = 0; i < q->threadCount; ++i)
+        joinThread(q->threads[i]);
+    tf_free(q->tasks);
+    destroyConditionVariable(&q->conditionIsIdle);
+    destroyConditionVariable(&q->conditionTasks);
+    destroyMutex(&q->mutex);
+}
+
+static void legacyAddTasks(LegacyTaskQueue* q, TaskFunc func, uint32_t count, uint32_t* users)
+{
+    acquireMutex(&q->mutex);
+    if (q->taken == q->queued)
+        q->taken = q->queued = 0;
+    ASSERT(q->queued + count <= q->capacity);
+    for (uint32_t i = 0; i < count; ++i)
+        q->tasks[q->queued++] = { func, users + i };
+    wakeAllConditionVariable(&q->conditionTasks);
+    releaseMutex(&q->mutex);
+}
+
+static void legacyWaitIdle(LegacyTaskQueue* q)
+{
+    acquireMutex(&q->mutex);
+    while (q->taken != q->queued || q->busyThreadCount)
+        waitConditionVariable(&q->conditionIsIdle, &q->mutex, TIMEOUT_INFINITE);
+    releaseMutex(&q->mutex);
+}
+
+static ThreadSystem gSpawnThreadSystem;
+
+// Binary tree of tasks, every task is scheduled from a worker thread
+static void benchSpawnTask(void* user, uint64_t)
+{
+    uintptr_t depth = (uintptr_t)user;
+    tfrg_atomic64_add_relaxed(&gExecutedTasks, 1);
+    if (!depth)
+        return;
+    threadSystemAddTask(gSpawnThreadSystem, benchSpawnTask, (void*)(depth - 1));
+    threadSystemAddTask(gSpawnThreadSystem, benchSpawnTask, (void*)(depth - 1));
+}
+
+// Cost of an iteration grows with its index, so equal slices are unbalanced
+static void benchLoopRange(void* user, uint64_t begin, uint64_t end, uint64_t)
+{
+    volatile uint32_t* values = (volatile uint32_t*)user;
+    for (uint64_t i = begin; i < end; ++i)
+    {
+        for (uint64_t j = 0; j < (i >> 8); ++j)
+            values[i] = values[i] * 1664525u + 1013904223u;
+    }
+}
+
+struct LoopSlice
+{
+    uint32_t* values;
+    uint64_t  begin;
+    uint64_t  end;
+};
+
+static void benchLoopSliceTask(void* user, uint64_t threadId)
+{
+    LoopSlice* slice = (LoopSlice*)user;
+    benchLoopRange(slice->values, slice->begin, slice->end, threadId);
+}
+
+static double tasksPerSecond(uint64_t taskCount, int64_t usec) { return usec > 0 ? (double)taskCount * 1e6 / (double)usec : 0.0; }
+
+static void benchmarkThreadCount(uint32_t threadCount, uint32_t* users)
+{
+    // Submission from the main thread in batches
+    LegacyTaskQueue* legacy = (LegacyTaskQueue*)tf_calloc(1, sizeof(LegacyTaskQueue));
+    legacyInit(legacy, threadCount);
+    gExecutedTasks = 0;
+    int64_t start = getUSec(true);
+    for (uint32_t i = 0; i < BENCH_TASK_COUNT; i += BENCH_BATCH_COUNT)
+        legacyAddTasks(legacy, benchLeafTask, BENCH_BATCH_COUNT, users + i);
+    legacyWaitIdle(legacy);
+    int64_t legacyUSec = getUSec(true) - start;
+    ASSERT(gExecutedTasks == BENCH_TASK_COUNT);
+    legacyExit(legacy);
+    tf_free(legacy);
+
+    ThreadSystemInitDesc desc = gThreadSystemInitDescDefault;
+    desc.threadCount = threadCount;
+    desc.threadName = "BenchWorker";
+    ThreadSystem ts = NULL;
+    threadSystemInit(&ts, &desc);
+
+    gExecutedTasks = 0;
+    start = getUSec(true);
+    for (uint32_t i = 0; i < BENCH_TASK_COUNT; i += BENCH_BATCH_COUNT)
+        threadSystemAddTaskGroup(ts, benchLeafTask, BENCH_BATCH_COUNT, users + i);
+    threadSystemWaitIdle(ts);
+    int64_t batchUSec = getUSec(true) - start;
+    ASSERT(gExecutedTasks == BENCH_TASK_COUNT);
+
+    // Recursive spawning from worker threads
+    gSpawnThreadSystem = ts;
+    gExecutedTasks = 0;
+    start = getUSec(true);
+    threadSystemAddTask(ts, benchSpawnTask, (void*)(uintptr_t)BENCH_SPAWN_DEPTH);
+    threadSystemWaitIdle(ts);
+    int64_t spawnUSec = getUSec(true) - start;
+    uint64_t spawnedTasks = gExecutedTasks;
+    ASSERT(spawnedTasks == (2ull << BENCH_SPAWN_DEPTH) - 1);
+
+    // Uneven loop, hand-rolled equal slices against adaptive splitting
+    LoopSlice slices[64];
+    uint32_t  sliceCount = TF_MIN(threadCount, (uint32_t)TF_ARRAY_COUNT(slices));
+    for (uint32_t i = 0; i < sliceCount; ++i)
+        slices[i] = { users, (uint64_t)BENCH_LOOP_COUNT * i / sliceCount, (uint64_t)BENCH_LOOP_COUNT * (i + 1) / sliceCount };
+    start = getUSec(true);
+    threadSystemAddTaskGroup(ts, benchLoopSliceTask, sliceCount, slices);
+    threadSystemWaitIdle(ts);
+    int64_t sliceUSec = getUSec(true) - start;
+
+    start = getUSec(true);
+    threadSystemParallelFor(ts, 0, BENCH_LOOP_COUNT, 64, benchLoopRange, users);
+    int64_t parallelForUSec = getUSec(true) - start;
+
+    threadSystemExit(&ts, &gThreadSystemExitDescDefault);
+
+    printf("%8u %16.0f %16.0f %16.0f %16.0f %16.0f\n", threadCount, tasksPerSecond(BENCH_TASK_COUNT, legacyUSec),
+           tasksPerSecond(BENCH_TASK_COUNT, batchUSec), tasksPerSecond(spawnedTasks, spawnUSec), tasksPerSecond(BENCH_LOOP_COUNT, sliceUSec),
+           tasksPerSecond(BENCH_LOOP_COUNT, parallelForUSec));
+}
+
+struct MutexBench
+{
+    Mutex             mutex;
+    ConditionVariable condition;
+#if BENCH_PTHREAD
+    pthread_mutex_t pthreadMutex;
+    pthread_cond_t  pthreadCondition;
+#endif
+    uint64_t counter;
+    uint32_t lockCount;
+    // barrier state for the broadcast benchmark
+    uint32_t threadCount;
+    uint32_t arrived;
+    uint32_t generation;
+};
+
+// Short critical section with a bit of work outside of it, close to how locks are used by the engine
+static void benchMutexThread(void* data)
+{
+    MutexBench* bench = (MutexBench*)data;
+    uint32_t    value = 0;
+    for (uint32_t i = 0; i < bench->lockCount; ++i)
+    {
+        acquireMutex(&bench->mutex);
+        ++bench->counter;
+        releaseMutex(&bench->mutex);
+        for (uint32_t j = 0; j < 8; ++j)
+            value = value * 1664525u + 1013904223u;
+    }
+    tfrg_atomic64_add_relaxed(&gExecutedTasks, value & 1);
+}
+
+// Every round all threads meet at a barrier, the last one to arrive wakes everybody else
+static void benchConditionThread(void* data)
+{
+    MutexBench* bench = (MutexBench*)data;
+    for (uint32_t i = 0; i < BENCH_MUTEX_ROUNDS; ++i)
+    {
+        acquireMutex(&bench->mutex);
+        uint32_t generation = bench->generation;
+        if (++bench->arrived == bench->threadCount)
+        {
+            bench->arrived = 0;
+            ++bench->generation;
+            wakeAllConditionVariable(&bench->condition);
+        }
+        else
+        {
+            while (generation == bench->generation)
+                waitConditionVariable(&bench->condition, &bench->mutex, TIMEOUT_INFINITE);
+        }
+        releaseMutex(&bench->mutex);
+    }
+}
+
+#if BENCH_PTHREAD
+static void benchPthreadMutexThread(void* data)
+{
+    MutexBench* bench = (MutexBench*)data;
+    uint32_t    value = 0;
+    for (uint32_t i = 0; i < bench->lockCount; ++i)
+    {
+        pthread_mutex_lock(&bench->pthreadMutex);
+        ++bench->counter;
+        pthread_mutex_unlock(&bench->pthreadMutex);
+        for (uint32_t j = 0; j < 8; ++j)
+            value = value * 1664525u + 1013904223u;
+    }
+    tfrg_atomic64_add_relaxed(&gExecutedTasks, value & 1);
+}
+
+static void benchPthreadConditionThread(void* data)
+{
+    MutexBench* bench = (MutexBench*)data;
+    for (uint32_t i = 0; i < BENCH_MUTEX_ROUNDS; ++i)
+    {
+        pthread_mutex_lock(&bench->pthreadMutex);
+        uint32_t generation = bench->generation;
+        if (++bench->arrived == bench->threadCount)
+        {
+            bench->arrived = 0;
+            ++bench->generation;
+            pthread_cond_broadcast(&bench->pthreadCondition);
+        }
+        else
+        {
+            while (generation == bench->generation)
+                pthread_cond_wait(&bench->pthreadCondition, &bench->pthreadMutex);
+        }
+        pthread_mutex_unlock(&bench->pthreadMutex);
+    }
+}
+#endif
+
+// Returns time in microseconds it took all threads to finish
+static int64_t runMutexBench(MutexBench* bench, uint32_t threadCount, ThreadFunction func)
+{
+    ThreadHandle threads[32];
+    ThreadDesc   desc = {};
+    desc.pFunc = func;
+    desc.pData = bench;
+    bench->counter = 0;
+    bench->arrived = 0;
+    bench->generation = 0;
+    bench->threadCount = threadCount;
+    bench->lockCount = BENCH_MUTEX_LOCK_COUNT / threadCount;
+
+    int64_t start = getUSec(true);
+    for (uint32_t i = 0; i < threadCount; ++i)
+        initThread(&desc, &threads[i]);
+    for (uint32_t i = 0; i < threadCount; ++i)
+        joinThread(threads[i]);
+    return getUSec(true) - start;
+}
+
+static void benchmarkMutex(uint32_t threadCount)
+{
+    MutexBench* bench = (MutexBench*)tf_calloc(1, sizeof(MutexBench));
+    initMutex(&bench->mutex);
+    initConditionVariable(&bench->condition);
+
+    int64_t mutexUSec = runMutexBench(bench, threadCount, benchMutexThread);
+    ASSERT(bench->counter == (uint64_t)bench->lockCount * threadCount);
+    uint64_t lockCount = bench->counter;
+    int64_t  conditionUSec = runMutexBench(bench, threadCount, benchConditionThread);
+    ASSERT(bench->generation == BENCH_MUTEX_ROUNDS);
+
+    destroyConditionVariable(&bench->condition);
+    destroyMutex(&bench->mutex);
+
+    double pthreadLocks = 0.0;
+    double pthreadRounds = 0.0;
+#if BENCH_PTHREAD
+    pthread_mutex_init(&bench->pthreadMutex, NULL);
+    pthread_cond_init(&bench->pthreadCondition, NULL);
+    pthreadLocks = tasksPerSecond(lockCount, runMutexBench(bench, threadCount, benchPthreadMutexThread));
+    pthreadRounds = tasksPerSecond(BENCH_MUTEX_ROUNDS, runMutexBench(bench, threadCount, benchPthreadConditionThread));
+    pthread_cond_destroy(&bench->pthreadCondition);
+    pthread_mutex_destroy(&bench->pthreadMutex);
+#endif
+    tf_free(bench);
+
+    printf("%8u %16.0f %16.0f %16.0f %16.0f\n", threadCount, tasksPerSecond(lockCount, mutexUSec), pthreadLocks,
+           tasksPerSecond(BENCH_MUTEX_ROUNDS, conditionUSec), pthreadRounds);
+}
+
+static void checkThreadSystem(bool condition, const char* pMessage)
+{
+    if (condition)
+        return;
+    printf("%s\n", pMessage);
+    ++gFailedChecks;
+}
+
+// Keeps a worker busy until the gate is opened, so that tasks can be queued behind it
+static tfrg_atomic32_t gGateStarted;
+static tfrg_atomic32_t gGateOpen;
+
+static void gateTask(void*, uint64_t)
+{
+    tfrg_atomic32_store_release(&gGateStarted, 1);
+    while (!tfrg_atomic32_load_acquire(&gGateOpen))
+        threadSleep(1);
+}
+
+static ThreadSystemTaskHandle closeGate(ThreadSystem ts)
+{
+    gGateStarted = 0;
+    gGateOpen = 0;
+    ThreadSystemTaskHandle handle = threadSystemAddTask(ts, gateTask, NULL);
+    while (!tfrg_atomic32_load_acquire(&gGateStarted))
+        threadSleep(1);
+    return handle;
+}
+
+static void openGate() { tfrg_atomic32_store_release(&gGateOpen, 1); }
+
+static tfrg_atomic32_t gExecutionOrder;
+
+static void orderedTask(void* user, uint64_t)
+{
+    uint32_t* order = (uint32_t*)user;
+    *order = tfrg_atomic32_add_relaxed(&gExecutionOrder, 1);
+}
+
+// Single worker is blocked while tasks of all priorities are queued, lower priorities first
+static void checkPriorityOrder()
+{
+    ThreadSystemInitDesc desc = gThreadSystemInitDescDefault;
+    desc.threadCount = 1;
+    desc.threadName = "CheckWorker";
+    ThreadSystem ts = NULL;
+    threadSystemInit(&ts, &desc);
+
+    const uint32_t taskCounts[TASK_PRIORITY_COUNT] = { CHECK_PRIORITY_TASK_COUNT / 2, CHECK_PRIORITY_TASK_COUNT - 2, CHECK_PRIORITY_TASK_COUNT };
+    uint32_t       order[TASK_PRIORITY_COUNT][CHECK_PRIORITY_TASK_COUNT] = {};
+    gExecutionOrder = 0;
+    closeGate(ts);
+    for (int p = TASK_PRIORITY_COUNT - 1; p >= 0; --p)
+        threadSystemAddTasksPriority(ts, (TaskPriority)p, orderedTask, taskCounts[p], sizeof(uint32_t), order[p]);
+
+    ThreadSystemInfo info = {};
+    threadSystemGetInfo(ts, &info);
+    for (uint32_t p = 0; p < TASK_PRIORITY_COUNT; ++p)
+        checkThreadSystem(info.queuedTaskCount[p] == taskCounts[p], "queuedTaskCount doesn't match tasks queued with the priority");
+
+    openGate();
+    threadSystemWaitIdle(ts);
+    threadSystemExit(&ts, &gThreadSystemExitDescDefault);
+
+    // Every task of a priority has to run before any task of a lower one
+    for (uint32_t p = 0; p + 1 < TASK_PRIORITY_COUNT; ++p)
+    {
+        uint32_t last = 0;
+        uint32_t next = UINT32_MAX;
+        for (uint32_t i = 0; i < taskCounts[p]; ++i)
+            last = TF_MAX(last, order[p][i]);
+        for (uint32_t i = 0; i < taskCounts[p + 1]; ++i)
+            next = TF_MIN(next, order[p + 1][i]);
+        checkThreadSystem(last < next, "queued task of lower priority executed before a higher priority one");
+    }
+    checkThreadSystem(gExecutionOrder == taskCounts[0] + taskCounts[1] + taskCounts[2], "not all queued tasks executed");
+}
+
+static tfrg_atomic32_t gRunningBackgroundTasks;
+static tfrg_atomic32_t gMaxRunningBackgroundTasks;
+
+static void backgroundTask(void*, uint64_t)
+{
+    uint32_t running = tfrg_atomic32_add_relaxed(&gRunningBackgroundTasks, 1) + 1;
+    tfrg_atomic32_max_relaxed(&gMaxRunningBackgroundTasks, running);
+    threadSleep(1);
+    tfrg_atomic32_add_relaxed(&gRunningBackgroundTasks, -1);
+}
+
+static void checkBackgroundThreadLimit(uint32_t threadCount, uint32_t backgroundThreadCount)
+{
+    ThreadSystemInitDesc desc = gThreadSystemInitDescDefault;
+    desc.threadCount = threadCount;
+    desc.threadName = "CheckWorker";
+    desc.backgroundThreadCount = backgroundThreadCount;
+    ThreadSystem ts = NULL;
+    threadSystemInit(&ts, &desc);
+
+    ThreadSystemInfo info = {};
+    threadSystemGetInfo(ts, &info);
+    uint64_t limit = backgroundThreadCount ? TF_MIN(backgroundThreadCount, info.threadCount) : TF_MAX(info.threadCount - 1, 1);
+
+    gRunningBackgroundTasks = 0;
+    gMaxRunningBackgroundTasks = 0;
+    threadSystemAddTasksPriority(ts, TASK_PRIORITY_LOW, backgroundTask, CHECK_BACKGROUND_TASK_COUNT, 0, NULL);
+    threadSystemWaitIdle(ts);
+    threadSystemExit(&ts, &gThreadSystemExitDescDefault);
+
+    checkThreadSystem(gMaxRunningBackgroundTasks >= 1 && gMaxRunningBackgroundTasks <= limit,
+                      "number of threads executing low priority tasks exceeds backgroundThreadCount");
+}
+
+static void emptyTask(void*, uint64_t) {}
+
+static tfrg_atomic32_t gPrerequisiteTasks;
+static tfrg_atomic32_t gEarlyDependentTasks;
+
+static void prerequisiteTask(void*, uint64_t)
+{
+    threadSleep(1);
+    tfrg_atomic32_add_relaxed(&gPrerequisiteTasks, 1);
+}
+
+static void dependentTask(void*, uint64_t)
+{
+    if (tfrg_atomic32_load_acquire(&gPrerequisiteTasks) != 2 * CHECK_DEPENDENCY_TASK_COUNT)
+        tfrg_atomic32_add_relaxed(&gEarlyDependentTasks, 1);
+}
+
+static void continuationTask(void* user, uint64_t) { tfrg_atomic32_add_relaxed((tfrg_atomic32_t*)user, 1); }
+
+static void checkDependencies(uint32_t threadCount)
+{
+    ThreadSystemInitDesc desc = gThreadSystemInitDescDefault;
+    desc.threadCount = threadCount;
+    desc.threadName = "CheckWorker";
+    ThreadSystem ts = NULL;
+    threadSystemInit(&ts, &desc);
+
+    // Dependent batch starts only after both prerequisite batches are done
+    gPrerequisiteTasks = 0;
+    gEarlyDependentTasks = 0;
+    ThreadSystemTaskHandle prerequisites[2] = {
+        threadSystemAddTasks(ts, prerequisiteTask, CHECK_DEPENDENCY_TASK_COUNT, 0, NULL),
+        threadSystemAddTasksPriority(ts, TASK_PRIORITY_LOW, prerequisiteTask, CHECK_DEPENDENCY_TASK_COUNT, 0, NULL),
+    };
+    ThreadSystemTaskHandle dependent =
+        threadSystemAddTasksAfter(ts, TASK_PRIORITY_HIGH, prerequisites, 2, dependentTask, CHECK_DEPENDENCY_TASK_COUNT, 0, NULL);
+    ThreadSystemTaskHandle join = threadSystemAddTasksAfter(ts, TASK_PRIORITY_NORMAL, &dependent, 1, NULL, 0, 0, NULL);
+    checkThreadSystem(threadSystemWaitTaskTimeout(ts, join, CHECK_TIMEOUT_MS), "batch joining dependencies never completed");
+    checkThreadSystem(threadSystemIsTaskComplete(ts, prerequisites[0]) && threadSystemIsTaskComplete(ts, dependent),
+                      "dependencies of a completed batch are not complete");
+    threadSystemWaitIdle(ts);
+    checkThreadSystem(gEarlyDependentTasks == 0, "dependent task started before its prerequisites completed");
+
+    // Every continuation runs once, whether its batch is in flight, already complete or null
+    tfrg_atomic32_t continuationCounts[CHECK_CONTINUATION_COUNT + 1] = {};
+    for (uint32_t i = 0; i < CHECK_CONTINUATION_COUNT; ++i)
+    {
+        ThreadSystemTaskHandle handle = threadSystemAddTasks(ts, emptyTask, 1 + i % 4, 0, NULL);
+        if (i % 8 == 0)
+            threadSystemWaitTask(ts, handle);
+        threadSystemAddContinuation(ts, handle, continuationTask, (void*)&continuationCounts[i]);
+    }
+    threadSystemAddContinuation(ts, THREAD_SYSTEM_NULL_TASK_HANDLE, continuationTask, (void*)&continuationCounts[CHECK_CONTINUATION_COUNT]);
+    threadSystemWaitIdle(ts);
+    for (uint32_t i = 0; i <= CHECK_CONTINUATION_COUNT; ++i)
+        checkThreadSystem(continuationCounts[i] == 1, "continuation didn't run exactly once");
+
+    threadSystemExit(&ts, &gThreadSystemExitDescDefault);
+}
+
+// Single worker is blocked by the gate, so that batches stay queued while the main thread waits
+static void checkTaskHandles()
+{
+    ThreadSystemInitDesc desc = gThreadSystemInitDescDefault;
+    desc.threadCount = 1;
+    desc.threadName = "CheckWorker";
+    ThreadSystem ts = NULL;
+    threadSystemInit(&ts, &desc);
+
+    // Group slot of a completed batch is reused by the gate, old handle has to stay complete
+    ThreadSystemTaskHandle stale = threadSystemAddTask(ts, emptyTask, NULL);
+    threadSystemWaitTask(ts, stale);
+    ThreadSystemTaskHandle gate = closeGate(ts);
+    checkThreadSystem(threadSystemIsTaskComplete(ts, stale), "handle of a completed batch is incomplete after its slot was reused");
+    ThreadSystemTaskHandle afterStale = threadSystemAddTasksAfter(ts, TASK_PRIORITY_HIGH, &stale, 1, emptyTask, 1, 0, NULL);
+    checkThreadSystem(threadSystemWaitTaskTimeout(ts, afterStale, CHECK_TIMEOUT_MS), "batch depending on a stale handle never started");
+
+    // Waiting for one batch doesn't wait for unrelated ones
+    ThreadSystemTaskHandle unrelated = threadSystemAddTasksPriority(ts, TASK_PRIORITY_LOW, emptyTask, CHECK_DEPENDENCY_TASK_COUNT, 0, NULL);
+    ThreadSystemTaskHandle waited = threadSystemAddTasksPriority(ts, TASK_PRIORITY_HIGH, emptyTask, 1, 0, NULL);
+    checkThreadSystem(threadSystemWaitTaskTimeout(ts, waited, CHECK_TIMEOUT_MS), "waiting for a batch timed out while an unrelated one was queued");
+    checkThreadSystem(!threadSystemIsTaskComplete(ts, unrelated), "unrelated batch completed while the worker was blocked");
+
+    // Batch waiting for the gate can't complete before timeout
+    ThreadSystemTaskHandle blocked = threadSystemAddTasksAfter(ts, TASK_PRIORITY_HIGH, &gate, 1, emptyTask, 1, 0, NULL);
+    int64_t                start = getUSec(true);
+    checkThreadSystem(!threadSystemWaitTaskTimeout(ts, blocked, CHECK_WAIT_TIMEOUT_MS), "waiting for a blocked batch didn't time out");
+    checkThreadSystem(getUSec(true) - start >= CHECK_WAIT_TIMEOUT_MS * 1000, "waiting for a blocked batch returned before timeout");
+    checkThreadSystem(!threadSystemIsTaskComplete(ts, blocked), "batch completed before its dependency");
+
+    openGate();
+    checkThreadSystem(threadSystemWaitTaskTimeout(ts, blocked, CHECK_TIMEOUT_MS), "batch never completed after its dependency");
+    checkThreadSystem(threadSystemWaitTaskTimeout(ts, unrelated, CHECK_TIMEOUT_MS), "unrelated batch never completed");
+    threadSystemExit(&ts, &gThreadSystemExitDescDefault);
+}
+
+int main(int, char**)
+{
+    initMemAlloc(NULL);
+
+    uint32_t* users = (uint32_t*)tf_calloc(BENCH_TASK_COUNT, sizeof(uint32_t));
+
+    printf("Fine-grained task throughput (tasks/s), uneven loop throughput (iterations/s)\n");
+    printf("%8s %16s %16s %16s %16s %16s\n", "threads", "legacy queue", "batched", "spawned", "loop slices", "parallel for");
+    uint32_t coreCount = getNumCPUCores();
+    for (uint32_t threadCount = 1; threadCount <= coreCount; threadCount *= 2)
+        benchmarkThreadCount(threadCount, users);
+
+    printf("\nMutex throughput (locks/s), condition variable broadcast (barrier rounds/s)\n");
+    printf("%8s %16s %16s %16s %16s\n", "threads", "mutex", "pthread mutex", "broadcast", "pthread cond");
+    const uint32_t mutexThreadCounts[] = { 2, 8, 32 };
+    for (uint32_t i = 0; i < TF_ARRAY_COUNT(mutexThreadCounts); ++i)
+        benchmarkMutex(mutexThreadCounts[i]);
+
+    checkPriorityOrder();
+    checkBackgroundThreadLimit(4, 0);
+    checkBackgroundThreadLimit(4, 2);
+    checkDependencies(1);
+    checkDependencies(4);
+    checkTaskHandles();
+    if (gFailedChecks)
+        printf("\n%u thread system checks failed\n", gFailedChecks);
+
+    tf_free(users);
+    exitMemAlloc();
+    return gFailedChecks ? 1 : 0;
+}
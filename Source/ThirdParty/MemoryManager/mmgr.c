@@ -235,6 +235,14 @@ extern void               debugger(const char* message);
 #undef realloc
 #undef free
 
+// With ENABLE_MIMALLOC tracked allocations are backed by mimalloc as well
+#if defined(ENABLE_MIMALLOC)
+#include <ThirdParty/mimalloc/include/mimalloc.h>
+#define malloc(size)       mi_malloc(size)
+#define realloc(ptr, size) mi_realloc(ptr, size)
+#define free(ptr)          mi_free(ptr)
+#endif
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 // -DOC- Get to know these values. They represent the values that will be used to fill unused and deallocated RAM.
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -279,6 +287,7 @@ const char*         mAppName;
 
 #include "../../../../Interfaces/IThread.h"
 #include "../../../../Interfaces/IFileSystem.h"
+#include <Runtime/Core/Private/Memory/Arena.h>
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof(*x))
 
@@ -462,34 +471,29 @@ static const char* ownerString(const char* sourceFile, const unsigned int source
 
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-static const char* insertCommas(unsigned int value)
+static const char* insertCommas(uint64_t value)
 {
 	static char str[30];
-	memset(str, 0, sizeof(str));
+	char        digits[21];
+	tf_sprintfarr(digits, "%llu", (unsigned long long)value);
 
-	tf_sprintfarr(str, "%u", value);
-	if (strlen(str) > 3)
-	{
-		memmove(&str[strlen(str) - 3], &str[strlen(str) - 4], 4);
-		str[strlen(str) - 4] = ',';
-	}
-	if (strlen(str) > 7)
+	// Comma before every group of three digits from the right
+	size_t digitCount = strlen(digits);
+	size_t length = 0;
+	for (size_t i = 0; i < digitCount; ++i)
 	{
-		memmove(&str[strlen(str) - 7], &str[strlen(str) - 8], 8);
-		str[strlen(str) - 8] = ',';
-	}
-	if (strlen(str) > 11)
-	{
-		memmove(&str[strlen(str) - 11], &str[strlen(str) - 12], 12);
-		str[strlen(str) - 12] = ',';
+		if (i && (digitCount - i) % 3 == 0)
+			str[length++] = ',';
+		str[length++] = digits[i];
 	}
+	str[length] = 0;
 
 	return str;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-static const char* memorySizeString(uint32_t size)
+static const char* memorySizeString(uint64_t size)
 {
 	static char str[90];
 	if (size > (1024 * 1024))
@@ -759,7 +763,12 @@ bool initMemAlloc(const char* appName)
 	return true;
 }
 
-void exitMemAlloc(void) { dumpLeakReport(); }
+void exitMemAlloc(void)
+{
+	// Thread arenas are allocated with tf_malloc, they'd show up as leaks
+	tf_arena_exit_threads();
+	dumpLeakReport();
+}
 // ---------------------------------------------------------------------------------------------------------------------------------
 // -DOC- Flags & options -- Call these routines to enable/disable the following options
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -1085,8 +1094,8 @@ void* mmgrAllocator(
 
 		// Account for the new allocatin unit in our stats
 
-		stats.totalReportedMemory += (unsigned int)(au->reportedSize);
-		stats.totalActualMemory += (unsigned int)(au->actualSize);
+		stats.totalReportedMemory += (uint64_t)(au->reportedSize);
+		stats.totalActualMemory += (uint64_t)(au->actualSize);
 		stats.totalAllocUnitCount++;
 		if (stats.totalReportedMemory > stats.peakReportedMemory)
 			stats.peakReportedMemory = stats.totalReportedMemory;
@@ -1094,8 +1103,8 @@ void* mmgrAllocator(
 			stats.peakActualMemory = stats.totalActualMemory;
 		if (stats.totalAllocUnitCount > stats.peakAllocUnitCount)
 			stats.peakAllocUnitCount = stats.totalAllocUnitCount;
-		stats.accumulatedReportedMemory += (unsigned int)(au->reportedSize);
-		stats.accumulatedActualMemory += (unsigned int)(au->actualSize);
+		stats.accumulatedReportedMemory += (uint64_t)(au->reportedSize);
+		stats.accumulatedActualMemory += (uint64_t)(au->actualSize);
 		stats.accumulatedAllocUnitCount++;
 
 		// Prepare the allocation unit for use (wipe it with recognizable garbage)
@@ -1266,8 +1275,8 @@ void* mmgrReallocator(
 		}
 		// Remove this allocation from our stats (we'll add the new reallocation again later)
 
-		stats.totalReportedMemory -= (unsigned int)(au->reportedSize);
-		stats.totalActualMemory -= (unsigned int)(au->actualSize);
+		stats.totalReportedMemory -= (uint64_t)(au->reportedSize);
+		stats.totalActualMemory -= (uint64_t)(au->actualSize);
 
 		// Update the allocation with the new information
 
@@ -1350,15 +1359,15 @@ void* mmgrReallocator(
 
 		// Account for the new allocatin unit in our stats
 
-		stats.totalReportedMemory += (unsigned int)(au->reportedSize);
-		stats.totalActualMemory += (unsigned int)(au->actualSize);
+		stats.totalReportedMemory += (uint64_t)(au->reportedSize);
+		stats.totalActualMemory += (uint64_t)(au->actualSize);
 		if (stats.totalReportedMemory > stats.peakReportedMemory)
 			stats.peakReportedMemory = stats.totalReportedMemory;
 		if (stats.totalActualMemory > stats.peakActualMemory)
 			stats.peakActualMemory = stats.totalActualMemory;
-		int deltaReportedSize = (int)(reportedSize - originalReportedSize);
-		if (deltaReportedSize > 0)
+		if (reportedSize > originalReportedSize)
 		{
+			uint64_t deltaReportedSize = (uint64_t)(reportedSize - originalReportedSize);
 			stats.accumulatedReportedMemory += deltaReportedSize;
 			stats.accumulatedActualMemory += deltaReportedSize;
 		}
@@ -1486,8 +1495,8 @@ void mmgrDeallocator(
 
 		// Remove this allocation from our stats
 
-		stats.totalReportedMemory -= (unsigned int)(au->reportedSize);
-		stats.totalActualMemory -= (unsigned int)(au->actualSize);
+		stats.totalReportedMemory -= (uint64_t)(au->reportedSize);
+		stats.totalActualMemory -= (uint64_t)(au->actualSize);
 		stats.totalAllocUnitCount--;
 
 		// Add this allocation unit to the front of our reservoir of unused allocation units
@@ -1665,9 +1674,9 @@ void mmgrDumpAllocUnit(const sAllocUnit* allocUnit, const char* prefix)
 	Log("[I] %sAddress (reported): %010p", prefix, allocUnit->reportedAddress);
 	Log("[I] %sAddress (actual)  : %010p", prefix, allocUnit->actualAddress);
 	Log("[I] %sSize (reported)   : 0x%08X (%s)", prefix, (unsigned int)(allocUnit->reportedSize),
-		memorySizeString((unsigned int)(allocUnit->reportedSize)));
+		memorySizeString((uint64_t)(allocUnit->reportedSize)));
 	Log("[I] %sSize (actual)     : 0x%08X (%s)", prefix, (unsigned int)(allocUnit->actualSize),
-		memorySizeString((unsigned int)(allocUnit->actualSize)));
+		memorySizeString((uint64_t)(allocUnit->actualSize)));
 	Log("[I] %sOwner             : %s(%d)::%s", prefix, allocUnit->sourceFile, allocUnit->sourceLine, allocUnit->sourceFunc);
 	Log("[I] %sAllocation type   : %s", prefix, allocationTypes[allocUnit->allocationType]);
 	Log("[I] %sAllocation number : %d", prefix, allocUnit->allocationNumber);
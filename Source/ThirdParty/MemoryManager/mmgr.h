@@ -43,6 +43,7 @@
 #endif
 
 #include "stdbool.h"
+#include "stdint.h"
 
 // ---------------------------------------------------------------------------------------------------------------------------------
 // Types
@@ -69,15 +70,15 @@ typedef struct tag_au
 
 typedef struct
 {
-	unsigned int totalReportedMemory;
-	unsigned int totalActualMemory;
-	unsigned int peakReportedMemory;
-	unsigned int peakActualMemory;
-	unsigned int accumulatedReportedMemory;
-	unsigned int accumulatedActualMemory;
-	unsigned int accumulatedAllocUnitCount;
-	unsigned int totalAllocUnitCount;
-	unsigned int peakAllocUnitCount;
+	uint64_t totalReportedMemory;
+	uint64_t totalActualMemory;
+	uint64_t peakReportedMemory;
+	uint64_t peakActualMemory;
+	uint64_t accumulatedReportedMemory;
+	uint64_t accumulatedActualMemory;
+	uint64_t accumulatedAllocUnitCount;
+	uint64_t totalAllocUnitCount;
+	uint64_t peakAllocUnitCount;
 } sMStats;
 
 // ---------------------------------------------------------------------------------------------------------------------------------
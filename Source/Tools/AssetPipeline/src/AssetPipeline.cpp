@@ -2363,14 +2363,12 @@ bool WriteZip(AssetPipelineParams* assetParams, WriteZipParams* zipParams)
 
 bool ZipAllAssets(AssetPipelineParams* assetParams, WriteZipParams* zipParams)
 {
-    // TODO: we should check that none of the existing assets have been cooked
-    if (!assetParams->mSettings.force && fsFileExist(assetParams->mRDOutput, zipParams->mZipFileName))
-    {
-        return false;
-    }
-
     BunyArLibCreateDesc archiveCreateDesc = { 0 };
 
+    // Existing archive is rebuilt incrementally, only cooked assets that changed get compressed again
+    if (!assetParams->mSettings.force && fsFileExist(assetParams->mRDOutput, zipParams->mZipFileName))
+        archiveCreateDesc.previousArchivePath = zipParams->mZipFileName;
+
     struct BunyArLibEntryCreateDesc entry = BUNYAR_LIB_FUNC_CREATE_DEFAULT_ENTRY_DESC;
 
     if (zipParams->mFiltersCount > 0)
@@ -25,6 +25,8 @@
 #define BUNYAR_LIB_INTERNAL
 #include "Buny.h"
 
+#include <float.h>
+
 #include <ThirdParty/stb/stb_ds.h>
 
 #include <Core/ILog.h>
@@ -39,8 +41,12 @@
 // This macro enables custom ZSTD allocator features
 #define ZSTD_STATIC_LINKING_ONLY
 #include "../../Utilities/ThirdParty/OpenSource/lz4/lz4hc.h"
+#include "../../Utilities/ThirdParty/OpenSource/zstd/zdict.h"
 #include "../../Utilities/ThirdParty/OpenSource/zstd/zstd.h"
 #include "../../Utilities/ThirdParty/OpenSource/zstd/zstd_errors.h"
+// XXH64_state_t definition
+#define XXH_STATIC_LINKING_ONLY
+#include "../../Utilities/ThirdParty/OpenSource/zstd/common/xxhash.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Function bunyArLibCreate (part one)                                     ///
@@ -258,6 +264,23 @@ static bool bunyArLibCreatePreprocessDesc(const struct BunyArLibCreateDesc* inDe
     {
         const struct BunyArLibEntryCreateDesc* entry = inDesc->entries + i;
 
+        // Tombstones have no input, inputPath is the name of deleted file
+        if (entry->format == BUNYAR_FILE_FORMAT_TOMBSTONE)
+        {
+            const char* outName = NULL;
+            if (!bunyArLibComputeEntryName(strings, entry, &outName))
+            {
+                success = false;
+                break;
+            }
+
+            arrpush(outDesc->entries, *entry);
+            struct BunyArLibEntryCreateDesc* newEntry = outDesc->entries + arrlenu(outDesc->entries) - 1;
+            newEntry->outputName = outName;
+            newEntry->index = outDesc->entryCount++;
+            continue;
+        }
+
         bool exist;
         bool isDir;
         bool isFile;
@@ -409,6 +432,23 @@ static void bunyArLibCreatePostprocessDesc(struct BunyArLibCreateDesc* desc, cha
 /// Prepare archive metadata                                                 ///
 ////////////////////////////////////////////////////////////////////////////////
 
+struct BunyArLibDictionary
+{
+    void*       content;
+    size_t      size;
+    ZSTD_CDict* cdict;
+    uint32_t    id;
+    // XXH64 of content, seed 0
+    uint64_t    hash;
+};
+
+struct BunyArLibContent
+{
+    uint64_t size;
+    uint64_t hash;
+    bool     hashed;
+};
+
 struct BunyArLibCreateMetadata
 {
     uint64_t                nodeCount;
@@ -419,6 +459,39 @@ struct BunyArLibCreateMetadata
     uint32_t                namesSize;
     bool                    lz4Used;
     bool                    zstdUsed;
+
+    // Trained by bunyArLibCreateDictionaries
+    uint32_t                    dictionaryCount;
+    struct BunyArLibDictionary* dictionaries;
+    // Dictionary index of each node, UINT32_MAX if node has no dictionary
+    uint32_t*                   nodeDictionaries;
+
+    // Set by bunyArLibFindDuplicates, index of node storing content of each node
+    uint64_t* nodeOriginals;
+    uint64_t  duplicateCount;
+    uint64_t  duplicateSize;
+
+    uint64_t tombstoneCount;
+
+    // Set by bunyArLibHashContents
+    struct BunyArLibContent* contents;
+
+    // Set by bunyArLibFindReusableNodes, node of previous archive holding compressed data of each node, UINT64_MAX if none
+    uint64_t* nodeReused;
+    uint64_t  reusedCount;
+    uint64_t  reusedSize;
+    void*     copyBuffer;
+
+    // Set by bunyArLibLoadPreviousArchive, all in one allocation at previousNodes
+    FileStream               previousArchive;
+    struct BunyArNode*       previousNodes;
+    struct BunyArNodeSource* previousSources;
+    char*                    previousNames;
+    uint64_t                 previousNodeCount;
+
+    // Set by bunyArLibLayoutByAccessTrace, node written at each position of archive data, NULL to write in node order
+    uint64_t* layoutOrder;
+    uint64_t  tracedCount;
 };
 
 // TODO experiment with this
@@ -436,11 +509,30 @@ static uint32_t convertBlockSize(enum BunyArFileFormat format, uint32_t blockSiz
     }
 }
 
+static inline uint64_t bunyArLibLayoutNode(const struct BunyArLibCreateMetadata* md, uint64_t position)
+{
+    return md->layoutOrder ? md->layoutOrder[position] : position;
+}
+
 static void bunyArLibCreateMetadataDestroy(struct BunyArLibCreateMetadata* md)
 {
     tf_free(md->nodes);
     tf_free(md->names);
     tf_free(md->hashTable);
+    for (uint32_t i = 0; i < md->dictionaryCount; ++i)
+    {
+        ZSTD_freeCDict(md->dictionaries[i].cdict);
+        tf_free(md->dictionaries[i].content);
+    }
+    tf_free(md->dictionaries);
+    tf_free(md->nodeDictionaries);
+    tf_free(md->nodeOriginals);
+    tf_free(md->contents);
+    tf_free(md->nodeReused);
+    tf_free(md->previousNodes);
+    tf_free(md->copyBuffer);
+    tf_free(md->layoutOrder);
+    fsCloseStream(&md->previousArchive);
     memset(md, 0, sizeof(*md));
 }
 
@@ -486,6 +578,9 @@ static bool bunyArLibCreateMetadataDetail(const struct BunyArLibCreateDesc* desc
         case BUNYAR_FILE_FORMAT_ZSTD_BLOCKS:
             md->zstdUsed = true;
             break;
+        case BUNYAR_FILE_FORMAT_TOMBSTONE:
+            ++md->tombstoneCount;
+            break;
         default:
             LOGF(eERROR, "Unsupported format: %llu\n", node->format);
             return false;
@@ -599,6 +694,8 @@ struct FileAssemblyLine
     struct ThreadsSharedMemory*            tsm;
     const struct BunyArLibEntryCreateDesc* entry;
     uint64_t                               entryIndex;
+    // Position of entry data in the archive
+    uint64_t                               layoutIndex;
     uint64_t                               streamOffset;
     uint64_t                               fsize;
     uint64_t                               blockCount;
@@ -638,7 +735,8 @@ struct ThreadsSharedMemory
 
     bool error;
 
-    struct CompressionContext* compressionContexts;
+    struct BunyArLibCreateMetadata* md;
+    struct CompressionContext*      compressionContexts;
 
     tfrg_atomic64_t priorityEntryIndex_Atomic64;
 
@@ -716,7 +814,7 @@ static bool getFileBlock(struct FileAssemblyLine* file, struct FileBlock** out)
     struct ThreadsSharedMemory* tsm = file->tsm;
 
     uint64_t pei = tfrg_atomic64_load_relaxed(&file->tsm->priorityEntryIndex_Atomic64);
-    bool     priority = file->entryIndex == pei;
+    bool     priority = file->layoutIndex == pei;
 
     uint64_t threshold = tsm->totalFileBlockCount / 2;
     if (priority)
@@ -820,8 +918,8 @@ static void compressionContextDestroy(struct CompressionContext* ctx)
     memset(ctx, 0, sizeof *ctx);
 }
 
-static bool bunyArLibTaskCompress(struct CompressionContext* ctx, enum BunyArFileFormat format, int compressionLevel, const void* src,
-                                  uint64_t size, void* dst,
+static bool bunyArLibTaskCompress(struct CompressionContext* ctx, enum BunyArFileFormat format, int compressionLevel,
+                                  const ZSTD_CDict* zstdDictionary, const void* src, uint64_t size, void* dst,
                                   uint64_t* dstLimitAndOutSize) // UINT64_MAX if not fit
 {
     if (size == 0)
@@ -852,7 +950,10 @@ static bool bunyArLibTaskCompress(struct CompressionContext* ctx, enum BunyArFil
     }
     case BUNYAR_FILE_FORMAT_ZSTD_BLOCKS:
     {
-        size_t compressedSize = ZSTD_compressCCtx(ctx->zstdCtx, dst, *dstLimitAndOutSize, src, size, compressionLevel);
+        // Compression level of dictionary is set on creation
+        size_t compressedSize = zstdDictionary
+                                    ? ZSTD_compress_usingCDict(ctx->zstdCtx, dst, *dstLimitAndOutSize, src, size, zstdDictionary)
+                                    : ZSTD_compressCCtx(ctx->zstdCtx, dst, *dstLimitAndOutSize, src, size, compressionLevel);
 
         ZSTD_ErrorCode error = ZSTD_getErrorCode(compressedSize);
 
@@ -934,6 +1035,88 @@ static bool initializeEntryBlockStream(enum BunyArFileFormat format, uint32_t bl
     return true;
 }
 
+static bool bunyArLibWriteDictionaries(FileStream* fs, struct BunyArPointer64 location, const struct BunyArLibCreateMetadata* md)
+{
+    if (!tf_seek(fs, location.offset))
+        return false;
+
+    uint64_t offset = location.offset + location.size;
+    for (uint32_t i = 0; i < md->dictionaryCount; ++i)
+    {
+        struct BunyArPointer64 ptr = { offset, md->dictionaries[i].size };
+        if (!tf_write(fs, sizeof ptr, &ptr))
+            return false;
+        offset += ptr.size;
+    }
+
+    for (uint32_t i = 0; i < md->dictionaryCount; ++i)
+    {
+        if (!tf_write(fs, md->dictionaries[i].size, md->dictionaries[i].content))
+            return false;
+    }
+
+    return true;
+}
+
+// Returns NULL if node is compressed without a dictionary
+static inline const struct BunyArLibDictionary* bunyArLibNodeDictionary(const struct BunyArLibCreateMetadata* md, uint64_t ni)
+{
+    if (!md->nodeDictionaries || md->nodeDictionaries[ni] == UINT32_MAX)
+        return NULL;
+    return md->dictionaries + md->nodeDictionaries[ni];
+}
+
+static bool bunyArLibWriteNodeSources(FileStream* fs, struct BunyArPointer64 location, const struct BunyArLibCreateDesc* desc,
+                                      const struct BunyArLibCreateMetadata* md)
+{
+    struct BunyArNodeSource* sources = (struct BunyArNodeSource*)tf_calloc(md->nodeCount, sizeof *sources);
+    if (!sources)
+        return false;
+
+    for (uint64_t i = 0; i < md->nodeCount; ++i)
+    {
+        // Duplicates are stored as their original
+        uint64_t original = md->nodeOriginals ? md->nodeOriginals[i] : i;
+
+        const struct BunyArLibDictionary* dictionary = bunyArLibNodeDictionary(md, original);
+
+        sources[i].contentHash = md->contents[i].hash;
+        sources[i].compressionLevel = desc->entries[original].compressionLevel;
+        sources[i].dictionaryId = dictionary ? dictionary->id : 0;
+        sources[i].dictionaryHash = dictionary ? dictionary->hash : 0;
+        sources[i].requestedFormat = (uint64_t)desc->entries[original].format;
+    }
+
+    bool success = tf_seek(fs, location.offset) && tf_write(fs, location.size, sources);
+    tf_free(sources);
+    return success;
+}
+
+#define BUNYAR_LIB_COPY_CHUNK_SIZE (1024 * 1024)
+
+static bool bunyArLibReadPrevious(FileStream* fs, uint64_t offset, uint64_t size, void* dst)
+{
+    return tf_seek(fs, (size_t)offset) && fsReadFromStream(fs, dst, (size_t)size) == size;
+}
+
+// Copies compressed data of a node of previous archive to the current position of 'dst'
+static bool bunyArLibCopyPreviousNode(FileStream* dst, struct BunyArLibCreateMetadata* md, struct BunyArPointer64 location)
+{
+    for (uint64_t copied = 0; copied < location.size;)
+    {
+        uint64_t size = location.size - copied;
+        if (size > BUNYAR_LIB_COPY_CHUNK_SIZE)
+            size = BUNYAR_LIB_COPY_CHUNK_SIZE;
+
+        if (!bunyArLibReadPrevious(&md->previousArchive, location.offset + copied, size, md->copyBuffer) ||
+            !tf_write(dst, (size_t)size, md->copyBuffer))
+            return false;
+
+        copied += size;
+    }
+    return true;
+}
+
 // Writes archive file. Gets compressed file data through 'packetIo'.
 // It just writes data given by 'packetIo' for each node one by one.
 static bool bunyArLibArchiveWrite(ResourceDirectory rd, const char* dstPath, struct bunyArLibPacketIo packetIo,
@@ -1006,6 +1189,78 @@ static bool bunyArLibArchiveWrite(ResourceDirectory rd, const char* dstPath, str
                 break;
             }
 
+            if (md->nodeOriginals && md->nodeOriginals[file->entryIndex] != file->entryIndex)
+            {
+                // Original is written before, layout keeps originals ahead of their duplicates
+                const struct BunyArNode* original = md->nodes + md->nodeOriginals[file->entryIndex];
+
+                node->format = original->format;
+                node->originalFileSize = original->originalFileSize;
+                node->filePointer = original->filePointer;
+
+                totalFilesSize += node->originalFileSize;
+
+                if (desc->verbose)
+                {
+                    fprintf(stdout, "%*llu/%*llu '%s'", counterWidth, (unsigned long long)filesDone + 1, counterWidth,
+                            (unsigned long long)md->nodeCount, md->names + node->namePointer.offset);
+                    if (desc->verbose > 1)
+                        fprintf(stdout, " = '%s'", md->names + original->namePointer.offset);
+                    putc('\n', stdout);
+                }
+
+                ++filesDone;
+                blockIndex = UINT64_MAX;
+                continue;
+            }
+
+            if (md->nodeReused && md->nodeReused[file->entryIndex] != UINT64_MAX)
+            {
+                // Block pointers are relative to node location, data is copied as is
+                const struct BunyArNode* previous = md->previousNodes + md->nodeReused[file->entryIndex];
+
+                node->format = previous->format;
+                node->originalFileSize = previous->originalFileSize;
+                node->filePointer.offset = offset;
+                node->filePointer.size = previous->filePointer.size;
+
+                if (!tf_seek(&archiveFs, offset) || !bunyArLibCopyPreviousNode(&archiveFs, md, previous->filePointer))
+                {
+                    result = BUNYAR_LIB_RESULT_OUTPUT_ERROR;
+                    break;
+                }
+
+                offset += node->filePointer.size;
+                totalFilesSize += node->originalFileSize;
+
+                if (desc->verbose)
+                {
+                    fprintf(stdout, "%*llu/%*llu '%s' unchanged\n", counterWidth, (unsigned long long)filesDone + 1, counterWidth,
+                            (unsigned long long)md->nodeCount, md->names + node->namePointer.offset);
+                }
+
+                ++filesDone;
+                blockIndex = UINT64_MAX;
+                continue;
+            }
+
+            if (node->format == BUNYAR_FILE_FORMAT_TOMBSTONE)
+            {
+                // Tombstones have no data
+                node->filePointer.offset = offset;
+
+                if (desc->verbose)
+                {
+                    fprintf(stdout, "%*llu/%*llu '%s' %s\n", counterWidth, (unsigned long long)filesDone + 1, counterWidth,
+                            (unsigned long long)md->nodeCount, md->names + node->namePointer.offset,
+                            bunyArFormatName(BUNYAR_FILE_FORMAT_TOMBSTONE));
+                }
+
+                ++filesDone;
+                blockIndex = UINT64_MAX;
+                continue;
+            }
+
             node->filePointer.offset = offset;
             node->originalFileSize = file->fsize;
 
@@ -1018,7 +1273,7 @@ static bool bunyArLibArchiveWrite(ResourceDirectory rd, const char* dstPath, str
 
             if (desc->verbose)
             {
-                prevPrintedLen += fprintf(stdout, "%*llu/%*llu ", counterWidth, (unsigned long long)file->entryIndex + 1, counterWidth,
+                prevPrintedLen += fprintf(stdout, "%*llu/%*llu ", counterWidth, (unsigned long long)filesDone + 1, counterWidth,
                                           (unsigned long long)md->nodeCount);
 
                 const char* name = md->names + node->namePointer.offset;
@@ -1208,6 +1463,11 @@ static bool bunyArLibArchiveWrite(ResourceDirectory rd, const char* dstPath, str
         struct BunyArHeader header = { 0 };
         memcpy(&header.magic, BUNYAR_MAGIC, sizeof(header.magic));
 
+        // Readers without dictionaries support can't decompress blocks,
+        // readers without tombstones support would see deleted files of patch archives
+        header.version.compatible = md->tombstoneCount ? 2 : md->dictionaryCount ? 1 : 0;
+        header.version.actual = BUNYAR_VERSION;
+
         header.nodesPointer.offset = sizeof(struct BunyArHeader);
         header.nodesPointer.size = sizeof(struct BunyArNode) * desc->entryCount;
 
@@ -1217,21 +1477,36 @@ static bool bunyArLibArchiveWrite(ResourceDirectory rd, const char* dstPath, str
         header.hashTablePointer.offset = offset;
         header.hashTablePointer.size = hashTableSize;
 
+        // dictionaries table is followed by dictionaries
+        header.dictionariesPointer.offset = header.hashTablePointer.offset + header.hashTablePointer.size;
+        header.dictionariesPointer.size = sizeof(struct BunyArPointer64) * md->dictionaryCount;
+
+        size_t dictionariesSize = header.dictionariesPointer.size;
+        for (uint32_t i = 0; i < md->dictionaryCount; ++i)
+            dictionariesSize += md->dictionaries[i].size;
+
+        header.nodeSourcesPointer.offset = header.dictionariesPointer.offset + dictionariesSize;
+        header.nodeSourcesPointer.size = sizeof(struct BunyArNodeSource) * md->nodeCount;
+
         if (!tf_seek(&archiveFs, 0) || !tf_write(&archiveFs, sizeof(header), &header) ||
             !tf_write(&archiveFs, header.nodesPointer.size, md->nodes) || !tf_write(&archiveFs, header.namesPointer.size, md->names) ||
             (md->hashTable &&
-             (!tf_seek(&archiveFs, header.hashTablePointer.offset) || !tf_write(&archiveFs, header.hashTablePointer.size, md->hashTable))))
+             (!tf_seek(&archiveFs, header.hashTablePointer.offset) || !tf_write(&archiveFs, header.hashTablePointer.size, md->hashTable))) ||
+            (md->dictionaryCount && !bunyArLibWriteDictionaries(&archiveFs, header.dictionariesPointer, md)) ||
+            !bunyArLibWriteNodeSources(&archiveFs, header.nodeSourcesPointer, desc, md))
             return BUNYAR_LIB_RESULT_OUTPUT_ERROR;
 
         if (desc->verbose > 1)
         {
-            size_t metadataSize = sizeof(header) + header.nodesPointer.size + header.namesPointer.size + header.hashTablePointer.size;
+            size_t metadataSize =
+                sizeof(header) + header.nodesPointer.size + header.namesPointer.size + header.hashTablePointer.size + dictionariesSize +
+                header.nodeSourcesPointer.size;
 
             fprintf(stdout, "|- %s\n\n", humanReadableSize(metadataSize).str);
         }
 
-        // because hash table is located in the end
-        archiveSize = header.hashTablePointer.offset + header.hashTablePointer.size;
+        // because hash table, dictionaries and node sources are located in the end
+        archiveSize = header.nodeSourcesPointer.offset + header.nodeSourcesPointer.size;
     }
 
     switch (result)
@@ -1263,8 +1538,21 @@ static bool bunyArLibArchiveWrite(ResourceDirectory rd, const char* dstPath, str
 
     if (desc->verbose && result == BUNYAR_LIB_RESULT_SUCCESS)
     {
-        fprintf(stdout, "Archive '%s' completed.\n|- %llu files\n|- %s -> %s (x%.2f)\n\n", dstPath, (unsigned long long)desc->entryCount,
+        fprintf(stdout, "Archive '%s' completed.\n|- %llu files\n|- %s -> %s (x%.2f)\n", dstPath, (unsigned long long)desc->entryCount,
                 humanReadableSize(totalFilesSize).str, humanReadableSize(archiveSize).str, (double)totalFilesSize / (double)archiveSize);
+        if (md->duplicateCount)
+        {
+            fprintf(stdout, "|- %llu duplicates, %s deduplicated\n", (unsigned long long)md->duplicateCount,
+                    humanReadableSize(md->duplicateSize).str);
+        }
+        if (md->tombstoneCount)
+            fprintf(stdout, "|- %llu tombstones\n", (unsigned long long)md->tombstoneCount);
+        if (md->reusedCount)
+        {
+            fprintf(stdout, "|- %llu unchanged, %s copied from previous archive\n", (unsigned long long)md->reusedCount,
+                    humanReadableSize(md->reusedSize).str);
+        }
+        putc('\n', stdout);
     }
 
     return result == BUNYAR_LIB_RESULT_SUCCESS;
@@ -1294,9 +1582,14 @@ static void fileAssemblyCompressTask(void* data, uint64_t thid)
 
     struct CompressionContext* ctx = tsm->compressionContexts + thid;
 
+    const struct BunyArLibCreateMetadata* md = tsm->md;
+    const ZSTD_CDict* zstdDictionary = md->nodeDictionaries && md->nodeDictionaries[file->entryIndex] < md->dictionaryCount
+                                           ? md->dictionaries[md->nodeDictionaries[file->entryIndex]].cdict
+                                           : NULL;
+
     block->compressedSize = block->bufferSize;
-    if (!bunyArLibTaskCompress(ctx, file->entry->format, file->entry->compressionLevel, block->bufferUncompressed, block->rawSize,
-                               block->bufferCompressed, &block->compressedSize))
+    if (!bunyArLibTaskCompress(ctx, file->entry->format, file->entry->compressionLevel, zstdDictionary, block->bufferUncompressed,
+                               block->rawSize, block->bufferCompressed, &block->compressedSize))
     {
         tfrg_atomic32_store_relaxed(&block->compressStatusId_Atomic32, BLOCK_TASK_STATUS_ERROR);
         file->error = true;
@@ -1320,6 +1613,16 @@ static void fileAssemblyReadTask(void* data, uint64_t thid)
 
     if (!file->fileStream.pIO)
     {
+        // Content is written by the original node or copied from previous archive, tombstones have no content
+        const struct BunyArLibCreateMetadata* md = file->tsm->md;
+        if ((md->nodeOriginals && md->nodeOriginals[file->entryIndex] != file->entryIndex) ||
+            (md->nodeReused && md->nodeReused[file->entryIndex] != UINT64_MAX) || file->entry->format == BUNYAR_FILE_FORMAT_TOMBSTONE)
+        {
+            file->fsize = 0;
+            file->blockCount = 0;
+            goto COMPLETE;
+        }
+
         if (!fsOpenStreamFromPath(file->entry->inputRd, file->entry->inputPath, FM_READ | FM_ALLOW_READ, &file->fileStream))
         {
             char buffer[MAX_THREAD_NAME_LENGTH + 1];
@@ -1514,11 +1817,13 @@ static void bunyArLibCreateTaskManager(struct ThreadsSharedMemory* tsm, const st
                 if (lastExecutedEntry >= desc->entryCount)
                     continue;
 
-                const struct BunyArLibEntryCreateDesc* entry = desc->entries + lastExecutedEntry;
+                uint64_t                               entryIndex = bunyArLibLayoutNode(tsm->md, lastExecutedEntry);
+                const struct BunyArLibEntryCreateDesc* entry = desc->entries + entryIndex;
 
                 file->tsm = tsm;
                 file->entry = entry;
-                file->entryIndex = lastExecutedEntry;
+                file->entryIndex = entryIndex;
+                file->layoutIndex = lastExecutedEntry;
 
                 ++lastExecutedEntry;
 
@@ -1549,7 +1854,7 @@ static void bunyArLibCreateTaskManager(struct ThreadsSharedMemory* tsm, const st
                 continue;
             }
 
-            if (file->entryIndex != entryId)
+            if (file->layoutIndex != entryId)
                 continue;
 
             if (readStatus == BLOCK_TASK_STATUS_COMPLETED && file->fsize == 0)
@@ -1638,6 +1943,8 @@ static bool initThreadSharedMemory(struct ThreadsSharedMemory* tsm, ResourceDire
 {
     memset(tsm, 0, sizeof(*tsm));
 
+    tsm->md = md;
+
     // waiter + scheduler + thread pool
     uint64_t threadPoolSize = (uint64_t)desc->threadPoolSize;
 
@@ -1836,11 +2143,13 @@ static bool packetSingleThreadProducerFunc(void* pUser, struct FileAssemblyLine*
 
     if (!file->entry)
     {
-        const struct BunyArLibEntryCreateDesc* entry = desc->entries + ctx->entryId;
+        uint64_t                               entryIndex = bunyArLibLayoutNode(tsm->md, ctx->entryId);
+        const struct BunyArLibEntryCreateDesc* entry = desc->entries + entryIndex;
 
         file->tsm = tsm;
         file->entry = entry;
-        file->entryIndex = ctx->entryId;
+        file->entryIndex = entryIndex;
+        file->layoutIndex = ctx->entryId;
     }
 
     for (; !tsm->error;)
@@ -1888,165 +2197,1209 @@ static bool packetSingleThreadProducerFunc(void* pUser, struct FileAssemblyLine*
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Function bunyArLibCreate (glue part)                                    ///
+/// Function bunyArLibCreate (content hashes)                               ///
+/// Step before archive creation.                                            ///
+/// Hashing input files. Hashes are used to find duplicates and unchanged    ///
+/// files, and are stored in the archive for the next incremental build      ///
 ////////////////////////////////////////////////////////////////////////////////
 
-// from lz4.c
-static const int LZ4_ACCELERATION_MAX = 65537;
+#define BUNYAR_LIB_HASH_CHUNK_SIZE (1024 * 1024)
 
-void bunyArLibCompressionLevelLimits(enum BunyArFileFormat format, int* min, int* max)
+static bool bunyArLibHashFile(const struct BunyArLibEntryCreateDesc* entry, void* buffer, struct BunyArLibContent* outContent)
 {
-    switch (format)
-    {
-    case BUNYAR_FILE_FORMAT_LZ4_BLOCKS:
-        *min = -LZ4_ACCELERATION_MAX;
-        *max = LZ4HC_CLEVEL_MAX;
-        break;
-    case BUNYAR_FILE_FORMAT_ZSTD_BLOCKS:
-        *min = ZSTD_minCLevel();
-        *max = ZSTD_maxCLevel();
-        break;
-    case BUNYAR_FILE_FORMAT_RAW:
-    default:
-        *min = 0;
-        *max = 0;
-        break;
-    }
-}
+    FileStream fs = { 0 };
+    if (!fsOpenStreamFromPath(entry->inputRd, entry->inputPath, FM_READ | FM_ALLOW_READ, &fs))
+        return false;
 
-static bool bunyArLibCreateArchive(ResourceDirectory rd, const char* dstPath, const struct BunyArLibCreateDesc* desc,
-                                   struct BunyArLibCreateMetadata* md)
-{
-    bool singleThreaded = desc->threadPoolSize == 0;
+    XXH64_state_t state;
+    XXH64_reset(&state, 0);
 
-    struct ThreadsSharedMemory tsm;
-    if (!initThreadSharedMemory(&tsm, rd, dstPath, desc, md))
+    size_t read;
+    while ((read = fsReadFromStream(&fs, buffer, BUNYAR_LIB_HASH_CHUNK_SIZE)) > 0)
     {
-        LOGF(eERROR, "Failed to initialize thread infrastructure");
-        return false;
+        XXH64_update(&state, buffer, read);
+        outContent->size += read;
     }
 
-    if (singleThreaded)
-    {
-        struct bunyArLibCreateSingleThreadContext ctx = { 0 };
-
-        ctx.tsm = &tsm;
-        ctx.desc = desc;
+    fsCloseStream(&fs);
+    outContent->hash = XXH64_digest(&state);
+    outContent->hashed = true;
+    return true;
+}
 
-        struct bunyArLibPacketIo io = { packetSingleThreadProducerFunc, &ctx };
+struct BunyArLibHashCtx
+{
+    const struct BunyArLibCreateDesc* desc;
+    struct BunyArLibCreateMetadata*   md;
+    // Set by any task
+    tfrg_atomic32_t                   error_Atomic32;
+};
 
-        tsm.archiveError = !bunyArLibArchiveWrite(rd, dstPath, io, desc, md);
-    }
-    else
-    {
-        bunyArLibCreateTaskManager(&tsm, desc);
-        if (tsm.hashTableThread)
-        {
-            joinThread(tsm.hashTableThread);
-            memset(&tsm.hashTableThread, 0, sizeof tsm.hashTableThread);
-        }
+static void bunyArLibHashTask(void* user, uint64_t begin, uint64_t end, uint64_t threadId)
+{
+    (void)threadId;
 
-        if (tsm.error)
-            tsm.packetIo.kill = true;
-        tsm.packetIo.done = true;
+    struct BunyArLibHashCtx* ctx = (struct BunyArLibHashCtx*)user;
 
-        wakeOneConditionVariable(&tsm.packetIo.condition);
-        joinThread(tsm.writerThread);
+    void* buffer = tf_malloc(BUNYAR_LIB_HASH_CHUNK_SIZE);
+    if (!buffer)
+    {
+        tfrg_atomic32_store_relaxed(&ctx->error_Atomic32, 1);
+        return;
     }
 
-    bool success = !tsm.archiveError && !tsm.error;
+    // Missing files are reported when archived
+    for (uint64_t i = begin; i < end; ++i)
+    {
+        if (ctx->desc->entries[i].format != BUNYAR_FILE_FORMAT_TOMBSTONE)
+            bunyArLibHashFile(ctx->desc->entries + i, buffer, ctx->md->contents + i);
+    }
 
-    destroyThreadSharedMemory(&tsm);
-    return success;
+    tf_free(buffer);
 }
 
-bool bunyArLibCreate(ResourceDirectory rd, const char* dstPath, const struct BunyArLibCreateDesc* inDesc)
+// Files are hashed on a thread pool of BunyArLibCreateDesc::threadPoolSize threads
+static bool bunyArLibHashContents(const struct BunyArLibCreateDesc* desc, struct BunyArLibCreateMetadata* md)
 {
-    char** strings = NULL;
-
-    struct BunyArLibCreateDesc desc;
-    if (!bunyArLibCreatePreprocessDesc(inDesc, &desc, &strings))
-    {
-        LOGF(eERROR, "Failed to preprocess file entries to create archive '%s'", dstPath);
-        bunyArLibCreatePostprocessDesc(&desc, &strings);
+    md->contents = (struct BunyArLibContent*)tf_calloc(md->nodeCount, sizeof *md->contents);
+    if (!md->contents)
         return false;
-    }
 
-    struct BunyArLibCreateMetadata md;
-    bool                           success = bunyArLibCreateMetadata(&desc, &md);
+    struct BunyArLibHashCtx ctx = { desc, md, 0 };
 
-    if (!success)
+    struct ThreadSystemInitDesc tsInfo = { 0 };
+    tsInfo.threadCount = desc->threadPoolSize < 0 ? getNumCPUCores() : (uint64_t)desc->threadPoolSize;
+
+    ThreadSystem threadSystem = NULL;
+    if (!threadSystemInit(&threadSystem, &tsInfo))
     {
-        LOGF(eERROR, "Failed to initialize metadata for archive '%s'", dstPath);
+        LOGF(eERROR, "Failed to start thread pool");
+        return false;
     }
 
-    if (success)
-        success = bunyArLibCreateArchive(rd, dstPath, &desc, &md);
+    threadSystemParallelFor(threadSystem, 0, md->nodeCount, 0, bunyArLibHashTask, &ctx);
+    threadSystemExit(&threadSystem, &gThreadSystemExitDescDefault);
 
-    bunyArLibCreateMetadataDestroy(&md);
-    bunyArLibCreatePostprocessDesc(&desc, &strings);
-    return success;
+    return !tfrg_atomic32_load_relaxed(&ctx.error_Atomic32);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Function bunyArLibExtract                                               ///
+/// Function bunyArLibCreate (deduplication)                                ///
+/// Optional step before archive creation.                                   ///
+/// Finding files with identical content, which are stored once              ///
 ////////////////////////////////////////////////////////////////////////////////
 
-bool bunyArLibExtract(struct IFileSystem* archive, ResourceDirectory rd, const char* dstDir, const struct BunyArLibExtractDesc* desc)
+#define BUNYAR_LIB_DEDUPLICATION_CHUNK_SIZE (1024 * 1024)
+
+struct BunyArLibContentKey
 {
-    struct BunyArDescription archiveInfo;
-    fsArchiveGetDescription(archive, &archiveInfo);
+    uint64_t size;
+    uint64_t hash;
+    uint64_t entry;
+};
 
-    FileStream fsOut = { 0 };
-    FileStream fsIn = { 0 };
+// Equal content is adjacent, first entry of equal content is the original
+static int bunyArLibContentKeyCmp(const void* v0, const void* v1)
+{
+    const struct BunyArLibContentKey* k0 = (const struct BunyArLibContentKey*)v0;
+    const struct BunyArLibContentKey* k1 = (const struct BunyArLibContentKey*)v1;
+    if (k0->size != k1->size)
+        return k0->size < k1->size ? -1 : 1;
+    if (k0->hash != k1->hash)
+        return k0->hash < k1->hash ? -1 : 1;
+    if (k0->entry != k1->entry)
+        return k0->entry < k1->entry ? -1 : 1;
+    return 0;
+}
 
-    bool loopFileNames = desc->fileNameCount > 0;
+// Rules out hash collisions. 'buffer' holds two chunks
+static bool bunyArLibFilesEqual(const struct BunyArLibEntryCreateDesc* e0, const struct BunyArLibEntryCreateDesc* e1, uint8_t* buffer)
+{
+    FileStream fs0 = { 0 };
+    FileStream fs1 = { 0 };
 
-    uint64_t loopLimit = loopFileNames ? desc->fileNameCount : archiveInfo.nodeCount;
+    bool equal = fsOpenStreamFromPath(e0->inputRd, e0->inputPath, FM_READ | FM_ALLOW_READ, &fs0) &&
+                 fsOpenStreamFromPath(e1->inputRd, e1->inputPath, FM_READ | FM_ALLOW_READ, &fs1);
 
-    int counterWidth = 0;
-    int printedLength = 0;
-    if (desc->verbose)
+    while (equal)
     {
-        char buffer[32];
-        counterWidth = snprintf(buffer, sizeof buffer, "%llu", (unsigned long long)loopLimit);
+        size_t read0 = fsReadFromStream(&fs0, buffer, BUNYAR_LIB_DEDUPLICATION_CHUNK_SIZE);
+        size_t read1 = fsReadFromStream(&fs1, buffer + BUNYAR_LIB_DEDUPLICATION_CHUNK_SIZE, BUNYAR_LIB_DEDUPLICATION_CHUNK_SIZE);
+
+        equal = read0 == read1 && memcmp(buffer, buffer + BUNYAR_LIB_DEDUPLICATION_CHUNK_SIZE, read0) == 0;
+        if (read0 == 0)
+            break;
     }
 
-    uint64_t failureCount = 0;
+    fsCloseStream(&fs0);
+    fsCloseStream(&fs1);
+    return equal;
+}
 
-    for (uint64_t i = 0; i < loopLimit; ++i)
+static bool bunyArLibFindDuplicates(const struct BunyArLibCreateDesc* desc, struct BunyArLibCreateMetadata* md)
+{
+    md->nodeOriginals = (uint64_t*)tf_malloc(sizeof *md->nodeOriginals * md->nodeCount);
+    struct BunyArLibContentKey* keys = (struct BunyArLibContentKey*)tf_malloc(sizeof *keys * md->nodeCount);
+    uint8_t*                    buffer = (uint8_t*)tf_malloc(BUNYAR_LIB_DEDUPLICATION_CHUNK_SIZE * 2);
+    if (!md->nodeOriginals || !keys || !buffer)
     {
-        const char* error = NULL;
-
-        uint64_t uid = i;
-
-        uint64_t totalSize = 0;
-        char     buffer[64 * 1024];
-        ASSERT(sizeof buffer >= FS_MAX_PATH);
+        tf_free(keys);
+        tf_free(buffer);
+        return false;
+    }
 
-        struct BunyArNodeDescription node;
+    uint64_t keyCount = 0;
+    for (uint64_t i = 0; i < md->nodeCount; ++i)
+    {
+        md->nodeOriginals[i] = i;
 
-        if (loopFileNames && !fsArchiveGetNodeId(archive, desc->fileNames[i], &uid))
+        const struct BunyArLibContent* content = md->contents + i;
+        if (content->hashed && content->size > 0)
         {
-            node.name = desc->fileNames[i];
-            error = "no such file";
-            goto FILE_DONE;
+            struct BunyArLibContentKey key = { content->size, content->hash, i };
+            keys[keyCount++] = key;
         }
+    }
 
-        fsArchiveGetNodeDescription(archive, uid, &node);
+    qsort(keys, keyCount, sizeof *keys, bunyArLibContentKeyCmp);
 
-        if (desc->verbose)
+    for (uint64_t k = 1; k < keyCount; ++k)
+    {
+        // Compare to originals with the same size and hash
+        for (uint64_t o = k; o-- > 0 && keys[o].size == keys[k].size && keys[o].hash == keys[k].hash;)
         {
-            printedLength =
-                fprintf(stdout, "%*llu/%*llu ", counterWidth, (unsigned long long)i + 1, counterWidth, (unsigned long long)loopLimit);
+            uint64_t original = keys[o].entry;
+            if (md->nodeOriginals[original] != original)
+                continue;
 
-            fprintf(stdout, "'%s'\n", node.name);
+            if (bunyArLibFilesEqual(desc->entries + original, desc->entries + keys[k].entry, buffer))
+            {
+                md->nodeOriginals[keys[k].entry] = original;
+                ++md->duplicateCount;
+                md->duplicateSize += keys[k].size;
+                break;
+            }
         }
+    }
 
-        if (strncmp(node.name, "../", 3) == 0)
-        {
-            LOGF(eERROR, "Archive file '%s' contains backlinks, so it is skipped.", node.name);
-            continue;
+    tf_free(keys);
+    tf_free(buffer);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function bunyArLibCreate (incremental)                                  ///
+/// Optional step before archive creation.                                   ///
+/// Finding unchanged files in the previous build of the archive,            ///
+/// their compressed data is copied instead of compressing them again        ///
+////////////////////////////////////////////////////////////////////////////////
+
+struct BunyArLibNodeSearchCtx
+{
+    const char* name;
+    const char* names;
+};
+
+static int bunyArLibNodeSearchCmp(const void* v0, const void* v1)
+{
+    const struct BunyArLibNodeSearchCtx* ctx = (const struct BunyArLibNodeSearchCtx*)v0;
+    const struct BunyArNode*             node = (const struct BunyArNode*)v1;
+    return strcmp(ctx->name, ctx->names + node->namePointer.offset);
+}
+
+// Reads nodes of the previous archive, before formats are picked so unchanged files can keep theirs.
+// Missing or unusable previous archive is not an error, false is returned only on memory failure
+static bool bunyArLibLoadPreviousArchive(ResourceDirectory rd, const struct BunyArLibCreateDesc* desc, struct BunyArLibCreateMetadata* md)
+{
+    const char* path = desc->previousArchivePath;
+
+    if (!fsFileExist(rd, path))
+    {
+        if (desc->verbose)
+            fprintf(stdout, "Previous archive '%s' is missing, all files are compressed\n", path);
+        return true;
+    }
+
+    FileStream* fs = &md->previousArchive;
+    if (!fsOpenStreamFromPath(rd, path, FM_READ, fs))
+        return true;
+
+    struct BunyArHeader header = { 0 };
+    bool headerReaded = fsReadFromStream(fs, &header, sizeof header) == sizeof header &&
+                        memcmp(header.magic, BUNYAR_MAGIC, sizeof header.magic) == 0 && header.version.compatible <= BUNYAR_VERSION;
+
+    uint64_t nodeCount = header.nodesPointer.size / sizeof(struct BunyArNode);
+
+    if (!headerReaded || header.version.actual < 3 || header.nodeSourcesPointer.size != nodeCount * sizeof(struct BunyArNodeSource))
+    {
+        LOGF(eWARNING, "Previous archive '%s' has no node sources, all files are compressed", path);
+        fsCloseStream(fs);
+        return true;
+    }
+
+    uint8_t* memory = (uint8_t*)tf_malloc(header.nodesPointer.size + header.nodeSourcesPointer.size + header.namesPointer.size + 1);
+    if (!memory)
+        return false;
+
+    struct BunyArNode*       nodes = (struct BunyArNode*)memory;
+    struct BunyArNodeSource* sources = (struct BunyArNodeSource*)(memory + header.nodesPointer.size);
+    char*                    names = (char*)sources + header.nodeSourcesPointer.size;
+
+    bool valid = bunyArLibReadPrevious(fs, header.nodesPointer.offset, header.nodesPointer.size, nodes) &&
+                 bunyArLibReadPrevious(fs, header.nodeSourcesPointer.offset, header.nodeSourcesPointer.size, sources) &&
+                 bunyArLibReadPrevious(fs, header.namesPointer.offset, header.namesPointer.size, names);
+
+    names[header.namesPointer.size] = 0;
+    for (uint64_t i = 0; valid && i < nodeCount; ++i)
+        valid = (uint64_t)nodes[i].namePointer.offset + nodes[i].namePointer.size < header.namesPointer.size + 1;
+
+    if (!valid)
+    {
+        LOGF(eWARNING, "Previous archive '%s' is corrupted, all files are compressed", path);
+        tf_free(memory);
+        fsCloseStream(fs);
+        return true;
+    }
+
+    md->previousNodes = nodes;
+    md->previousSources = sources;
+    md->previousNames = names;
+    md->previousNodeCount = nodeCount;
+    return true;
+}
+
+// Returns index of node of previous archive with same name and content as node 'ni', UINT64_MAX if none
+static uint64_t bunyArLibFindPreviousNode(const struct BunyArLibCreateDesc* desc, const struct BunyArLibCreateMetadata* md, uint64_t ni)
+{
+    const struct BunyArLibContent* content = md->contents + ni;
+    if (!md->previousNodes || !content->hashed)
+        return UINT64_MAX;
+
+    // Nodes of both archives are sorted by name
+    struct BunyArLibNodeSearchCtx ctx = { desc->entries[ni].outputName, md->previousNames };
+    const struct BunyArNode*      previous =
+        (const struct BunyArNode*)bsearch(&ctx, md->previousNodes, md->previousNodeCount, sizeof *md->previousNodes, bunyArLibNodeSearchCmp);
+    if (!previous || previous->originalFileSize != content->size || md->previousSources[previous - md->previousNodes].contentHash != content->hash)
+        return UINT64_MAX;
+
+    return (uint64_t)(previous - md->previousNodes);
+}
+
+// Called once formats and dictionaries are final, false is returned only on memory failure
+static bool bunyArLibFindReusableNodes(const struct BunyArLibCreateDesc* desc, struct BunyArLibCreateMetadata* md)
+{
+    if (!md->previousNodes)
+        return true;
+
+    md->nodeReused = (uint64_t*)tf_malloc(sizeof *md->nodeReused * md->nodeCount);
+    md->copyBuffer = tf_malloc(BUNYAR_LIB_COPY_CHUNK_SIZE);
+    if (!md->nodeReused || !md->copyBuffer)
+        return false;
+
+    for (uint64_t i = 0; i < md->nodeCount; ++i)
+    {
+        const struct BunyArLibEntryCreateDesc* entry = desc->entries + i;
+        const struct BunyArLibContent*         content = md->contents + i;
+
+        md->nodeReused[i] = UINT64_MAX;
+
+        // Duplicates share data of the original
+        uint64_t pi = md->nodeOriginals && md->nodeOriginals[i] != i ? UINT64_MAX : bunyArLibFindPreviousNode(desc, md, i);
+        if (pi == UINT64_MAX)
+            continue;
+
+        // Stored format can differ from the requested one, e.g. empty files are always RAW
+        const struct BunyArNode*       previous = md->previousNodes + pi;
+        const struct BunyArNodeSource* source = md->previousSources + pi;
+        if (source->requestedFormat != (uint64_t)entry->format)
+            continue;
+
+        // Same dictionary ID doesn't mean same dictionary, data is only reused if it decompresses with the new one
+        const struct BunyArLibDictionary* dictionary = bunyArLibNodeDictionary(md, i);
+        if (source->compressionLevel != entry->compressionLevel || source->dictionaryId != (dictionary ? dictionary->id : 0) ||
+            source->dictionaryHash != (dictionary ? dictionary->hash : 0))
+            continue;
+
+        if (previous->format != BUNYAR_FILE_FORMAT_RAW)
+        {
+            struct BunyArBlockFormatHeader blocksHeader;
+            if (previous->filePointer.size < sizeof blocksHeader ||
+                !bunyArLibReadPrevious(&md->previousArchive, previous->filePointer.offset, sizeof blocksHeader, &blocksHeader) ||
+                blocksHeader.blockSize != convertBlockSize(entry->format, entry->blockSizeKb))
+                continue;
+        }
+
+        md->nodeReused[i] = pi;
+        ++md->reusedCount;
+        md->reusedSize += content->size;
+    }
+
+    if (desc->verbose)
+    {
+        fprintf(stdout, "%llu/%llu files are unchanged since previous archive '%s'\n", (unsigned long long)md->reusedCount,
+                (unsigned long long)md->nodeCount, desc->previousArchivePath);
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function bunyArLibCreate (dictionaries)                                 ///
+/// Optional step before archive creation.                                   ///
+/// Training zstd dictionaries from sampled small files                      ///
+////////////////////////////////////////////////////////////////////////////////
+
+// Larger files compress well enough without a dictionary, they are not sampled
+#define BUNYAR_LIB_DICTIONARY_SAMPLE_MAX_SIZE (128 * 1024)
+// Training on fewer samples is unlikely to produce a useful dictionary
+#define BUNYAR_LIB_DICTIONARY_MIN_SAMPLES     16
+// Total size of samples, relative to dictionary size
+#define BUNYAR_LIB_DICTIONARY_SAMPLES_RATIO   100
+
+// ZSTD entries sharing file extension and compression level
+struct BunyArLibDictionaryGroup
+{
+    const char* extension;
+    int         compressionLevel;
+    uint64_t*   entries; // stb array
+};
+
+struct BunyArLibDictionarySample
+{
+    uint64_t entry;
+    size_t   size;
+};
+
+static const char* bunyArLibEntryExtension(const char* name)
+{
+    const char* extension = "";
+    for (const char* c = name; *c; ++c)
+    {
+        if (*c == '/')
+            extension = "";
+        else if (*c == '.')
+            extension = c;
+    }
+    return extension;
+}
+
+static bool bunyArLibReadSample(const struct BunyArLibEntryCreateDesc* entry, size_t size, void* dst)
+{
+    FileStream fs = { 0 };
+    if (!fsOpenStreamFromPath(entry->inputRd, entry->inputPath, FM_READ | FM_ALLOW_READ, &fs))
+        return false;
+    bool success = fsReadFromStream(&fs, dst, size) == size;
+    fsCloseStream(&fs);
+    return success;
+}
+
+// Dictionary is not added if training fails, false is returned only on memory failure
+static bool bunyArLibTrainDictionary(const struct BunyArLibCreateDesc* desc, struct BunyArLibCreateMetadata* md,
+                                     const struct BunyArLibDictionaryGroup* group)
+{
+    size_t capacity = (size_t)desc->zstdDictionarySizeKb * 1024;
+    size_t samplesLimit = capacity * BUNYAR_LIB_DICTIONARY_SAMPLES_RATIO;
+
+    struct BunyArLibDictionarySample* candidates = NULL;
+    size_t                            candidatesSize = 0;
+
+    for (uint64_t i = 0; i < (uint64_t)arrlenu(group->entries); ++i)
+    {
+        const struct BunyArLibEntryCreateDesc* entry = desc->entries + group->entries[i];
+
+        // Missing files are reported when archived
+        FileStream fs = { 0 };
+        if (!fsOpenStreamFromPath(entry->inputRd, entry->inputPath, FM_READ | FM_ALLOW_READ, &fs))
+            continue;
+        ssize_t size = fsGetStreamFileSize(&fs);
+        fsCloseStream(&fs);
+
+        if (size <= 0 || size > BUNYAR_LIB_DICTIONARY_SAMPLE_MAX_SIZE)
+            continue;
+
+        struct BunyArLibDictionarySample candidate = { group->entries[i], (size_t)size };
+        arrpush(candidates, candidate);
+        candidatesSize += (size_t)size;
+    }
+
+    // Evenly spread samples over the group when there are too many
+    size_t stride = candidatesSize / samplesLimit + 1;
+
+    size_t* sampleSizes = NULL;
+    size_t  samplesSize = 0;
+    for (size_t i = 0; i < arrlenu(candidates); i += stride)
+    {
+        arrpush(sampleSizes, candidates[i].size);
+        samplesSize += candidates[i].size;
+    }
+
+    size_t sampleCount = arrlenu(sampleSizes);
+
+    bool  success = true;
+    void* samples = NULL;
+    void* content = NULL;
+
+    if (sampleCount < BUNYAR_LIB_DICTIONARY_MIN_SAMPLES)
+        goto RETURN;
+
+    samples = tf_malloc(samplesSize);
+    content = tf_malloc(capacity);
+    if (!samples || !content)
+    {
+        success = false;
+        goto RETURN;
+    }
+
+    uint8_t* sample = (uint8_t*)samples;
+    for (size_t i = 0; i < sampleCount; ++i)
+    {
+        const struct BunyArLibEntryCreateDesc* entry = desc->entries + candidates[i * stride].entry;
+        if (!bunyArLibReadSample(entry, sampleSizes[i], sample))
+        {
+            LOGF(eWARNING, "Failed to read dictionary sample '%s'", entry->inputPath);
+            goto RETURN;
+        }
+        sample += sampleSizes[i];
+    }
+
+    size_t size = ZDICT_trainFromBuffer(content, capacity, samples, sampleSizes, (unsigned)sampleCount);
+    if (ZDICT_isError(size))
+    {
+        LOGF(eWARNING, "Failed to train zstd dictionary for '*%s' files: %s", group->extension, ZDICT_getErrorName(size));
+        goto RETURN;
+    }
+
+    // Dictionaries are found by ID when decompressed
+    unsigned id = ZDICT_getDictID(content, size);
+    for (uint32_t i = 0; i < md->dictionaryCount; ++i)
+    {
+        if (md->dictionaries[i].id == id)
+        {
+            LOGF(eWARNING, "Dropped zstd dictionary for '*%s' files: ID %u is already used", group->extension, id);
+            goto RETURN;
+        }
+    }
+
+    ZSTD_compressionParameters cParams = ZSTD_getCParams(group->compressionLevel, 0, size);
+    ZSTD_CDict* cdict = ZSTD_createCDict_advanced(content, size, ZSTD_dlm_byRef, ZSTD_dct_fullDict, cParams, ZSTD_MEMORY_ALLOCATOR);
+    if (!cdict)
+    {
+        success = false;
+        goto RETURN;
+    }
+
+    struct BunyArLibDictionary* dictionaries =
+        (struct BunyArLibDictionary*)tf_realloc(md->dictionaries, sizeof *dictionaries * (md->dictionaryCount + 1));
+    if (!dictionaries)
+    {
+        ZSTD_freeCDict(cdict);
+        success = false;
+        goto RETURN;
+    }
+
+    md->dictionaries = dictionaries;
+    md->dictionaries[md->dictionaryCount].content = content;
+    md->dictionaries[md->dictionaryCount].size = size;
+    md->dictionaries[md->dictionaryCount].cdict = cdict;
+    md->dictionaries[md->dictionaryCount].id = id;
+    md->dictionaries[md->dictionaryCount].hash = XXH64(content, size, 0);
+    content = NULL;
+
+    for (uint64_t i = 0; i < (uint64_t)arrlenu(group->entries); ++i)
+        md->nodeDictionaries[group->entries[i]] = md->dictionaryCount;
+
+    ++md->dictionaryCount;
+
+    if (desc->verbose)
+    {
+        fprintf(stdout, "Dictionary for '*%s' files: %s from %llu samples\n", group->extension, humanReadableSize(size).str,
+                (unsigned long long)sampleCount);
+    }
+
+RETURN:
+    tf_free(content);
+    tf_free(samples);
+    arrfree(sampleSizes);
+    arrfree(candidates);
+    return success;
+}
+
+static bool bunyArLibCreateDictionaries(const struct BunyArLibCreateDesc* desc, struct BunyArLibCreateMetadata* md)
+{
+    md->nodeDictionaries = (uint32_t*)tf_malloc(sizeof *md->nodeDictionaries * md->nodeCount);
+    if (!md->nodeDictionaries)
+        return false;
+    memset(md->nodeDictionaries, 0xFF, sizeof *md->nodeDictionaries * md->nodeCount);
+
+    struct BunyArLibDictionaryGroup* groups = NULL;
+
+    for (uint64_t ei = 0; ei < desc->entryCount; ++ei)
+    {
+        const struct BunyArLibEntryCreateDesc* entry = desc->entries + ei;
+        if (entry->format != BUNYAR_FILE_FORMAT_ZSTD_BLOCKS)
+            continue;
+
+        // Duplicates are not compressed
+        if (md->nodeOriginals && md->nodeOriginals[ei] != ei)
+            continue;
+
+        const char* extension = bunyArLibEntryExtension(entry->outputName);
+
+        struct BunyArLibDictionaryGroup* group = NULL;
+        for (size_t gi = 0; gi < arrlenu(groups); ++gi)
+        {
+            if (groups[gi].compressionLevel == entry->compressionLevel && strcmp(groups[gi].extension, extension) == 0)
+            {
+                group = groups + gi;
+                break;
+            }
+        }
+
+        if (!group)
+        {
+            struct BunyArLibDictionaryGroup newGroup = { extension, entry->compressionLevel, NULL };
+            arrpush(groups, newGroup);
+            group = groups + arrlenu(groups) - 1;
+        }
+
+        arrpush(group->entries, ei);
+    }
+
+    bool success = true;
+    for (size_t gi = 0; gi < arrlenu(groups); ++gi)
+    {
+        if (success)
+            success = bunyArLibTrainDictionary(desc, md, groups + gi);
+        arrfree(groups[gi].entries);
+    }
+    arrfree(groups);
+
+    return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function bunyArLibCreate (adaptive formats)                             ///
+/// Optional step before archive creation.                                   ///
+/// Picking format and compression level of each file by estimated load     ///
+/// time, candidates are measured on the first block of the file             ///
+////////////////////////////////////////////////////////////////////////////////
+
+// Decompression of a sample is repeated until it takes this long, single runs of small samples are below timer precision
+#define BUNYAR_LIB_ADAPTIVE_MIN_DECOMPRESSION_USEC 50
+
+struct BunyArLibAdaptiveCtx
+{
+    const struct BunyArLibCreateDesc*      desc;
+    const struct BunyArLibCreateMetadata*  md;
+    const struct BunyArLibFormatCandidate* candidates;
+    uint32_t                               candidateCount;
+    uint64_t                               maxSampleSize;
+    // Files keeping format of previous archive
+    tfrg_atomic64_t                        keptCount_Atomic64;
+    // Set by any task
+    tfrg_atomic32_t                        error_Atomic32;
+};
+
+// Returns average decompression time in microseconds, 0 if data is corrupted
+static double bunyArLibMeasureDecompression(ZSTD_DCtx* zstdCtx, enum BunyArFileFormat format, const void* src, size_t srcSize, void* dst,
+                                            size_t dstSize)
+{
+    uint64_t repeatCount = 0;
+    int64_t  start = getUSec(true);
+    int64_t  elapsed = 0;
+    do
+    {
+        size_t size = format == BUNYAR_FILE_FORMAT_LZ4_BLOCKS
+                          ? (size_t)LZ4_decompress_safe((const char*)src, (char*)dst, (int)srcSize, (int)dstSize)
+                          : ZSTD_decompressDCtx(zstdCtx, dst, dstSize, src, srcSize);
+        if (size != dstSize)
+            return 0;
+
+        ++repeatCount;
+        elapsed = getUSec(true) - start;
+    } while (elapsed < BUNYAR_LIB_ADAPTIVE_MIN_DECOMPRESSION_USEC);
+
+    return (double)elapsed / (double)repeatCount;
+}
+
+// Raw or one of the candidates
+static bool bunyArLibIsFormatCandidate(const struct BunyArLibAdaptiveCtx* ctx, enum BunyArFileFormat format, int32_t compressionLevel)
+{
+    if (format == BUNYAR_FILE_FORMAT_RAW)
+        return true;
+    for (uint32_t ci = 0; ci < ctx->candidateCount; ++ci)
+    {
+        if (ctx->candidates[ci].format == format && ctx->candidates[ci].compressionLevel == compressionLevel)
+            return true;
+    }
+    return false;
+}
+
+static void bunyArLibAdaptiveTask(void* user, uint64_t begin, uint64_t end, uint64_t threadId)
+{
+    (void)threadId;
+
+    struct BunyArLibAdaptiveCtx*          ctx = (struct BunyArLibAdaptiveCtx*)user;
+    const struct BunyArLibCreateMetadata* md = ctx->md;
+
+    size_t lz4Bound = (size_t)LZ4_compressBound((int)ctx->maxSampleSize);
+    size_t zstdBound = ZSTD_compressBound(ctx->maxSampleSize);
+    size_t compressedLimit = lz4Bound > zstdBound ? lz4Bound : zstdBound;
+
+    struct CompressionContext compressionCtx;
+    bool                      initialized = compressionContextInit(&compressionCtx, true, true);
+    ZSTD_DCtx*                zstdCtx = ZSTD_createDCtx_advanced(ZSTD_MEMORY_ALLOCATOR);
+    uint8_t*                  sample = (uint8_t*)tf_malloc(ctx->maxSampleSize * 2 + compressedLimit);
+    if (!initialized || !zstdCtx || !sample)
+    {
+        tfrg_atomic32_store_relaxed(&ctx->error_Atomic32, 1);
+        goto FREE;
+    }
+
+    uint8_t* decompressed = sample + ctx->maxSampleSize;
+    uint8_t* compressed = decompressed + ctx->maxSampleSize;
+
+    // Bytes per microsecond
+    double readSpeed = (double)ctx->desc->adaptiveFormat.readSpeedMBps;
+
+    for (uint64_t ei = begin; ei < end && !tfrg_atomic32_load_relaxed(&ctx->error_Atomic32); ++ei)
+    {
+        struct BunyArLibEntryCreateDesc* entry = ctx->desc->entries + ei;
+        const struct BunyArLibContent*   content = md->contents + ei;
+
+        // Duplicates are not compressed, unreadable files are reported when archived
+        if (entry->format == BUNYAR_FILE_FORMAT_TOMBSTONE || (md->nodeOriginals && md->nodeOriginals[ei] != ei) || !content->hashed)
+            continue;
+
+        entry->format = BUNYAR_FILE_FORMAT_RAW;
+        entry->compressionLevel = 0;
+
+        // Unchanged files keep format picked for their previous build, so their compressed data is reused
+        uint64_t previous = bunyArLibFindPreviousNode(ctx->desc, md, ei);
+        if (previous != UINT64_MAX && bunyArLibIsFormatCandidate(ctx, (enum BunyArFileFormat)md->previousSources[previous].requestedFormat,
+                                                                 md->previousSources[previous].compressionLevel))
+        {
+            entry->format = (enum BunyArFileFormat)md->previousSources[previous].requestedFormat;
+            entry->compressionLevel = entry->format == BUNYAR_FILE_FORMAT_RAW ? 0 : md->previousSources[previous].compressionLevel;
+            tfrg_atomic64_add_relaxed(&ctx->keptCount_Atomic64, 1);
+            continue;
+        }
+
+        uint64_t blockSize = convertBlockSize(BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, entry->blockSizeKb);
+        size_t   sampleSize = (size_t)(content->size < blockSize ? content->size : blockSize);
+
+        if (sampleSize == 0 || !bunyArLibReadSample(entry, sampleSize, sample))
+            continue;
+
+        double sampleScale = (double)content->size / (double)sampleSize;
+        double bestTime = (double)content->size / readSpeed;
+
+        for (uint32_t ci = 0; ci < ctx->candidateCount; ++ci)
+        {
+            const struct BunyArLibFormatCandidate* candidate = ctx->candidates + ci;
+
+            uint64_t compressedSize = compressedLimit;
+            if (!bunyArLibTaskCompress(&compressionCtx, candidate->format, candidate->compressionLevel, NULL, sample, sampleSize, compressed,
+                                       &compressedSize))
+            {
+                tfrg_atomic32_store_relaxed(&ctx->error_Atomic32, 1);
+                break;
+            }
+
+            if (compressedSize >= sampleSize)
+                continue;
+
+            double decompressionTime =
+                bunyArLibMeasureDecompression(zstdCtx, candidate->format, compressed, (size_t)compressedSize, decompressed, sampleSize);
+            if (decompressionTime <= 0)
+            {
+                LOGF(eWARNING, "Candidate %s %i failed to decompress sample of '%s'", bunyArFormatName(candidate->format),
+                     candidate->compressionLevel, entry->outputName);
+                continue;
+            }
+
+            double time = ((double)compressedSize / readSpeed + decompressionTime) * sampleScale;
+            if (time < bestTime)
+            {
+                bestTime = time;
+                entry->format = candidate->format;
+                entry->compressionLevel = candidate->compressionLevel;
+            }
+        }
+    }
+
+FREE:
+    tf_free(sample);
+    ZSTD_freeDCtx(zstdCtx);
+    compressionContextDestroy(&compressionCtx);
+}
+
+static bool bunyArLibPickFormats(const struct BunyArLibCreateDesc* desc, struct BunyArLibCreateMetadata* md)
+{
+    const struct BunyArLibAdaptiveFormatDesc* policy = &desc->adaptiveFormat;
+
+    // ZSTD decompresses at about the same speed at every level, higher levels trade build time for smaller files
+    static const struct BunyArLibFormatCandidate defaultCandidates[] = {
+        { BUNYAR_FILE_FORMAT_LZ4_BLOCKS, BUNYAR_LIB_COMPRESSION_LEVEL_DEFAULT },
+        { BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, 3 },
+        { BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, 9 },
+        { BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, 19 },
+    };
+
+    const struct BunyArLibFormatCandidate* inCandidates = policy->candidateCount ? policy->candidates : defaultCandidates;
+    uint32_t inCandidateCount = policy->candidateCount ? policy->candidateCount : sizeof defaultCandidates / sizeof *defaultCandidates;
+
+    // Last statistics slot counts raw files
+    struct BunyArLibFormatCandidate* candidates = (struct BunyArLibFormatCandidate*)tf_malloc(sizeof *candidates * inCandidateCount);
+    uint64_t*                        fileCounts = (uint64_t*)tf_calloc(inCandidateCount + 1, sizeof *fileCounts);
+    uint64_t*                        fileSizes = (uint64_t*)tf_calloc(inCandidateCount + 1, sizeof *fileSizes);
+    if (!candidates || !fileCounts || !fileSizes)
+    {
+        tf_free(candidates);
+        tf_free(fileCounts);
+        tf_free(fileSizes);
+        return false;
+    }
+
+    uint32_t candidateCount = 0;
+    for (uint32_t ci = 0; ci < inCandidateCount; ++ci)
+    {
+        struct BunyArLibFormatCandidate candidate = inCandidates[ci];
+        if (candidate.format != BUNYAR_FILE_FORMAT_LZ4_BLOCKS && candidate.format != BUNYAR_FILE_FORMAT_ZSTD_BLOCKS)
+        {
+            LOGF(eWARNING, "Adaptive format candidate '%s' is skipped, raw storage is always tried", bunyArFormatName(candidate.format));
+            continue;
+        }
+
+        validateCompressionLevel(candidate.format, &candidate.compressionLevel);
+        candidates[candidateCount++] = candidate;
+    }
+
+    struct BunyArLibAdaptiveCtx ctx = { desc, md, candidates, candidateCount, 0, 0, 0 };
+    for (uint64_t ei = 0; ei < desc->entryCount; ++ei)
+    {
+        uint64_t blockSize = convertBlockSize(BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, desc->entries[ei].blockSizeKb);
+        if (blockSize > ctx.maxSampleSize)
+            ctx.maxSampleSize = blockSize;
+    }
+
+    struct ThreadSystemInitDesc tsInfo = { 0 };
+    tsInfo.threadCount = desc->threadPoolSize < 0 ? getNumCPUCores() : (uint64_t)desc->threadPoolSize;
+
+    ThreadSystem threadSystem = NULL;
+    if (!threadSystemInit(&threadSystem, &tsInfo))
+    {
+        LOGF(eERROR, "Failed to start thread pool");
+        tfrg_atomic32_store_relaxed(&ctx.error_Atomic32, 1);
+    }
+    else
+    {
+        threadSystemParallelFor(threadSystem, 0, desc->entryCount, 0, bunyArLibAdaptiveTask, &ctx);
+        threadSystemExit(&threadSystem, &gThreadSystemExitDescDefault);
+    }
+
+    bool error = tfrg_atomic32_load_relaxed(&ctx.error_Atomic32) != 0;
+
+    md->lz4Used = false;
+    md->zstdUsed = false;
+    md->maxBlockSize = 0;
+
+    for (uint64_t ei = 0; !error && ei < desc->entryCount; ++ei)
+    {
+        struct BunyArLibEntryCreateDesc* entry = desc->entries + ei;
+
+        bool duplicate = md->nodeOriginals && md->nodeOriginals[ei] != ei;
+        if (duplicate)
+        {
+            entry->format = desc->entries[md->nodeOriginals[ei]].format;
+            entry->compressionLevel = desc->entries[md->nodeOriginals[ei]].compressionLevel;
+        }
+
+        md->nodes[ei].format = entry->format;
+
+        uint64_t blockSize = convertBlockSize(entry->format, entry->blockSizeKb);
+        if (blockSize > md->maxBlockSize)
+            md->maxBlockSize = blockSize;
+
+        md->lz4Used |= entry->format == BUNYAR_FILE_FORMAT_LZ4_BLOCKS;
+        md->zstdUsed |= entry->format == BUNYAR_FILE_FORMAT_ZSTD_BLOCKS;
+
+        if (duplicate || entry->format == BUNYAR_FILE_FORMAT_TOMBSTONE)
+            continue;
+
+        uint32_t slot = candidateCount;
+        for (uint32_t ci = 0; ci < candidateCount && entry->format != BUNYAR_FILE_FORMAT_RAW; ++ci)
+        {
+            if (candidates[ci].format == entry->format && candidates[ci].compressionLevel == entry->compressionLevel)
+                slot = ci;
+        }
+
+        ++fileCounts[slot];
+        fileSizes[slot] += md->contents[ei].size;
+    }
+
+    if (!error && desc->verbose)
+    {
+        fprintf(stdout, "Formats picked for %u MB/s read speed:\n", policy->readSpeedMBps);
+        for (uint32_t ci = 0; ci < candidateCount; ++ci)
+        {
+            fprintf(stdout, "|- %s %i: %llu files, %s\n", bunyArFormatName(candidates[ci].format), candidates[ci].compressionLevel,
+                    (unsigned long long)fileCounts[ci], humanReadableSize(fileSizes[ci]).str);
+        }
+        fprintf(stdout, "|- %s: %llu files, %s\n", bunyArFormatName(BUNYAR_FILE_FORMAT_RAW), (unsigned long long)fileCounts[candidateCount],
+                humanReadableSize(fileSizes[candidateCount]).str);
+        if (md->previousNodes)
+        {
+            fprintf(stdout, "|- %llu unchanged files kept format of previous archive\n",
+                    (unsigned long long)tfrg_atomic64_load_relaxed(&ctx.keptCount_Atomic64));
+        }
+    }
+
+    tf_free(candidates);
+    tf_free(fileCounts);
+    tf_free(fileSizes);
+    return !error;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function bunyArLibCreate (access trace layout)                          ///
+/// Optional step before archive creation.                                   ///
+/// Ordering file data by first access recorded with                         ///
+/// ArchiveOpenDesc::recordAccessTrace, so traced loads read sequentially    ///
+////////////////////////////////////////////////////////////////////////////////
+
+static void bunyArLibLayoutPush(struct BunyArLibCreateMetadata* md, bool* placed, uint64_t* layoutCount, uint64_t ni)
+{
+    // Duplicates point to data of their original, it has to be written first
+    uint64_t original = md->nodeOriginals ? md->nodeOriginals[ni] : ni;
+    if (!placed[original])
+    {
+        placed[original] = true;
+        md->layoutOrder[(*layoutCount)++] = original;
+    }
+    if (!placed[ni])
+    {
+        placed[ni] = true;
+        md->layoutOrder[(*layoutCount)++] = ni;
+    }
+}
+
+static bool bunyArLibLayoutByAccessTrace(ResourceDirectory rd, const struct BunyArLibCreateDesc* desc, struct BunyArLibCreateMetadata* md)
+{
+    const char* path = desc->accessTracePath;
+
+    FileStream fs = { 0 };
+    if (!fsOpenStreamFromPath(rd, path, FM_READ, &fs))
+    {
+        LOGF(eERROR, "Failed to open access trace '%s'", path);
+        return false;
+    }
+
+    ssize_t traceSize = fsGetStreamFileSize(&fs);
+    char*   trace = traceSize >= 0 ? (char*)tf_malloc((size_t)traceSize + 1) : NULL;
+    bool    success = trace && fsReadFromStream(&fs, trace, (size_t)traceSize) == (size_t)traceSize;
+    fsCloseStream(&fs);
+
+    md->layoutOrder = (uint64_t*)tf_malloc(sizeof *md->layoutOrder * md->nodeCount);
+    bool* placed = (bool*)tf_calloc(md->nodeCount, sizeof *placed);
+    if (!success || !md->layoutOrder || !placed)
+    {
+        LOGF(eERROR, "Failed to read access trace '%s'", path);
+        tf_free(trace);
+        tf_free(placed);
+        return false;
+    }
+    trace[traceSize] = '\0';
+
+    uint64_t layoutCount = 0;
+    uint64_t unknownCount = 0;
+
+    for (char* line = trace; *line;)
+    {
+        char* end = line + strcspn(line, "\r\n");
+        char* next = end + strspn(end, "\r\n");
+        *end = '\0';
+
+        if (*line)
+        {
+            struct BunyArLibNodeSearchCtx ctx = { line, md->names };
+            const struct BunyArNode*      node =
+                (const struct BunyArNode*)bsearch(&ctx, md->nodes, md->nodeCount, sizeof *md->nodes, bunyArLibNodeSearchCmp);
+            if (node)
+                bunyArLibLayoutPush(md, placed, &layoutCount, (uint64_t)(node - md->nodes));
+            else
+                ++unknownCount;
+        }
+
+        line = next;
+    }
+
+    md->tracedCount = layoutCount;
+
+    // Files missing in the trace follow in node order
+    for (uint64_t i = 0; i < md->nodeCount; ++i)
+        bunyArLibLayoutPush(md, placed, &layoutCount, i);
+
+    ASSERT(layoutCount == md->nodeCount);
+
+    if (desc->verbose)
+    {
+        fprintf(stdout, "%llu/%llu files are laid out in order of access trace '%s'", (unsigned long long)md->tracedCount,
+                (unsigned long long)md->nodeCount, path);
+        if (unknownCount)
+            fprintf(stdout, ", %llu traced files are not archived", (unsigned long long)unknownCount);
+        putc('\n', stdout);
+    }
+
+    tf_free(trace);
+    tf_free(placed);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function bunyArLibCreate (glue part)                                    ///
+////////////////////////////////////////////////////////////////////////////////
+
+// fsRenameFile replaces an existing file in one step on POSIX platforms, so that a failure never leaves no archive at all.
+// On Windows it fails if destination exists, then previous file is removed first.
+static bool bunyArLibReplaceFile(ResourceDirectory rd, const char* srcPath, const char* dstPath)
+{
+    if (fsRenameFile(rd, srcPath, dstPath))
+        return true;
+
+    return fsFileExist(rd, dstPath) && fsRemoveFile(rd, dstPath) && fsRenameFile(rd, srcPath, dstPath);
+}
+
+// from lz4.c
+static const int LZ4_ACCELERATION_MAX = 65537;
+
+void bunyArLibCompressionLevelLimits(enum BunyArFileFormat format, int* min, int* max)
+{
+    switch (format)
+    {
+    case BUNYAR_FILE_FORMAT_LZ4_BLOCKS:
+        *min = -LZ4_ACCELERATION_MAX;
+        *max = LZ4HC_CLEVEL_MAX;
+        break;
+    case BUNYAR_FILE_FORMAT_ZSTD_BLOCKS:
+        *min = ZSTD_minCLevel();
+        *max = ZSTD_maxCLevel();
+        break;
+    case BUNYAR_FILE_FORMAT_RAW:
+    default:
+        *min = 0;
+        *max = 0;
+        break;
+    }
+}
+
+static bool bunyArLibCreateArchive(ResourceDirectory rd, const char* dstPath, const struct BunyArLibCreateDesc* desc,
+                                   struct BunyArLibCreateMetadata* md)
+{
+    bool singleThreaded = desc->threadPoolSize == 0;
+
+    struct ThreadsSharedMemory tsm;
+    if (!initThreadSharedMemory(&tsm, rd, dstPath, desc, md))
+    {
+        LOGF(eERROR, "Failed to initialize thread infrastructure");
+        return false;
+    }
+
+    if (singleThreaded)
+    {
+        struct bunyArLibCreateSingleThreadContext ctx = { 0 };
+
+        ctx.tsm = &tsm;
+        ctx.desc = desc;
+
+        struct bunyArLibPacketIo io = { packetSingleThreadProducerFunc, &ctx };
+
+        tsm.archiveError = !bunyArLibArchiveWrite(rd, dstPath, io, desc, md);
+    }
+    else
+    {
+        bunyArLibCreateTaskManager(&tsm, desc);
+        if (tsm.hashTableThread)
+        {
+            joinThread(tsm.hashTableThread);
+            memset(&tsm.hashTableThread, 0, sizeof tsm.hashTableThread);
+        }
+
+        if (tsm.error)
+            tsm.packetIo.kill = true;
+        tsm.packetIo.done = true;
+
+        wakeOneConditionVariable(&tsm.packetIo.condition);
+        joinThread(tsm.writerThread);
+    }
+
+    bool success = !tsm.archiveError && !tsm.error;
+
+    destroyThreadSharedMemory(&tsm);
+    return success;
+}
+
+bool bunyArLibCreate(ResourceDirectory rd, const char* dstPath, const struct BunyArLibCreateDesc* inDesc)
+{
+    char** strings = NULL;
+
+    struct BunyArLibCreateDesc desc;
+    if (!bunyArLibCreatePreprocessDesc(inDesc, &desc, &strings))
+    {
+        LOGF(eERROR, "Failed to preprocess file entries to create archive '%s'", dstPath);
+        bunyArLibCreatePostprocessDesc(&desc, &strings);
+        return false;
+    }
+
+    struct BunyArLibCreateMetadata md;
+    bool                           success = bunyArLibCreateMetadata(&desc, &md);
+
+    if (!success)
+    {
+        LOGF(eERROR, "Failed to initialize metadata for archive '%s'", dstPath);
+    }
+
+    if (success)
+    {
+        success = bunyArLibHashContents(&desc, &md);
+        if (!success)
+            LOGF(eERROR, "Failed to hash files for archive '%s'", dstPath);
+    }
+
+    if (success && !desc.skipDeduplication)
+    {
+        success = bunyArLibFindDuplicates(&desc, &md);
+        if (!success)
+            LOGF(eERROR, "Failed to find duplicated files for archive '%s'", dstPath);
+    }
+
+    if (success && desc.previousArchivePath)
+    {
+        success = bunyArLibLoadPreviousArchive(rd, &desc, &md);
+        if (!success)
+            LOGF(eERROR, "Failed to read previous archive '%s'", desc.previousArchivePath);
+    }
+
+    if (success && desc.adaptiveFormat.readSpeedMBps)
+    {
+        success = bunyArLibPickFormats(&desc, &md);
+        if (!success)
+            LOGF(eERROR, "Failed to pick formats of files for archive '%s'", dstPath);
+    }
+
+    if (success && md.zstdUsed && desc.zstdDictionarySizeKb)
+    {
+        success = bunyArLibCreateDictionaries(&desc, &md);
+        if (!success)
+            LOGF(eERROR, "Failed to create dictionaries for archive '%s'", dstPath);
+    }
+
+    if (success && desc.previousArchivePath)
+    {
+        success = bunyArLibFindReusableNodes(&desc, &md);
+        if (!success)
+            LOGF(eERROR, "Failed to find unchanged files of previous archive '%s'", desc.previousArchivePath);
+    }
+
+    if (success && desc.accessTracePath)
+        success = bunyArLibLayoutByAccessTrace(rd, &desc, &md);
+
+    // Previous archive is read while new one is written, it is replaced afterwards
+    char tmpPath[FS_MAX_PATH];
+    bool replacePrevious = md.previousArchive.pIO && strcmp(desc.previousArchivePath, dstPath) == 0;
+    if (replacePrevious)
+        snprintf(tmpPath, sizeof tmpPath, "%s.tmp", dstPath);
+
+    if (success)
+        success = bunyArLibCreateArchive(rd, replacePrevious ? tmpPath : dstPath, &desc, &md);
+
+    if (replacePrevious)
+    {
+        fsCloseStream(&md.previousArchive);
+        if (success && !bunyArLibReplaceFile(rd, tmpPath, dstPath))
+        {
+            LOGF(eERROR, "Failed to replace archive '%s', new archive is left in '%s'", dstPath, tmpPath);
+            success = false;
+        }
+        else if (!success)
+        {
+            fsRemoveFile(rd, tmpPath);
+        }
+    }
+
+    bunyArLibCreateMetadataDestroy(&md);
+    bunyArLibCreatePostprocessDesc(&desc, &strings);
+    return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function bunyArLibExtract                                               ///
+////////////////////////////////////////////////////////////////////////////////
+
+bool bunyArLibExtract(struct IFileSystem* archive, ResourceDirectory rd, const char* dstDir, const struct BunyArLibExtractDesc* desc)
+{
+    struct BunyArDescription archiveInfo;
+    fsArchiveGetDescription(archive, &archiveInfo);
+
+    FileStream fsOut = { 0 };
+    FileStream fsIn = { 0 };
+
+    bool loopFileNames = desc->fileNameCount > 0;
+
+    uint64_t loopLimit = loopFileNames ? desc->fileNameCount : archiveInfo.nodeCount;
+
+    int counterWidth = 0;
+    int printedLength = 0;
+    if (desc->verbose)
+    {
+        char buffer[32];
+        counterWidth = snprintf(buffer, sizeof buffer, "%llu", (unsigned long long)loopLimit);
+    }
+
+    uint64_t failureCount = 0;
+
+    for (uint64_t i = 0; i < loopLimit; ++i)
+    {
+        const char* error = NULL;
+
+        uint64_t uid = i;
+
+        uint64_t totalSize = 0;
+        char     buffer[64 * 1024];
+        ASSERT(sizeof buffer >= FS_MAX_PATH);
+
+        struct BunyArNodeDescription node;
+
+        if (loopFileNames && !fsArchiveGetNodeId(archive, desc->fileNames[i], &uid))
+        {
+            node.name = desc->fileNames[i];
+            error = "no such file";
+            goto FILE_DONE;
+        }
+
+        fsArchiveGetNodeDescription(archive, uid, &node);
+
+        // Deleted files have nothing to extract
+        if (node.format == BUNYAR_FILE_FORMAT_TOMBSTONE)
+        {
+            if (!loopFileNames)
+                continue;
+            error = "file is deleted";
+            goto FILE_DONE;
+        }
+
+        if (desc->verbose)
+        {
+            printedLength =
+                fprintf(stdout, "%*llu/%*llu ", counterWidth, (unsigned long long)i + 1, counterWidth, (unsigned long long)loopLimit);
+
+            fprintf(stdout, "'%s'\n", node.name);
+        }
+
+        if (strncmp(node.name, "../", 3) == 0)
+        {
+            LOGF(eERROR, "Archive file '%s' contains backlinks, so it is skipped.", node.name);
+            continue;
         }
 
         if (desc->verbose > 1)
@@ -2342,3 +3695,478 @@ CLEANUP:
 
     return success;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function bunyArLibArchiveBenchmarks                                     ///
+////////////////////////////////////////////////////////////////////////////////
+
+// Streams opened at once by decompression passes, each one holds a block sized buffer
+#define BUNYAR_LIB_BENCH_STREAM_BATCH 256
+#define BUNYAR_LIB_BENCH_READ_SIZE    (1024 * 1024)
+
+static const uint64_t BUNYAR_LIB_BENCH_BLOCK_SIZE_BINS[] = { 1024, 4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, UINT64_MAX };
+static const double   BUNYAR_LIB_BENCH_RATIO_BINS[] = { 1.5, 2.0, 3.0, 4.0, 8.0, DBL_MAX };
+
+struct BunyArLibBenchFile
+{
+    uint64_t offset;
+    uint64_t nodeId;
+};
+
+struct BunyArLibBenchFormat
+{
+    enum BunyArFileFormat format;
+    uint64_t*             nodeIds;
+    uint64_t              fileSize;
+    uint64_t              compressedSize;
+};
+
+struct BunyArLibBenchRead
+{
+    FileStream*     streams;
+    uint64_t*       sizes;
+    // Set by any task
+    tfrg_atomic32_t error_Atomic32;
+};
+
+static int bunyArLibBenchFileCmp(const void* v0, const void* v1)
+{
+    const struct BunyArLibBenchFile* f0 = (const struct BunyArLibBenchFile*)v0;
+    const struct BunyArLibBenchFile* f1 = (const struct BunyArLibBenchFile*)v1;
+    if (f0->offset != f1->offset)
+        return f0->offset < f1->offset ? -1 : 1;
+    return f0->nodeId < f1->nodeId ? -1 : f0->nodeId > f1->nodeId;
+}
+
+static void bunyArLibBenchReadTask(void* user, uint64_t begin, uint64_t end, uint64_t threadId)
+{
+    (void)threadId;
+
+    struct BunyArLibBenchRead* read = (struct BunyArLibBenchRead*)user;
+
+    uint8_t* buffer = (uint8_t*)tf_malloc(BUNYAR_LIB_BENCH_READ_SIZE);
+    if (!buffer)
+    {
+        tfrg_atomic32_store_relaxed(&read->error_Atomic32, 1);
+        return;
+    }
+
+    for (uint64_t i = begin; i < end; ++i)
+    {
+        uint64_t total = 0;
+        size_t   size;
+        do
+        {
+            size = fsReadFromStream(read->streams + i, buffer, BUNYAR_LIB_BENCH_READ_SIZE);
+            total += size;
+        } while (size == BUNYAR_LIB_BENCH_READ_SIZE);
+
+        if (total != read->sizes[i])
+            tfrg_atomic32_store_relaxed(&read->error_Atomic32, 1);
+    }
+
+    tf_free(buffer);
+}
+
+// Reads files in batches, opening streams is not measured. threadSystem is NULL for single-threaded pass
+static bool bunyArLibBenchDecompress(IFileSystem* archive, const uint64_t* nodeIds, uint64_t fileCount, ThreadSystem threadSystem,
+                                     int64_t* outUsec)
+{
+    FileStream streams[BUNYAR_LIB_BENCH_STREAM_BATCH];
+    uint64_t   sizes[BUNYAR_LIB_BENCH_STREAM_BATCH];
+
+    struct BunyArLibBenchRead read = { streams, sizes, 0 };
+
+    *outUsec = 0;
+    for (uint64_t bi = 0; bi < fileCount && !tfrg_atomic32_load_relaxed(&read.error_Atomic32); bi += BUNYAR_LIB_BENCH_STREAM_BATCH)
+    {
+        uint64_t batchCount = fileCount - bi < BUNYAR_LIB_BENCH_STREAM_BATCH ? fileCount - bi : BUNYAR_LIB_BENCH_STREAM_BATCH;
+
+        uint64_t openedCount = 0;
+        for (; openedCount < batchCount; ++openedCount)
+        {
+            if (!fsIoOpenByUid(archive, nodeIds[bi + openedCount], FM_READ, streams + openedCount))
+            {
+                tfrg_atomic32_store_relaxed(&read.error_Atomic32, 1);
+                break;
+            }
+            sizes[openedCount] = (uint64_t)fsGetStreamFileSize(streams + openedCount);
+        }
+
+        if (openedCount == batchCount)
+        {
+            int64_t start = getUSec(true);
+            threadSystemParallelFor(threadSystem, 0, batchCount, 1, bunyArLibBenchReadTask, &read);
+            *outUsec += getUSec(true) - start;
+        }
+
+        for (uint64_t i = 0; i < openedCount; ++i)
+            fsCloseStream(streams + i);
+    }
+
+    return !tfrg_atomic32_load_relaxed(&read.error_Atomic32);
+}
+
+static inline double bunyArLibBenchSpeed(uint64_t size, int64_t usec) { return usec > 0 ? (double)size / (double)usec : 0.0; }
+
+bool bunyArLibArchiveBenchmarks(ResourceDirectory rd, const char* archivePath, const struct BunyArLibBenchmarkDesc* desc,
+                                struct BunyArLibBenchmarkResults* outResults)
+{
+    if (outResults)
+        memset(outResults, 0, sizeof(*outResults));
+
+    uint32_t roundCount = desc->roundCount ? desc->roundCount : 1;
+    int      threadCount = desc->threadCount < 0 ? (int)getNumCPUCores() : desc->threadCount;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    //////////////////////////////////////////////////////
+    // Archive is read from memory, storage is not measured
+
+    FileStream fs = { 0 };
+    if (!fsOpenStreamFromPath(rd, archivePath, FM_READ, &fs))
+    {
+        LOGF(eERROR, "Failed to open archive '%s'", archivePath);
+        return false;
+    }
+
+    ssize_t  archiveSize = fsGetStreamFileSize(&fs);
+    uint8_t* archiveMemory = archiveSize > 0 ? (uint8_t*)tf_malloc((size_t)archiveSize) : NULL;
+    bool     success = archiveMemory && fsReadFromStream(&fs, archiveMemory, (size_t)archiveSize) == (size_t)archiveSize;
+    fsCloseStream(&fs);
+    if (!success)
+    {
+        LOGF(eERROR, "Failed to read archive '%s'", archivePath);
+        tf_free(archiveMemory);
+        return false;
+    }
+
+    ////////////
+    // Open test
+
+    struct ArchiveOpenDesc openDescs[3] = { { 0 }, { 0 }, { 0 } };
+    openDescs[1].disableHashTable = true;
+    const char* openNames[3] = { "stream", "stream without hash table", "memory" };
+    int64_t     openTimes[3] = { INT64_MAX, INT64_MAX, INT64_MAX };
+
+    for (uint32_t r = 0; r < roundCount && success; ++r)
+    {
+        for (int i = 0; i < 3 && success; ++i)
+        {
+            IFileSystem archive;
+            int64_t     start = getUSec(true);
+            success = i < 2 ? fsArchiveOpen(rd, archivePath, openDescs + i, &archive)
+                            : fsArchiveOpenFromMemory((uint64_t)archiveSize, archiveMemory, openDescs + i, &archive);
+            int64_t time = getUSec(true) - start;
+            if (time < openTimes[i])
+                openTimes[i] = time;
+            if (success)
+                fsArchiveClose(&archive);
+        }
+    }
+
+    // Every read decompresses its blocks
+    struct ArchiveOpenDesc benchDesc = { 0 };
+    benchDesc.disableBlockCache = true;
+
+    IFileSystem archive = { 0 };
+    if (!success || !fsArchiveOpenFromMemory((uint64_t)archiveSize, archiveMemory, &benchDesc, &archive))
+    {
+        LOGF(eERROR, "Failed to open archive '%s'", archivePath);
+        tf_free(archiveMemory);
+        return false;
+    }
+
+    struct BunyArDescription archiveInfo;
+    fsArchiveGetDescription(&archive, &archiveInfo);
+    uint64_t nodeCount = archiveInfo.nodeCount;
+
+    ///////////////////////////////////////////////////////
+    // Node names for lookups, unique file data by location
+
+    struct BunyArNode*         nodes = (struct BunyArNode*)tf_calloc(nodeCount + 1, sizeof *nodes);
+    struct BunyArLibBenchFile* files = (struct BunyArLibBenchFile*)tf_malloc((nodeCount + 1) * sizeof *files);
+    char*                      names = NULL;
+    uint64_t                   fileCount = 0;
+    uint64_t                   archivedSize = 0;
+    uint64_t                   archivedCompressedSize = 0;
+
+    struct BunyArLibBenchFormat formats[BUNYAR_LIB_BENCH_FORMAT_COUNT] = {
+        { BUNYAR_FILE_FORMAT_RAW, NULL, 0, 0 },
+        { BUNYAR_FILE_FORMAT_LZ4_BLOCKS, NULL, 0, 0 },
+        { BUNYAR_FILE_FORMAT_ZSTD_BLOCKS, NULL, 0, 0 },
+    };
+    const uint32_t formatCount = sizeof formats / sizeof *formats;
+
+    uint64_t blockSizeCounts[sizeof BUNYAR_LIB_BENCH_BLOCK_SIZE_BINS / sizeof *BUNYAR_LIB_BENCH_BLOCK_SIZE_BINS] = { 0 };
+    // First slot counts blocks stored raw
+    uint64_t ratioCounts[1 + sizeof BUNYAR_LIB_BENCH_RATIO_BINS / sizeof *BUNYAR_LIB_BENCH_RATIO_BINS] = { 0 };
+    uint64_t blockCount = 0;
+
+    success = nodes && files;
+    for (uint64_t i = 0; i < nodeCount && success; ++i)
+    {
+        struct BunyArNodeDescription node;
+        fsArchiveGetNodeDescription(&archive, i, &node);
+
+        nodes[i].namePointer.offset = (uint32_t)arrlenu(names);
+        nodes[i].namePointer.size = (uint32_t)strlen(node.name);
+        memcpy(arraddnptr(names, nodes[i].namePointer.size + 1), node.name, nodes[i].namePointer.size + 1);
+
+        if (node.format == BUNYAR_FILE_FORMAT_TOMBSTONE)
+            continue;
+
+        struct BunyArLibBenchFile file = { node.compressedSize ? node.offset : UINT64_MAX, i };
+        files[fileCount++] = file;
+    }
+
+    // Duplicates share location and are measured once, files are read in archive order
+    qsort(files, fileCount, sizeof *files, bunyArLibBenchFileCmp);
+
+    for (uint64_t i = 0; i < fileCount && success; ++i)
+    {
+        if (i > 0 && files[i].offset != UINT64_MAX && files[i].offset == files[i - 1].offset)
+            continue;
+
+        struct BunyArNodeDescription node;
+        fsArchiveGetNodeDescription(&archive, files[i].nodeId, &node);
+
+        archivedSize += node.fileSize;
+        archivedCompressedSize += node.compressedSize;
+
+        for (uint32_t fi = 0; fi < formatCount; ++fi)
+        {
+            if (formats[fi].format != node.format)
+                continue;
+            arrpush(formats[fi].nodeIds, files[i].nodeId);
+            formats[fi].fileSize += node.fileSize;
+            formats[fi].compressedSize += node.compressedSize;
+        }
+
+        if (node.format == BUNYAR_FILE_FORMAT_RAW)
+            continue;
+
+        FileStream                     stream;
+        struct BunyArBlockFormatHeader header;
+        const BunyArBlockPointer*      blocks;
+        if (!fsIoOpenByUid(&archive, files[i].nodeId, FM_READ, &stream))
+        {
+            success = false;
+            break;
+        }
+
+        if (fsArchiveGetFileBlockMetadata(&stream, &header, &blocks))
+        {
+            for (uint64_t bi = 0; bi < header.blockCount; ++bi)
+            {
+                struct BunyArBlockInfo block = bunyArDecodeBlockPointer(blocks[bi]);
+                uint64_t               rawSize = bi + 1 == header.blockCount ? header.blockSizeLast : header.blockSize;
+
+                uint32_t sizeBin = 0;
+                while (block.size > BUNYAR_LIB_BENCH_BLOCK_SIZE_BINS[sizeBin])
+                    ++sizeBin;
+                ++blockSizeCounts[sizeBin];
+
+                uint32_t ratioBin = 0;
+                if (block.isCompressed)
+                {
+                    double ratio = (double)rawSize / (double)block.size;
+                    while (ratio >= BUNYAR_LIB_BENCH_RATIO_BINS[ratioBin])
+                        ++ratioBin;
+                    ++ratioBin;
+                }
+                ++ratioCounts[ratioBin];
+                ++blockCount;
+            }
+        }
+
+        fsCloseStream(&stream);
+    }
+
+    for (uint32_t fi = 0; fi < formatCount && outResults; ++fi)
+    {
+        struct BunyArLibFormatBenchmarkResult* result = outResults->formats + fi;
+        result->format = formats[fi].format;
+        result->fileCount = arrlenu(formats[fi].nodeIds);
+        result->fileSize = formats[fi].fileSize;
+        result->compressedSize = formats[fi].compressedSize;
+    }
+
+    fprintf(stdout, "Archive '%s'\n|- %llu files, %llu with unique data\n|- %s -> %s (x%.2f)\n", archivePath, (unsigned long long)nodeCount,
+            (unsigned long long)(arrlenu(formats[0].nodeIds) + arrlenu(formats[1].nodeIds) + arrlenu(formats[2].nodeIds)),
+            humanReadableSize(archivedSize).str, humanReadableSize(archivedCompressedSize).str,
+            archivedCompressedSize ? (double)archivedSize / (double)archivedCompressedSize : 1.0);
+    if (archiveInfo.dictionaryCount)
+        fprintf(stdout, "|- %llu zstd dictionaries\n", (unsigned long long)archiveInfo.dictionaryCount);
+
+    fprintf(stdout, "\nOpen, best of %u rounds\n", roundCount);
+    for (int i = 0; i < 3; ++i)
+        fprintf(stdout, "|- %-26s %10lli us\n", openNames[i], (long long)openTimes[i]);
+
+    //////////////
+    // Lookup test
+
+    if (success && nodeCount)
+    {
+        const struct BunyArHashTable* hashTable = archiveInfo.hashTable;
+        struct BunyArHashTable*       builtHashTable = NULL;
+        int64_t                       buildTime = 0;
+        if (!hashTable)
+        {
+            int64_t start = getUSec(true);
+            builtHashTable = bunyArHashTableConstruct(nodeCount, nodes, names);
+            buildTime = getUSec(true) - start;
+            hashTable = builtHashTable;
+        }
+
+        int64_t hashTableTime = INT64_MAX;
+        int64_t searchTime = INT64_MAX;
+        for (uint32_t r = 0; r < roundCount && success && hashTable; ++r)
+        {
+            int64_t start = getUSec(true);
+            for (uint64_t i = 0; i < nodeCount; ++i)
+                success &= bunyArHashTableLookup(hashTable, names + nodes[i].namePointer.offset, nodeCount, nodes, names) == i;
+            int64_t time = getUSec(true) - start;
+            if (time < hashTableTime)
+                hashTableTime = time;
+
+            start = getUSec(true);
+            for (uint64_t i = 0; i < nodeCount; ++i)
+            {
+                struct BunyArLibNodeSearchCtx ctx = { names + nodes[i].namePointer.offset, names };
+                success &= bsearch(&ctx, nodes, nodeCount, sizeof *nodes, bunyArLibNodeSearchCmp) == nodes + i;
+            }
+            time = getUSec(true) - start;
+            if (time < searchTime)
+                searchTime = time;
+        }
+
+        if (!success || !hashTable)
+        {
+            LOGF(eERROR, "Lookup of archive file names failed");
+            success = false;
+        }
+        else
+        {
+            fprintf(stdout, "\nLookup of %llu names, best of %u rounds\n", (unsigned long long)nodeCount, roundCount);
+            fprintf(stdout, "|- %-26s %10.1f ns/name", "bunyArHashTableLookup", (double)hashTableTime * 1000.0 / (double)nodeCount);
+            if (builtHashTable)
+                fprintf(stdout, " (table is not stored, built in %lli us)", (long long)buildTime);
+            fprintf(stdout, "\n|- %-26s %10.1f ns/name\n", "binary search", (double)searchTime * 1000.0 / (double)nodeCount);
+        }
+
+        tf_free(builtHashTable);
+    }
+
+    /////////////////////
+    // Decompression test
+
+    ThreadSystem threadSystem = NULL;
+    if (success && threadCount > 1)
+    {
+        // Calling thread works too
+        struct ThreadSystemInitDesc tsInfo = { 0 };
+        tsInfo.threadCount = (uint64_t)threadCount - 1;
+        if (!threadSystemInit(&threadSystem, &tsInfo))
+        {
+            LOGF(eERROR, "Failed to start thread pool");
+            success = false;
+        }
+    }
+
+    if (success)
+    {
+        fprintf(stdout, "\nDecompression from memory without block cache, MB/s of decompressed data, best of %u rounds\n", roundCount);
+        fprintf(stdout, "|- %-6s %8s %10s %7s %10s", "format", "files", "size", "ratio", "1 thread");
+        if (threadSystem)
+            fprintf(stdout, " %7i threads", threadCount);
+        putc('\n', stdout);
+    }
+
+    for (uint32_t fi = 0; fi < formatCount && success; ++fi)
+    {
+        const struct BunyArLibBenchFormat* format = formats + fi;
+        uint64_t                           formatFileCount = arrlenu(format->nodeIds);
+        if (!formatFileCount)
+            continue;
+
+        int64_t singleTime = INT64_MAX;
+        int64_t multiTime = INT64_MAX;
+        for (uint32_t r = 0; r < roundCount && success; ++r)
+        {
+            int64_t time;
+            success = bunyArLibBenchDecompress(&archive, format->nodeIds, formatFileCount, NULL, &time);
+            if (time < singleTime)
+                singleTime = time;
+
+            if (success && threadSystem)
+            {
+                success = bunyArLibBenchDecompress(&archive, format->nodeIds, formatFileCount, threadSystem, &time);
+                if (time < multiTime)
+                    multiTime = time;
+            }
+        }
+
+        if (!success)
+        {
+            LOGF(eERROR, "Failed to read %s files of archive '%s'", bunyArFormatName(format->format), archivePath);
+            break;
+        }
+
+        fprintf(stdout, "|- %-6s %8llu %10s %7.2f %10.1f", bunyArFormatName(format->format), (unsigned long long)formatFileCount,
+                humanReadableSize(format->fileSize).str,
+                format->compressedSize ? (double)format->fileSize / (double)format->compressedSize : 1.0,
+                bunyArLibBenchSpeed(format->fileSize, singleTime));
+        if (threadSystem)
+            fprintf(stdout, " %15.1f", bunyArLibBenchSpeed(format->fileSize, multiTime));
+        putc('\n', stdout);
+
+        if (outResults)
+        {
+            outResults->formats[fi].singleThreadSpeed = bunyArLibBenchSpeed(format->fileSize, singleTime);
+            outResults->formats[fi].multiThreadSpeed = threadSystem ? bunyArLibBenchSpeed(format->fileSize, multiTime) : 0.0;
+        }
+    }
+
+    if (threadSystem)
+        threadSystemExit(&threadSystem, &gThreadSystemExitDescDefault);
+
+    /////////////////////////////
+    // Compressed block analysis
+
+    if (success && blockCount)
+    {
+        fprintf(stdout, "\nSizes of %llu compressed format blocks in archive\n", (unsigned long long)blockCount);
+        for (uint32_t i = 0; i < sizeof blockSizeCounts / sizeof *blockSizeCounts; ++i)
+        {
+            char label[32];
+            if (BUNYAR_LIB_BENCH_BLOCK_SIZE_BINS[i] == UINT64_MAX)
+                snprintf(label, sizeof label, " > %s", humanReadableSize(BUNYAR_LIB_BENCH_BLOCK_SIZE_BINS[i - 1]).str);
+            else
+                snprintf(label, sizeof label, "<= %s", humanReadableSize(BUNYAR_LIB_BENCH_BLOCK_SIZE_BINS[i]).str);
+            fprintf(stdout, "|- %-11s %10llu %6.1f%%\n", label, (unsigned long long)blockSizeCounts[i],
+                    100.0 * (double)blockSizeCounts[i] / (double)blockCount);
+        }
+
+        fprintf(stdout, "\nCompression ratios of blocks\n");
+        for (uint32_t i = 0; i < sizeof ratioCounts / sizeof *ratioCounts; ++i)
+        {
+            char label[32] = "stored raw";
+            if (i > 0 && BUNYAR_LIB_BENCH_RATIO_BINS[i - 1] == DBL_MAX)
+                snprintf(label, sizeof label, ">= x%.1f", BUNYAR_LIB_BENCH_RATIO_BINS[i - 2]);
+            else if (i > 0)
+                snprintf(label, sizeof label, " < x%.1f", BUNYAR_LIB_BENCH_RATIO_BINS[i - 1]);
+            fprintf(stdout, "|- %-11s %10llu %6.1f%%\n", label, (unsigned long long)ratioCounts[i],
+                    100.0 * (double)ratioCounts[i] / (double)blockCount);
+        }
+    }
+
+    for (uint32_t fi = 0; fi < formatCount; ++fi)
+        arrfree(formats[fi].nodeIds);
+    arrfree(names);
+    tf_free(files);
+    tf_free(nodes);
+    fsArchiveClose(&archive);
+    tf_free(archiveMemory);
+    return success;
+}
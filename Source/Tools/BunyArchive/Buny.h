@@ -65,12 +65,37 @@ extern "C"
 #endif
     };
 
+    struct BunyArLibFormatCandidate
+    {
+        enum BunyArFileFormat format;
+        int                   compressionLevel;
+    };
+
+    // Picks format and compression level of every entry.
+    // Candidates compress the first block of the file, load time of the file is estimated from each result as
+    //     compressed size / readSpeedMBps + measured decompression time
+    // and the fastest candidate wins, raw storage included. Slow storage favours ratio, fast storage favours decompression speed.
+    // Entry format and compression level are ignored, except for tombstones.
+    // Estimates are timing based, the same input can get other formats on another machine or run.
+    struct BunyArLibAdaptiveFormatDesc
+    {
+        // Read speed of storage the archive is loaded from. 0 disables adaptive formats.
+        // Files unchanged since BunyArLibCreateDesc::previousArchivePath keep their previous format if it is still a candidate.
+        uint32_t readSpeedMBps;
+
+        // If 0, candidates are LZ4 at default compression level and ZSTD at levels 3, 9 and 19
+        uint32_t                               candidateCount;
+        const struct BunyArLibFormatCandidate* candidates;
+    };
+
     struct BunyArLibCreateDesc
     {
         uint64_t                         entryCount;
         struct BunyArLibEntryCreateDesc* entries;
 
         bool     skipHashTable;
+        // Files with identical content are stored once, unless set
+        bool     skipDeduplication;
         // larger value, more details
         unsigned verbose;
 
@@ -88,6 +113,23 @@ extern "C"
         // Minimum is 4KB
         // If 0, it sets to default 4MB
         size_t memorySizePerThread;
+
+        // Maximum size of zstd dictionaries in KB. 0 disables dictionaries.
+        // ZSTD entries are grouped by file extension and compression level,
+        // one dictionary is trained from small files of each group.
+        uint32_t zstdDictionarySizeKb;
+
+        // Previous build of the archive in the output resource directory, can be the output path. NULL to build from scratch.
+        // Compressed data of unchanged entries is copied from it instead of compressing them again.
+        // Entry is unchanged if content hash, format, block size, compression level and zstd dictionary are the same.
+        // Archives without node sources (BunyArHeader::nodeSourcesPointer) are not reused.
+        const char* previousArchivePath;
+
+        // File in the output resource directory written by fsArchiveWriteAccessTrace. NULL to write files in name order.
+        // Data of traced files is written first, in first-access order, followed by other files.
+        const char* accessTracePath;
+
+        struct BunyArLibAdaptiveFormatDesc adaptiveFormat;
     };
 
     static const struct BunyArLibEntryCreateDesc BUNYAR_LIB_FUNC_CREATE_DEFAULT_ENTRY_DESC = {
@@ -128,6 +170,42 @@ extern "C"
 
     bool bunyArLibHashTableBenchmarks(size_t keyCount, size_t keySize);
 
+    struct BunyArLibBenchmarkDesc
+    {
+        // Measurements are repeated, the best round is reported. 1 if 0
+        uint32_t roundCount;
+
+        // Threads of multithreaded decompression, calling thread included. If < 0, uses getNumCPUCores()
+        int threadCount;
+    };
+
+#define BUNYAR_LIB_BENCH_FORMAT_COUNT 3
+
+    struct BunyArLibFormatBenchmarkResult
+    {
+        enum BunyArFileFormat format;
+        // Files with unique data, duplicates are measured once
+        uint64_t              fileCount;
+        uint64_t              fileSize;
+        uint64_t              compressedSize;
+        // MB/s of decompressed data in the best round, 0 if format has no files.
+        // multiThreadSpeed is 0 if a single thread is used.
+        double                singleThreadSpeed;
+        double                multiThreadSpeed;
+    };
+
+    struct BunyArLibBenchmarkResults
+    {
+        // RAW, LZ4 and ZSTD
+        struct BunyArLibFormatBenchmarkResult formats[BUNYAR_LIB_BENCH_FORMAT_COUNT];
+    };
+
+    // Measures open time, name lookup time and decompression speed of each format from memory,
+    // prints distribution of compressed block sizes and compression ratios.
+    // Decompression results are also written to 'outResults', which can be NULL.
+    bool bunyArLibArchiveBenchmarks(ResourceDirectory rd, const char* archivePath, const struct BunyArLibBenchmarkDesc* desc,
+                                    struct BunyArLibBenchmarkResults* outResults);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,8 @@
 
 #include "Buny.h"
 
+#define BUNYAR_TOOL_MAX_ADAPTIVE_CANDIDATES 16
+
 #if defined(_WINDOWS)
 static const char DIR_SEP = '\\';
 #else
@@ -56,6 +58,12 @@ enum ArgType
     AT_PARALLEL_READS,
     AT_MEMORY_SIZE,
     AT_THREADS,
+    AT_DICTIONARY_SIZE,
+    AT_DEDUPLICATION,
+    AT_INCREMENTAL,
+    AT_ACCESS_TRACE,
+    AT_ADAPTIVE,
+    AT_ROUNDS,
 };
 
 struct ArgTracker
@@ -70,7 +78,10 @@ struct ArgTracker
 struct BunyArToolCtx
 {
     // archive create flags
-    bool hashMap;
+    bool  hashMap;
+    bool  deduplicate;
+    bool  incremental;
+    char* accessTracePath;
 
     // archive create entry args
     size_t                outputNameCutLength; // only set by drag&drop
@@ -83,6 +94,12 @@ struct BunyArToolCtx
     int                   threadCount;
     size_t                parallelFileReads;
     size_t                MBPerThread;
+    uint32_t              zstdDictionarySizeKb;
+    uint32_t              adaptiveReadSpeedMBps;
+
+    // Formats tried by --adaptive, library defaults if 0
+    uint32_t                        adaptiveCandidateCount;
+    struct BunyArLibFormatCandidate adaptiveCandidates[BUNYAR_TOOL_MAX_ADAPTIVE_CANDIDATES];
 
     // inspect
     bool inspectBlocks;
@@ -94,6 +111,9 @@ struct BunyArToolCtx
     size_t keyCount;
     size_t keySize;
 
+    // bench
+    uint32_t roundCount;
+
     // global
     bool     archivePathDontWanna;
     char*    archivePath;
@@ -122,12 +142,19 @@ static struct ArgTracker ARG_TRACKER_CREATE[] = {
 	{ "--raw",            AT_FORMAT,            0, 0, "no   compression for next entries" },
 	{ "--zstd",           AT_FORMAT,            0, 0, "ZSTD compression for next entries" },
 	{ "--lz4",            AT_FORMAT,            0, 0, "LZ4  compression for next entries" },
+	{ "--tombstone",      AT_FORMAT,            0, 0, "next entries are names of files deleted by this patch archive" },
 	{ "--threads",        AT_THREADS,          -1, 99, "thread pool size. 0 singlethreaded. -1 auto" },
 	{ "--parallel-reads", AT_PARALLEL_READS,    1, 99, "max number of file streams when thread pool enabled" },
 	{ "--thread-memory",  AT_MEMORY_SIZE,       1, 64, "MB of memory allocated per thread. Threads can starve on low amount." },
 	{ "--bsize",          AT_BLOCK_SIZE,        1, (BUNYAR_BLOCK_MAX_SIZE_MINUS_ONE + 1) / 1024, "size of compressed data block in KB" },
+	{ "--zstd-dict",      AT_DICTIONARY_SIZE,   0, 1024, "train zstd dictionaries of up to KB size for ZSTD entries. 0 disables" },
 	{ "--hashmap",        AT_HASHMAP,           0, 0, "precompute hash table (enabled by default)" },
 	{ "--no-hashmap",     AT_HASHMAP,           0, 0, "disable hash table precomputing" },
+	{ "--dedup",          AT_DEDUPLICATION,     0, 0, "store files with identical content once (enabled by default)" },
+	{ "--no-dedup",       AT_DEDUPLICATION,     0, 0, "disable deduplication" },
+	{ "--incremental",    AT_INCREMENTAL,       0, 0, "copy unchanged files from existing output archive instead of compressing them" },
+	{ "--adaptive",       AT_ADAPTIVE,          1, 0, "MB/s[:formats] pick raw or one of the formats per file by load time at MB/s read speed, e.g. 200:lz4,zstd19" },
+	{ "--trace",          AT_ACCESS_TRACE,      1, 0, "lay out file data in order of access trace file written by fsArchiveWriteAccessTrace" },
 	{ "--optional",       AT_OPTIONAL,          0, 0, "keep going if next entries are missing" },
 	{ "--required",       AT_OPTIONAL,          0, 0, "undo --optional" },
 	{ "--help",           AT_HELP,              0, 0, "be provided with something that is useful or necessary in achieving" },
@@ -151,8 +178,76 @@ static struct ArgTracker ARG_TRACKER_BENCHMARK[] = {
 	{ "--help",       AT_HELP,              0, 0, "get support or aid" },
 	{ NULL,           AT_UNRECOGNIZED,      0, 0, NULL },
 };
+static struct ArgTracker ARG_TRACKER_BENCH[] = {
+	{ "--rounds",     AT_ROUNDS,            1, 1000, "repeat measurements, best round is reported" },
+	{ "--threads",    AT_THREADS,          -1, 99, "threads of multithreaded decompression. 1 singlethreaded only. -1 auto" },
+	{ "--help",       AT_HELP,              0, 0, "receive assistance in measuring things" },
+	{ NULL,           AT_UNRECOGNIZED,      0, 0, NULL },
+};
 // clang-format on
 
+// "MB/s" or "MB/s:candidates", candidates are lz4 or zstd followed by compression level, e.g. "200:lz4,zstd3,zstd19".
+// Format without level uses --lz4cl or --zstdcl.
+static bool parseAdaptiveArg(struct BunyArToolCtx* ctx, char* arg)
+{
+    char* end;
+    long  readSpeed = strtol(arg, &end, 10);
+    if (end == arg || (*end && *end != ':') || readSpeed < 1 || readSpeed > 1000000)
+    {
+        fprintf(stderr, "Bad read speed '%s' for argument '--adaptive', must be in range [1;1000000].\n", arg);
+        return false;
+    }
+    ctx->adaptiveReadSpeedMBps = (uint32_t)readSpeed;
+    ctx->adaptiveCandidateCount = 0;
+
+    for (char* cur = *end ? end + 1 : end; *cur;)
+    {
+        struct BunyArLibFormatCandidate candidate;
+        if (strncmp(cur, "lz4", 3) == 0)
+        {
+            candidate.format = BUNYAR_FILE_FORMAT_LZ4_BLOCKS;
+            cur += 3;
+        }
+        else if (strncmp(cur, "zstd", 4) == 0)
+        {
+            candidate.format = BUNYAR_FILE_FORMAT_ZSTD_BLOCKS;
+            cur += 4;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown format '%s' for argument '--adaptive', expected lz4 or zstd.\n", cur);
+            return false;
+        }
+
+        candidate.compressionLevel = BUNYAR_LIB_COMPRESSION_LEVEL_DEFAULT;
+        if (*cur && *cur != ',')
+        {
+            int  min;
+            int  max;
+            long level = strtol(cur, &end, 10);
+            bunyArLibCompressionLevelLimits(candidate.format, &min, &max);
+            if (end == cur || (*end && *end != ',') || level < min || level > max)
+            {
+                fprintf(stderr, "Bad compression level '%s' for argument '--adaptive', must be in range [%i;%i].\n", cur, min, max);
+                return false;
+            }
+            candidate.compressionLevel = (int)level;
+            cur = end;
+        }
+
+        if (ctx->adaptiveCandidateCount == BUNYAR_TOOL_MAX_ADAPTIVE_CANDIDATES)
+        {
+            fprintf(stderr, "Too many formats for argument '--adaptive', maximum is %u.\n", BUNYAR_TOOL_MAX_ADAPTIVE_CANDIDATES);
+            return false;
+        }
+        ctx->adaptiveCandidates[ctx->adaptiveCandidateCount++] = candidate;
+
+        if (*cur == ',')
+            ++cur;
+    }
+    return true;
+}
+
 static bool nextArg(struct BunyArToolCtx* ctx, char** out)
 {
     *out = NULL;
@@ -253,11 +348,30 @@ static bool nextArg(struct BunyArToolCtx* ctx, char** out)
             case 'z':
                 ctx->format = BUNYAR_FILE_FORMAT_ZSTD_BLOCKS;
                 break;
+            case 't':
+                ctx->format = BUNYAR_FILE_FORMAT_TOMBSTONE;
+                break;
             }
             break;
         case AT_HASHMAP:
             ctx->hashMap = resolver != 'n';
             break;
+        case AT_DEDUPLICATION:
+            ctx->deduplicate = resolver != 'n';
+            break;
+        case AT_INCREMENTAL:
+            ctx->incremental = true;
+            break;
+        case AT_ROUNDS:
+            ctx->roundCount = (uint32_t)value;
+            break;
+        case AT_ADAPTIVE:
+            if (!parseAdaptiveArg(ctx, b))
+                return false;
+            break;
+        case AT_ACCESS_TRACE:
+            ctx->accessTracePath = b;
+            break;
         case AT_VERBOSITY:
             ctx->verbose = resolver == 'q' ? 0 : 2;
             break;
@@ -291,6 +405,9 @@ static bool nextArg(struct BunyArToolCtx* ctx, char** out)
         case AT_MEMORY_SIZE:
             ctx->MBPerThread = (size_t)value;
             break;
+        case AT_DICTIONARY_SIZE:
+            ctx->zstdDictionarySizeKb = (uint32_t)value;
+            break;
         case AT_UNRECOGNIZED:
         default:
             fprintf(stderr, "Unrecognized argument '%s'\n", a);
@@ -357,7 +474,16 @@ static int bunyArToolCreate(struct BunyArToolCtx* ctx)
 	  "Create archive from the list of entries. Entries are directory or file paths.\n"
 	  "\nUsage:\n\tcreate output_file --zstd Art --lz4 readme.txt --name backup /home/Downloads\n\n"
 	  "Each entry has its own set of options, e.g. Art directory is compressed using ZSTD, while \"readme.txt\" and \"/home/Downloads\" entries are compressed using LZ4.\n\n"
-	  "\"--name\" argument is used to set name for next entry, so files from \"/home/Downloads/\" are going to be located in the \"backup/\" archive directory.\n";
+	  "\"--name\" argument is used to set name for next entry, so files from \"/home/Downloads/\" are going to be located in the \"backup/\" archive directory.\n\n"
+	  "Patch archive for a mount stack holds changed files and tombstones of deleted files:\n"
+	  "\tcreate patch_file --zstd --name Art Art_changed --tombstone Art/old.png Art/unused.gltf\n\n"
+	  "Files opened while a level loads are stored first and in the same order, given a trace recorded with ArchiveOpenDesc::recordAccessTrace:\n"
+	  "\tcreate output_file --trace level_trace.txt --zstd Art\n\n"
+	  "With --adaptive every file is compressed with each listed format, load time is estimated as compressed size divided by\n"
+	  "the read speed plus the measured decompression time, and the fastest one wins, raw storage included:\n"
+	  "\tcreate output_file --adaptive 200:lz4,zstd3,zstd9,zstd19 Art\n"
+	  "Without a list the formats are LZ4 and ZSTD at levels 3, 9 and 19. Higher ZSTD levels decompress about as fast as low ones,\n"
+	  "they only take longer to build.\n";
     // clang-format on
 
     struct BunyArLibCreateDesc info = { 0 };
@@ -415,11 +541,26 @@ static int bunyArToolCreate(struct BunyArToolCtx* ctx)
     if (success)
     {
         info.skipHashTable = !ctx->hashMap;
+        info.skipDeduplication = !ctx->deduplicate;
         info.verbose = ctx->verbose;
 
         info.maxParallelFileReads = ctx->parallelFileReads;
         info.threadPoolSize = ctx->threadCount;
         info.memorySizePerThread = ctx->MBPerThread * 1024 * 1024;
+        info.zstdDictionarySizeKb = ctx->zstdDictionarySizeKb;
+        info.previousArchivePath = ctx->incremental ? ctx->archivePath : NULL;
+        info.accessTracePath = ctx->accessTracePath;
+
+        // Levels of --lz4cl and --zstdcl are known once all arguments are parsed
+        for (uint32_t ci = 0; ci < ctx->adaptiveCandidateCount; ++ci)
+        {
+            struct BunyArLibFormatCandidate* candidate = &ctx->adaptiveCandidates[ci];
+            if (candidate->compressionLevel == BUNYAR_LIB_COMPRESSION_LEVEL_DEFAULT)
+                candidate->compressionLevel = candidate->format == BUNYAR_FILE_FORMAT_LZ4_BLOCKS ? ctx->lz4cl : ctx->zstdcl;
+        }
+        info.adaptiveFormat.readSpeedMBps = ctx->adaptiveReadSpeedMBps;
+        info.adaptiveFormat.candidateCount = ctx->adaptiveCandidateCount;
+        info.adaptiveFormat.candidates = ctx->adaptiveCandidates;
 
         success = bunyArLibCreate(TF_RD, ctx->archivePath, &info);
     }
@@ -429,6 +570,13 @@ static int bunyArToolCreate(struct BunyArToolCtx* ctx)
     return success ? 0 : -1;
 }
 
+static int bunyArPointerCmp(const void* v0, const void* v1)
+{
+    uint64_t a = ((const struct BunyArPointer64*)v0)->offset;
+    uint64_t b = ((const struct BunyArPointer64*)v1)->offset;
+    return a < b ? -1 : a > b;
+}
+
 static int bunyArToolInspect(struct BunyArToolCtx* ctx)
 {
     ctx->argTrackers = ARG_TRACKER_INSPECT;
@@ -467,11 +615,36 @@ static int bunyArToolInspect(struct BunyArToolCtx* ctx)
     struct BunyArDescription archiveInfo;
     fsArchiveGetDescription(&archiveFs, &archiveInfo);
 
+    if (archiveInfo.dictionaryCount)
+        fprintf(stdout, "%llu zstd dictionaries\n\n", (unsigned long long)archiveInfo.dictionaryCount);
+
+    // Deduplicated files share data location
+    struct BunyArPointer64* dataPointers = tf_malloc(sizeof *dataPointers * (archiveInfo.nodeCount + 1));
+    uint64_t                dataCount = 0;
+    if (!dataPointers)
+    {
+        fprintf(stderr, "Failed to allocate memory for %llu nodes\n", (unsigned long long)archiveInfo.nodeCount);
+        fsArchiveClose(&archiveFs);
+        return -1;
+    }
+
     for (uint64_t i = 0; i < archiveInfo.nodeCount; ++i)
     {
         struct BunyArNodeDescription node;
         fsArchiveGetNodeDescription(&archiveFs, i, &node);
 
+        if (node.fileSize)
+        {
+            struct BunyArPointer64 ptr = { node.offset, node.compressedSize };
+            dataPointers[dataCount++] = ptr;
+        }
+
+        if (node.format == BUNYAR_FILE_FORMAT_TOMBSTONE)
+        {
+            fprintf(stdout, "'%s'\n|- %s\n\n", node.name, bunyArFormatName(node.format));
+            continue;
+        }
+
         fprintf(stdout, "'%s'\n|- %s %s -> %s (x%.2f)\n", node.name, bunyArFormatName(node.format), humanReadableSize(node.fileSize).str,
                 humanReadableSize(node.compressedSize).str, (double)node.fileSize / (double)node.compressedSize);
 
@@ -505,6 +678,25 @@ static int bunyArToolInspect(struct BunyArToolCtx* ctx)
         putc('\n', stdout);
     }
 
+    uint64_t duplicateCount = 0;
+    uint64_t duplicateSize = 0;
+
+    qsort(dataPointers, dataCount, sizeof *dataPointers, bunyArPointerCmp);
+    for (uint64_t i = 1; i < dataCount; ++i)
+    {
+        if (dataPointers[i].offset != dataPointers[i - 1].offset)
+            continue;
+        ++duplicateCount;
+        duplicateSize += dataPointers[i].size;
+    }
+    tf_free(dataPointers);
+
+    if (duplicateCount)
+    {
+        fprintf(stdout, "%llu duplicates share data with other files, %s saved\n\n", (unsigned long long)duplicateCount,
+                humanReadableSize(duplicateSize).str);
+    }
+
     fsArchiveClose(&archiveFs);
     return 0;
 }
@@ -596,6 +788,38 @@ static int bunyArToolBenchmark(struct BunyArToolCtx* ctx)
     return bunyArLibHashTableBenchmarks(ctx->keyCount, ctx->keySize) ? 0 : -1;
 }
 
+static int bunyArToolBench(struct BunyArToolCtx* ctx)
+{
+    ctx->argTrackers = ARG_TRACKER_BENCH;
+
+    // clang-format off
+	ctx->helpStr =
+	  "Measure read performance of archive: open time, file name lookup time and decompression speed of each format,\n"
+	  "singlethreaded and multithreaded. Archive is read from memory, so results do not depend on storage.\n"
+	  "Distribution of compressed block sizes and compression ratios is shown too.\n"
+	  "\nUsage:\n\tbench archive_file --rounds=5 --threads=8\n";
+    // clang-format on
+
+    for (;;)
+    {
+        char* arg;
+        if (!nextArg(ctx, &arg))
+            return -1;
+
+        if (arg == NULL)
+            break;
+
+        fprintf(stderr, "Unexpected argument '%s'\n", arg);
+        return -1;
+    }
+
+    struct BunyArLibBenchmarkDesc desc = { 0 };
+    desc.roundCount = ctx->roundCount;
+    desc.threadCount = ctx->threadCount;
+
+    return bunyArLibArchiveBenchmarks(TF_RD, ctx->archivePath, &desc, NULL) ? 0 : -1;
+}
+
 static inline bool isRootPath(char* path)
 {
 #if defined(_WINDOWS)
@@ -827,6 +1051,7 @@ static int bunyArTool(int argCount, char** args)
         fprintf(stdout, "\tcreate      Create archive\n");
         fprintf(stdout, "\tinspect     Lookup archive content\n");
         fprintf(stdout, "\textract     Extract archive\n");
+        fprintf(stdout, "\tbench       Measure archive read performance\n");
         fprintf(stdout, "\tbenchmark   Run benchmarks\n");
         putc('\n', stdout);
         return argCount != 1;
@@ -840,6 +1065,7 @@ static int bunyArTool(int argCount, char** args)
 
     ctx.verbose = 1;
     ctx.hashMap = true;
+    ctx.deduplicate = true;
 
     ctx.blockSizeKb = defaults.blockSizeKb;
     ctx.format = defaults.format;
@@ -852,6 +1078,8 @@ static int bunyArTool(int argCount, char** args)
     ctx.keyCount = 10000000;
     ctx.keySize = 8;
 
+    ctx.roundCount = 3;
+
     ctx.argBeg = args + 2;
     ctx.argEnd = args + argCount;
     ctx.argCur = ctx.argBeg;
@@ -866,6 +1094,8 @@ static int bunyArTool(int argCount, char** args)
         res = bunyArToolExtract(&ctx);
     else if (strcmp(cmd, "benchmark") == 0)
         res = bunyArToolBenchmark(&ctx);
+    else if (strcmp(cmd, "bench") == 0)
+        res = bunyArToolBench(&ctx);
     else
     {
         ctx.argBeg = args + 1;
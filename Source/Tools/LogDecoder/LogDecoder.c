@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "LogDecoder.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../Runtime/Core/Private/Log/BinaryLog.h"
+
+#define FILENAME_NAME_LENGTH_LOG 23
+#define INDENTATION_SIZE_LOG     4
+#define DECODER_MAX_MESSAGE      4096
+
+// Bits of LogLevel
+#define LOG_DEBUG   2
+#define LOG_INFO    4
+#define LOG_WARNING 8
+#define LOG_ERROR   16
+
+typedef struct Format
+{
+    uint64_t mId;
+    int32_t  mLine;
+    char*    pFile;
+    char*    pFormat;
+} Format;
+
+typedef struct Thread
+{
+    uint64_t mId;
+    char*    pName;
+} Thread;
+
+typedef struct Decoder
+{
+    BinaryLogHeader mHeader;
+    // Open addressing by id, mFormatCapacity is a power of two
+    Format*         pFormats;
+    uint32_t        mFormatCount;
+    uint32_t        mFormatCapacity;
+    Thread*         pThreads;
+    uint32_t        mThreadCount;
+    uint32_t        mThreadCapacity;
+} Decoder;
+
+typedef struct Text
+{
+    char   mBuffer[DECODER_MAX_MESSAGE];
+    size_t mLength;
+} Text;
+
+static const struct
+{
+    uint32_t    mLevel;
+    const char* pPrefix;
+} gLevelPrefixes[] = { { LOG_WARNING, "WARN| " }, { LOG_INFO, "INFO| " }, { LOG_DEBUG, " DBG| " }, { LOG_ERROR, " ERR| " } };
+
+static char* copyString(const char* str, size_t length)
+{
+    char* copy = (char*)malloc(length + 1);
+    memcpy(copy, str, length);
+    copy[length] = 0;
+    return copy;
+}
+
+static void appendText(Text* pText, const char* fmt, ...)
+{
+    size_t  available = sizeof(pText->mBuffer) - pText->mLength;
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(pText->mBuffer + pText->mLength, available, fmt, args);
+    va_end(args);
+    if (length > 0)
+        pText->mLength += (size_t)length < available ? (size_t)length : available - 1;
+}
+
+static void appendChars(Text* pText, const char* str, size_t length)
+{
+    size_t available = sizeof(pText->mBuffer) - pText->mLength - 1;
+    length = length < available ? length : available;
+    memcpy(pText->mBuffer + pText->mLength, str, length);
+    pText->mLength += length;
+    pText->mBuffer[pText->mLength] = 0;
+}
+
+static Format* findFormat(Decoder* pDecoder, uint64_t id)
+{
+    if (!pDecoder->mFormatCapacity)
+        return NULL;
+    for (uint32_t i = (uint32_t)id;; ++i)
+    {
+        Format* pFormat = &pDecoder->pFormats[i & (pDecoder->mFormatCapacity - 1)];
+        if (!pFormat->pFormat || pFormat->mId == id)
+            return pFormat;
+    }
+}
+
+static void addFormat(Decoder* pDecoder, const Format* pNew)
+{
+    if ((pDecoder->mFormatCount + 1) * 4 > pDecoder->mFormatCapacity * 3)
+    {
+        Decoder grown = *pDecoder;
+        grown.mFormatCapacity = pDecoder->mFormatCapacity ? pDecoder->mFormatCapacity * 2 : 256;
+        grown.pFormats = (Format*)calloc(grown.mFormatCapacity, sizeof(Format));
+        for (uint32_t i = 0; i < pDecoder->mFormatCapacity; ++i)
+        {
+            if (pDecoder->pFormats[i].pFormat)
+                *findFormat(&grown, pDecoder->pFormats[i].mId) = pDecoder->pFormats[i];
+        }
+        free(pDecoder->pFormats);
+        *pDecoder = grown;
+    }
+
+    // Every thread writes the formats it uses, later copies are the same
+    Format* pFormat = findFormat(pDecoder, pNew->mId);
+    if (pFormat->pFormat)
+    {
+        free(pNew->pFile);
+        free(pNew->pFormat);
+        return;
+    }
+    *pFormat = *pNew;
+    ++pDecoder->mFormatCount;
+}
+
+static void setThreadName(Decoder* pDecoder, uint64_t id, char* name)
+{
+    for (uint32_t i = 0; i < pDecoder->mThreadCount; ++i)
+    {
+        if (pDecoder->pThreads[i].mId == id)
+        {
+            // Thread ids are reused by the OS
+            free(pDecoder->pThreads[i].pName);
+            pDecoder->pThreads[i].pName = name;
+            return;
+        }
+    }
+    if (pDecoder->mThreadCount == pDecoder->mThreadCapacity)
+    {
+        pDecoder->mThreadCapacity = pDecoder->mThreadCapacity ? pDecoder->mThreadCapacity * 2 : 16;
+        pDecoder->pThreads = (Thread*)realloc(pDecoder->pThreads, pDecoder->mThreadCapacity * sizeof(Thread));
+    }
+    pDecoder->pThreads[pDecoder->mThreadCount].mId = id;
+    pDecoder->pThreads[pDecoder->mThreadCount].pName = name;
+    ++pDecoder->mThreadCount;
+}
+
+static const char* getThreadName(const Decoder* pDecoder, uint64_t id)
+{
+    for (uint32_t i = 0; i < pDecoder->mThreadCount; ++i)
+    {
+        if (pDecoder->pThreads[i].mId == id && pDecoder->pThreads[i].pName[0])
+            return pDecoder->pThreads[i].pName;
+    }
+    return "NoName";
+}
+
+static bool readArgument(const char** pArgs, const char* end, void* pValue, size_t size)
+{
+    if ((size_t)(end - *pArgs) < size)
+        return false;
+    memcpy(pValue, *pArgs, size);
+    *pArgs += size;
+    return true;
+}
+
+// Length modifier for the value as it's passed to snprintf
+static const char* getLengthModifier(const BinaryLogSpec* pSpec)
+{
+    switch (pSpec->mType)
+    {
+    case BINARY_LOG_ARG_INT:
+        if (pSpec->pLength[0] == 'h')
+            return pSpec->pLength[1] == 'h' ? "hh" : "h";
+        return "";
+    case BINARY_LOG_ARG_LONG:
+        return "l";
+    case BINARY_LOG_ARG_LONG_LONG:
+        return "ll";
+    case BINARY_LOG_ARG_INTMAX:
+        return "j";
+    case BINARY_LOG_ARG_SIZE:
+        return "z";
+    case BINARY_LOG_ARG_PTRDIFF:
+        return "t";
+    case BINARY_LOG_ARG_LONG_DOUBLE:
+        return "L";
+    default:
+        return "";
+    }
+}
+
+#define APPEND_VALUE(pText, fmt, starCount, stars, value)                \
+    ((starCount) == 0   ? appendText(pText, fmt, value)                  \
+     : (starCount) == 1 ? appendText(pText, fmt, stars[0], value)        \
+                        : appendText(pText, fmt, stars[0], stars[1], value))
+
+// Formats the message like vsnprintf did at the time it was logged
+static void formatMessage(Text* pText, const char* format, const char* args, const char* argsEnd)
+{
+    BinaryLogSpec spec;
+    const char*   p = format;
+    for (; binaryLogNextSpec(p, &spec); p = spec.pEnd)
+    {
+        appendChars(pText, p, (size_t)(spec.pBegin - p));
+        if (spec.mType == BINARY_LOG_ARG_NONE)
+        {
+            if (spec.mConversion == '%')
+                appendChars(pText, "%", 1);
+            else
+                appendChars(pText, spec.pBegin, (size_t)(spec.pEnd - spec.pBegin));
+            continue;
+        }
+        if (spec.mType == BINARY_LOG_ARG_COUNT)
+            continue;
+
+        int     stars[2] = { 0, 0 };
+        int64_t star = 0;
+        for (uint32_t i = 0; i < spec.mStarCount; ++i)
+        {
+            if (!readArgument(&args, argsEnd, &star, sizeof(star)))
+                goto truncated;
+            stars[i] = (int)star;
+        }
+
+        // Original flags, width and precision with the length modifier of the stored value
+        char   fmt[64];
+        size_t flagsLength = (size_t)(spec.pLength - spec.pBegin);
+        if (flagsLength > sizeof(fmt) - 8)
+            flagsLength = 1;
+        bool string = spec.mType == BINARY_LOG_ARG_STRING || spec.mType == BINARY_LOG_ARG_WIDE_STRING;
+        char conversion = string ? 's' : (spec.mConversion == 'C' ? 'c' : spec.mConversion);
+        snprintf(fmt, sizeof(fmt), "%.*s%s%c", (int)flagsLength, spec.pBegin, getLengthModifier(&spec), conversion);
+
+        if (string)
+        {
+            uint32_t length = 0;
+            if (!readArgument(&args, argsEnd, &length, sizeof(length)) || (size_t)(argsEnd - args) < length)
+                goto truncated;
+            char* str = copyString(args, length);
+            args += length;
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, str);
+            free(str);
+            continue;
+        }
+
+        uint64_t value = 0;
+        if (!readArgument(&args, argsEnd, &value, sizeof(value)))
+            goto truncated;
+        double real = 0.0;
+        memcpy(&real, &value, sizeof(real));
+
+        switch (spec.mType)
+        {
+        case BINARY_LOG_ARG_INT:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, (int)(int64_t)value);
+            break;
+        case BINARY_LOG_ARG_LONG:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, (long)(int64_t)value);
+            break;
+        case BINARY_LOG_ARG_LONG_LONG:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, (long long)value);
+            break;
+        case BINARY_LOG_ARG_INTMAX:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, (intmax_t)value);
+            break;
+        case BINARY_LOG_ARG_SIZE:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, (size_t)value);
+            break;
+        case BINARY_LOG_ARG_PTRDIFF:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, (ptrdiff_t)(int64_t)value);
+            break;
+        case BINARY_LOG_ARG_DOUBLE:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, real);
+            break;
+        case BINARY_LOG_ARG_LONG_DOUBLE:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, (long double)real);
+            break;
+        case BINARY_LOG_ARG_POINTER:
+            APPEND_VALUE(pText, fmt, spec.mStarCount, stars, (void*)(uintptr_t)value);
+            break;
+        default:
+            break;
+        }
+    }
+    appendChars(pText, p, strlen(p));
+    return;
+
+truncated:
+    appendChars(pText, " <missing arguments>", 20);
+}
+
+static void writeMessage(Decoder* pDecoder, FILE* pOutput, const BinaryLogMessage* pMessage, const char* args, const char* argsEnd)
+{
+    Text* pText = (Text*)malloc(sizeof(Text));
+    pText->mLength = 0;
+    pText->mBuffer[0] = 0;
+
+    time_t     t = (time_t)(pDecoder->mHeader.mStartTime + (pMessage->mUSec - pDecoder->mHeader.mStartUSec) / 1000000);
+    struct tm* pTime = localtime(&t);
+    if (pTime)
+        appendText(pText, "%04d-%02d-%02d %02d:%02d:%02d ", 1900 + pTime->tm_year, 1 + pTime->tm_mon, pTime->tm_mday, pTime->tm_hour,
+                   pTime->tm_min, pTime->tm_sec);
+    appendText(pText, "[%-15s]", getThreadName(pDecoder, pMessage->mThreadId));
+
+    Format* pFormat = findFormat(pDecoder, pMessage->mFormatId);
+    if (!pFormat || !pFormat->pFormat)
+    {
+        appendText(pText, " %23s:%-5s  ERR| Unknown format %016llx\n", "", "", (unsigned long long)pMessage->mFormatId);
+        fputs(pText->mBuffer, pOutput);
+        free(pText);
+        return;
+    }
+    appendText(pText, " %23.*s:%-5i ", FILENAME_NAME_LENGTH_LOG, pFormat->pFile, pFormat->mLine);
+
+    size_t prefixOffset = pText->mLength;
+    appendText(pText, "%*s", (int)(6 + pMessage->mIndentation * INDENTATION_SIZE_LOG), "");
+    formatMessage(pText, pFormat->pFormat, args, argsEnd);
+    appendChars(pText, "\n", 1);
+
+    // Message is written once for every level, as with text logs
+    for (uint32_t i = 0; i < sizeof(gLevelPrefixes) / sizeof(gLevelPrefixes[0]); ++i)
+    {
+        if (!(gLevelPrefixes[i].mLevel & pMessage->mLevel))
+            continue;
+        memcpy(pText->mBuffer + prefixOffset, gLevelPrefixes[i].pPrefix, 6);
+        fputs(pText->mBuffer, pOutput);
+    }
+    free(pText);
+}
+
+static bool decode(Decoder* pDecoder, const char* data, size_t size, FILE* pOutput)
+{
+    if (size < sizeof(BinaryLogHeader))
+    {
+        fprintf(stderr, "File is too small to be a binary log\n");
+        return false;
+    }
+    memcpy(&pDecoder->mHeader, data, sizeof(BinaryLogHeader));
+    if (memcmp(pDecoder->mHeader.mMagic, BINARY_LOG_MAGIC, sizeof(pDecoder->mHeader.mMagic)) != 0)
+    {
+        fprintf(stderr, "File is not a binary log\n");
+        return false;
+    }
+    if (pDecoder->mHeader.mVersion != BINARY_LOG_VERSION)
+    {
+        fprintf(stderr, "Unsupported binary log version %u\n", pDecoder->mHeader.mVersion);
+        return false;
+    }
+
+    fputs("date       time     "
+          "[thread name/id ]"
+          "                   file:line  "
+          "  v |\n",
+          pOutput);
+
+    size_t position = sizeof(BinaryLogHeader);
+    while (position + sizeof(BinaryLogRecord) <= size)
+    {
+        const char*     pRecordData = data + position;
+        BinaryLogRecord record;
+        memcpy(&record, pRecordData, sizeof(record));
+        if (record.mSize < sizeof(record) || record.mSize > size - position)
+            break;
+        position += record.mSize;
+
+        switch (record.mType)
+        {
+        case BINARY_LOG_RECORD_FORMAT:
+        {
+            BinaryLogFormat format;
+            if (record.mSize < sizeof(format))
+                break;
+            memcpy(&format, pRecordData, sizeof(format));
+            if (sizeof(format) + format.mFileLength + format.mFormatLength > record.mSize)
+                break;
+            Format newFormat;
+            newFormat.mId = format.mFormatId;
+            newFormat.mLine = format.mLine;
+            newFormat.pFile = copyString(pRecordData + sizeof(format), format.mFileLength);
+            newFormat.pFormat = copyString(pRecordData + sizeof(format) + format.mFileLength, format.mFormatLength);
+            addFormat(pDecoder, &newFormat);
+            break;
+        }
+        case BINARY_LOG_RECORD_THREAD:
+        {
+            BinaryLogThread thread;
+            if (record.mSize < sizeof(thread))
+                break;
+            memcpy(&thread, pRecordData, sizeof(thread));
+            if (sizeof(thread) + thread.mNameLength > record.mSize)
+                break;
+            setThreadName(pDecoder, thread.mThreadId, copyString(pRecordData + sizeof(thread), thread.mNameLength));
+            break;
+        }
+        case BINARY_LOG_RECORD_MESSAGE:
+        {
+            BinaryLogMessage message;
+            if (record.mSize < sizeof(message))
+                break;
+            memcpy(&message, pRecordData, sizeof(message));
+            writeMessage(pDecoder, pOutput, &message, pRecordData + sizeof(message), pRecordData + record.mSize);
+            break;
+        }
+        default:
+            // Unknown records are skipped
+            break;
+        }
+    }
+
+    // Application didn't exit cleanly, last record was cut short
+    if (position != size)
+        fprintf(stderr, "Binary log ends with an incomplete record\n");
+    return true;
+}
+
+bool decodeBinaryLog(const char* data, size_t size, FILE* pOutput)
+{
+    Decoder decoder;
+    memset(&decoder, 0, sizeof(decoder));
+    bool success = decode(&decoder, data, size, pOutput);
+
+    for (uint32_t i = 0; i < decoder.mFormatCapacity; ++i)
+    {
+        free(decoder.pFormats[i].pFile);
+        free(decoder.pFormats[i].pFormat);
+    }
+    for (uint32_t i = 0; i < decoder.mThreadCount; ++i)
+        free(decoder.pThreads[i].pName);
+    free(decoder.pFormats);
+    free(decoder.pThreads);
+    return success;
+}
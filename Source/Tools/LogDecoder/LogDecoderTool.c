@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2017-2024 The Forge Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Command line tool turning binary log files into text, see LogDecoder.h.
+//
+// Usage: LogDecoder <binary log> [output, stdout by default]
+// Doesn't depend on the runtime, builds with any C99 compiler: cc LogDecoder.c LogDecoderTool.c -o LogDecoder
+
+#include <stdlib.h>
+
+#include "LogDecoder.h"
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <binary log> [output]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* pInput = fopen(argv[1], "rb");
+    if (!pInput)
+    {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return 1;
+    }
+    fseek(pInput, 0, SEEK_END);
+    long size = ftell(pInput);
+    fseek(pInput, 0, SEEK_SET);
+    char*  data = (char*)malloc(size > 0 ? (size_t)size : 1);
+    size_t read = fread(data, 1, size > 0 ? (size_t)size : 0, pInput);
+    fclose(pInput);
+
+    FILE* pOutput = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (!pOutput)
+    {
+        fprintf(stderr, "Failed to create %s\n", argv[2]);
+        free(data);
+        return 1;
+    }
+
+    bool success = decodeBinaryLog(data, read, pOutput);
+
+    if (pOutput != stdout)
+        fclose(pOutput);
+    free(data);
+    return success ? 0 : 1;
+}